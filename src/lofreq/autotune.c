@@ -0,0 +1,460 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+
+/* Per host choice of the exact Poisson-binomial engine. See
+ * autotune.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#include "log.h"
+#include "utils.h"
+#include "defaults.h"
+#include "snpcaller.h"
+#include "autotune.h"
+
+
+/* bump if buckets or engines change meaning. older cache files are
+ * then ignored and overwritten */
+#define AUTOTUNE_VERSION 1
+/* time engines at least this long per bucket and round */
+#define AUTOTUNE_MIN_SEC 0.002
+/* best of this many rounds counts */
+#define AUTOTUNE_ROUNDS 2
+
+/* bucket upper bounds (incl.) and the values benchmarked for them */
+static const int n_max[] = {64, 256, 1024, 4096, 16384, INT_MAX};
+static const int n_bench[] = {48, 192, 768, 3072, 12288, 24576};
+static const int k_max[] = {2, 8, 32, 128, INT_MAX};
+static const int k_bench[] = {2, 6, 24, 96, 192};
+static const int d_max[] = {4, 16, 64, 256, INT_MAX};
+static const int d_bench[] = {3, 12, 48, 192, 512};
+#define NUM_N_BUCKETS ((int)(sizeof(n_max)/sizeof(n_max[0])))
+#define NUM_K_BUCKETS ((int)(sizeof(k_max)/sizeof(k_max[0])))
+#define NUM_D_BUCKETS ((int)(sizeof(d_max)/sizeof(d_max[0])))
+
+static const char *engine_names[NUM_PBIN_ENGINES] = {"pruned", "hist"};
+
+
+struct autotune {
+     pbin_engine_t engine[NUM_N_BUCKETS][NUM_K_BUCKETS][NUM_D_BUCKETS];
+};
+
+autotune_t *pbin_autotune = NULL;
+
+
+static int
+bucket(const int *max, int num_buckets, int val)
+{
+     int i;
+     for (i=0; i<num_buckets-1 && val>max[i]; i++) {
+          ;
+     }
+     return i;
+}
+/* bucket() */
+
+
+pbin_engine_t
+autotune_engine(const autotune_t *t, int N, int K, int num_distinct)
+{
+     return t->engine[bucket(n_max, NUM_N_BUCKETS, N)]
+          [bucket(k_max, NUM_K_BUCKETS, K)]
+          [bucket(d_max, NUM_D_BUCKETS, num_distinct)];
+}
+/* autotune_engine() */
+
+
+static double
+elapsed_sec(const struct timespec *start)
+{
+     struct timespec now;
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+/* elapsed_sec() */
+
+
+/* sorted error probabilities of N reads with num_distinct qualities
+ * between Q20 and Q40, scaled so that on average K/2 failures are
+ * expected. K is then insignificant but not so much that the
+ * engines would exit early (bonf=1 and sig=1 in time_engine()) */
+static void
+synth_col(double *err_probs, int N, int K, int num_distinct)
+{
+     double sum = 0.0;
+     int n;
+
+     for (n=0; n<N; n++) {
+          int d = (int)((long long int)n * num_distinct / N);
+          err_probs[n] = PHREDQUAL_TO_PROB(20.0 + 20.0*d/num_distinct);
+          sum += err_probs[n];
+     }
+     for (n=0; n<N; n++) {
+          err_probs[n] = MIN(err_probs[n] * K/2.0/sum, 0.5);
+     }
+}
+/* synth_col() */
+
+
+/* seconds per call of engine. negative on error */
+static double
+time_engine(pbin_engine_t engine, const double *err_probs, int N, int K)
+{
+     struct timespec start;
+     long int reps = 0;
+     double sec;
+
+     clock_gettime(CLOCK_MONOTONIC, &start);
+     do {
+          double *probvec;
+          if (PBIN_ENGINE_HIST == engine) {
+               probvec = hist_calc_prob_dist(err_probs, N, K, 1, 1.0);
+          } else {
+               probvec = pruned_calc_prob_dist(err_probs, N, K, 1, 1.0,
+                                               NULL, 0, NULL);
+          }
+          if (NULL == probvec) {
+               return -1.0;
+          }
+          free(probvec);
+          reps += 1;
+          sec = elapsed_sec(&start);
+     } while (sec < AUTOTUNE_MIN_SEC);
+
+     return sec/reps;
+}
+/* time_engine() */
+
+
+static int
+autotune_run(autotune_t *t)
+{
+     struct timespec start;
+     double *err_probs;
+     int num_hist = 0;
+     int i, j, l, r;
+
+     if (NULL == (err_probs = malloc(n_bench[NUM_N_BUCKETS-1] * sizeof(double)))) {
+          LOG_FATAL("%s\n", "couldn't allocate memory");
+          return -1;
+     }
+
+     LOG_VERBOSE("%s\n", "Benchmarking Poisson-binomial engines (done once per host)");
+     clock_gettime(CLOCK_MONOTONIC, &start);
+     for (i=0; i<NUM_N_BUCKETS; i++) {
+          for (j=0; j<NUM_K_BUCKETS; j++) {
+               int N = n_bench[i];
+               int K = MIN(k_bench[j], N);
+               double pruned_sec = DBL_MAX;
+
+               /* pruned doesn't care about distinct values */
+               synth_col(err_probs, N, K, N);
+               for (r=0; r<AUTOTUNE_ROUNDS; r++) {
+                    double sec = time_engine(PBIN_ENGINE_PRUNED, err_probs, N, K);
+                    if (sec < 0.0) {
+                         free(err_probs);
+                         return -1;
+                    }
+                    pruned_sec = MIN(pruned_sec, sec);
+               }
+
+               for (l=0; l<NUM_D_BUCKETS; l++) {
+                    int D = MIN(d_bench[l], N);
+                    double hist_sec = DBL_MAX;
+
+                    synth_col(err_probs, N, K, D);
+                    for (r=0; r<AUTOTUNE_ROUNDS; r++) {
+                         double sec = time_engine(PBIN_ENGINE_HIST, err_probs, N, K);
+                         if (sec < 0.0) {
+                              free(err_probs);
+                              return -1;
+                         }
+                         hist_sec = MIN(hist_sec, sec);
+                         /* only close calls need another round */
+                         if (hist_sec < pruned_sec/2.0 || hist_sec > pruned_sec*2.0) {
+                              break;
+                         }
+                    }
+                    t->engine[i][j][l] = hist_sec < pruned_sec ?
+                         PBIN_ENGINE_HIST : PBIN_ENGINE_PRUNED;
+                    num_hist += (PBIN_ENGINE_HIST == t->engine[i][j][l]);
+                    LOG_DEBUG("N=%d K=%d distinct=%d: pruned %g s, hist %g s\n",
+                              N, K, D, pruned_sec, hist_sec);
+               }
+          }
+     }
+     LOG_VERBOSE("Benchmarking took %.1f s. hist engine wins %d of %d buckets\n",
+                 elapsed_sec(&start), num_hist,
+                 NUM_N_BUCKETS * NUM_K_BUCKETS * NUM_D_BUCKETS);
+
+     free(err_probs);
+     return 0;
+}
+/* autotune_run() */
+
+
+static int
+find_bound(const int *max, int num_buckets, int val)
+{
+     int i;
+     for (i=0; i<num_buckets; i++) {
+          if (max[i] == val) {
+               return i;
+          }
+     }
+     return -1;
+}
+/* find_bound() */
+
+
+/* returns non-zero if fn is missing, from another version or
+ * incomplete */
+static int
+autotune_load(autotune_t *t, const char *fn)
+{
+     char seen[NUM_N_BUCKETS][NUM_K_BUCKETS][NUM_D_BUCKETS];
+     char line[1024];
+     FILE *fp;
+     int version;
+     int num_seen = 0;
+
+     if (NULL == (fp = fopen(fn, "r"))) {
+          return -1;
+     }
+     if (NULL == fgets(line, sizeof(line), fp)
+         || 1 != sscanf(line, "#lofreq autotune v%d", &version)
+         || AUTOTUNE_VERSION != version) {
+          LOG_VERBOSE("Ignoring %s from other lofreq version\n", fn);
+          fclose(fp);
+          return -1;
+     }
+
+     memset(seen, 0, sizeof(seen));
+     while (NULL != fgets(line, sizeof(line), fp)) {
+          char name[64];
+          int nm, km, dm;
+          int i, j, l, e;
+
+          if (line[0] == '#') {
+               continue;
+          }
+          if (4 != sscanf(line, "%d %d %d %63s", &nm, &km, &dm, name)
+              || -1 == (i = find_bound(n_max, NUM_N_BUCKETS, nm))
+              || -1 == (j = find_bound(k_max, NUM_K_BUCKETS, km))
+              || -1 == (l = find_bound(d_max, NUM_D_BUCKETS, dm))) {
+               LOG_WARN("Ignoring invalid line in %s: %s", fn, line);
+               continue;
+          }
+          for (e=0; e<NUM_PBIN_ENGINES; e++) {
+               if (0 == strcmp(name, engine_names[e])) {
+                    break;
+               }
+          }
+          if (e == NUM_PBIN_ENGINES) {
+               LOG_WARN("Ignoring unknown engine in %s: %s", fn, line);
+               continue;
+          }
+          t->engine[i][j][l] = e;
+          if (! seen[i][j][l]) {
+               seen[i][j][l] = 1;
+               num_seen += 1;
+          }
+     }
+     fclose(fp);
+
+     if (num_seen != NUM_N_BUCKETS * NUM_K_BUCKETS * NUM_D_BUCKETS) {
+          LOG_VERBOSE("Ignoring incomplete %s\n", fn);
+          return -1;
+     }
+     return 0;
+}
+/* autotune_load() */
+
+
+static void
+get_hostname(char *host, size_t size)
+{
+     if (gethostname(host, size)) {
+          strncpy(host, "localhost", size);
+     }
+     host[size-1] = '\0';
+}
+/* get_hostname() */
+
+
+static int
+autotune_save(const autotune_t *t, const char *fn)
+{
+     char host[256];
+     char *tmp_fn;
+     FILE *fp;
+     int i, j, l;
+     int rc = 0;
+
+     /* same directory, so that rename() is atomic */
+     tmp_fn = malloc(strlen(fn) + 32);
+     sprintf(tmp_fn, "%s.tmp.%d", fn, (int)getpid());
+     if (NULL == (fp = fopen(tmp_fn, "w"))) {
+          free(tmp_fn);
+          return -1;
+     }
+
+     get_hostname(host, sizeof(host));
+     fprintf(fp, "#lofreq autotune v%d host=%s\n", AUTOTUNE_VERSION, host);
+     fprintf(fp, "#n_max\tk_max\tdistinct_max\tengine\n");
+     for (i=0; i<NUM_N_BUCKETS; i++) {
+          for (j=0; j<NUM_K_BUCKETS; j++) {
+               for (l=0; l<NUM_D_BUCKETS; l++) {
+                    fprintf(fp, "%d\t%d\t%d\t%s\n", n_max[i], k_max[j], d_max[l],
+                            engine_names[t->engine[i][j][l]]);
+               }
+          }
+     }
+
+     if (ferror(fp)) {
+          rc = -1;
+     }
+     if (fclose(fp)) {
+          rc = -1;
+     }
+     if (0 == rc && rename(tmp_fn, fn)) {
+          rc = -1;
+     }
+     if (rc) {
+          unlink(tmp_fn);
+     }
+     free(tmp_fn);
+     return rc;
+}
+/* autotune_save() */
+
+
+/* $HOME/LOFREQ_AUTOTUNE_DIR/autotune-<hostname>.txt. creates the
+ * directory if needed. NULL if not possible */
+static char *
+default_cache_fn(void)
+{
+     const char *home = getenv("HOME");
+     char host[256];
+     char *fn;
+
+     if (NULL == home || '\0' == home[0]) {
+          return NULL;
+     }
+     get_hostname(host, sizeof(host));
+
+     fn = malloc(strlen(home) + strlen(LOFREQ_AUTOTUNE_DIR) + strlen(host) + 32);
+     sprintf(fn, "%s/%s", home, LOFREQ_AUTOTUNE_DIR);
+     if (mkdir(fn, 0755) && EEXIST != errno) {
+          LOG_WARN("Couldn't create directory %s\n", fn);
+          free(fn);
+          return NULL;
+     }
+     sprintf(fn, "%s/%s/autotune-%s.txt", home, LOFREQ_AUTOTUNE_DIR, host);
+     return fn;
+}
+/* default_cache_fn() */
+
+
+autotune_t *
+autotune_init(const char *fn)
+{
+     autotune_t *t;
+     char *cache_fn;
+     char *lock_fn;
+     int lock_fd;
+     int rc = 0;
+
+     if (NULL == (t = calloc(1, sizeof(autotune_t)))) {
+          LOG_FATAL("%s\n", "couldn't allocate memory");
+          return NULL;
+     }
+
+     cache_fn = fn ? strdup(fn) : default_cache_fn();
+     if (NULL == cache_fn) {
+          LOG_WARN("%s\n", "No cache file for autotuning. Benchmarking anew");
+          if (autotune_run(t)) {
+               free(t);
+               return NULL;
+          }
+          return t;
+     }
+
+     /* call-parallel starts many processes at once. only one of them
+      * benchmarks (on an otherwise idle machine), the others wait and
+      * read its results */
+     lock_fn = malloc(strlen(cache_fn) + 6);
+     sprintf(lock_fn, "%s.lock", cache_fn);
+     if (-1 == (lock_fd = open(lock_fn, O_RDWR | O_CREAT, 0644))
+         || flock(lock_fd, LOCK_EX)) {
+          LOG_WARN("Couldn't lock %s. Other processes might benchmark at the same time\n", lock_fn);
+     }
+
+     if (0 == autotune_load(t, cache_fn)) {
+          LOG_VERBOSE("Using Poisson-binomial engines from %s\n", cache_fn);
+     } else if (0 == (rc = autotune_run(t))) {
+          if (autotune_save(t, cache_fn)) {
+               LOG_WARN("Couldn't write autotuning results to %s\n", cache_fn);
+          } else {
+               LOG_VERBOSE("Autotuning results written to %s\n", cache_fn);
+          }
+     }
+
+     if (-1 != lock_fd) {
+          close(lock_fd); /* releases lock */
+     }
+     free(lock_fn);
+     free(cache_fn);
+     if (rc) {
+          free(t);
+          return NULL;
+     }
+     return t;
+}
+/* autotune_init() */
+
+
+void
+autotune_free(autotune_t *t)
+{
+     free(t);
+}
+/* autotune_free() */
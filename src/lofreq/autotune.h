@@ -0,0 +1,73 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+
+/* Per host choice of the exact Poisson-binomial engine.
+ *
+ * Which engine is fastest depends on the number of error
+ * probabilities (N), the number of failures (K), the number of
+ * distinct error probabilities and the CPU: pruned_calc_prob_dist()
+ * is O(N*K) while hist_calc_prob_dist() is O(D*K^2) for D distinct
+ * values. On first use both are timed on synthetic columns for each
+ * (N, K, distinct) bucket and the winners are cached in a small text
+ * file per host, which later runs just read. poissbin() then
+ * dispatches each column to the winner of its bucket.
+ */
+
+/* LOFREQ_AUTOTUNE_DIR/autotune-<hostname>.txt in $HOME */
+#define LOFREQ_AUTOTUNE_DIR ".lofreq"
+
+typedef enum {
+     PBIN_ENGINE_PRUNED = 0,
+     PBIN_ENGINE_HIST,
+     NUM_PBIN_ENGINES
+} pbin_engine_t;
+
+typedef struct autotune autotune_t;
+
+/* table used by poissbin() if set. NULL means always pruned */
+extern autotune_t *pbin_autotune;
+
+/* reads the table from cache file fn (default per host file if NULL)
+ * or, if missing or outdated, benchmarks the engines and writes it
+ * there. concurrent processes wait for the one benchmarking. returns
+ * NULL on error */
+autotune_t *
+autotune_init(const char *fn);
+
+void
+autotune_free(autotune_t *t);
+
+pbin_engine_t
+autotune_engine(const autotune_t *t, int N, int K, int num_distinct);
+
+#endif
@@ -243,6 +243,45 @@ void *bed_read(const char *fn)
     return NULL;
 }
 
+/* regions as "ref:beg-end" strings (1-based, inclusive), e.g. for
+ * sam_itr_regarray(). returns their number or -1 on error */
+int bed_regions(const void *_h, char ***regs)
+{
+    const reghash_t *h = (const reghash_t*)_h;
+    khint_t k;
+    int i, n = 0;
+    char **r;
+
+    *regs = NULL;
+    for (k = 0; k < kh_end(h); ++k)
+        if (kh_exist(h, k)) n += kh_val(h, k).n;
+    if (n == 0) return 0;
+    if (NULL == (r = malloc(n * sizeof(char*)))) return -1;
+
+    n = 0;
+    for (k = 0; k < kh_end(h); ++k) {
+        const bed_reglist_t *p;
+        if (!kh_exist(h, k)) continue;
+        p = &kh_val(h, k);
+        for (i = 0; i < p->n; ++i) {
+            uint32_t beg = p->a[i]>>32, end = (uint32_t)p->a[i];
+            if (end <= beg) continue; // empty
+            if (NULL == (r[n] = malloc(strlen(kh_key(h, k)) + 32))) {
+                while (n > 0) free(r[--n]);
+                free(r);
+                return -1;
+            }
+            sprintf(r[n++], "%s:%u-%u", kh_key(h, k), beg+1, end);
+        }
+    }
+    if (n == 0) {
+        free(r);
+        return 0;
+    }
+    *regs = r;
+    return n;
+}
+
 void bed_destroy(void *_h)
 {
     reghash_t *h = (reghash_t*)_h;
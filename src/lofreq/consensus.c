@@ -0,0 +1,224 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Consensus sequence output. See consensus.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "htslib/hts.h"
+
+#include "log.h"
+#include "utils.h"
+#include "plp.h"
+#include "consensus.h"
+
+
+static void
+consensus_putc(consensus_t *c, char base)
+{
+     if (putc(base, c->fp) == EOF) {
+          c->err = 1;
+     }
+     c->num_written += 1;
+     if (++c->line_len == CONSENSUS_LINE_WIDTH) {
+          putc('\n', c->fp);
+          c->line_len = 0;
+     }
+}
+/* consensus_putc() */
+
+
+/* writes N up to (excl.) pos */
+static void
+consensus_fill(consensus_t *c, int pos)
+{
+     for (; c->next_pos < pos; c->next_pos++) {
+          consensus_putc(c, 'N');
+          c->num_n += 1;
+     }
+}
+/* consensus_fill() */
+
+
+static void
+consensus_end_target(consensus_t *c)
+{
+     if (! c->target) {
+          return;
+     }
+     consensus_fill(c, c->target_len);
+     if (c->line_len) {
+          putc('\n', c->fp);
+          c->line_len = 0;
+     }
+     free(c->target);
+     c->target = NULL;
+}
+/* consensus_end_target() */
+
+
+/* The base written for column p. With a threshold of 0 this is the
+ * base with the highest error-prob corrected count (as used for
+ * p->cons_base). Otherwise it's the IUPAC code for the smallest set
+ * of bases, taken in order of decreasing count, that together make up
+ * at least this fraction of all bases (as in e.g. iVar).
+ */
+static char
+consensus_base(const consensus_t *c, const plp_col_t *p)
+{
+     double total = 0.0, sum = 0.0;
+     int used[NUM_NT4-1] = {0};
+     int mask = 0;
+     int i, j;
+
+     if (c->threshold <= 0.0) {
+          return bam_nt4_rev_table[argmax_d(p->cons_counts, NUM_NT4)];
+     }
+
+     for (i=0; i<NUM_NT4-1; i++) {
+          total += p->cons_counts[i];
+     }
+     if (total <= 0.0) {
+          return 'N';
+     }
+     for (i=0; i<NUM_NT4-1 && sum < c->threshold * total; i++) {
+          int max = -1;
+          for (j=0; j<NUM_NT4-1; j++) {
+               if (! used[j] && (max == -1 || p->cons_counts[j] > p->cons_counts[max])) {
+                    max = j;
+               }
+          }
+          used[max] = 1;
+          mask |= 1<<max; /* A=1, C=2, G=4, T=8 as in seq_nt16_str */
+          sum += p->cons_counts[max];
+     }
+     return seq_nt16_str[mask];
+}
+/* consensus_base() */
+
+
+consensus_t *
+consensus_open(const char *fn, int min_depth, double threshold)
+{
+     consensus_t *c;
+
+     if (threshold < 0.0 || threshold > 1.0) {
+          LOG_ERROR("Invalid consensus threshold %f\n", threshold);
+          return NULL;
+     }
+     c = calloc(1, sizeof(consensus_t));
+     if (NULL == (c->fp = fopen(fn, "w"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", fn);
+          free(c);
+          return NULL;
+     }
+     c->fn = strdup(fn);
+     c->min_depth = min_depth;
+     c->threshold = threshold;
+     return c;
+}
+/* consensus_open() */
+
+
+void
+consensus_add_col(consensus_t *c, const plp_col_t *p, int target_len)
+{
+     char base;
+
+     if (! c->target || 0 != strcmp(c->target, p->target)) {
+          consensus_end_target(c);
+          if (fprintf(c->fp, ">%s\n", p->target) < 0) {
+               c->err = 1;
+          }
+          c->target = strdup(p->target);
+          c->target_len = target_len;
+          c->next_pos = 0;
+     }
+     if (p->pos < c->next_pos) {
+          /* deleted by an upstream consensus deletion */
+          return;
+     }
+     consensus_fill(c, p->pos);
+
+     if (p->num_bases < c->min_depth) {
+          consensus_putc(c, 'N');
+          c->num_n += 1;
+          c->next_pos = p->pos + 1;
+          return;
+     }
+
+     base = consensus_base(c, p);
+     if (base == 'N') {
+          c->num_n += 1;
+     } else if (! strchr("ACGT", base)) {
+          c->num_ambig += 1;
+     }
+     consensus_putc(c, base);
+     c->next_pos = p->pos + 1;
+
+     if (p->cons_base[0] == '+') {
+          const char *ins;
+          for (ins = p->cons_base+1; *ins; ins++) {
+               consensus_putc(c, *ins);
+          }
+          c->num_ins += 1;
+     } else if (p->cons_base[0] == '-') {
+          c->next_pos += strlen(p->cons_base+1);
+          c->num_del += 1;
+     }
+}
+/* consensus_add_col() */
+
+
+int
+consensus_close(consensus_t *c)
+{
+     int rc;
+
+     if (! c) {
+          return 0;
+     }
+     consensus_end_target(c);
+     if (fclose(c->fp)) {
+          c->err = 1;
+     }
+     rc = c->err;
+     if (rc) {
+          LOG_ERROR("Writing consensus to %s failed\n", c->fn);
+     } else {
+          LOG_VERBOSE("Wrote %lld consensus bases to %s (%lld N, %lld ambiguous, %lld insertions, %lld deletions)\n",
+                      c->num_written, c->fn, c->num_n, c->num_ambig, c->num_ins, c->num_del);
+     }
+     free(c->fn);
+     free(c);
+     return rc;
+}
+/* consensus_close() */
@@ -0,0 +1,83 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+#ifndef CONSENSUS_H
+#define CONSENSUS_H
+
+#include "plp.h"
+
+
+/* Consensus sequence written as a side output of the pileup pass
+ * (lofreq call --consensus-out).
+ *
+ * Columns are streamed in as they come out of compile_plp_col() and
+ * the consensus is written straight away, so memory use doesn't
+ * depend on the depth or length of the targets. Each target with at
+ * least one column becomes one FASTA record covering the whole
+ * target. Positions without (or below the minimum) coverage are
+ * written as N. Consensus insertions are inserted after their
+ * column's base and bases of consensus deletions are left out.
+ */
+
+#define CONSENSUS_LINE_WIDTH 60
+#define CONSENSUS_DEFAULT_MIN_DEPTH 10
+
+typedef struct {
+     FILE *fp;
+     char *fn;
+     int min_depth; /* less bases (after filtering) give N */
+     double threshold; /* see consensus_base(). 0: majority base */
+     char *target; /* current target */
+     int target_len;
+     int next_pos; /* next position of target to be written */
+     int line_len;
+     int err;
+     /* stats */
+     long long int num_written;
+     long long int num_n;
+     long long int num_ambig;
+     long long int num_ins;
+     long long int num_del;
+} consensus_t;
+
+
+/* returns NULL on error */
+consensus_t *
+consensus_open(const char *fn, int min_depth, double threshold);
+
+/* columns have to come sorted per target. target_len is the length
+ * of p->target */
+void
+consensus_add_col(consensus_t *c, const plp_col_t *p, int target_len);
+
+/* writes the rest of the last target and frees c. returns non-zero
+ * on (any earlier) write error */
+int
+consensus_close(consensus_t *c);
+
+#endif
@@ -0,0 +1,189 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Per window cost profile. See cost_profile.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "log.h"
+#include "cost_profile.h"
+
+
+struct cost_profile {
+     FILE *fp;
+     char *fn;
+     int win_size;
+     const long long int *counters[COST_PROFILE_MAX_COUNTERS];
+     int num_counters;
+     struct timespec last; /* end of last column */
+     /* current window */
+     char *target;
+     int beg;
+     double seconds;
+     long long int num_cols;
+     long long int depth;
+     long long int work_start; /* counters at window start */
+     long long int work_last; /* counters after last column */
+     int err;
+     long long int num_wins;
+};
+
+
+static double
+elapsed_since(struct timespec *last)
+{
+     struct timespec now;
+     double d;
+
+     clock_gettime(CLOCK_MONOTONIC, &now);
+     d = (now.tv_sec - last->tv_sec) + (now.tv_nsec - last->tv_nsec) / 1e9;
+     *last = now;
+     return d;
+}
+/* elapsed_since() */
+
+
+static long long int
+cost_profile_work(const cost_profile_t *cp)
+{
+     long long int work = 0;
+     int i;
+
+     for (i=0; i<cp->num_counters; i++) {
+          work += *cp->counters[i];
+     }
+     return work;
+}
+/* cost_profile_work() */
+
+
+static void
+cost_profile_flush(cost_profile_t *cp)
+{
+     if (! cp->target) {
+          return;
+     }
+     if (fprintf(cp->fp, "%s\t%d\t%d\t%.6f\t%lld\t%lld\t%lld\n",
+                 cp->target, cp->beg, cp->beg + cp->win_size, cp->seconds,
+                 cp->num_cols, cp->depth,
+                 cp->work_last - cp->work_start) < 0) {
+          cp->err = 1;
+     }
+     cp->num_wins += 1;
+     free(cp->target);
+     cp->target = NULL;
+}
+/* cost_profile_flush() */
+
+
+cost_profile_t *
+cost_profile_open(const char *fn, int win_size)
+{
+     cost_profile_t *cp;
+
+     cp = calloc(1, sizeof(cost_profile_t));
+     if (NULL == (cp->fp = fopen(fn, "w"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", fn);
+          free(cp);
+          return NULL;
+     }
+     cp->fn = strdup(fn);
+     cp->win_size = win_size > 0 ? win_size : COST_PROFILE_WIN_SIZE;
+     fprintf(cp->fp, "#lofreq cost profile v1 win_size=%d\n", cp->win_size);
+     fprintf(cp->fp, "#chrom\tstart\tend\tseconds\tcolumns\tdepth\twork\n");
+     clock_gettime(CLOCK_MONOTONIC, &cp->last);
+     return cp;
+}
+/* cost_profile_open() */
+
+
+int
+cost_profile_add_counter(cost_profile_t *cp, const long long int *counter)
+{
+     if (cp->num_counters == COST_PROFILE_MAX_COUNTERS) {
+          LOG_ERROR("%s\n", "Too many cost profile counters");
+          return 1;
+     }
+     cp->counters[cp->num_counters++] = counter;
+     cp->work_last = cost_profile_work(cp);
+     return 0;
+}
+/* cost_profile_add_counter() */
+
+
+void
+cost_profile_add_col(cost_profile_t *cp, const char *target, int pos, int depth)
+{
+     /* time up to the end of this column. includes reading and
+      * pileup of its reads */
+     double seconds = elapsed_since(&cp->last);
+
+     if (! cp->target || pos >= cp->beg + cp->win_size || pos < cp->beg
+         || 0 != strcmp(cp->target, target)) {
+          cost_profile_flush(cp);
+          cp->target = strdup(target);
+          cp->beg = pos - pos % cp->win_size;
+          cp->seconds = 0.0;
+          cp->num_cols = cp->depth = 0;
+          cp->work_start = cp->work_last;
+     }
+     cp->work_last = cost_profile_work(cp);
+     cp->seconds += seconds;
+     cp->num_cols += 1;
+     cp->depth += depth;
+}
+/* cost_profile_add_col() */
+
+
+int
+cost_profile_close(cost_profile_t *cp)
+{
+     int rc;
+
+     if (! cp) {
+          return 0;
+     }
+     cost_profile_flush(cp);
+     if (fclose(cp->fp)) {
+          cp->err = 1;
+     }
+     rc = cp->err;
+     if (rc) {
+          LOG_ERROR("Writing cost profile to %s failed\n", cp->fn);
+     } else {
+          LOG_VERBOSE("Wrote cost profile of %lld windows to %s\n", cp->num_wins, cp->fn);
+     }
+     free(cp->fn);
+     free(cp);
+     return rc;
+}
+/* cost_profile_close() */
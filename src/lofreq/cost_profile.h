@@ -0,0 +1,73 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+#ifndef COST_PROFILE_H
+#define COST_PROFILE_H
+
+
+/* Per window cost profile of a calling run (lofreq call
+ * --cost-profile).
+ *
+ * The target is tiled into fixed size windows. For every window with
+ * coverage one line is written with the wall time spent on it
+ * (reading, pileup and calling), the number of columns, the summed
+ * depth and the kernel work (number of tests performed). Regions tend
+ * to be slow or fast consistently across samples of the same assay,
+ * so call-parallel can use profiles of earlier runs to balance its
+ * shards (see --pp-cost-model there).
+ *
+ * Format is tab separated with BED coordinates:
+ * #chrom start end seconds columns depth work
+ */
+
+#define COST_PROFILE_WIN_SIZE 10000
+#define COST_PROFILE_MAX_COUNTERS 4
+
+typedef struct cost_profile cost_profile_t;
+
+/* returns NULL on error */
+cost_profile_t *
+cost_profile_open(const char *fn, int win_size);
+
+/* adds a counter of kernel work, e.g. the number of tests. the
+ * increase of all counters during a window is its work. returns
+ * non-zero if there are too many counters */
+int
+cost_profile_add_counter(cost_profile_t *cp, const long long int *counter);
+
+/* to be called after each column has been processed. columns have
+ * to come sorted per target */
+void
+cost_profile_add_col(cost_profile_t *cp, const char *target, int pos, int depth);
+
+/* writes the last window and frees cp. returns non-zero on (any
+ * earlier) write error. cp may be NULL */
+int
+cost_profile_close(cost_profile_t *cp);
+
+#endif
@@ -78,11 +78,20 @@
 #define VARCALL_USE_SQ      4
 /* indel alignment quality */
 #define VARCALL_USE_IDAQ      8
+/* let snpcaller() stop early once significance is certain (only
+ * used with a fixed bonferroni factor, see lofreq_call.c) */
+#define VARCALL_EARLY_ACCEPT  16
 
 
 /* private tag for actual baq values: "l"ofreseq "b"ase-alignment */
 #define BAQ_TAG "lb"
 
+/* From the SAM spec: "tags starting with `X', `Y' and `Z' or tags
+ * containing lowercase letters in either position are reserved for
+ * local use".
+*/
+#define SRC_QUAL_TAG "sq"
+
 
 #ifndef MIN
 #define MIN(X,Y) ((X) < (Y) ? (X) : (Y))
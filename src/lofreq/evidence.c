@@ -0,0 +1,409 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Supporting reads of calls written to a BAM file. See evidence.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
+
+#include "htslib/sam.h"
+#include <uthash.h>
+
+#include "log.h"
+#include "utils.h"
+#include "samutils.h"
+#include "evidence.h"
+
+
+/* max length of read keys, see read_key() */
+#define EVIDENCE_KEY_SIZE 512
+
+
+typedef struct {
+     char *target;
+     int pos;
+     char *ref;
+     char *alt;
+} evidence_var_t;
+
+/* buffered read. idx keeps the order of reads starting at the same
+ * position */
+typedef struct {
+     bam1_t *b;
+     long long int idx;
+} evidence_rec_t;
+
+/* reads in the buffer, so that they are written only once */
+typedef struct {
+     char *key;
+     UT_hash_handle hh;
+} evidence_seen_t;
+
+struct evidence {
+     samFile *fp;
+     bam_hdr_t *h;
+     char *fn;
+     char *fnidx; /* index name while indexing, else NULL */
+     int max_ref_reads;
+     /* calls of the current column */
+     evidence_var_t *vars;
+     int n_vars, m_vars;
+     /* reads to be written */
+     evidence_rec_t *recs;
+     int n_recs, m_recs;
+     int recs_tid;
+     evidence_seen_t *seen; /* hash */
+     long long int num_kept;
+     int err;
+     /* stats */
+     long long int num_vars;
+     long long int num_written;
+};
+
+
+/* identifies a read. flag tells mates and supplementary alignments
+ * apart */
+static void
+read_key(const bam1_t *b, char *key)
+{
+     snprintf(key, EVIDENCE_KEY_SIZE, "%s\t%d\t%d",
+              bam_get_qname(b), b->core.flag, b->core.pos);
+}
+/* read_key() */
+
+
+static int
+rec_cmp(const void *a, const void *b)
+{
+     const evidence_rec_t *ra = (const evidence_rec_t *)a;
+     const evidence_rec_t *rb = (const evidence_rec_t *)b;
+
+     if (ra->b->core.pos != rb->b->core.pos) {
+          return ra->b->core.pos < rb->b->core.pos ? -1 : 1;
+     }
+     return ra->idx < rb->idx ? -1 : (ra->idx > rb->idx);
+}
+/* rec_cmp() */
+
+
+/* writes all buffered reads starting before pos */
+static void
+evidence_flush(evidence_t *e, int32_t pos)
+{
+     char key[EVIDENCE_KEY_SIZE];
+     int i, j;
+
+     if (! e->n_recs) {
+          return;
+     }
+     qsort(e->recs, e->n_recs, sizeof(evidence_rec_t), rec_cmp);
+     for (i=0; i<e->n_recs && e->recs[i].b->core.pos < pos; i++) {
+          bam1_t *b = e->recs[i].b;
+          evidence_seen_t *s;
+
+          if (sam_write1(e->fp, e->h, b) < 0) {
+               e->err = 1;
+          }
+          e->num_written += 1;
+
+          read_key(b, key);
+          HASH_FIND_STR(e->seen, key, s);
+          if (s) {
+               HASH_DEL(e->seen, s);
+               free(s->key);
+               free(s);
+          }
+          bam_destroy1(b);
+     }
+     for (j=0; i<e->n_recs; i++, j++) {
+          e->recs[j] = e->recs[i];
+     }
+     e->n_recs = j;
+}
+/* evidence_flush() */
+
+
+/* buffers a copy of b unless it's buffered already */
+static void
+evidence_keep(evidence_t *e, const bam1_t *b)
+{
+     char key[EVIDENCE_KEY_SIZE];
+     evidence_seen_t *s;
+     evidence_rec_t *r;
+
+     read_key(b, key);
+     HASH_FIND_STR(e->seen, key, s);
+     if (s) {
+          return;
+     }
+     s = malloc(sizeof(evidence_seen_t));
+     s->key = strdup(key);
+     HASH_ADD_KEYPTR(hh, e->seen, s->key, strlen(s->key), s);
+
+     if (e->n_recs == e->m_recs) {
+          e->m_recs = e->m_recs ? 2*e->m_recs : 64;
+          e->recs = realloc(e->recs, e->m_recs * sizeof(evidence_rec_t));
+     }
+     r = & e->recs[e->n_recs];
+     if (NULL == (r->b = bam_dup1(b))) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          exit(1);
+     }
+     r->idx = e->num_kept++;
+     e->n_recs += 1;
+     e->recs_tid = b->core.tid;
+}
+/* evidence_keep() */
+
+
+/* returns 1 if entry i of w carries the alt allele of v, 0 if it
+ * carries the reference allele and -1 otherwise. indels are
+ * reported with the preceding base, so ref reads are those without
+ * indel after this column's base */
+static int
+entry_allele(const plp_sweep_win_t *w, int i, const evidence_var_t *v)
+{
+     const plp_sweep_reads_t *r = w->reads;
+     const int slot = w->slot[i];
+     const int qpos = w->qpos[i];
+     const int indel = w->indel[i];
+     const int ref_len = strlen(v->ref);
+     const int alt_len = strlen(v->alt);
+
+     if (w->flag[i] & (PLP_SWEEP_IS_DEL | PLP_SWEEP_IS_REFSKIP)) {
+          return -1;
+     }
+
+     if (ref_len == 1 && alt_len == 1) {
+          char nt = seq_nt16_str[r->nt16[slot][qpos]];
+          if (nt == toupper(v->alt[0])) {
+               return 1;
+          } else if (nt == toupper(v->ref[0])) {
+               return 0;
+          }
+          return -1;
+
+     } else if (alt_len > ref_len) {
+          /* insertion */
+          int k;
+          if (0 == indel) {
+               return 0;
+          } else if (indel != alt_len-1) {
+               return -1;
+          }
+          for (k=1; k<=indel; k++) {
+               if (seq_nt16_str[r->nt16[slot][qpos+k]] != toupper(v->alt[k])) {
+                    return -1;
+               }
+          }
+          return 1;
+
+     } else {
+          /* deletion. deleted bases are reference, so the length
+           * identifies it */
+          if (0 == indel) {
+               return 0;
+          }
+          return indel == -(ref_len-1) ? 1 : -1;
+     }
+}
+/* entry_allele() */
+
+
+evidence_t *
+evidence_open(const char *fn, const char *bam_fn, int max_ref_reads)
+{
+     evidence_t *e;
+     samFile *in;
+
+     e = calloc(1, sizeof(evidence_t));
+     e->max_ref_reads = max_ref_reads;
+     e->recs_tid = -1;
+
+     if (NULL == (in = sam_open(bam_fn, "r"))) {
+          LOG_ERROR("Couldn't open %s\n", bam_fn);
+          free(e);
+          return NULL;
+     }
+     e->h = sam_hdr_read(in);
+     sam_close(in);
+     if (NULL == e->h) {
+          LOG_ERROR("Couldn't read header of %s\n", bam_fn);
+          free(e);
+          return NULL;
+     }
+
+     if (NULL == (e->fp = sam_open(fn, "wb"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", fn);
+          bam_hdr_destroy(e->h);
+          free(e);
+          return NULL;
+     }
+     if (sam_hdr_write(e->fp, e->h) < 0) {
+          LOG_ERROR("Couldn't write header to %s\n", fn);
+          sam_close(e->fp);
+          bam_hdr_destroy(e->h);
+          free(e);
+          return NULL;
+     }
+     /* reads are written sorted (see evidence_add_col()) */
+     if (sam_idx_out_init(e->fp, e->h, fn, &e->fnidx) < 0) {
+          sam_close(e->fp);
+          bam_hdr_destroy(e->h);
+          free(e);
+          return NULL;
+     }
+     e->fn = strdup(fn);
+     return e;
+}
+/* evidence_open() */
+
+
+void
+evidence_add_var(evidence_t *e, const char *target, int pos,
+                 const char *ref, const char *alt)
+{
+     evidence_var_t *v;
+
+     if (e->n_vars == e->m_vars) {
+          e->m_vars = e->m_vars ? 2*e->m_vars : 8;
+          e->vars = realloc(e->vars, e->m_vars * sizeof(evidence_var_t));
+     }
+     v = & e->vars[e->n_vars++];
+     v->target = strdup(target);
+     v->pos = pos;
+     v->ref = strdup(ref);
+     v->alt = strdup(alt);
+     e->num_vars += 1;
+}
+/* evidence_add_var() */
+
+
+void
+evidence_add_col(evidence_t *e, const plp_sweep_win_t *w, int col)
+{
+     const plp_sweep_reads_t *r = w->reads;
+     const int pos = w->beg + col;
+     int32_t min_beg;
+     int i, j;
+
+     if (! e->n_vars && ! e->n_recs) {
+          return;
+     }
+     if (e->n_recs && w->tid != e->recs_tid) {
+          evidence_flush(e, INT_MAX);
+     }
+
+     for (j=0; j<e->n_vars; j++) {
+          evidence_var_t *v = & e->vars[j];
+          int num_ref = 0;
+
+          if (v->pos != pos || strcmp(v->target, e->h->target_name[w->tid])) {
+               LOG_WARN("Ignoring call at %s:%d reported at column %s:%d\n",
+                        v->target, v->pos+1, e->h->target_name[w->tid], pos+1);
+          } else {
+               for (i=w->off[col]; i<w->off[col+1]; i++) {
+                    int allele;
+                    if (! r->rec[w->slot[i]]) {
+                         continue; /* records not kept */
+                    }
+                    allele = entry_allele(w, i, v);
+                    if (1 == allele) {
+                         evidence_keep(e, r->rec[w->slot[i]]);
+                    } else if (0 == allele && num_ref < e->max_ref_reads) {
+                         evidence_keep(e, r->rec[w->slot[i]]);
+                         num_ref += 1;
+                    }
+               }
+          }
+          free(v->target);
+          free(v->ref);
+          free(v->alt);
+     }
+     e->n_vars = 0;
+
+     if (! e->n_recs) {
+          return;
+     }
+     /* reads appearing in later columns either cover this one or
+      * start after it. so everything starting before the reads of
+      * this column is complete */
+     min_beg = pos;
+     for (i=w->off[col]; i<w->off[col+1]; i++) {
+          if (r->beg[w->slot[i]] < min_beg) {
+               min_beg = r->beg[w->slot[i]];
+          }
+     }
+     evidence_flush(e, min_beg);
+}
+/* evidence_add_col() */
+
+
+int
+evidence_close(evidence_t *e)
+{
+     int rc;
+     int j;
+
+     if (! e) {
+          return 0;
+     }
+     for (j=0; j<e->n_vars; j++) {
+          free(e->vars[j].target);
+          free(e->vars[j].ref);
+          free(e->vars[j].alt);
+     }
+     free(e->vars);
+     evidence_flush(e, INT_MAX);
+     free(e->recs);
+
+     if (e->fnidx && sam_idx_save(e->fp) < 0) {
+          LOG_ERROR("Couldn't write index %s\n", e->fnidx);
+          e->err = 1;
+     }
+     free(e->fnidx);
+     if (sam_close(e->fp) < 0) {
+          e->err = 1;
+     }
+     rc = e->err;
+     if (rc) {
+          LOG_ERROR("Writing supporting reads to %s failed\n", e->fn);
+     } else {
+          LOG_VERBOSE("Wrote %lld reads supporting %lld calls to %s\n",
+                      e->num_written, e->num_vars, e->fn);
+     }
+     bam_hdr_destroy(e->h);
+     free(e->fn);
+     free(e);
+     return rc;
+}
+/* evidence_close() */
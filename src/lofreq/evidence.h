@@ -0,0 +1,74 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef EVIDENCE_H
+#define EVIDENCE_H
+
+#include "plp_sweep.h"
+
+
+/* Supporting reads of calls written as a side output of the pileup
+ * pass (lofreq call --evidence-bam).
+ *
+ * Calls are registered as they are reported. After their column has
+ * been processed, the reads carrying the alternate allele (and
+ * optionally a few carrying the reference allele) are copied from the
+ * sweep (see plp_sweep_set_keep_records()). Reads are written as
+ * seen by the caller, i.e. after on-the-fly primer clipping, sidecar
+ * tags and recalibration, and only once even if they support several
+ * calls. They are buffered until no read starting before them can
+ * come anymore, so the output is coordinate sorted and indexed on the
+ * fly.
+ */
+
+typedef struct evidence evidence_t;
+
+/* opens BAM output fn with the header of bam_fn. max_ref_reads is
+ * the number of reference allele reads to add per call. returns NULL
+ * on error */
+evidence_t *
+evidence_open(const char *fn, const char *bam_fn, int max_ref_reads);
+
+/* registers a call made at the column currently processed. ref and
+ * alt as in the VCF output */
+void
+evidence_add_var(evidence_t *e, const char *target, int pos,
+                 const char *ref, const char *alt);
+
+/* to be called after column col of w has been processed (and all of
+ * its calls have been registered). columns have to come sorted */
+void
+evidence_add_col(evidence_t *e, const plp_sweep_win_t *w, int col);
+
+/* writes buffered reads and the index, and frees e. returns non-zero
+ * on (any earlier) error. e may be NULL */
+int
+evidence_close(evidence_t *e);
+
+#endif
@@ -17,22 +17,7 @@
 #define PROFILING 0
 // PROFILING:
 // Set to 1 to enable wall-clock time measurement of FPGA activities
-// of processing each column and printing to stdout.
- 
-extern char cl_device_name[NAME_LENGTH];
-
-// OpenCL objects
-extern cl_device_id devices;
-extern cl_context context;
-extern cl_program program;
-extern cl_command_queue cmd_queue;
-extern unsigned char *kernelBinary;
-extern char *krnl_func;
-extern char *xclbin;
-extern cl_kernel kernel1;
-extern cl_mem in_buf;
-extern cl_mem out_buf;
-extern double * in_buf_host;
-extern double * out_buf_host;
+// of processing each batch of jobs and printing to stderr.
 
-extern int proc_bin_id;  // Input data chunk (bin) id
+// The OpenCL objects are owned by the pbin-owner process only (see
+// pbin_owner.c)
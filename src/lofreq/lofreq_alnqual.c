@@ -28,6 +28,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
 #include <unistd.h>
 #include "htslib/faidx.h"
 #include "htslib/sam.h"
@@ -35,6 +37,9 @@
 #include "utils.h"
 #include "bam_md_ext.h"
 #include "defaults.h"
+#include "sidecar.h"
+#include "samutils.h"
+#include "thread_budget.h"
 
 #define USE_EQUAL 1
 #define DROP_TAG  2
@@ -58,7 +63,11 @@ static void usage()
      fprintf(stderr, "         -B       Don't compute base alignment qualities\n");
      fprintf(stderr, "         -A       Don't compute indel alignment qualities\n");
      fprintf(stderr, "         -r       Recompute i.e. overwrite existing values\n");
-     fprintf(stderr, "- Output BAM will be written to stdout.\n");				
+     fprintf(stderr, "         -s FILE  Write qualities to this sidecar file (see call --sidecar) instead of BAM\n");
+     fprintf(stderr, "         -o FILE  Write output to this file instead of stdout\n");
+     fprintf(stderr, "         -t INT   Number of threads for BAM (de)compression [$%s or 1]\n", THREAD_BUDGET_ENV);
+     fprintf(stderr, "- Output BAM will be written to stdout (unless -s or -o is used).\n");
+     fprintf(stderr, "- Coordinate sorted BAM output written to a file (-b -o) is indexed on the fly.\n");
      fprintf(stderr, "- Only reads containing indels will contain indel-alignment qualities (tags: %s and %s).\n", AI_TAG, AD_TAG);
      fprintf(stderr, "- Do not change the alignmnent after running this, i.e. use this as last postprocessing step!\n");
      fprintf(stderr, "- This program is based on samtools. BAQ was introduced by Heng Li PMID:21320865\n\n");
@@ -77,12 +86,19 @@ int main_alnqual(int argc, char *argv[])
      int ext_baq = 1;
      int idaq_flag = 1;
      int redo = 0;
+     char *sidecar_fn = NULL;
+     sidecar_writer_t *sidecar = NULL;
+     char *out_fn = NULL;
+     int num_threads = 0;
+     char *fnidx = NULL;
+     int rc = 0;
+     const char *sidecar_tags[] = {BAQ_TAG, AI_TAG, AD_TAG};
 
      is_bam_out = is_sam_in = is_uncompressed = 0;
      mode_w[0] = mode_r[0] = 0;
      strcpy(mode_r, "r"); strcpy(mode_w, "w");
 	
-     while ((c = getopt(argc, argv, "buSeBAr")) >= 0) {
+     while ((c = getopt(argc, argv, "buSeBArs:o:t:")) >= 0) {
           switch (c) {
           case 'b': is_bam_out = 1; break;
           case 'u': is_uncompressed = is_bam_out = 1; break;
@@ -91,6 +107,14 @@ int main_alnqual(int argc, char *argv[])
           case 'B': baq_flag = 0; break;
           case 'A': idaq_flag = 0; break;
           case 'r': redo = 1; break;
+          case 's': sidecar_fn = optarg; break;
+          case 'o': out_fn = optarg; break;
+          case 't':
+               if (! isdigit(optarg[0]) || (num_threads = atoi(optarg)) < 1) {
+                    fprintf(stderr, "FATAL: %s: invalid number of threads: %s\n", MYNAME, optarg);
+                    return 1;
+               }
+               break;
           case '?': 
                fprintf(stderr, "FATAL: unrecognized arguments found. Exiting...\n");
                return 1;
@@ -125,17 +149,49 @@ int main_alnqual(int argc, char *argv[])
           return 1;
      }
 
+     if (out_fn && strcmp(out_fn, "-") && file_exists(out_fn)) {
+          fprintf(stderr, "FATAL: %s: Cowardly refusing to overwrite file '%s'\n", MYNAME, out_fn);
+          return 1;
+     }
+     if (thread_budget_init(num_threads)) {
+          return 1;
+     }
+
      fp = sam_open(argv[optind], mode_r);
      if (fp == 0) return 1;
+     thread_budget_hts(fp);
      bam_hdr_t *header = sam_hdr_read(fp);
      if (header == 0) {
           fprintf(stderr, "FATAL: %s: input SAM does not have header\n", MYNAME);
           return 1;
      }
-     fpout = sam_open("-", mode_w);
-     if (sam_hdr_write(fpout, header) < 0) {
-          fprintf(stderr, "FATAL: %s: failed to copy SAM header to output\n", MYNAME);
-          return 1;
+     if (sidecar_fn) {
+          if (file_exists(sidecar_fn)) {
+               fprintf(stderr, "FATAL: %s: Cowardly refusing to overwrite file '%s'\n", MYNAME, sidecar_fn);
+               return 1;
+          }
+          if (NULL == (sidecar = sidecar_writer_open(sidecar_fn, sidecar_tags, 3))) {
+               return 1;
+          }
+     } else {
+          fpout = sam_open(out_fn ? out_fn : "-", mode_w);
+          if (fpout == 0) {
+               fprintf(stderr, "FATAL: %s: failed to open output %s\n", MYNAME, out_fn ? out_fn : "-");
+               return 1;
+          }
+          if (is_bam_out) {
+               thread_budget_hts(fpout);
+          }
+          if (sam_hdr_write(fpout, header) < 0) {
+               fprintf(stderr, "FATAL: %s: failed to copy SAM header to output\n", MYNAME);
+               return 1;
+          }
+          /* BAQ and IDAQ don't move reads, so sorted input gives sorted output */
+          if (is_bam_out && sam_hdr_is_coord_sorted(header)) {
+               if (sam_idx_out_init(fpout, header, out_fn, &fnidx) < 0) {
+                    return 1;
+               }
+          }
      }
 
      fai = fai_load(argv[optind+1]);
@@ -161,7 +217,12 @@ int main_alnqual(int argc, char *argv[])
                
                bam_prob_realn_core_ext(b, ref, baq_flag, ext_baq, idaq_flag);
           }
-          if (sam_write1(fpout, header, b) < 0) {
+          if (sidecar) {
+               if (sidecar_writer_add(sidecar, b)) {
+                    fprintf(stderr, "FATAL: %s failed to write record to sidecar\n", MYNAME);
+                    return 1;
+               }
+          } else if (sam_write1(fpout, header, b) < 0) {
                          fprintf(stderr, "FATAL: %s failed to write record to output\n",
                                    MYNAME);
                          return 1;
@@ -173,6 +234,21 @@ int main_alnqual(int argc, char *argv[])
      fai_destroy(fai);
      bam_hdr_destroy(header);
      sam_close(fp);
-     sam_close(fpout);
-     return 0;
+     if (sidecar) {
+          if (sidecar_writer_close(sidecar)) {
+               return 1;
+          }
+     } else {
+          if (fnidx && sam_idx_save(fpout) < 0) {
+               fprintf(stderr, "FATAL: %s: failed to save index %s\n", MYNAME, fnidx);
+               rc = 1;
+          }
+          free(fnidx);
+          if (sam_close(fpout) < 0) {
+               fprintf(stderr, "FATAL: %s: failed to close output\n", MYNAME);
+               rc = 1;
+          }
+     }
+     thread_budget_destroy();
+     return rc;
 }
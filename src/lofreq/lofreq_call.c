@@ -56,6 +56,7 @@
 void *bed_read(const char *fn);
 void bed_destroy(void *_h);
 int bed_overlap(const void *_h, const char *chr, int beg, int end);
+int bed_regions(const void *_h, char ***regs);
 
 
 
@@ -67,10 +68,13 @@ int bed_overlap(const void *_h, const char *chr, int beg, int end);
 #include "log.h"
 #include "plp.h"
 #include "defaults.h"
-
-#ifdef USE_FPGA
-#include "fpga.h"
-#endif
+#include "pbin_owner.h"
+#include "plp_store.h"
+#include "preview.h"
+#include "consensus.h"
+#include "cost_profile.h"
+#include "autotune.h"
+#include "evidence.h"
 
 #if 1
 #define MYNAME "lofreq call"
@@ -82,78 +86,39 @@ int bed_overlap(const void *_h, const char *chr, int beg, int end);
 #define BUF_SIZE 1<<16
 
 
-/* number of tests performed (CONSVAR doesn't count). for downstream
- * multiple testing correction. corresponds to bonf if bonf_dynamic is
- * true. */
-long long int num_snv_tests = 0;
-long long int num_indel_tests = 0;
 /* FIXME extend to keep some more stats, e.g. num_pos_with_cov etc */
 
 long int indel_calls_wo_idaq = 0;
 
-#ifdef USE_FPGA
-
-/* Helper function to initialize OpenCL platforms and devices.
- * Adapted from the Xilinx Vitis doc:
- * https://docs.xilinx.com/r/2021.1-English/ug1393-vitis-application-acceleration/OpenCL-Host-Application
- * */
-void get_xilinx_device(cl_device_id * devices, cl_uint *num_devices)
+/* live metrics (see --metrics-file) */
+static metrics_t *call_metrics = NULL;
+static int metrics_calls = -1;
+
+/* supporting reads of calls (see --evidence-bam) */
+static evidence_t *call_evidence = NULL;
+
+/* early accept (see pruned_calc_prob_dist()) reports a bound as QUAL
+ * that is only certainly significant with regard to the current
+ * bonferroni factor. a dynamic one grows until the end and the
+ * eventual filter threshold would then cut calls, so use early accept
+ * only if the factor is fixed. returns the out parameter to pass to
+ * snpcaller() */
+static int *
+early_accept_flag(const varcall_conf_t *conf, int *pvalues_are_bounds)
 {
-     cl_uint num_entries = MAX_DEVICE_ENTIRES;
-     cl_uint platform_count;
-
-     cl_platform_id platforms[MAX_DEVICE_ENTIRES];
-     char cl_platform_vendor[NAME_LENGTH];
-     char cl_device_name[NAME_LENGTH];
-
-     cl_int err;
-
-     // Set up the OpenCL platform.
-     err = clGetPlatformIDs(num_entries, platforms, &platform_count);
-     if (err != CL_SUCCESS) {
-          fprintf(stderr, "clGetPlatformIDs failed\n");
-          if (err != CL_INVALID_VALUE) {
-               fprintf(stderr, "clGetPlatformIDs: CL_INVALID_VALUE\n");
-          }
-          return;
+     if (conf->bonf_dynamic || ! (conf->flag & VARCALL_EARLY_ACCEPT)) {
+          return NULL;
      }
-
-     // Looking for the Xilinx Platform
-     for (unsigned int iplat=0; iplat < platform_count; iplat++) {
-          err = clGetPlatformInfo(platforms[iplat],
-          CL_PLATFORM_VENDOR, PLATFORM_PARAM_SIZE,
-          cl_platform_vendor, NULL);
-
-          if (err != CL_SUCCESS) {
-               fprintf(stderr, "clGetPlatformInfo failed\n");
-               return;
-          }
-
-          if (strcmp(cl_platform_vendor, "Xilinx") == 0) {
-               fprintf(stdout, "SUCCESS: %d %s platform(s) found\n",
-                    platform_count, cl_platform_vendor);
-
-               err = clGetDeviceIDs(platforms[iplat],
-                    CL_DEVICE_TYPE_ACCELERATOR, MAX_DEVICE_ENTIRES,
-                    devices, num_devices);
-               if (err != CL_SUCCESS) {
-                    fprintf(stderr, "clGetDeviceIDs failed\n");
-                    exit(-1);
-               }
-               fprintf(stdout, "SUCCESS: Found %d device(s)\n", *num_devices);
-               return;
-          }
-     }
-     fprintf(stderr, "Failed to find Xilinx devices.\n");
-     exit(-1);
+     return pvalues_are_bounds;
 }
+/* early_accept_flag() */
 
-#endif
 
 /* variant reporter to be used for all types */
 void
 report_var(vcf_file_t *vcf_file, const plp_col_t *p, const char *ref,
            const char *alt, const float af, const int qual,
+           const int qual_is_bound,
            const int is_indel, const int is_consvar,
            const dp4_counts_t *dp4)
 {
@@ -191,9 +156,18 @@ report_var(vcf_file_t *vcf_file, const plp_col_t *p, const char *ref,
      }
      vcf_var_sprintf_info(var, is_indel? p->coverage_plp - p->num_tails : p->coverage_plp,
                           af, sb_qual, dp4, is_indel, p->hrun, is_consvar);
+     if (qual_is_bound) {
+          vcf_var_add_to_info(var, QUAL_BOUND_FLAG);
+     }
 
      vcf_write_var(vcf_file, var);
      vcf_free_var(&var);
+     if (call_metrics) {
+          metrics_add(call_metrics, metrics_calls, 1);
+     }
+     if (call_evidence) {
+          evidence_add_var(call_evidence, p->target, p->pos, ref, alt);
+     }
 }
 /* report_var() */
 
@@ -226,7 +200,7 @@ report_cons_sub(const plp_col_t *p, varcall_conf_t *conf){
      LOG_DEBUG("cons var snp: %s %d %c>%s\n",
                p->target, p->pos+1, p->ref_base, p->cons_base);
      report_var(& conf->vcf_out, p, report_ref, p->cons_base,
-                af, qual, is_indel, is_consvar, &dp4);
+                af, qual, 0, is_indel, is_consvar, &dp4);
 }
 
 /* report consensus insertion */
@@ -265,7 +239,7 @@ report_cons_ins(const plp_col_t *p, varcall_conf_t *conf) {
      LOG_DEBUG("Consensus insertion: %s %d %s>%s\n",
                p->target, p->pos+1, report_ins_ref, report_ins_alt);
      report_var(& conf->vcf_out, p, report_ins_ref, report_ins_alt,
-                af, qual, is_indel, is_consvar, &dp4);
+                af, qual, 0, is_indel, is_consvar, &dp4);
      return;
 }
 
@@ -305,7 +279,7 @@ report_cons_del(const plp_col_t *p, varcall_conf_t *conf) {
      LOG_DEBUG("Consensus deletion: %s %d %s>%s\n",
                p->target, p->pos+1, report_del_ref, report_del_alt);
      report_var(&conf->vcf_out, p, report_del_ref, report_del_alt,
-                af, qual, is_indel, is_consvar, &dp4);
+                af, qual, 0, is_indel, is_consvar, &dp4);
 
 }
 #endif
@@ -368,6 +342,7 @@ call_alt_ins(const plp_col_t *p, double *bi_err_probs, int bi_num_err_probs,
 
      int ins_counts[3];
      long double bi_pvalues[3];
+     int bi_pvalues_are_bounds = 0;
 
      // prep for snpcaller
      ins_counts[0] = it->count;
@@ -377,7 +352,8 @@ call_alt_ins(const plp_col_t *p, double *bi_err_probs, int bi_num_err_probs,
                bi_num_err_probs, ins_counts[0], ins_counts[1], ins_counts[2]);
      // compute p-value for insertion
      if (snpcaller(bi_pvalues, bi_err_probs, bi_num_err_probs, ins_counts,
-                   conf->bonf_indel, conf->sig, conf->approx_threshold_n)) {
+                   conf->bonf_indel, conf->sig, conf->approx_threshold_n,
+                   early_accept_flag(conf, &bi_pvalues_are_bounds))) {
           fprintf(stderr, "FATAL: snpcaller() failed at %s:%s():%d\n",
                   __FILE__, __FUNCTION__, __LINE__);
           return 1;
@@ -404,7 +380,7 @@ call_alt_ins(const plp_col_t *p, double *bi_err_probs, int bi_num_err_probs,
                     p->target, p->pos+1, report_ins_ref, report_ins_alt,
                     bi_pvalue, qual);
           report_var(&conf->vcf_out, p, report_ins_ref, report_ins_alt,
-                     af, qual, is_indel, is_consvar, &dp4);
+                     af, qual, bi_pvalues_are_bounds, is_indel, is_consvar, &dp4);
 
           free(report_ins_ref); free(report_ins_alt);
      } 
@@ -424,6 +400,7 @@ int call_alt_del(const plp_col_t *p, double *bd_err_probs, int bd_num_err_probs,
 
      int del_counts[3];
      long double bd_pvalues[3];
+     int bd_pvalues_are_bounds = 0;
 
      /* prep for snpcaller */
      del_counts[0] = it->count;
@@ -442,7 +419,8 @@ int call_alt_del(const plp_col_t *p, double *bd_err_probs, int bd_num_err_probs,
 
      /* snpcaller for deletion */
      if (snpcaller(bd_pvalues, bd_err_probs, bd_num_err_probs, del_counts,
-                   conf->bonf_indel, conf->sig, conf->approx_threshold_n)) {
+                   conf->bonf_indel, conf->sig, conf->approx_threshold_n,
+                   early_accept_flag(conf, &bd_pvalues_are_bounds))) {
           fprintf(stderr, "FATAL: snpcaller() failed at %s:%s():%d\n",
                   __FILE__, __FUNCTION__, __LINE__);
           return 1;
@@ -470,7 +448,7 @@ int call_alt_del(const plp_col_t *p, double *bd_err_probs, int bd_num_err_probs,
                     p->target, p->pos+1, report_del_ref, report_del_alt,
                     bd_pvalue, qual);
           report_var(&conf->vcf_out, p, report_del_ref, report_del_alt,
-                     af, qual, is_indel, is_consvar, &dp4);
+                     af, qual, bd_pvalues_are_bounds, is_indel, is_consvar, &dp4);
           free(report_del_ref);
           free(report_del_alt);
      } 
@@ -740,6 +718,16 @@ call_indels(const plp_col_t *p, varcall_conf_t *conf)
            }
       }      
 
+      /* alleles dropped by top-k tracking (--max-indel-alleles) are
+       * not tested, but count as tests nevertheless, i.e. multiple
+       * testing correction stays as if all of them had been tested */
+      if (p->num_ins_evicted || p->num_dels_evicted) {
+           if (conf->bonf_dynamic) {
+                conf->bonf_indel += p->num_ins_evicted + p->num_dels_evicted;
+           }
+           conf->num_indel_tests += p->num_ins_evicted + p->num_dels_evicted;
+      }
+
       /*if (p->num_ins && p->ins_quals.n) { FIXME check for ins_quals.n breaks if 100% consvar. why was this needed? see also del */
       if (p->num_ins) {
            ins_event *it, *it_tmp;
@@ -753,7 +741,7 @@ call_indels(const plp_col_t *p, varcall_conf_t *conf)
                 if (conf->bonf_dynamic) {
                      conf->bonf_indel += 1;
                 }
-                num_indel_tests += 1;
+                conf->num_indel_tests += 1;
                 if (call_alt_ins(p, bi_err_probs, bi_num_err_probs, conf, it)) {
                      free(bi_err_probs);
                      return;
@@ -775,7 +763,7 @@ call_indels(const plp_col_t *p, varcall_conf_t *conf)
                 if (conf->bonf_dynamic) {
                      conf->bonf_indel += 1;
                 }
-                num_indel_tests += 1;
+                conf->num_indel_tests += 1;
                 if (call_alt_del(p, bd_err_probs, bd_num_err_probs, conf, it)) {
                      free(bd_err_probs);
                      return;
@@ -799,6 +787,7 @@ call_snvs(const plp_col_t *p, varcall_conf_t *conf)
      int i;
      /* 4 bases ignoring N, -1 reference/consensus base makes 3 */
      long double pvalues[NUM_NONCONS_BASES]; /* pvalues reported back from snpcaller */
+     int pvalues_are_bounds = 0; /* snpcaller stopped early and pvalues are bounds */
      int alt_counts[NUM_NONCONS_BASES]; /* counts for alt bases handed down to snpcaller */
      int alt_raw_counts[NUM_NONCONS_BASES]; /* raw, unfiltered alt-counts */
      int alt_bases[NUM_NONCONS_BASES];/* actual alt bases */
@@ -858,14 +847,15 @@ call_snvs(const plp_col_t *p, varcall_conf_t *conf)
                 conf->bonf_subst += NUM_NONCONS_BASES; /* will do one test per non-cons nuc */
            }
       }
-      num_snv_tests += NUM_NONCONS_BASES;
+      conf->num_snv_tests += NUM_NONCONS_BASES;
 
       LOG_DEBUG("%s %d: passing down %d quals with noncons_counts"
                 " (%d, %d, %d) to snpcaller(num_snv_tests=%lld conf->bonf=%lld, conf->sig=%f)\n", p->target, p->pos+1,
-                bc_num_err_probs, alt_counts[0], alt_counts[1], alt_counts[2], num_snv_tests, conf->bonf_subst, conf->sig);
+                bc_num_err_probs, alt_counts[0], alt_counts[1], alt_counts[2], conf->num_snv_tests, conf->bonf_subst, conf->sig);
 
       if (snpcaller(pvalues, bc_err_probs, bc_num_err_probs,
-                   alt_counts, conf->bonf_subst, conf->sig, conf->approx_threshold_n)) {
+                   alt_counts, conf->bonf_subst, conf->sig, conf->approx_threshold_n,
+                   early_accept_flag(conf, &pvalues_are_bounds))) {
            fprintf(stderr, "FATAL: snpcaller() failed at %s:%s():%d\n",
                    __FILE__, __FUNCTION__, __LINE__);
            free(bc_err_probs);
@@ -917,7 +907,7 @@ call_snvs(const plp_col_t *p, varcall_conf_t *conf)
                 dp4.alt_rv = p->rv_counts[alt_nt4];
 
                 report_var(& conf->vcf_out, p, report_ref, report_alt,
-                           af, PROB_TO_PHREDQUAL(pvalue),
+                           af, PROB_TO_PHREDQUAL(pvalue), pvalues_are_bounds,
                            is_indel, is_consvar, &dp4);
                 LOG_DEBUG("low freq snp: %s %d %c>%c pv-prob:%Lg;pv-qual:%d"
                           " counts-raw:%d/%d=%.6f counts-filt:%d/%d=%.6f\n",
@@ -993,6 +983,577 @@ call_vars(const plp_col_t *p, void *confp)
 /* call_vars() */
 
 
+/* all varcall configurations evaluated on the same pileup (see
+ * --param-set) */
+typedef struct {
+     int n;
+     varcall_conf_t **confs;
+} varcall_confs_t;
+
+
+/* one extra configuration read from a --param-set file */
+typedef struct {
+     varcall_conf_t conf;
+     char *vcf_out;
+     char *vcf_tmp_out;
+} param_set_t;
+
+
+/* calls variants with each configuration. column compilation
+ * (decoding, BAQ etc.) was done once for all of them upstream */
+void
+call_vars_multi(const plp_col_t *p, void *confsp)
+{
+     varcall_confs_t *confs = (varcall_confs_t *)confsp;
+     int i;
+
+     for (i=0; i<confs->n; i++) {
+          call_vars(p, confs->confs[i]);
+     }
+}
+/* call_vars_multi() */
+
+
+/* sampled preview (see --preview and preview.h). only columns within
+ * sampled windows are called */
+typedef struct {
+     varcall_conf_t *conf;
+     preview_t *preview;
+} preview_conf_t;
+
+
+void
+call_vars_preview(const plp_col_t *p, void *confp)
+{
+     preview_conf_t *pc = (preview_conf_t *)confp;
+
+     if (preview_add_col(pc->preview, p)) {
+          call_vars(p, pc->conf);
+     }
+}
+/* call_vars_preview() */
+
+
+/* priority regions (see --priority-bed). reads are fetched for the
+ * regions only, but columns of reads reaching out of them have to be
+ * skipped here */
+typedef struct {
+     varcall_conf_t *conf;
+     void *bed;
+} priority_conf_t;
+
+
+void
+call_vars_priority(const plp_col_t *p, void *confp)
+{
+     priority_conf_t *pc = (priority_conf_t *)confp;
+
+     if (bed_overlap(pc->bed, p->target, p->pos, p->pos+1)) {
+          call_vars(p, pc->conf);
+     }
+}
+/* call_vars_priority() */
+
+
+/* copies file at path to stream. returns non-zero on error */
+static int
+cat_file(const char *path, FILE *stream)
+{
+     char buf[BUF_SIZE];
+     size_t len;
+     FILE *fh;
+
+     if (NULL == (fh = fopen(path, "r"))) {
+          return 1;
+     }
+     while ((len = fread(buf, 1, sizeof(buf), fh)) > 0) {
+          if (fwrite(buf, 1, len, stream) != len) {
+               fclose(fh);
+               return 1;
+          }
+     }
+     fclose(fh);
+     return 0;
+}
+
+
+/* incremental calling (see --state and plp_store.h). pileup columns
+ * of the new reads are merged into the stored ones, which are called
+ * again. stored records in between are passed through.
+ */
+typedef struct {
+     varcall_conf_t *conf;
+     const bam_hdr_t *header;
+     plp_store_t *in; /* previous state. NULL if there is none */
+     plp_store_t *out;
+     plp_store_rec_t next; /* next record of in */
+     int has_next;
+     long long int num_snv_tests; /* summed over all columns */
+     long long int num_indel_tests;
+     int err;
+} incr_conf_t;
+
+
+static void
+incr_read_next(incr_conf_t *ic)
+{
+     int ret;
+
+     ic->has_next = 0;
+     if (NULL == ic->in) {
+          return;
+     }
+     if ((ret = plp_store_read(ic->in, & ic->next)) < 0) {
+          ic->err = 1;
+     }
+     if (ret <= 0) {
+          plp_store_rec_free(& ic->next);
+          return;
+     }
+     ic->has_next = 1;
+}
+
+
+/* adds the tests and calls of rec to the totals and writes it to the
+ * new state */
+static void
+incr_emit(incr_conf_t *ic, const plp_store_rec_t *rec)
+{
+     if (rec->calls[0] != '\0') {
+          vcf_printf(& ic->conf->vcf_out, "%s", rec->calls);
+     }
+     ic->num_snv_tests += rec->num_snv_tests;
+     ic->num_indel_tests += rec->num_indel_tests;
+     if (plp_store_write(ic->out, rec)) {
+          ic->err = 1;
+     }
+}
+
+
+/* passes through all stored records before tid:pos. use tid=INT_MAX
+ * for all remaining ones */
+static void
+incr_flush_until(incr_conf_t *ic, int tid, int pos)
+{
+     while (ic->has_next && ! ic->err
+            && (ic->next.tid < tid
+                || (ic->next.tid == tid && ic->next.col.pos < pos))) {
+          incr_emit(ic, & ic->next);
+          plp_store_rec_free(& ic->next);
+          incr_read_next(ic);
+     }
+}
+
+
+void
+call_vars_incremental(const plp_col_t *p, void *confp)
+{
+     incr_conf_t *ic = (incr_conf_t *)confp;
+     varcall_conf_t *conf = ic->conf;
+     plp_store_rec_t new_rec;
+     plp_store_rec_t *rec;
+     vcf_file_t vcf_out_org;
+     long long int num_snv_tests_org = conf->num_snv_tests;
+     long long int num_indel_tests_org = conf->num_indel_tests;
+     size_t calls_len;
+     int tid;
+
+     if (ic->err) {
+          return;
+     }
+     if ((tid = bam_name2id((bam_hdr_t *)ic->header, p->target)) < 0) {
+          LOG_ERROR("Unknown target %s\n", p->target);
+          ic->err = 1;
+          return;
+     }
+
+     incr_flush_until(ic, tid, p->pos);
+     if (ic->err) {
+          return;
+     }
+     if (ic->has_next && ic->next.tid == tid && ic->next.col.pos == p->pos) {
+          rec = & ic->next;
+     } else {
+          rec = & new_rec;
+          plp_col_init(& rec->col);
+          rec->tid = tid;
+          rec->col.target = strdup(p->target);
+          rec->col.pos = p->pos;
+          rec->col.ref_base = p->ref_base;
+          rec->col.hrun = p->hrun;
+          rec->calls = NULL;
+     }
+     plp_col_merge(& rec->col, p);
+
+     /* call the merged column, capturing its calls */
+     free(rec->calls);
+     rec->calls = NULL;
+     vcf_out_org = conf->vcf_out;
+     memset(& conf->vcf_out, 0, sizeof(vcf_file_t));
+     conf->vcf_out.mode = 'w';
+     if (NULL == (conf->vcf_out.fh = open_memstream(& rec->calls, & calls_len))) {
+          LOG_ERROR("%s\n", "Couldn't open memory stream");
+          conf->vcf_out = vcf_out_org;
+          ic->err = 1;
+          return;
+     }
+     call_vars(& rec->col, conf);
+     fclose(conf->vcf_out.fh);
+     conf->vcf_out = vcf_out_org;
+
+     rec->num_snv_tests = conf->num_snv_tests - num_snv_tests_org;
+     rec->num_indel_tests = conf->num_indel_tests - num_indel_tests_org;
+     incr_emit(ic, rec);
+
+     plp_store_rec_free(rec);
+     if (rec == & ic->next) {
+          incr_read_next(ic);
+     }
+}
+/* call_vars_incremental() */
+
+
+/* calling parameters that have to stay the same for all updates of a
+ * state file */
+static void
+incr_params(char *buf, size_t size, const mplp_conf_t *mplp_conf,
+            const varcall_conf_t *varcall_conf)
+{
+     char bonf[64];
+
+     if (varcall_conf->bonf_dynamic) {
+          strcpy(bonf, "dynamic");
+     } else {
+          snprintf(bonf, sizeof(bonf), "%lld", varcall_conf->bonf_subst);
+     }
+     snprintf(buf, size,
+              "mq=%d-%d mplp_flag=%d max_depth=%d min_plp_bq=%d min_plp_idq=%d def_nm_q=%d max_indel_alleles=%d"
+              " bq=%d,%d,%d jq=%d,%d,%d min_cov=%d sig=%g bonf=%s varcall_flag=%d indels=%d,%d",
+              mplp_conf->min_mq, mplp_conf->max_mq, mplp_conf->flag, mplp_conf->max_depth,
+              mplp_conf->min_plp_bq, mplp_conf->min_plp_idq, mplp_conf->def_nm_q,
+              mplp_conf->max_indel_alleles,
+              varcall_conf->min_bq, varcall_conf->min_alt_bq, varcall_conf->def_alt_bq,
+              varcall_conf->min_jq, varcall_conf->min_alt_jq, varcall_conf->def_alt_jq,
+              varcall_conf->min_cov, varcall_conf->sig, bonf, varcall_conf->flag,
+              varcall_conf->no_indels, varcall_conf->only_indels);
+}
+/* incr_params() */
+
+
+/* Reads one extra configuration per line from fn, appending them to
+ * param_sets. Each line holds the output vcf file followed by options
+ * that change the settings of base, e.g.:
+ *
+ * sig0.001.vcf.gz --sig 0.001 --min-bq 20
+ * nobaq.vcf.gz --no-baq --no-mq
+ *
+ * Empty lines and lines starting with # are ignored. Only options
+ * that don't influence pileup/column compilation are allowed.
+ *
+ * Returns non-zero on error
+ */
+static int
+param_set_load(const char *fn, const varcall_conf_t *base,
+               param_set_t **param_sets, int *num_param_sets)
+{
+     FILE *fh;
+     char line[BUF_SIZE];
+     int line_no = 0;
+     int rc = 0;
+     const char *delim = " \t\r\n";
+
+     if (NULL == (fh = fopen(fn, "r"))) {
+          LOG_ERROR("Couldn't open %s\n", fn);
+          return 1;
+     }
+
+     while (NULL != fgets(line, sizeof(line), fh)) {
+          param_set_t *ps;
+          char *saveptr = NULL;
+          char *tok;
+
+          line_no++;
+          if (NULL == (tok = strtok_r(line, delim, &saveptr)) || tok[0] == '#') {
+               continue;
+          }
+
+          (*num_param_sets)++;
+          *param_sets = realloc(*param_sets, (*num_param_sets) * sizeof(param_set_t));
+          ps = &(*param_sets)[(*num_param_sets)-1];
+          memcpy(&ps->conf, base, sizeof(varcall_conf_t));
+          ps->vcf_out = strdup(tok);
+          ps->vcf_tmp_out = NULL;
+
+          while (NULL != (tok = strtok_r(NULL, delim, &saveptr))) {
+               char *arg;
+
+               if (0 == strcmp(tok, "-B") || 0 == strcmp(tok, "--no-baq")) {
+                    ps->conf.flag &= ~VARCALL_USE_BAQ;
+                    continue;
+               } else if (0 == strcmp(tok, "-N") || 0 == strcmp(tok, "--no-mq")) {
+                    ps->conf.flag &= ~VARCALL_USE_MQ;
+                    continue;
+               }
+
+               /* all others need an argument */
+               if (NULL == (arg = strtok_r(NULL, delim, &saveptr))) {
+                    LOG_ERROR("Missing argument for %s in line %d of %s\n", tok, line_no, fn);
+                    rc = 1;
+                    goto done;
+               }
+               if (0 == strcmp(tok, "-a") || 0 == strcmp(tok, "--sig")) {
+                    ps->conf.sig = strtof(arg, (char **)NULL);
+                    if (0 == ps->conf.sig) {
+                         LOG_ERROR("Couldn't parse sig in line %d of %s\n", line_no, fn);
+                         rc = 1;
+                         goto done;
+                    }
+               } else if (0 == strcmp(tok, "-b") || 0 == strcmp(tok, "--bonf")) {
+                    if (0 == strncmp(arg, "dynamic", 7)) {
+                         ps->conf.bonf_dynamic = 1;
+                         ps->conf.bonf_subst = ps->conf.bonf_indel = 1;
+                    } else {
+                         ps->conf.bonf_dynamic = 0;
+                         ps->conf.bonf_subst = strtoll(arg, (char **)NULL, 10);
+                         if (1 > ps->conf.bonf_subst) {
+                              LOG_ERROR("Couldn't parse Bonferroni factor in line %d of %s\n", line_no, fn);
+                              rc = 1;
+                              goto done;
+                         }
+                    }
+               } else if (0 == strcmp(tok, "-q") || 0 == strcmp(tok, "--min-bq")) {
+                    ps->conf.min_bq = atoi(arg);
+               } else if (0 == strcmp(tok, "-Q") || 0 == strcmp(tok, "--min-alt-bq")) {
+                    ps->conf.min_alt_bq = atoi(arg);
+               } else if (0 == strcmp(tok, "-R") || 0 == strcmp(tok, "--def-alt-bq")) {
+                    ps->conf.def_alt_bq = atoi(arg);
+               } else if (0 == strcmp(tok, "-j") || 0 == strcmp(tok, "--min-jq")) {
+                    ps->conf.min_jq = atoi(arg);
+               } else if (0 == strcmp(tok, "-J") || 0 == strcmp(tok, "--min-alt-jq")) {
+                    ps->conf.min_alt_jq = atoi(arg);
+               } else if (0 == strcmp(tok, "-K") || 0 == strcmp(tok, "--def-alt-jq")) {
+                    ps->conf.def_alt_jq = atoi(arg);
+                    if (-1 == ps->conf.def_alt_jq) {
+                         LOG_ERROR("%s\n", "Sorry, use of median ref JQ implemented yet");/* FIXME */
+                         rc = 1;
+                         goto done;
+                    }
+               } else if (0 == strcmp(tok, "-C") || 0 == strcmp(tok, "--min-cov")) {
+                    ps->conf.min_cov = atoi(arg);
+               } else {
+                    LOG_ERROR("Unsupported option %s in line %d of %s\n", tok, line_no, fn);
+                    rc = 1;
+                    goto done;
+               }
+          }
+
+          if (ps->conf.min_bq > ps->conf.min_alt_bq) {
+               LOG_ERROR("Minimum base-call quality for all bases (%d) larger than minimum"
+                         " base-call quality for alternate bases (%d) in line %d of %s\n",
+                         ps->conf.min_bq, ps->conf.min_alt_bq, line_no, fn);
+               rc = 1;
+               goto done;
+          }
+     }
+
+done:
+     fclose(fh);
+     return rc;
+}
+/* param_set_load() */
+
+
+/* opens conf->vcf_out: vcf_out (NULL or - for stdout) directly if no
+ * filtering is needed afterwards, otherwise a tmp file whose name is
+ * returned via vcf_tmp_out. returns non-zero on error */
+static int
+open_var_out(varcall_conf_t *conf, const char *vcf_out,
+             const int no_default_filter, char **vcf_tmp_out)
+{
+     *vcf_tmp_out = NULL;
+
+     /* if we don't apply a default filter and bonf is not dynamic then
+      * we can directly write to requested output file. otherwise we
+      * use a tmp file that gets filtered.
+      */
+     if (no_default_filter && ! conf->bonf_dynamic) {
+          if (NULL == vcf_out || 0 == strcmp(vcf_out, "-")) {
+               if (vcf_file_open(& conf->vcf_out, "-",
+                                 0, 'w')) {
+                    LOG_ERROR("%s\n", "Couldn't open stdout");
+                    return 1;
+               }
+          } else {
+               if (vcf_file_open(& conf->vcf_out, vcf_out,
+                                 HAS_GZIP_EXT(vcf_out), 'w')) {
+                    LOG_ERROR("Couldn't open %s\n", vcf_out);
+                    return 1;
+               }
+          }
+     } else {
+          char vcf_tmp_template[] = "/tmp/lofreq2-call-dyn-bonf.XXXXXX";
+          *vcf_tmp_out = strdup(mktemp(vcf_tmp_template));
+          if (NULL == *vcf_tmp_out) {
+               LOG_FATAL("%s\n", "Couldn't create temporary vcf file");
+               return 1;
+          }
+          if (vcf_file_open(& conf->vcf_out, *vcf_tmp_out,
+                            HAS_GZIP_EXT(*vcf_tmp_out), 'w')) {
+               LOG_ERROR("Couldn't open %s\n", *vcf_tmp_out);
+               free(*vcf_tmp_out);
+               *vcf_tmp_out = NULL;
+               return 1;
+          }
+     }
+     return 0;
+}
+/* open_var_out() */
+
+
+/* snv calling completed. now filter vcf_tmp_out into vcf_out
+ * according to the following rules:
+ *  1. no_default_filter and ! dyn
+ *     just print (already written to vcf_out by open_var_out())
+ *  2 filter with
+ *     - no_default_filter, if set
+ *     - filter snvphred according to bonf, if dynamic
+ * returns non-zero on error
+ */
+static int
+filter_var_out(const varcall_conf_t *conf, const char *vcf_tmp_out,
+               const char *vcf_out, const int no_default_filter)
+{
+     char cmd[BUF_SIZE];
+     int len;
+
+     if (no_default_filter && ! conf->bonf_dynamic) {
+          /* vcf file needs no filtering and was already printed to
+           * final destination. already taken care of above. */
+          LOG_VERBOSE("%s\n", "No filtering needed or requested: variants already written to final destination");
+          return 0;
+     }
+
+     snprintf(cmd, BUF_SIZE,
+              "lofreq filter -i %s -o %s",
+              vcf_tmp_out, NULL==vcf_out ? "-" : vcf_out);
+     len = strlen(cmd);
+
+     if (no_default_filter) {
+          len += sprintf(cmd+len, " %s", "--no-defaults");
+     }
+
+     if (conf->bonf_dynamic) {
+          int snvqual_thresh = INT_MAX;
+          int indelqual_thresh = INT_MAX;
+
+          if (conf->bonf_subst) {
+               snvqual_thresh = PROB_TO_PHREDQUAL(conf->sig/conf->bonf_subst);
+               if (snvqual_thresh < 0) {
+                    snvqual_thresh = 0;
+               }
+          }
+          if (conf->bonf_indel) {
+               indelqual_thresh =  PROB_TO_PHREDQUAL(conf->sig/conf->bonf_indel);
+               if (indelqual_thresh < 0) {
+                    indelqual_thresh = 0;
+               }
+          }
+
+          len += sprintf(cmd+len,/* appending to str with format. see http://stackoverflow.com/questions/14023024/strcat-for-formatted-strings */
+                         " --snvqual-thresh %d --indelqual-thresh %d",
+                         snvqual_thresh, indelqual_thresh);
+     } else {
+          LOG_VERBOSE("%s\n", "No SNV/indel-quality filtering needed (already applied during call since bonf was fixed)");
+     }
+
+     LOG_VERBOSE("Executing %s\n", cmd);
+     if (0 != system(cmd)) {
+          LOG_ERROR("The following command failed: %s\n", cmd);
+          return 1;
+     }
+     /*if (! debug)*/
+     (void) unlink(vcf_tmp_out);
+     return 0;
+}
+/* filter_var_out() */
+
+
+/* calls the regions listed in bed_file only and writes final,
+ * filtered calls to vcf_out. called before the main pass, so that
+ * these results are available early. bonf > 0 replaces the
+ * Bonferroni factor of conf (dynamic or not), so that no later
+ * adjustment is needed. returns non-zero on error */
+static int
+call_priority(const mplp_conf_t *mplp_conf, const varcall_conf_t *varcall_conf,
+              const char *bed_file, const char *vcf_out, const long long int bonf,
+              const int no_default_filter, const char *bam_file)
+{
+     mplp_conf_t pr_mplp_conf;
+     varcall_conf_t pr_varcall_conf;
+     priority_conf_t pc;
+     char *vcf_tmp_out = NULL;
+     int rc = 0;
+     int i;
+
+     if (NULL == (pc.bed = bed_read(bed_file))) {
+          LOG_ERROR("Couldn't read %s\n", bed_file);
+          return 1;
+     }
+
+     memcpy(& pr_mplp_conf, mplp_conf, sizeof(mplp_conf_t));
+     pr_mplp_conf.reg = NULL;
+     /* outputs of the main pass only */
+     pr_mplp_conf.metrics = NULL;
+     pr_mplp_conf.consensus = NULL;
+     pr_mplp_conf.cost_profile = NULL;
+     pr_mplp_conf.evidence = NULL;
+     if (1 > (pr_mplp_conf.num_regs = bed_regions(pc.bed, & pr_mplp_conf.regs))) {
+          LOG_ERROR("No regions found in %s\n", bed_file);
+          bed_destroy(pc.bed);
+          return 1;
+     }
+
+     memcpy(& pr_varcall_conf, varcall_conf, sizeof(varcall_conf_t));
+     if (bonf > 0) {
+          pr_varcall_conf.bonf_dynamic = 0;
+          pr_varcall_conf.bonf_subst = pr_varcall_conf.bonf_indel = bonf;
+     }
+     pr_varcall_conf.num_snv_tests = pr_varcall_conf.num_indel_tests = 0;
+     pc.conf = & pr_varcall_conf;
+
+     if (open_var_out(& pr_varcall_conf, vcf_out, no_default_filter, & vcf_tmp_out)) {
+          rc = 1;
+          goto free_and_exit;
+     }
+     vcf_write_new_header(& pr_varcall_conf.vcf_out,
+                          mplp_conf->cmdline, mplp_conf->fa);
+
+     LOG_VERBOSE("Calling %d priority region(s) from %s first (Bonferroni factor %lld)\n",
+                 pr_mplp_conf.num_regs, bed_file, pr_varcall_conf.bonf_subst);
+     rc = mpileup(& pr_mplp_conf, & call_vars_priority, & pc, 1, & bam_file);
+     vcf_file_close(& pr_varcall_conf.vcf_out);
+
+     if (0 == rc) {
+          rc = filter_var_out(& pr_varcall_conf, vcf_tmp_out, vcf_out, no_default_filter);
+     } else if (vcf_tmp_out) {
+          (void) unlink(vcf_tmp_out);
+     }
+     if (0 == rc) {
+          LOG_VERBOSE("Priority calls written to %s\n", vcf_out);
+     }
+
+free_and_exit:
+     free(vcf_tmp_out);
+     for (i=0; i<pr_mplp_conf.num_regs; i++) {
+          free(pr_mplp_conf.regs[i]);
+     }
+     free(pr_mplp_conf.regs);
+     bed_destroy(pc.bed);
+     return rc;
+}
+/* call_priority() */
+
+
 
 static void
 usage(const mplp_conf_t *mplp_conf, const varcall_conf_t *varcall_conf)
@@ -1011,6 +1572,7 @@ usage(const mplp_conf_t *mplp_conf, const varcall_conf_t *varcall_conf)
      fprintf(stderr, "- Regions:\n");
      fprintf(stderr, "       -r | --region STR            Limit calls to this region (chrom:start-end) [null]\n");
      fprintf(stderr, "       -l | --bed FILE              List of positions (chr pos) or regions (BED) [null]\n");
+     fprintf(stderr, "            --primer-bed FILE       Soft-clip amplicon primers listed in this BED file on the fly (names ending in _LEFT/_RIGHT) [null]\n");
 
      fprintf(stderr, "- Base-call quality:\n");
      fprintf(stderr, "       -q | --min-bq INT            Skip any base with baseQ smaller than INT [%d]\n", varcall_conf->min_bq);
@@ -1020,6 +1582,8 @@ usage(const mplp_conf_t *mplp_conf, const varcall_conf_t *varcall_conf)
      fprintf(stderr, "       -j | --min-jq INT            Skip any base with joinedQ smaller than INT [%d]\n", varcall_conf->min_jq);
      fprintf(stderr, "       -J | --min-alt-jq INT        Skip alternate bases with joinedQ smaller than INT [%d]\n", varcall_conf->min_alt_jq);
      fprintf(stderr, "       -K | --def-alt-jq INT        Overwrite joinedQs of alternate bases (that passed jq filter) with this value (-1: use median ref-bq; 0: keep) [%d]\n", varcall_conf->def_alt_jq);
+     fprintf(stderr, "            --recal-table FILE      Recalibrate base qualities on the fly with this GATK BaseRecalibrator table [null]\n");
+     fprintf(stderr, "            --sidecar FILE          Take per-base tags (BAQ, IDAQ, indel qualities) from this sidecar file written by alnqual -s or indelqual --sidecar (can be used more than once) [null]\n");
 
      fprintf(stderr, "- Base-alignment (BAQ) and indel-aligment (IDAQ) qualities:\n");
      fprintf(stderr, "       -B | --no-baq                Disable use of base-alignment quality (BAQ)\n");
@@ -1034,6 +1598,8 @@ usage(const mplp_conf_t *mplp_conf, const varcall_conf_t *varcall_conf)
      fprintf(stderr, "- Indels:\n");
      fprintf(stderr, "            --call-indels           Enable indel calls (note: preprocess your file to include indel alignment qualities!)\n");
      fprintf(stderr, "            --only-indels           Only call indels; no SNVs\n");
+     fprintf(stderr, "            --max-indel-alleles INT Per column, keep exact qualities only for the INT most frequent insertion\n"
+                     "                                    and deletion alleles each. Reads of rarer ones count as non-indel (0: no limit) [%d]\n", mplp_conf->max_indel_alleles);
 
      fprintf(stderr, "- Source quality:\n");
      fprintf(stderr, "       -s | --src-qual              Enable computation of source quality\n");
@@ -1051,9 +1617,44 @@ usage(const mplp_conf_t *mplp_conf, const varcall_conf_t *varcall_conf)
      fprintf(stderr, "       -t | --approx-threshold INT  Use fast approximation at this depth (might decrease number of calls; off if <= 0) [%d]\n", varcall_conf->approx_threshold_n);
      fprintf(stderr, "            --illumina-1.3          Assume the quality is Illumina-1.3-1.7/ASCII+64 encoded\n");
      fprintf(stderr, "            --use-orphan            Count anomalous read pairs (i.e. where mate is not aligned properly)\n");
+     fprintf(stderr, "            --merge-mates           Count bases where read mates overlap only once (with combined quality)\n");
      fprintf(stderr, "            --plp-summary-only      No variant calling. Just output pileup summary per column\n");
      fprintf(stderr, "            --no-default-filter     Don't run default 'lofreq filter' automatically after calling variants\n");
+     fprintf(stderr, "            --no-early-accept       Always compute exact p-values. Otherwise, with a fixed Bonferroni factor (-b),\n"
+                     "                                    computation stops once significance is certain and QUAL is a bound (QUALBOUND)\n");
      fprintf(stderr, "            --force-overwrite       Overwrite any existing output\n");
+     fprintf(stderr, "            --param-set FILE        Also call with these parameter sets (one per line: output vcf followed by\n"
+                     "                                    options; only -a -b -q -Q -R -j -J -K -C -B -N) in the same pileup pass\n");
+     fprintf(stderr, "            --pbin-owner NAME       Let pbin-owner process NAME compute p-values (used by call-parallel)\n");
+     fprintf(stderr, "            --metrics-file FILE     Rewrite a snapshot of progress metrics (position, columns, reads, calls, RSS) to this\n"
+                     "                                    file every %d seconds (JSON if ending in .json, Prometheus text format otherwise)\n", METRICS_DEFAULT_INTERVAL);
+     fprintf(stderr, "            --state FILE            Incremental calling: merge the pileup of the given (new) BAM into the pileup\n"
+                     "                                    summaries kept in FILE (created if missing) and output calls for all reads seen\n"
+                     "                                    so far. Calling parameters have to stay the same between updates\n");
+     fprintf(stderr, "            --preview FRACTION      Quick look: only call a deterministic, stratified sample of this fraction of\n"
+                     "                                    genome windows (needs BAM index) and report extrapolated numbers of SNVs\n"
+                     "                                    and indels, Ts/Tv, depth and strand bias with 95%% CIs to stderr\n");
+     fprintf(stderr, "            --consensus-out FILE    Also write the consensus sequence of all targets with coverage to this FASTA file\n"
+                     "                                    (uncovered positions are N; consensus indels are applied)\n");
+     fprintf(stderr, "            --consensus-min-depth INT  Write N where fewer bases (after filtering) are left [%d]\n", CONSENSUS_DEFAULT_MIN_DEPTH);
+     fprintf(stderr, "            --consensus-threshold FLOAT  Write the IUPAC code of the fewest bases making up at least this\n"
+                     "                                    fraction of the column (0: majority base) [0]\n");
+     fprintf(stderr, "            --cost-profile FILE     Write time, columns, depth and number of tests per %d bp window to FILE\n"
+                     "                                    (can be used by call-parallel to balance its shards)\n", COST_PROFILE_WIN_SIZE);
+     fprintf(stderr, "            --autotune              Compute p-values with the fastest exact engine for each column's depth, number of\n"
+                     "                                    alt bases and distinct qualities (benchmarked once per host; see --autotune-cache)\n");
+     fprintf(stderr, "            --autotune-cache FILE   Read/write benchmark results from/to FILE (implies --autotune)\n"
+                     "                                    [$HOME/%s/autotune-<hostname>.txt]\n", LOFREQ_AUTOTUNE_DIR);
+     fprintf(stderr, "            --priority-bed FILE     Call the regions listed in this BED file first and write their final, filtered\n"
+                     "                                    calls to --priority-out as soon as done (needs BAM index). The main\n"
+                     "                                    output still covers all regions\n");
+     fprintf(stderr, "            --priority-out FILE     VCF output for --priority-bed\n");
+     fprintf(stderr, "            --priority-bonf INT     Bonferroni factor for --priority-bed calls. Default: -b if fixed, otherwise\n"
+                     "                                    the largest possible number of substitution tests (%d per reference position)\n", NUM_NONCONS_BASES);
+     fprintf(stderr, "            --priority-only         Only produce the --priority-bed calls (used by call-parallel)\n");
+     fprintf(stderr, "            --evidence-bam FILE     Also write the reads supporting each call (before filtering) to this\n"
+                     "                                    coordinate sorted and indexed BAM file\n");
+     fprintf(stderr, "            --evidence-ref-reads INT  Add up to this many reference allele reads per call to --evidence-bam [0]\n");
      fprintf(stderr, "            --verbose               Be verbose\n");
      fprintf(stderr, "            --debug                 Enable debugging\n");
 }
@@ -1066,17 +1667,22 @@ main_call(int argc, char *argv[])
      /* based on bam_mpileup() */
      int c, i;
      static int use_orphan = 0;
+     static int autotune = 0;
+     static int priority_only = 0;
      static int only_indels = 0;
      static int no_indels = 1;
 
      static int plp_summary_only = 0;
      static int no_default_filter = 0;
+     static int no_early_accept = 0;
      static int force_overwrite = 0;
      static int illumina_1_3 = 0;
+     static int merge_mates = 0;
      char *bam_file = NULL;
      char *bed_file = NULL;
+     char *primer_bed_file = NULL;
+     char *recal_table_file = NULL;
      char *vcf_out = NULL; /* == - == stdout */
-     char vcf_tmp_template[] = "/tmp/lofreq2-call-dyn-bonf.XXXXXX";
      char *vcf_tmp_out = NULL; /* write to this file first, then filter */
      mplp_conf_t mplp_conf;
      varcall_conf_t varcall_conf;
@@ -1084,6 +1690,28 @@ main_call(int argc, char *argv[])
      void (*plp_proc_func)(const plp_col_t*, void*);
      int rc = 0;
      char *ign_vcf = NULL;
+     char *pbin_owner = NULL;
+     char *param_set_file = NULL;
+     char *metrics_file = NULL;
+     char *state_file = NULL;
+     char *state_tmp_file = NULL;
+     incr_conf_t incr_conf;
+     double preview_fraction = 0.0;
+     char *consensus_file = NULL;
+     int consensus_min_depth = CONSENSUS_DEFAULT_MIN_DEPTH;
+     double consensus_threshold = 0.0;
+     char *cost_profile_file = NULL;
+     char *evidence_file = NULL;
+     int evidence_ref_reads = 0;
+     char *autotune_file = NULL;
+     char *priority_bed_file = NULL;
+     char *priority_out = NULL;
+     long long int priority_bonf = 0;
+     int preview_to_stdout = 0;
+     preview_conf_t preview_conf;
+     param_set_t *param_sets = NULL; /* extra configurations */
+     int num_param_sets = 0;
+     varcall_confs_t varcall_confs;
 
 
 /* FIXME add sens test:
@@ -1127,16 +1755,35 @@ for cov in coverage_range:
               /* see usage sync */
               {"region", required_argument, NULL, 'r'},
               {"bed", required_argument, NULL, 'l'}, /* changes here must be reflected in pseudo_parallel code as well */
+              {"primer-bed", required_argument, NULL, 'c'},
 
               {"ref", required_argument, NULL, 'f'},
               {"call-indels", no_argument, &no_indels, 0},
               {"only-indels", no_argument, &only_indels, 1},
+              {"max-indel-alleles", required_argument, NULL, 'I'},
 
               {"out", required_argument, NULL, 'o'}, /* NOTE changes here must be reflected in pseudo_parallel code as well */
 
               {"min-bq", required_argument, NULL, 'q'},
               {"min-alt-bq", required_argument, NULL, 'Q'},
               {"def-alt-bq", required_argument, NULL, 'R'},
+              {"recal-table", required_argument, NULL, 'G'},
+              {"sidecar", required_argument, NULL, 'Y'},
+              {"metrics-file", required_argument, NULL, 'X'},
+              {"state", required_argument, NULL, 'U'},
+              {"preview", required_argument, NULL, 'V'},
+              {"consensus-out", required_argument, NULL, 'O'},
+              {"consensus-min-depth", required_argument, NULL, 'W'},
+              {"consensus-threshold", required_argument, NULL, 'Z'},
+              {"cost-profile", required_argument, NULL, 'E'},
+              {"autotune", no_argument, &autotune, 1},
+              {"autotune-cache", required_argument, NULL, 'g'},
+              {"priority-bed", required_argument, NULL, 'H'},
+              {"priority-out", required_argument, NULL, 'L'},
+              {"priority-bonf", required_argument, NULL, 'F'},
+              {"priority-only", no_argument, &priority_only, 1},
+              {"evidence-bam", required_argument, NULL, 'i'},
+              {"evidence-ref-reads", required_argument, NULL, 'k'},
 
               {"min-jq", required_argument, NULL, 'j'},
               {"min-alt-jq", required_argument, NULL, 'J'},
@@ -1154,19 +1801,19 @@ for cov in coverage_range:
               {"def-nm-q", required_argument, NULL, 'T'},
               {"sig", required_argument, NULL, 'a'},
               {"bonf", required_argument, NULL, 'b'}, /* NOTE changes here must be reflected in pseudo_parallel code as well */
-
-#ifdef USE_FPGA
-              {"in-data-chunk-id", required_argument, NULL, 'p'},
-#endif
+              {"pbin-owner", required_argument, NULL, 'P'},
+              {"param-set", required_argument, NULL, 'p'},
               {"min-cov", required_argument, NULL, 'C'},
               {"max-depth", required_argument, NULL, 'd'},
               {"approx-threshold", required_argument, NULL, 't'},
 
               {"illumina-1.3", no_argument, &illumina_1_3, 1},
               {"use-orphan", no_argument, &use_orphan, 1},
+              {"merge-mates", no_argument, &merge_mates, 1},
               {"plp-summary-only", no_argument, &plp_summary_only, 1},
               {"force-overwrite", no_argument, &force_overwrite, 1},
               {"no-default-filter", no_argument, &no_default_filter, 1},
+              {"no-early-accept", no_argument, &no_early_accept, 1},
               {"verbose", no_argument, &verbose, 1},
               {"debug", no_argument, &debug, 1},
               {"help", no_argument, NULL, 'h'},
@@ -1175,11 +1822,7 @@ for cov in coverage_range:
          };
 
          /* keep in sync with long_opts and usage */
-#ifdef USE_FPGA
-         static const char *long_opts_str = "r:l:f:o:q:Q:R:j:J:K:DeBAm:M:NsS:T:a:b:p:C:d:h";
-#else
          static const char *long_opts_str = "r:l:f:o:q:Q:R:j:J:K:DeBAm:M:NsS:T:a:b:C:d:h";
-#endif
          /* getopt_long stores the option index here. */
          int long_opts_index = 0;
          c = getopt_long(argc-1, argv+1, /* skipping 'lofreq', just leaving 'command', i.e. call */
@@ -1190,12 +1833,6 @@ for cov in coverage_range:
 
          switch (c) {
          /* see usage sync */
-#ifdef USE_FPGA
-         case 'p':
-            proc_bin_id = atoi(optarg); // the bin number generated in the call_parallel script
-            break;
-#endif 
-
          case 'r':
               mplp_conf.reg = strdup(optarg);
               /* FIXME you can enter lots of invalid stuff and libbam
@@ -1206,6 +1843,24 @@ for cov in coverage_range:
               bed_file = strdup(optarg);
               break;
 
+         case 'c':
+              primer_bed_file = strdup(optarg);
+              break;
+
+         case 'G':
+              recal_table_file = strdup(optarg);
+              break;
+
+         case 'Y':
+              if (! file_exists(optarg)) {
+                   LOG_FATAL("Sidecar file '%s' does not exist. Exiting...\n", optarg);
+                   return 1;
+              }
+              mplp_conf.sidecar_fns = realloc(mplp_conf.sidecar_fns,
+                                              (mplp_conf.num_sidecars+1) * sizeof(char*));
+              mplp_conf.sidecar_fns[mplp_conf.num_sidecars++] = strdup(optarg);
+              break;
+
          case 'f':
               if (! file_exists(optarg)) {
                    LOG_FATAL("Reference fasta file '%s' does not exist. Exiting...\n", optarg);
@@ -1353,6 +2008,99 @@ for cov in coverage_range:
               varcall_conf.approx_threshold_n = atoi(optarg);
               break;
 
+         case 'P':
+              pbin_owner = strdup(optarg);
+              break;
+
+         case 'p':
+              param_set_file = strdup(optarg);
+              break;
+
+         case 'X':
+              metrics_file = strdup(optarg);
+              break;
+
+         case 'U':
+              state_file = strdup(optarg);
+              break;
+
+         case 'V':
+              preview_fraction = strtod(optarg, (char **)NULL);
+              if (preview_fraction <= 0.0 || preview_fraction > 1.0) {
+                   LOG_FATAL("%s\n", "Preview fraction has to be >0 and <=1");
+                   return 1;
+              }
+              break;
+
+         case 'I':
+              mplp_conf.max_indel_alleles = atoi(optarg);
+              if (mplp_conf.max_indel_alleles < 0) {
+                   LOG_FATAL("%s\n", "Maximum number of indel alleles can't be negative");
+                   return 1;
+              }
+              break;
+
+         case 'O':
+              if (file_exists(optarg)) {
+                   LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                   return 1;
+              }
+              consensus_file = strdup(optarg);
+              break;
+
+         case 'W':
+              consensus_min_depth = atoi(optarg);
+              break;
+
+         case 'Z':
+              consensus_threshold = strtod(optarg, (char **)NULL);
+              if (consensus_threshold < 0.0 || consensus_threshold > 1.0) {
+                   LOG_FATAL("%s\n", "Consensus threshold has to be >=0 and <=1");
+                   return 1;
+              }
+              break;
+
+         case 'E':
+              cost_profile_file = strdup(optarg);
+              break;
+
+         case 'i':
+              evidence_file = strdup(optarg);
+              break;
+
+         case 'k':
+              evidence_ref_reads = atoi(optarg);
+              if (evidence_ref_reads < 0) {
+                   LOG_FATAL("%s\n", "Number of evidence reference reads can't be negative");
+                   return 1;
+              }
+              break;
+
+         case 'g':
+              autotune_file = strdup(optarg);
+              autotune = 1;
+              break;
+
+         case 'H':
+              if (! file_exists(optarg)) {
+                   LOG_FATAL("Priority BED file '%s' does not exist. Exiting...\n", optarg);
+                   return 1;
+              }
+              priority_bed_file = strdup(optarg);
+              break;
+
+         case 'L':
+              priority_out = strdup(optarg);
+              break;
+
+         case 'F':
+              priority_bonf = strtoll(optarg, (char **)NULL, 10);
+              if (1 > priority_bonf) {
+                   LOG_FATAL("%s\n", "Couldn't parse priority Bonferroni factor");
+                   return 1;
+              }
+              break;
+
          case 'h':
               usage(& mplp_conf, & varcall_conf);
               return 0; /* WARN: not printing defaults if some args where parsed */
@@ -1360,6 +2108,16 @@ for cov in coverage_range:
          case '?':
               LOG_FATAL("%s\n", "unrecognized arguments found. Exiting...\n");
               free(bed_file);
+              free(primer_bed_file);
+              free(recal_table_file);
+              free(metrics_file);
+              free(state_file);
+              free(consensus_file);
+              free(cost_profile_file);
+              free(evidence_file);
+              free(autotune_file);
+              free(priority_bed_file);
+              free(priority_out);
               free(vcf_out);
               return 1;
 #if 0
@@ -1405,6 +2163,14 @@ for cov in coverage_range:
          mplp_conf.flag &= ~MPLP_NO_ORPHAN;
     }
 
+    if (merge_mates) {
+         mplp_conf.flag |= MPLP_MERGE_MATES;
+    }
+
+    if (no_early_accept) {
+         varcall_conf.flag &= ~VARCALL_EARLY_ACCEPT;
+    }
+
     if (no_indels && only_indels) {
          LOG_FATAL("%s\n", "Invalid user request to predict no-indels *and* only-indels!? Exiting...\n");
          return -1;
@@ -1465,34 +2231,151 @@ for cov in coverage_range:
          LOG_WARN("%s\n", "Calling SNVs without reference\n");
     }
 
-    /* if we don't apply a default filter and bonf is not dynamic then
-     * we can directly write to requested output file. otherwise we
-     * use a tmp file that gets filtered.
-     */
-    if (no_default_filter && ! varcall_conf.bonf_dynamic) {
+    /* extra configurations evaluated on the same pileup. they
+     * inherit all settings given on the command line */
+    if (param_set_file) {
+         if (plp_summary_only) {
+              LOG_FATAL("%s\n", "--param-set makes no sense with --plp-summary-only");
+              return 1;
+         }
+         if (param_set_load(param_set_file, & varcall_conf,
+                            & param_sets, & num_param_sets)) {
+              LOG_FATAL("Couldn't load parameter sets from %s\n", param_set_file);
+              return 1;
+         }
+         for (i=0; i<num_param_sets; i++) {
+              const char *f = param_sets[i].vcf_out;
+              if (0 == strcmp(f, "-") || (vcf_out && 0 == strcmp(f, vcf_out))) {
+                   LOG_FATAL("Output of parameter set %d (%s) has to be a file of its own\n", i+1, f);
+                   return 1;
+              }
+              if (file_exists(f)) {
+                   if (! force_overwrite) {
+                        LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", f);
+                        return 1;
+                   } else {
+                        unlink(f);
+                   }
+              }
+         }
+         LOG_VERBOSE("Evaluating %d extra parameter set(s) from %s\n",
+                     num_param_sets, param_set_file);
+         free(param_set_file);
+    }
+
+    if (state_file) {
+         if (plp_summary_only || num_param_sets) {
+              LOG_FATAL("%s\n", "--state can't be used with --plp-summary-only or --param-set");
+              return 1;
+         }
+         if (0 == strcmp(bam_file, "-")) {
+              LOG_FATAL("%s\n", "--state needs a BAM file (not stdin)");
+              return 1;
+         }
+    }
+
+    if (preview_fraction > 0.0) {
+         if (plp_summary_only || num_param_sets || state_file || mplp_conf.reg) {
+              LOG_FATAL("%s\n", "--preview can't be used with --plp-summary-only, --param-set, --state or --region");
+              return 1;
+         }
+         if (0 == strcmp(bam_file, "-")) {
+              LOG_FATAL("%s\n", "--preview needs an indexed BAM file (not stdin)");
+              return 1;
+         }
+         /* calls are read back for the preview report. so if they go
+          * to stdout, write to a file first */
          if (NULL == vcf_out || 0 == strcmp(vcf_out, "-")) {
-              if (vcf_file_open(& varcall_conf.vcf_out, "-",
-                                0, 'w')) {
-                   LOG_ERROR("%s\n", "Couldn't open stdout");
+              char vcf_preview_template[] = "/tmp/lofreq2-call-preview.XXXXXX";
+              free(vcf_out);
+              vcf_out = strdup(mktemp(vcf_preview_template));
+              preview_to_stdout = 1;
+         }
+    }
+
+    if (priority_bed_file) {
+         if (plp_summary_only || num_param_sets || state_file || preview_fraction > 0.0) {
+              LOG_FATAL("%s\n", "--priority-bed can't be used with --plp-summary-only, --param-set, --state or --preview");
+              return 1;
+         }
+         if (0 == strcmp(bam_file, "-")) {
+              LOG_FATAL("%s\n", "--priority-bed needs an indexed BAM file (not stdin)");
+              return 1;
+         }
+         if (NULL == priority_out || 0 == strcmp(priority_out, "-")
+             || (vcf_out && 0 == strcmp(priority_out, vcf_out))) {
+              LOG_FATAL("%s\n", "--priority-bed needs an output file of its own (--priority-out)");
+              return 1;
+         }
+         if (file_exists(priority_out)) {
+              if (! force_overwrite) {
+                   LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", priority_out);
                    return 1;
+              } else {
+                   unlink(priority_out);
+              }
+         }
+         if (0 == priority_bonf && varcall_conf.bonf_dynamic) {
+              /* the dynamic factor is only known at the very end.
+               * pre-declare the largest possible number of
+               * substitution tests instead (conservative) */
+              samFile *fp;
+              bam_hdr_t *header = NULL;
+              if (NULL != (fp = sam_open(bam_file, "r"))) {
+                   header = sam_hdr_read(fp);
+                   sam_close(fp);
               }
-         } else {
-              if (vcf_file_open(& varcall_conf.vcf_out, vcf_out,
-                                HAS_GZIP_EXT(vcf_out), 'w')) {
-                   LOG_ERROR("Couldn't open %s\n", vcf_out);
+              if (NULL == header) {
+                   LOG_FATAL("Couldn't read header of %s\n", bam_file);
                    return 1;
               }
+              for (i=0; i<header->n_targets; i++) {
+                   priority_bonf += (long long int)header->target_len[i] * NUM_NONCONS_BASES;
+              }
+              bam_hdr_destroy(header);
+              if (1 > priority_bonf) {
+                   priority_bonf = 1;
+              }
          }
-    } else {
-         vcf_tmp_out = strdup(mktemp(vcf_tmp_template));
-         if (NULL == vcf_tmp_out) {
-              LOG_FATAL("%s\n", "Couldn't create temporary vcf file");
+    } else if (priority_out || priority_bonf || priority_only) {
+         LOG_FATAL("%s\n", "--priority-out, --priority-bonf and --priority-only need --priority-bed");
+         return 1;
+    }
+
+    if (evidence_file) {
+         if (plp_summary_only || num_param_sets || state_file || priority_only) {
+              LOG_FATAL("%s\n", "--evidence-bam can't be used with --plp-summary-only, --param-set, --state or --priority-only");
               return 1;
          }
-         if (vcf_file_open(& varcall_conf.vcf_out, vcf_tmp_out,
-                           HAS_GZIP_EXT(vcf_tmp_out), 'w')) {
-              LOG_ERROR("Couldn't open %s\n", vcf_tmp_out);
-              free(vcf_tmp_out);
+         if (0 == strcmp(bam_file, "-")) {
+              LOG_FATAL("%s\n", "--evidence-bam needs a BAM file (not stdin)");
+              return 1;
+         }
+         if (0 == strcmp(evidence_file, "-")) {
+              LOG_FATAL("%s\n", "--evidence-bam needs an output file (not stdout)");
+              return 1;
+         }
+         if (file_exists(evidence_file)) {
+              if (! force_overwrite) {
+                   LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", evidence_file);
+                   return 1;
+              } else {
+                   unlink(evidence_file);
+              }
+         }
+    } else if (evidence_ref_reads) {
+         LOG_FATAL("%s\n", "--evidence-ref-reads needs --evidence-bam");
+         return 1;
+    }
+
+    /* with --priority-only there are no other calls */
+    if (! priority_only
+        && open_var_out(& varcall_conf, vcf_out, no_default_filter, & vcf_tmp_out)) {
+         return 1;
+    }
+    for (i=0; i<num_param_sets; i++) {
+         if (open_var_out(& param_sets[i].conf, param_sets[i].vcf_out,
+                          no_default_filter, & param_sets[i].vcf_tmp_out)) {
               return 1;
          }
     }
@@ -1514,6 +2397,20 @@ for cov in coverage_range:
               return 1;
          }
     }
+    if (primer_bed_file) {
+         if (NULL == (mplp_conf.primers = primer_idx_load(primer_bed_file))) {
+              LOG_ERROR("Couldn't load primers from %s\n", primer_bed_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+    }
+    if (recal_table_file) {
+         if (NULL == (mplp_conf.recal = recal_table_load(recal_table_file))) {
+              LOG_ERROR("Couldn't load recalibration table from %s\n", recal_table_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+    }
 
     if (debug) {
          dump_mplp_conf(& mplp_conf, stderr);
@@ -1537,78 +2434,228 @@ for cov in coverage_range:
     if (plp_summary_only) {
          plp_proc_func = &plp_summary;
 
-    } else {
+    } else if (! priority_only) {
          /* or use PACKAGE_STRING */
          vcf_write_new_header(& varcall_conf.vcf_out,
                               mplp_conf.cmdline, mplp_conf.fa);
          plp_proc_func = &call_vars;
+         for (i=0; i<num_param_sets; i++) {
+              vcf_write_new_header(& param_sets[i].conf.vcf_out,
+                                   mplp_conf.cmdline, mplp_conf.fa);
+         }
     }
 
-#ifdef USE_FPGA
-    printf("***************** FPGA HOST - OpenCL INIT *****************\n");
-    cl_int err = CL_SUCCESS;
-    cl_int status = CL_SUCCESS;
-    cl_uint num_devices = 0;
-
-    get_xilinx_device(&devices, &num_devices);
-    err = clGetDeviceInfo(devices, CL_DEVICE_NAME,
-         PLATFORM_PARAM_SIZE, cl_device_name, 0);
-    if (err != CL_SUCCESS) {
-         fprintf(stderr, "clGetDeviceInfo failed.\n");
-         return -1;
+    /* all configurations share one pileup pass */
+    varcall_confs.n = 1 + num_param_sets;
+    varcall_confs.confs = malloc(varcall_confs.n * sizeof(varcall_conf_t *));
+    varcall_confs.confs[0] = & varcall_conf;
+    for (i=0; i<num_param_sets; i++) {
+         varcall_confs.confs[i+1] = & param_sets[i].conf;
+    }
+    if (num_param_sets) {
+         plp_proc_func = &call_vars_multi;
     }
-    fprintf(stdout, "Device: %s\n", cl_device_name);
 
-    // context
-    err = CL_SUCCESS;
-    context = clCreateContext(0, num_devices, &devices, NULL, NULL, &err);
+    memset(& incr_conf, 0, sizeof(incr_conf_t));
+    if (state_file) {
+         samFile *fp;
+         bam_hdr_t *header = NULL;
+         char params[BUF_SIZE];
 
-    // Load the XCLBIN.
-    int size = ae_load_file_to_memory(xclbin, (char **) &kernelBinary);
-    if (size < 0) {
-         fprintf(stderr, "loading binary failed.\n");
-         return -1; 
+         if (NULL != (fp = sam_open(bam_file, "r"))) {
+              header = sam_hdr_read(fp);
+              sam_close(fp);
+         }
+         if (NULL == header) {
+              LOG_FATAL("Couldn't read header of %s\n", bam_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+         incr_params(params, sizeof(params), & mplp_conf, & varcall_conf);
+
+         incr_conf.conf = & varcall_conf;
+         incr_conf.header = header;
+         if (file_exists(state_file)) {
+              if (NULL == (incr_conf.in = plp_store_open(state_file, "r", header, params))) {
+                   LOG_FATAL("Couldn't load state from %s\n", state_file);
+                   free(vcf_tmp_out);
+                   return 1;
+              }
+         }
+         state_tmp_file = malloc(strlen(state_file) + 5);
+         sprintf(state_tmp_file, "%s.tmp", state_file);
+         if (NULL == (incr_conf.out = plp_store_open(state_tmp_file, "w", header, params))) {
+              LOG_FATAL("Couldn't write state to %s\n", state_tmp_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+         incr_read_next(& incr_conf);
+         plp_proc_func = &call_vars_incremental;
     }
-    fprintf(stdout, "SUCCESS: XCLBIN loaded\n");
-
-    // Create an OpenCL Program from the loaded XCLBIN.
-    err = CL_SUCCESS; 
-    size_t size_var = size; 
-    program = clCreateProgramWithBinary(context, num_devices,
-         &devices, &size_var,(unsigned char **) &kernelBinary, &status, &err);
-    if (status != CL_SUCCESS || err != CL_SUCCESS) {
-         fprintf(stderr, "clCreateProgramWithBinary failed.\n");
-         return -1; 
-    } 
-
-    // Set up an OpenCL Command Queue.
-    err = CL_SUCCESS;
-    cmd_queue = clCreateCommandQueue(context, devices,
-         CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
-    if (err != CL_SUCCESS) {
-         fprintf(stderr, "clCreateCommandQueue failed.\n");
-         return -1;
+
+    memset(& preview_conf, 0, sizeof(preview_conf_t));
+    if (preview_fraction > 0.0) {
+         if (NULL == (preview_conf.preview = preview_init(bam_file, preview_fraction))) {
+              LOG_FATAL("%s\n", "Couldn't sample preview windows");
+              free(vcf_tmp_out);
+              return 1;
+         }
+         preview_conf.conf = & varcall_conf;
+         mplp_conf.regs = preview_regions(preview_conf.preview);
+         mplp_conf.num_regs = preview_conf.preview->n;
+         plp_proc_func = &call_vars_preview;
     }
 
-    // Create an OpenCL Kernel.
-    err = CL_SUCCESS;
-    kernel1 = clCreateKernel(program, krnl_func, &err);
-    if (err != CL_SUCCESS) { 
-         fprintf(stderr, "clCreateKernel failed.\n");
-         return -1;
+    if (pbin_owner) {
+         /* Poisson-binomial jobs are served by a pbin-owner process
+          * shared with the other call processes of call-parallel */
+         if (NULL == (pbin_client = pbin_client_attach(pbin_owner, PBIN_ATTACH_TIMEOUT))) {
+              LOG_FATAL("Couldn't attach to pbin-owner %s\n", pbin_owner);
+              free(vcf_tmp_out);
+              return 1;
+         }
     }
-    printf("***************** FPGA HOST - OpenCL INIT *****************\n");
-#endif
-    rc = mpileup(&mplp_conf, plp_proc_func, (void*)&varcall_conf,
+    if (autotune) {
+         /* pick the fastest exact engine per column shape. benchmarked
+          * once per host, see autotune.h */
+         if (NULL == (pbin_autotune = autotune_init(autotune_file))) {
+              LOG_FATAL("%s\n", "Autotuning of Poisson-binomial engines failed");
+              free(vcf_tmp_out);
+              return 1;
+         }
+         free(autotune_file);
+    }
+    if (priority_bed_file) {
+         /* priority regions are called first and their results are
+          * final. the main pass then covers everything */
+         rc = call_priority(& mplp_conf, & varcall_conf, priority_bed_file,
+                            priority_out, priority_bonf, no_default_filter, bam_file);
+         free(priority_bed_file);
+         free(priority_out);
+         if (rc || priority_only) {
+              pbin_client_detach(pbin_client);
+              pbin_client = NULL;
+              autotune_free(pbin_autotune);
+              pbin_autotune = NULL;
+              free(vcf_tmp_out);
+              return rc;
+         }
+    }
+    if (metrics_file) {
+         if (NULL == (mplp_conf.metrics = metrics_open(metrics_file, "lofreq_call",
+                                                       METRICS_DEFAULT_INTERVAL))) {
+              LOG_FATAL("Couldn't write metrics to %s\n", metrics_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+         call_metrics = mplp_conf.metrics;
+         metrics_calls = metrics_register(call_metrics, "calls",
+                                          "Variants emitted (before filtering)", METRICS_COUNTER);
+         free(metrics_file);
+    }
+    if (consensus_file) {
+         if (NULL == (mplp_conf.consensus = consensus_open(consensus_file, consensus_min_depth,
+                                                           consensus_threshold))) {
+              LOG_FATAL("Couldn't write consensus to %s\n", consensus_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+         free(consensus_file);
+    }
+    if (cost_profile_file) {
+         if (NULL == (mplp_conf.cost_profile = cost_profile_open(cost_profile_file, 0))) {
+              LOG_FATAL("Couldn't write cost profile to %s\n", cost_profile_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+         /* tests of the main configuration are the kernel work */
+         cost_profile_add_counter(mplp_conf.cost_profile, & varcall_conf.num_snv_tests);
+         cost_profile_add_counter(mplp_conf.cost_profile, & varcall_conf.num_indel_tests);
+         free(cost_profile_file);
+    }
+    if (evidence_file) {
+         if (NULL == (mplp_conf.evidence = evidence_open(evidence_file, bam_file,
+                                                         evidence_ref_reads))) {
+              LOG_FATAL("Couldn't write supporting reads to %s\n", evidence_file);
+              free(vcf_tmp_out);
+              return 1;
+         }
+         call_evidence = mplp_conf.evidence;
+         free(evidence_file);
+    }
+    rc = mpileup(&mplp_conf, plp_proc_func,
+                 state_file ? (void*)&incr_conf :
+                 preview_conf.preview ? (void*)&preview_conf :
+                 num_param_sets ? (void*)&varcall_confs : (void*)&varcall_conf,
                  1, (const char **) argv + optind + 1);
-#ifdef USE_FPGA
-    // Releasing OpenCL objects
-    clReleaseCommandQueue(cmd_queue);
-    clReleaseContext(context);
-    clReleaseDevice(devices);
-    clReleaseKernel(kernel1);
-    clReleaseProgram(program);
-#endif
+    if (state_file) {
+         /* pass through the rest and replace the old state. the
+          * number of tests is now the one of all columns seen so far */
+         incr_flush_until(& incr_conf, INT_MAX, INT_MAX);
+         if (incr_conf.has_next) {
+              /* only on error */
+              plp_store_rec_free(& incr_conf.next);
+         }
+         plp_store_close(incr_conf.in);
+         if (plp_store_close(incr_conf.out) || incr_conf.err) {
+              rc = 1;
+         }
+         if (0 == rc && 0 != rename(state_tmp_file, state_file)) {
+              LOG_ERROR("Couldn't rename %s to %s\n", state_tmp_file, state_file);
+              rc = 1;
+         }
+         if (rc) {
+              (void) unlink(state_tmp_file);
+         }
+         varcall_conf.num_snv_tests = incr_conf.num_snv_tests;
+         varcall_conf.num_indel_tests = incr_conf.num_indel_tests;
+         if (varcall_conf.bonf_dynamic) {
+              varcall_conf.bonf_subst = incr_conf.num_snv_tests ? incr_conf.num_snv_tests : 1;
+              varcall_conf.bonf_indel = 1 + incr_conf.num_indel_tests;
+         }
+         bam_hdr_destroy((bam_hdr_t *)incr_conf.header);
+         free(state_tmp_file);
+         free(state_file);
+    }
+    if (preview_conf.preview) {
+         /* filter as if all windows had been tested */
+         double f = preview_sampled_fraction(preview_conf.preview);
+         if (varcall_conf.bonf_dynamic) {
+              varcall_conf.bonf_subst = (long long int)(varcall_conf.num_snv_tests / f + 0.5);
+              if (varcall_conf.bonf_subst < 1) {
+                   varcall_conf.bonf_subst = 1;
+              }
+              varcall_conf.bonf_indel = 1 + (long long int)(varcall_conf.num_indel_tests / f + 0.5);
+         }
+         for (i=0; i<mplp_conf.num_regs; i++) {
+              free(mplp_conf.regs[i]);
+         }
+         free(mplp_conf.regs);
+         mplp_conf.regs = NULL;
+         mplp_conf.num_regs = 0;
+    }
+    metrics_close(mplp_conf.metrics);
+    mplp_conf.metrics = call_metrics = NULL;
+    if (consensus_close(mplp_conf.consensus)) {
+         rc = 1;
+    }
+    mplp_conf.consensus = NULL;
+    if (cost_profile_close(mplp_conf.cost_profile)) {
+         rc = 1;
+    }
+    mplp_conf.cost_profile = NULL;
+    if (evidence_close(mplp_conf.evidence)) {
+         rc = 1;
+    }
+    mplp_conf.evidence = call_evidence = NULL;
+    pbin_client_detach(pbin_client);
+    pbin_client = NULL;
+    autotune_free(pbin_autotune);
+    pbin_autotune = NULL;
+    free(pbin_owner);
+    if (mplp_conf.primers) {
+         primer_idx_log_stats(mplp_conf.primers);
+    }
 
     if (rc) {
          free(vcf_tmp_out);
@@ -1620,69 +2667,37 @@ for cov in coverage_range:
                   " Did you forget to indel alignment-quality to your bam-file?\n", indel_calls_wo_idaq);
     }
 
-    vcf_file_close(& varcall_conf.vcf_out);
+    for (i=0; i<varcall_confs.n; i++) {
+         vcf_file_close(& varcall_confs.confs[i]->vcf_out);
+    }
 
-    /* snv calling completed. now filter according to the following rules:
-     *  1. no_default_filter and ! dyn
-     *     just print
-     *  2 filter with
-     *     - no_default_filter, if set
-     *     - filter snvphred according to bonf, if dynamic
-     */
     if (plp_summary_only) {
          LOG_VERBOSE("%s\n", "No filtering needed: didn't run in SNV calling mode");
 
-    } else if (no_default_filter && ! varcall_conf.bonf_dynamic) {
-         /* vcf file needs no filtering and was already printed to
-          * final destination. already taken care of above. */
-         LOG_VERBOSE("%s\n", "No filtering needed or requested: variants already written to final destination");
-
     } else {
-         char cmd[BUF_SIZE];
-         int len;
-
-         snprintf(cmd, BUF_SIZE,
-                  "lofreq filter -i %s -o %s",
-                  vcf_tmp_out, NULL==vcf_out ? "-" : vcf_out);
-         len = strlen(cmd);
-
-         if (no_default_filter) {
-              len += sprintf(cmd+len, " %s", "--no-defaults");
+         rc = filter_var_out(& varcall_conf, vcf_tmp_out, vcf_out, no_default_filter);
+         for (i=0; i<num_param_sets && rc==0; i++) {
+              rc = filter_var_out(& param_sets[i].conf, param_sets[i].vcf_tmp_out,
+                                  param_sets[i].vcf_out, no_default_filter);
          }
+    }
 
-         if (varcall_conf.bonf_dynamic) {
-              int snvqual_thresh = INT_MAX;
-              int indelqual_thresh = INT_MAX;
-
-              if (varcall_conf.bonf_subst) {
-                   snvqual_thresh = PROB_TO_PHREDQUAL(varcall_conf.sig/varcall_conf.bonf_subst);
-                   if (snvqual_thresh < 0) {
-                        snvqual_thresh = 0;
-                   }
+    if (preview_conf.preview) {
+         if (rc == 0) {
+              if (preview_add_vcf(preview_conf.preview, vcf_out)) {
+                   rc = 1;
+              } else {
+                   preview_report(preview_conf.preview, stderr);
               }
-              if (varcall_conf.bonf_indel) {
-                   indelqual_thresh =  PROB_TO_PHREDQUAL(varcall_conf.sig/varcall_conf.bonf_indel);
-                   if (indelqual_thresh < 0) {
-                        indelqual_thresh = 0;
-                   }
-              }         
-                             
-              len += sprintf(cmd+len,/* appending to str with format. see http://stackoverflow.com/questions/14023024/strcat-for-formatted-strings */
-                             " --snvqual-thresh %d --indelqual-thresh %d",
-                             snvqual_thresh, indelqual_thresh);
-         } else {
-              LOG_VERBOSE("%s\n", "No SNV/indel-quality filtering needed (already applied during call since bonf was fixed)");
          }
-
-         LOG_VERBOSE("Executing %s\n", cmd);
-         if (0 != (rc = system(cmd))) {
-              LOG_ERROR("The following command failed: %s\n", cmd);
+         if (rc == 0 && preview_to_stdout && cat_file(vcf_out, stdout)) {
+              LOG_ERROR("Couldn't copy %s to stdout\n", vcf_out);
               rc = 1;
-
-         } else {
-              /*if (! debug)*/
-              (void) unlink(vcf_tmp_out);
          }
+         if (preview_to_stdout) {
+              (void) unlink(vcf_out);
+         }
+         preview_free(preview_conf.preview);
     }
 
     if (! plp_summary_only && rc==0) {
@@ -1693,13 +2708,24 @@ for cov in coverage_range:
          int org_verbose = verbose;
          verbose = 1;
          /* lofreq2_call_parallel.py and used by lofreq2_somatic.py */
-         LOG_VERBOSE("Number of substitution tests performed: %lld\n", num_snv_tests);
-         LOG_VERBOSE("Number of indel tests performed: %lld\n", num_indel_tests);
+         LOG_VERBOSE("Number of substitution tests performed: %lld\n", varcall_conf.num_snv_tests);
+         LOG_VERBOSE("Number of indel tests performed: %lld\n", varcall_conf.num_indel_tests);
          verbose = org_verbose;
+         for (i=0; i<num_param_sets; i++) {
+              LOG_VERBOSE("Number of substitution/indel tests performed for %s: %lld/%lld\n",
+                          param_sets[i].vcf_out, param_sets[i].conf.num_snv_tests,
+                          param_sets[i].conf.num_indel_tests);
+         }
     }
 
     source_qual_free_ign_vars();
 
+    for (i=0; i<num_param_sets; i++) {
+         free(param_sets[i].vcf_out);
+         free(param_sets[i].vcf_tmp_out);
+    }
+    free(param_sets);
+    free(varcall_confs.confs);
     free(vcf_tmp_out);
     free(vcf_out);
     free(mplp_conf.alnerrprof_file);
@@ -1712,6 +2738,14 @@ for cov in coverage_range:
     if (mplp_conf.bed) {
          bed_destroy(mplp_conf.bed);
     }
+    free(primer_bed_file);
+    primer_idx_free(mplp_conf.primers);
+    free(recal_table_file);
+    recal_table_free(mplp_conf.recal);
+    for (i=0; i<mplp_conf.num_sidecars; i++) {
+         free(mplp_conf.sidecar_fns[i]);
+    }
+    free(mplp_conf.sidecar_fns);
 
     if (0==rc) {
          LOG_VERBOSE("%s\n", "Successful exit.");
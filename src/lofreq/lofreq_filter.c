@@ -35,6 +35,7 @@
 #include <stdarg.h>
 #include <getopt.h>
 #include <stdlib.h>
+#include <limits.h>
 
 /* lofreq includes */
 #include "lofreq_filter.h"
@@ -96,6 +97,20 @@ typedef struct {
      char id[FILTER_ID_STRSIZE];
 } indelqual_filter_t;
 
+typedef struct {
+     int enabled;
+     char id[FILTER_ID_STRSIZE];
+     /* variants held back while a cluster of overlapping indels is
+      * open (in input order) */
+     var_t **pending;
+     int num_pending;
+     int max_pending;
+     /* indices into pending of the cluster's indels */
+     int *cluster;
+     int num_cluster;
+     int max_cluster;
+} ovlp_indel_filter_t;
+
 typedef struct {
      vcf_file_t vcf_in;
      vcf_file_t vcf_out;
@@ -109,6 +124,7 @@ typedef struct {
      sb_filter_t sb_filter;
      snvqual_filter_t snvqual_filter;
      indelqual_filter_t indelqual_filter;
+     ovlp_indel_filter_t ovlp_indel_filter;
 } filter_conf_t;
 
 typedef struct mtc_qual_s {
@@ -146,6 +162,7 @@ dump_filter_conf(const filter_conf_t *cfg)
      fprintf(stderr, "  indelqual_filter thresh=%d mtc_type=%d|%s alpha=%f ntests=%ld\n",
              cfg->indelqual_filter.thresh, cfg->indelqual_filter.mtc_type, mtc_type_str[cfg->indelqual_filter.mtc_type],
              cfg->indelqual_filter.alpha, cfg->indelqual_filter.ntests);
+     fprintf(stderr, "  ovlp_indel_filter enabled=%d\n", cfg->ovlp_indel_filter.enabled);
 }
 
 
@@ -191,6 +208,7 @@ usage(const filter_conf_t* filter_conf)
      fprintf(stderr, "  -k | --indelqual-mtc STRING    Multiple testing correction type. One of 'bonf', 'holm' or 'fdr'. Conflicts with -Q\n");
      fprintf(stderr, "  -l | --indelqual-alpha FLOAT   Multiple testing correction pvalue threshold\n");
      fprintf(stderr, "  -m | --indelqual-ntests INT    Number of performed indel tests for multiple testing correction\n");
+     fprintf(stderr, "       --rm-ovlp-indels          Of overlapping indels only keep the one with highest quality (ties: highest AF)\n");
 
      fprintf(stderr, "\n");
      fprintf(stderr, "  Misc.:\n");
@@ -677,6 +695,136 @@ int apply_sb_filter_mtc(mtc_qual_t *mtc_quals, sb_filter_t *sb_filter, const lon
 }
 
 
+/* end (excl.) of positions affected by var, i.e. pos ...
+ * pos+max(len(ref), len(alt))-1 */
+static long int
+var_affected_end(const var_t *var)
+{
+     return var->pos + MAX(strlen(var->ref), strlen(var->alt));
+}
+
+
+/* quality used for picking the best of overlapping indels. missing
+ * quality wins. AF is added to break ties */
+static double
+ovlp_indel_qual(const var_t *var)
+{
+     char *af_char = NULL;
+     double af = 0.0;
+
+     if (var->qual < 0) {
+          return INT_MAX;
+     }
+     if (vcf_var_has_info_key(&af_char, var, "AF")) {
+          af = strtod(af_char, (char **)NULL);
+          free(af_char);
+     }
+     return var->qual + af;
+}
+
+
+/* final stage: prints var (if passed or requested) and frees it */
+static void
+output_var(filter_conf_t *cfg, var_t *var)
+{
+     if (cfg->print_only_passed && ! (VCF_VAR_PASSES(var))) {
+          vcf_free_var(&var);
+          return;
+     }
+
+     /* add pass if no filters were set */
+     if (! var->filter || strlen(var->filter)<=1) {
+          char pass_str[] = "PASS";
+          if (var->filter) {
+               free(var->filter);
+          }
+          var->filter = strdup(pass_str);
+     }
+
+     vcf_write_var(& cfg->vcf_out, var);
+     vcf_free_var(&var);
+}
+
+
+/* closes the open cluster of overlapping indels: all but the best
+ * (first one on ties) are marked as filtered. then writes out
+ * everything that was held back */
+static void
+ovlp_indel_flush(filter_conf_t *cfg)
+{
+     ovlp_indel_filter_t *f = & cfg->ovlp_indel_filter;
+     double best_qual = 0.0;
+     int best = 0;
+     int i;
+
+     for (i=0; i<f->num_cluster; i++) {
+          double qual = ovlp_indel_qual(f->pending[f->cluster[i]]);
+          if (0 == i || qual > best_qual) {
+               best = i;
+               best_qual = qual;
+          }
+     }
+     for (i=0; i<f->num_cluster; i++) {
+          if (i != best) {
+               vcf_var_add_to_filter(f->pending[f->cluster[i]], f->id);
+          }
+     }
+     for (i=0; i<f->num_pending; i++) {
+          output_var(cfg, f->pending[i]);
+     }
+     f->num_pending = f->num_cluster = 0;
+}
+
+
+/* Streaming version of lofreq2_indel_ovlp.py: consecutive passed
+ * indels overlapping their predecessor form a cluster of which only
+ * the best survives. Needs sorted input. Only the open cluster and
+ * the variants in between are held in memory. Takes ownership of var.
+ */
+static void
+apply_ovlp_indel_filter(filter_conf_t *cfg, var_t *var, const int is_indel)
+{
+     ovlp_indel_filter_t *f = & cfg->ovlp_indel_filter;
+     int joins = is_indel && VCF_VAR_PASSES(var);
+
+     if (f->num_cluster) {
+          const var_t *last = f->pending[f->cluster[f->num_cluster-1]];
+          /* later variants can't overlap once we're past last */
+          if (0 != strcmp(var->chrom, last->chrom)
+              || var->pos >= var_affected_end(last)
+              || (joins && var_affected_end(var) <= last->pos)) {
+               ovlp_indel_flush(cfg);
+          }
+     }
+
+     if (! joins && ! f->num_cluster) {
+          output_var(cfg, var);
+          return;
+     }
+
+     if (f->num_pending == f->max_pending) {
+          f->max_pending = f->max_pending ? 2*f->max_pending : 64;
+          f->pending = realloc(f->pending, f->max_pending * sizeof(var_t *));
+          if (! f->pending) {
+               LOG_FATAL("%s\n", "memory allocation failed");
+               exit(1);
+          }
+     }
+     if (joins) {
+          if (f->num_cluster == f->max_cluster) {
+               f->max_cluster = f->max_cluster ? 2*f->max_cluster : 16;
+               f->cluster = realloc(f->cluster, f->max_cluster * sizeof(int));
+               if (! f->cluster) {
+                    LOG_FATAL("%s\n", "memory allocation failed");
+                    exit(1);
+               }
+          }
+          f->cluster[f->num_cluster++] = f->num_pending;
+     }
+     f->pending[f->num_pending++] = var;
+}
+
+
 /* adds FILTER tags to vcf header based on config. also initializes
  * filter ids!
  */
@@ -771,6 +919,14 @@ void cfg_filter_to_vcf_header(filter_conf_t *cfg, char **header)
                    cfg->indelqual_filter.id, buf, cfg->indelqual_filter.alpha);
           vcf_header_add(header, full_filter_str);
      }
+
+     if (cfg->ovlp_indel_filter.enabled) {
+          snprintf(cfg->ovlp_indel_filter.id, FILTER_ID_STRSIZE, "ovlp_indel");
+          snprintf(full_filter_str, FILTER_STRSIZE,
+               "##FILTER=<ID=%s,Description=\"Overlaps indel of higher quality\">\n",
+                   cfg->ovlp_indel_filter.id);
+          vcf_header_add(header, full_filter_str);
+     }
 }
 
 
@@ -867,6 +1023,7 @@ main_filter(int argc, char *argv[])
      static int sb_filter_incl_indels = 0;
      static int only_indels = 0;
      static int only_snvs = 0;
+     static int rm_ovlp_indels = 0;
      char *vcf_header = NULL;
      mtc_qual_t *mtc_quals = NULL;
      long int num_vars;
@@ -897,6 +1054,7 @@ main_filter(int argc, char *argv[])
               {"no-defaults", no_argument, &no_defaults, 1},
               {"only-indels", no_argument, &only_indels, 1},
               {"only-snvs", no_argument, &only_snvs, 1},
+              {"rm-ovlp-indels", no_argument, &rm_ovlp_indels, 1},
 
               {"help", no_argument, NULL, 'h'},
               {"in", required_argument, NULL, 'i'},
@@ -1080,6 +1238,7 @@ main_filter(int argc, char *argv[])
     cfg.only_snvs = only_snvs;
     cfg.sb_filter.no_compound = sb_filter_no_compound;
     cfg.sb_filter.incl_indels = sb_filter_incl_indels;
+    cfg.ovlp_indel_filter.enabled = rm_ovlp_indels;
 
     if (cfg.only_indels && cfg.only_snvs) {
          LOG_FATAL("%s\n", "Can't keep only indels and only snvs");
@@ -1298,30 +1457,25 @@ main_filter(int argc, char *argv[])
          }
          
 
-         /* output
+         /* output (possibly held back by overlapping indel filter)
           */
-         if (cfg.print_only_passed && ! (VCF_VAR_PASSES(var))) {
-              vcf_free_var(&var);
-              continue;
-         }
-
-         /* add pass if no filters were set */
-         if (! var->filter || strlen(var->filter)<=1) {
-              char pass_str[] = "PASS";
-              if (var->filter) {
-                   free(var->filter);
-              }
-              var->filter = strdup(pass_str);
+         if (cfg.ovlp_indel_filter.enabled) {
+              apply_ovlp_indel_filter(& cfg, var, is_indel);
+         } else {
+              output_var(& cfg, var);
          }
 
-         vcf_write_var(& cfg.vcf_out, var);
-         vcf_free_var(&var);
-
          if (var_idx%1000==0) {
               (void) vcf_file_flush(& cfg.vcf_out);
          }
     }
 
+    if (cfg.ovlp_indel_filter.enabled) {
+         ovlp_indel_flush(& cfg);
+         free(cfg.ovlp_indel_filter.pending);
+         free(cfg.ovlp_indel_filter.cluster);
+    }
+
     vcf_file_close(& cfg.vcf_in);
     vcf_file_close(& cfg.vcf_out);
 
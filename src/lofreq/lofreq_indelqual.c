@@ -36,6 +36,9 @@
 #include "log.h"
 #include "utils.h"
 #include "defaults.h"
+#include "sidecar.h"
+#include "samutils.h"
+#include "thread_budget.h"
 #include "lofreq_indelqual.h"
 
 
@@ -46,6 +49,7 @@ char DINDELQ2[] = "!CCCBA;963210/----,"; /* *10 */
 typedef struct {
      samFile *in;
      samFile *out;
+     sidecar_writer_t *sidecar; /* used instead of out if set */
      bam_hdr_t *header;
      int iq;
      int dq;
@@ -55,6 +59,7 @@ typedef struct {
 typedef struct {
      samFile *in;
      samFile *out;
+     sidecar_writer_t *sidecar; /* used instead of out if set */
      bam_hdr_t *header;
      faidx_t *fai;
      int *hpcount;
@@ -66,6 +71,78 @@ typedef struct {
 #define ENCODE_Q(q) (uint8_t)(q < 33 ? '!' : (q > 126 ? '~' : q))
 
 
+static const char *sidecar_tags[] = {BI_TAG, BD_TAG};
+
+
+static void
+write_read(samFile *out, sidecar_writer_t *sidecar,
+           const bam_hdr_t *header, bam1_t *b)
+{
+     if (sidecar) {
+          if (sidecar_writer_add(sidecar, b)) {
+               LOG_FATAL("%s\n", "Failed to write record to sidecar");
+               exit(1);
+          }
+     } else if (sam_write1(out, header, b) < 0) {
+          LOG_FATAL("Failed to write read %s\n", bam_get_qname(b));
+          exit(1);
+     }
+}
+
+
+/* opens bam_out (- for stdout) and writes header. if the header
+ * declares coordinate order, the output is indexed while written
+ * (see sam_idx_out_init()) and *fnidx is set to the index name */
+static samFile *
+open_bam_out(const char *bam_out, bam_hdr_t *header, char **fnidx)
+{
+     samFile *out;
+
+     *fnidx = NULL;
+     if (!bam_out || bam_out[0] == '-') {
+          out = sam_open("-", "wb");
+     } else {
+          out = sam_open(bam_out, "wb");
+     }
+     if (! out) {
+          LOG_FATAL("Failed to open BAM file %s\n", bam_out ? bam_out : "-");
+          return NULL;
+     }
+     thread_budget_hts(out);
+     if (sam_hdr_write(out, header) < 0) {
+          LOG_FATAL("Failed to write header to BAM file %s\n", bam_out ? bam_out : "-");
+          sam_close(out);
+          return NULL;
+     }
+     if (sam_hdr_is_coord_sorted(header)) {
+          if (sam_idx_out_init(out, header, bam_out, fnidx) < 0) {
+               sam_close(out);
+               return NULL;
+          }
+     }
+     return out;
+}
+
+
+/* saves index if fnidx is set and frees it. returns non-zero on error */
+static int
+close_bam_out(samFile *out, char *fnidx)
+{
+     int rc = 0;
+
+     if (fnidx && sam_idx_save(out) < 0) {
+          LOG_FATAL("Failed to save BAM index %s\n", fnidx);
+          rc = 1;
+     }
+     free(fnidx);
+     if (sam_close(out) < 0) {
+          LOG_FATAL("%s\n", "Failed to close BAM file");
+          rc = 1;
+     }
+     return rc;
+}
+
+
 static int uniform_fetch_func(bam1_t *b, void *data)
 {
      uint8_t *to_delete;
@@ -95,7 +172,7 @@ static int uniform_fetch_func(bam1_t *b, void *data)
      }
      bam_aux_append(b, BD_TAG, 'Z', c->l_qseq+1, (uint8_t*) dq);
 
-     sam_write1(tmp->out, tmp->header, b);
+     write_read(tmp->out, tmp->sidecar, tmp->header, b);
 
      free(iq);
      free(dq);
@@ -106,7 +183,7 @@ static int uniform_fetch_func(bam1_t *b, void *data)
 
 /* Stores an array of ints that corresponds to the length of the
  * homopolymer at the start of each homopolymer*/
-int find_homopolymers(char *query, int *count, int qlen)
+int find_homopolymers(const char *query, int *count, int qlen)
 {
      int i, j;
      int curr_i = 0;
@@ -133,36 +210,11 @@ int find_homopolymers(char *query, int *count, int qlen)
 }
 
 
-static int dindel_fetch_func(bam1_t *b, void *data)
+void dindel_add_indelqual(bam1_t *b, const int *hpcount, int rlen)
 {
-     data_t_dindel *tmp = (data_t_dindel*)data;
      bam1_core_t *c = &b->core;
-     int rlen;
      uint8_t *to_delete;
 
-     /* don't change reads failing default mask: BAM_FUNMAP | BAM_FSECONDARY | BAM_FQCFAIL | BAM_FDUP */
-     if (c->flag & (BAM_FUNMAP | BAM_FSECONDARY | BAM_FQCFAIL | BAM_FDUP)) {
-          /* fprintf(stderr, "skipping read: %s at pos %d\n", bam_get_qname(b), c->pos); */
-          sam_write1(tmp->out, tmp->header, b);
-          return 0;
-     }
-
-     /* get the reference sequence and compute homopolymer array */
-     if (tmp->tid != c->tid) {
-             /*fprintf(stderr, "fetching reference sequence %s\n",
-               tmp->header->target_name[c->tid]); */
-          char *ref = fai_fetch(tmp->fai, tmp->header->target_name[c->tid], &rlen);
-          strtoupper(ref);/* safeguard */
-          int rlen = strlen(ref);
-          tmp->tid = c->tid;
-          if (tmp->hpcount) free(tmp->hpcount);
-          tmp->hpcount = (int*)malloc(rlen*sizeof(int));
-          find_homopolymers(ref, tmp->hpcount, rlen);
-          free(ref);
-          tmp->rlen = rlen;
-          /* fprintf(stderr, "fetched reference sequence\n");*/
-     }
-
      /* parse the cigar string */
      uint32_t *cigar = bam_get_cigar(b);
      uint8_t indelq[c->l_qseq+1];
@@ -175,10 +227,10 @@ static int dindel_fetch_func(bam1_t *b, void *data)
           if (op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF) {
                for (j = 0; j < oplen; j++) {
                        /*fprintf(stderr, "query:%d, ref:%d, count:%d\n", 
-                         y, x, tmp->hpcount[x+1]); */
+                         y, x, hpcount[x+1]); */
                     /* FIXME clang complains: The left operand of '>' is a garbage value */
-                    indelq[y] = (x > tmp->rlen-2) ? DINDELQ[0] : (tmp->hpcount[x+1]>18 ?
-                         DINDELQ[0] : DINDELQ[tmp->hpcount[x+1]]);
+                    indelq[y] = (x > rlen-2) ? DINDELQ[0] : (hpcount[x+1]>18 ?
+                         DINDELQ[0] : DINDELQ[hpcount[x+1]]);
                     x++; 
                     y++;
                }
@@ -209,13 +261,47 @@ static int dindel_fetch_func(bam1_t *b, void *data)
           bam_aux_del(b, to_delete);
      }
      bam_aux_append(b, BD_TAG, 'Z', c->l_qseq+1, indelq);
+}
+/* dindel_add_indelqual() */
+
 
-     sam_write1(tmp->out, tmp->header, b);
+static int dindel_fetch_func(bam1_t *b, void *data)
+{
+     data_t_dindel *tmp = (data_t_dindel*)data;
+     bam1_core_t *c = &b->core;
+     int rlen;
+
+     /* don't change reads failing default mask: BAM_FUNMAP | BAM_FSECONDARY | BAM_FQCFAIL | BAM_FDUP */
+     if (c->flag & DINDEL_SKIP_MASK) {
+          /* fprintf(stderr, "skipping read: %s at pos %d\n", bam_get_qname(b), c->pos); */
+          write_read(tmp->out, tmp->sidecar, tmp->header, b);
+          return 0;
+     }
+
+     /* get the reference sequence and compute homopolymer array */
+     if (tmp->tid != c->tid) {
+             /*fprintf(stderr, "fetching reference sequence %s\n",
+               tmp->header->target_name[c->tid]); */
+          char *ref = fai_fetch(tmp->fai, tmp->header->target_name[c->tid], &rlen);
+          strtoupper(ref);/* safeguard */
+          int rlen = strlen(ref);
+          tmp->tid = c->tid;
+          if (tmp->hpcount) free(tmp->hpcount);
+          tmp->hpcount = (int*)malloc(rlen*sizeof(int));
+          find_homopolymers(ref, tmp->hpcount, rlen);
+          free(ref);
+          tmp->rlen = rlen;
+          /* fprintf(stderr, "fetched reference sequence\n");*/
+     }
+
+     dindel_add_indelqual(b, tmp->hpcount, tmp->rlen);
+     write_read(tmp->out, tmp->sidecar, tmp->header, b);
      return 0;
 }
 
 
 int add_uniform(const char *bam_in, const char *bam_out,
+                const char *sidecar_out,
                 const int ins_qual, const int del_qual)
 {
 	data_t_uniform tmp;
@@ -223,11 +309,13 @@ int add_uniform(const char *bam_in, const char *bam_out,
     uint8_t dq = ENCODE_Q(del_qual+33);
     bam1_t *b = NULL;
     int count = 0;
+    char *fnidx = NULL;
 
 	if ((tmp.in = sam_open(bam_in, "rb")) == 0) {
          LOG_FATAL("Failed to open BAM file %s\n", bam_in);
          return 1;
     }
+    thread_budget_hts(tmp.in);
 
     if ((tmp.header = sam_hdr_read(tmp.in)) == 0) {
          LOG_FATAL("Failed to read headers from BAM file %s\n", bam_in);
@@ -237,12 +325,16 @@ int add_uniform(const char *bam_in, const char *bam_out,
     tmp.iq = iq;
     tmp.dq = dq;
 
-    if (!bam_out || bam_out[0] == '-') {
-         tmp.out = sam_open("-", "wb");
-    } else {
-         tmp.out = sam_open(bam_out, "wb");
+    tmp.out = NULL;
+    tmp.sidecar = NULL;
+    if (sidecar_out) {
+         if (NULL == (tmp.sidecar = sidecar_writer_open(sidecar_out, sidecar_tags, 2))) {
+              LOG_FATAL("Failed to open sidecar file %s\n", sidecar_out);
+              return 1;
+         }
+    } else if (NULL == (tmp.out = open_bam_out(bam_out, tmp.header, &fnidx))) {
+         return 1;
     }
-    sam_hdr_write(tmp.out, tmp.header);
     
     b = bam_init1();
     while (sam_read1(tmp.in, tmp.header, b) >= 0) {
@@ -252,22 +344,32 @@ int add_uniform(const char *bam_in, const char *bam_out,
     bam_destroy1(b);
     bam_hdr_destroy(tmp.header);
     sam_close(tmp.in);
-    sam_close(tmp.out);
+    if (tmp.sidecar) {
+         if (sidecar_writer_close(tmp.sidecar)) {
+              LOG_FATAL("Failed to close sidecar file %s\n", sidecar_out);
+              return 1;
+         }
+    } else if (close_bam_out(tmp.out, fnidx)) {
+         return 1;
+    }
     LOG_VERBOSE("Processed %d reads\n", count);
     return 0;
 }
 
 
-int add_dindel(const char *bam_in, const char *bam_out, const char *ref)
+int add_dindel(const char *bam_in, const char *bam_out,
+               const char *sidecar_out, const char *ref)
 {
 	data_t_dindel tmp;
     int count = 0;
     bam1_t *b = NULL;
+    char *fnidx = NULL;
 
 	if ((tmp.in = sam_open(bam_in, "rb")) == 0) {
          LOG_FATAL("Failed to open BAM file %s\n", bam_in);
              return 1;
         }
+    thread_budget_hts(tmp.in);
     if ((tmp.header = sam_hdr_read(tmp.in)) == 0) {
          LOG_FATAL("Failed to read headers from BAM file %s\n", bam_in);
          return 1;
@@ -278,12 +380,16 @@ int add_dindel(const char *bam_in, const char *bam_out, const char *ref)
     }
     /*warn_old_fai(ref);*/
 
-    if (!bam_out || bam_out[0] == '-') {
-         tmp.out = sam_open("-", "wb");
-    } else {
-         tmp.out = sam_open(bam_out, "wb");
+    tmp.out = NULL;
+    tmp.sidecar = NULL;
+    if (sidecar_out) {
+         if (NULL == (tmp.sidecar = sidecar_writer_open(sidecar_out, sidecar_tags, 2))) {
+              LOG_FATAL("Failed to open sidecar file %s\n", sidecar_out);
+              return 1;
+         }
+    } else if (NULL == (tmp.out = open_bam_out(bam_out, tmp.header, &fnidx))) {
+         return 1;
     }
-    sam_hdr_write(tmp.out, tmp.header);
     
     b = bam_init1();
     tmp.tid = -1;
@@ -297,7 +403,14 @@ int add_dindel(const char *bam_in, const char *bam_out, const char *ref)
     bam_hdr_destroy(tmp.header);
     if (tmp.hpcount) free(tmp.hpcount);
     sam_close(tmp.in);
-    sam_close(tmp.out);
+    if (tmp.sidecar) {
+         if (sidecar_writer_close(tmp.sidecar)) {
+              LOG_FATAL("Failed to close sidecar file %s\n", sidecar_out);
+              return 1;
+         }
+    } else if (close_bam_out(tmp.out, fnidx)) {
+         return 1;
+    }
     fai_destroy(tmp.fai);
 	LOG_VERBOSE("Processed %d reads\n", count);
 	return 0;
@@ -320,6 +433,9 @@ usage()
      fprintf(stderr, "  -f | --ref                Reference sequence used for mapping\n");
      fprintf(stderr, "                            (Only required for --dindel)\n");
      fprintf(stderr, "  -o | --out FILE           Output BAM file [- = stdout = default]\n");
+     fprintf(stderr, "       --sidecar FILE       Write indel qualities to this sidecar file\n");
+     fprintf(stderr, "                            (see call --sidecar) instead of BAM\n");
+     fprintf(stderr, "       --threads INT        Number of threads for BAM compression [$%s or 1]\n", THREAD_BUDGET_ENV);
      fprintf(stderr, "       --verbose            Be verbose\n");
      fprintf(stderr, "\n");
      fprintf(stderr,
@@ -330,6 +446,7 @@ usage()
              "- 'dindel' will insert indel qualities based on Dindel (PMID 20980555).\n" \
              "Both will overwrite any existing values.\n");
      fprintf(stderr, "Do not realign your BAM file afterwards!\n");
+     fprintf(stderr, "Coordinate sorted BAM output written to a file is indexed on the fly.\n");
      fprintf(stderr, "\n");
 }
 
@@ -353,10 +470,13 @@ int main_indelqual(int argc, char *argv[])
      char *bam_in = NULL;
      char *bam_out = NULL; /* - == stdout */
      char *ref = NULL;
+     char *sidecar_out = NULL;
      int c;
      static int dindel = 0;
      int uni_iq = -1;
      int uni_dq = -1;
+     int num_threads = 0;
+     int rc;
      while (1) {
           static struct option long_opts[] = {
                /* see usage sync */
@@ -367,6 +487,8 @@ int main_indelqual(int argc, char *argv[])
                {"out", required_argument, NULL, 'o'},
                {"uniform", required_argument, NULL, 'u'},
                {"ref", required_argument, NULL, 'f'},
+               {"sidecar", required_argument, NULL, 's'},
+               {"threads", required_argument, NULL, 't'},
                {0, 0, 0, 0} /* sentinel */
           };
           
@@ -404,6 +526,19 @@ int main_indelqual(int argc, char *argv[])
                }
                bam_out = strdup(optarg);
                break;
+          case 's':
+               if (file_exists(optarg)) {
+                    LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                    return 1;
+               }
+               sidecar_out = strdup(optarg);
+               break;
+          case 't':
+               if (! isdigit(optarg[0]) || (num_threads = atoi(optarg)) < 1) {
+                    LOG_FATAL("Invalid number of threads: %s\n", optarg);
+                    return 1;
+               }
+               break;
           case '?':
                LOG_FATAL("%s\n", "unrecognized arguments found. Exiting...\n");
                return 1;
@@ -432,6 +567,7 @@ int main_indelqual(int argc, char *argv[])
      LOG_DEBUG("bam_in=%s\n", bam_in);
      LOG_DEBUG("bam_out=%s\n", bam_out);
      LOG_DEBUG("ref=%s\n", ref);
+     LOG_DEBUG("sidecar_out=%s\n", sidecar_out);
 
      if ((uni_iq != -1 && uni_dq == -1)
          ||
@@ -445,14 +581,24 @@ int main_indelqual(int argc, char *argv[])
                LOG_FATAL("%s\n", "Can't insert both, uniform and dindel qualities");
                return -1;
           }
-          return add_uniform(bam_in, bam_out, uni_iq, uni_dq);
+          if (thread_budget_init(num_threads)) {
+               return 1;
+          }
+          rc = add_uniform(bam_in, bam_out, sidecar_out, uni_iq, uni_dq);
+          thread_budget_destroy();
+          return rc;
 
      } else if (dindel) {
           if (! ref) {
                LOG_FATAL("%s\n", "Need reference for Dindel model");
                return -1;
           }
-          return add_dindel(bam_in, bam_out, ref);          
+          if (thread_budget_init(num_threads)) {
+               return 1;
+          }
+          rc = add_dindel(bam_in, bam_out, sidecar_out, ref);
+          thread_budget_destroy();
+          return rc;
 
      } else {
           LOG_FATAL("%s\n", "Please specify either dindel or uniform mode");
@@ -28,6 +28,20 @@
 #ifndef LOFREQ_INDELQUAL
 #define LOFREQ_INDELQUAL
 
+#include "htslib/sam.h"
+
+/* reads failing this mask are left untouched by dindel */
+#define DINDEL_SKIP_MASK (BAM_FUNMAP | BAM_FSECONDARY | BAM_FQCFAIL | BAM_FDUP)
+
 int main_indelqual(int argc, char *argv[]);
 
+/* stores the length of the homopolymer starting at each position of
+ * query (1 for positions within a homopolymer) in count */
+int find_homopolymers(const char *query, int *count, int qlen);
+
+/* sets Dindel's indel qualities (BI/BD) for b, overwriting existing
+ * ones. hpcount is the output of find_homopolymers() for b's
+ * reference sequence of length rlen */
+void dindel_add_indelqual(bam1_t *b, const int *hpcount, int rlen);
+
 #endif
@@ -45,45 +45,19 @@
 #include "lofreq_index.h"
 #include "lofreq_indelqual.h"
 #include "lofreq_call.h"
+#include "lofreq_pon.h"
+#include "lofreq_preprocess.h"
 #include "lofreq_uniq.h"
 #include "lofreq_vcfset.h"
+#include "lofreq_vcfsort.h"
+#include "lofreq_vcfstats.h"
 #include "lofreq_viterbi.h"
+#include "pbin_owner.h"
 
 #ifndef __DATE__
 __DATE__ = "NA";
 #endif
 
-#ifdef USE_FPGA
-
-#include "fpga.h"
-
-char cl_device_name[NAME_LENGTH];  // The OpenCL device name
-
-// OpenCL objects
-cl_device_id devices;
-cl_context context;
-cl_program program;
-cl_command_queue cmd_queue;
-cl_kernel kernel1;
-cl_mem in_buf, out_buf;
-double * in_buf_host;
-double * out_buf_host;
-unsigned char *kernelBinary;
-
-// The name of the XCLBIN file
-char *xclbin = "krnl.xclbin";
-
-// The name of the kernel function
-char *krnl_func = "krnl";
-
-// Input data chunk (bin) id: the id of the data chunk 
-// generated in the lofreq2_call_pparallel.py script.
-// This is needed when using an FPGA design with
-// more than 15 CUs, in the lofreq call-parallel mode.
-int proc_bin_id; 
-
-#endif
-
 static void prepend_dir_to_path(const char *dir_to_add)
 {
      char *old_path = NULL;
@@ -201,16 +175,20 @@ static void usage(const char *myname)
      fprintf(stderr, "    viterbi       : Viterbi realignment\n");
      fprintf(stderr, "    indelqual     : Insert indel qualities\n");
      fprintf(stderr, "    alnqual       : Insert base and indel alignment qualities\n");
+     fprintf(stderr, "    preprocess    : viterbi, alnqual and indelqual --dindel in one go\n");
      fprintf(stderr, "\n");
      fprintf(stderr, "  Other Commands:\n");
      fprintf(stderr, "    checkref      : Check that reference fasta and BAM file match\n");
      fprintf(stderr, "    filter        : Filter variants in VCF file\n");
      fprintf(stderr, "    uniq          : Test whether variants predicted in only one sample really are unique\n");
+     fprintf(stderr, "    pon           : Build and filter against panel of normals\n");
      fprintf(stderr, "    plpsummary    : Print pileup summary per position\n");
 #ifdef USE_ALNERRPROF
      fprintf(stderr, "    bamstats      : Collect BAM statistics\n");
 #endif
      fprintf(stderr, "    vcfset        : VCF set operations\n");
+     fprintf(stderr, "    vcfsort       : Sort VCF files (in bounded memory)\n");
+     fprintf(stderr, "    vcfstats      : VCF summary statistics (see also vcfplot)\n");
 
      fprintf(stderr, "    version       : Print version info\n");
      fprintf(stderr, "\n");
@@ -243,9 +221,22 @@ int main(int argc, char *argv[])
      } else if (strcmp(argv[1], "uniq") == 0)  {
           return main_uniq(argc, argv);
 
+     } else if (strcmp(argv[1], "pon") == 0)  {
+          return main_pon(argc, argv);
+
      } else if (strcmp(argv[1], "vcfset") == 0)  {
           return main_vcfset(argc, argv);
 
+     } else if (strcmp(argv[1], "vcfsort") == 0)  {
+          return main_vcfsort(argc, argv);
+
+     } else if (strcmp(argv[1], "vcfstats") == 0)  {
+          return main_vcfstats(argc, argv);
+
+     } else if (strcmp(argv[1], "pbin-owner") == 0)  {
+          /* used internally by call-parallel */
+          return main_pbin_owner(argc, argv);
+
      } else if (strcmp(argv[1], "viterbi") == 0){
           return main_viterbi(argc,argv);
 
@@ -261,6 +252,9 @@ int main(int argc, char *argv[])
      } else if (strcmp(argv[1], "alnqual") == 0)  {
           return main_alnqual(argc-1, argv+1);
 
+     } else if (strcmp(argv[1], "preprocess") == 0)  {
+          return main_preprocess(argc, argv);
+
      } else if (strcmp(argv[1], "idxstats") == 0)  {
           return main_idxstats(argc, argv);
 
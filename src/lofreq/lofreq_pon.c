@@ -0,0 +1,760 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Panel of normals for tumour-only filtering.
+ *
+ * 'build' piles up each normal once and keeps per site (position and
+ * alt allele) counts and quality summaries of all sites with alt
+ * evidence, merging the sorted sites of each normal into the panel.
+ * The result is written as memory-mappable database (see pon.h).
+ * 'filter' annotates and filters calls with lookups in that database,
+ * instead of running uniq or vcfset against every normal.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <getopt.h>
+
+#include "htslib/faidx.h"
+#include "uthash.h"
+
+#include "lofreq_pon.h"
+#include "pon.h"
+#include "plp.h"
+#include "vcf.h"
+#include "log.h"
+#include "utils.h"
+#include "defaults.h"
+
+
+#if 1
+#define MYNAME "lofreq pon"
+#else
+#define MYNAME PACKAGE
+#endif
+
+#define BUF_SIZE 1<<16
+
+#define DEFAULT_PON_MIN_ALT 2
+#define DEFAULT_PON_MIN_NORMALS 2
+
+#define PON_FILTER_ID "pon"
+
+void *bed_read(const char *fn);
+void bed_destroy(void *_h);
+
+
+typedef struct {
+     char *name;
+     int tid;
+     UT_hash_handle hh;
+} pon_tid_t;
+
+typedef struct {
+     int min_alt;
+     pon_tid_t *tids; /* target name to index as in reference */
+     const char *last_target; /* lookup cache */
+     int last_tid;
+     pon_site_t *sites; /* of current normal */
+     int64_t num_sites, max_sites;
+} pon_build_conf_t;
+
+
+static void
+usage_build(void)
+{
+     fprintf(stderr, "%s build: Build panel of normals database from normal BAM files\n\n", MYNAME);
+     fprintf(stderr, "Usage: %s build [options] -f ref.fa -o pon.db normal1.bam [normal2.bam ...]\n\n", MYNAME);
+     fprintf(stderr,"Options:\n");
+     fprintf(stderr, "  -f | --ref FILE          Indexed reference fasta file (required)\n");
+     fprintf(stderr, "  -o | --out FILE          Database output file (required)\n");
+     fprintf(stderr, "  -L | --bam-list FILE     Read normal BAM files from this file (one per line)\n");
+     fprintf(stderr, "  -l | --bed FILE          Only use positions listed in this BED file\n");
+     fprintf(stderr, "  -a | --min-alt-count INT Minimum number of alt reads in a normal to count as evidence [%d]\n", DEFAULT_PON_MIN_ALT);
+     fprintf(stderr, "  -q | --min-bq INT        Skip bases with base quality smaller than INT [%d]\n", DEFAULT_MIN_PLP_BQ);
+     fprintf(stderr, "  -m | --min-mq INT        Skip reads with mapping quality smaller than INT [%d]\n", DEFAULT_MIN_MQ);
+     fprintf(stderr, "  -B | --no-baq            Disable use of base-alignment quality (BAQ)\n");
+     fprintf(stderr, "       --use-orphan        Don't ignore anomalous read pairs / orphan reads\n");
+     fprintf(stderr, "       --verbose           Be verbose\n");
+     fprintf(stderr, "       --debug             Enable debugging\n");
+}
+
+
+static void
+usage_filter(void)
+{
+     fprintf(stderr, "%s filter: Annotate and filter variants found in a panel of normals\n\n", MYNAME);
+     fprintf(stderr, "Usage: %s filter [options] -p pon.db\n\n", MYNAME);
+     fprintf(stderr,"Options:\n");
+     fprintf(stderr, "  -p | --pon FILE          Panel of normals database created with '%s build' (required)\n", MYNAME);
+     fprintf(stderr, "  -i | --vcf-in FILE       Input vcf file [- = stdin; gzip supported]\n");
+     fprintf(stderr, "  -o | --vcf-out FILE      Output vcf file [- = stdout; gzip supported]\n");
+     fprintf(stderr, "  -n | --min-normals INT   Filter variants with evidence in at least this many normals [%d]\n", DEFAULT_PON_MIN_NORMALS);
+     fprintf(stderr, "  -a | --min-af FLOAT      ...and an AF of at least FLOAT in one of them [0.0]\n");
+     fprintf(stderr, "       --annotate-only     Only annotate, don't filter\n");
+     fprintf(stderr, "       --verbose           Be verbose\n");
+     fprintf(stderr, "       --debug             Enable debugging\n");
+     fprintf(stderr, "\nVariants found in the panel are annotated with PON, PON_AC, PON_DP, PON_AQ and PON_MAXAF.\n");
+}
+
+
+static void
+usage(void)
+{
+     fprintf(stderr, "%s: Panel of normals for tumour-only filtering\n\n", MYNAME);
+     fprintf(stderr, "Usage: %s <build|filter> [options]\n\n", MYNAME);
+     fprintf(stderr, "  build  : Build panel of normals database from normal BAM files\n");
+     fprintf(stderr, "  filter : Annotate and filter variants found in a panel of normals\n");
+}
+
+
+static int
+pon_tid(pon_build_conf_t *conf, const char *target)
+{
+     pon_tid_t *t;
+
+     if (conf->last_target && 0 == strcmp(conf->last_target, target)) {
+          return conf->last_tid;
+     }
+     HASH_FIND_STR(conf->tids, target, t);
+     conf->last_target = t ? t->name : NULL;
+     conf->last_tid = t ? t->tid : -1;
+     if (! t) {
+          LOG_WARN("Ignoring %s which is not part of reference\n", target);
+     }
+     return conf->last_tid;
+}
+
+
+static void
+pon_add_site(pon_build_conf_t *conf, int tid, const plp_col_t *p,
+             int allele, uint32_t indel_hash, int count, const int_varray_t *quals)
+{
+     pon_site_t *s;
+     double qual_sum = 0.0;
+     unsigned long int i;
+
+     if (conf->num_sites == conf->max_sites) {
+          conf->max_sites = conf->max_sites ? conf->max_sites*2 : 1024;
+          conf->sites = realloc(conf->sites, conf->max_sites * sizeof(pon_site_t));
+     }
+     for (i=0; i<quals->n; i++) {
+          qual_sum += quals->data[i];
+     }
+     s = & conf->sites[conf->num_sites++];
+     memset(s, 0, sizeof(pon_site_t));
+     s->tid = tid;
+     s->pos = p->pos;
+     s->allele = allele;
+     s->indel_hash = indel_hash;
+     s->alt_count = count;
+     s->depth = p->coverage_plp;
+     s->alt_qual_mean = quals->n ? qual_sum/quals->n : 0.0;
+     s->max_af = count/(float)p->coverage_plp;
+     s->num_normals = 1;
+}
+
+
+static int
+pon_site_qsort_cmp(const void *a, const void *b)
+{
+     return pon_site_cmp((const pon_site_t *)a, (const pon_site_t *)b);
+}
+
+
+/* collects sites with alt evidence of the current normal */
+static void
+pon_build_col(const plp_col_t *p, void *confp)
+{
+     pon_build_conf_t *conf = (pon_build_conf_t *)confp;
+     int64_t first = conf->num_sites;
+     int ref_nt4 = bam_nt4_table[(int)p->ref_base];
+     int tid;
+     int b;
+
+     if (0 == p->coverage_plp) {
+          return;
+     }
+     if ((tid = pon_tid(conf, p->target)) < 0) {
+          return;
+     }
+
+     for (b=0; b<4; b++) {
+          if (b == ref_nt4 || (int)p->base_quals[b].n < conf->min_alt) {
+               continue;
+          }
+          pon_add_site(conf, tid, p, b, 0, p->base_quals[b].n, & p->base_quals[b]);
+     }
+     if (p->num_ins) {
+          ins_event *it, *it_tmp;
+          HASH_ITER(hh_ins, p->ins_event_counts, it, it_tmp) {
+               if (it->count >= conf->min_alt) {
+                    pon_add_site(conf, tid, p, PON_ALLELE_INS, pon_indel_hash(it->key),
+                                 it->count, & it->ins_quals);
+               }
+          }
+     }
+     if (p->num_dels) {
+          del_event *it, *it_tmp;
+          HASH_ITER(hh_del, p->del_event_counts, it, it_tmp) {
+               if (it->count >= conf->min_alt) {
+                    pon_add_site(conf, tid, p, PON_ALLELE_DEL, pon_indel_hash(it->key),
+                                 it->count, & it->del_quals);
+               }
+          }
+     }
+     /* indel events come in hash order */
+     if (conf->num_sites - first > 1) {
+          qsort(& conf->sites[first], conf->num_sites - first,
+                sizeof(pon_site_t), pon_site_qsort_cmp);
+     }
+}
+/* pon_build_col() */
+
+
+/* merges sorted sites of one normal into the sorted panel sites */
+static void
+pon_merge_sites(pon_site_t **panel, int64_t *num_panel,
+                const pon_site_t *sites, int64_t num_sites)
+{
+     pon_site_t *merged = malloc((*num_panel + num_sites) * sizeof(pon_site_t));
+     int64_t i = 0, j = 0, n = 0;
+
+     while (i < *num_panel || j < num_sites) {
+          int c;
+          if (i == *num_panel) {
+               c = 1;
+          } else if (j == num_sites) {
+               c = -1;
+          } else {
+               c = pon_site_cmp(& (*panel)[i], & sites[j]);
+          }
+          if (c < 0) {
+               merged[n++] = (*panel)[i++];
+          } else if (c > 0) {
+               merged[n++] = sites[j++];
+          } else {
+               pon_site_t *m = & merged[n++];
+               const pon_site_t *s = & sites[j++];
+               *m = (*panel)[i++];
+               m->alt_qual_mean = (m->alt_qual_mean * m->alt_count + s->alt_qual_mean * s->alt_count)
+                    / (m->alt_count + s->alt_count);
+               m->alt_count += s->alt_count;
+               m->depth += s->depth;
+               if (s->max_af > m->max_af) {
+                    m->max_af = s->max_af;
+               }
+               if (m->num_normals < UINT16_MAX) {
+                    m->num_normals++;
+               }
+          }
+     }
+     free(*panel);
+     *panel = merged;
+     *num_panel = n;
+}
+/* pon_merge_sites() */
+
+
+/* appends BAM files listed in fn (one per line) */
+static int
+read_bam_list(const char *fn, char ***bams, int *num_bams)
+{
+     char line[BUF_SIZE];
+     FILE *fh;
+
+     if (NULL == (fh = fopen(fn, "r"))) {
+          LOG_ERROR("Couldn't open %s\n", fn);
+          return 1;
+     }
+     while (NULL != fgets(line, sizeof(line), fh)) {
+          size_t len = strcspn(line, "\r\n");
+          line[len] = '\0';
+          if (0 == len || line[0] == '#') {
+               continue;
+          }
+          (*bams) = realloc((*bams), ((*num_bams)+1) * sizeof(char *));
+          (*bams)[(*num_bams)++] = strdup(line);
+     }
+     fclose(fh);
+     return 0;
+}
+
+
+static int
+main_pon_build(int argc, char *argv[])
+{
+     mplp_conf_t mplp_conf;
+     pon_build_conf_t conf;
+     char *db_out = NULL;
+     char *bam_list = NULL;
+     char *bed_file = NULL;
+     char **bams = NULL;
+     int num_bams = 0;
+     char **target_names = NULL;
+     int *target_lens = NULL;
+     int num_targets = 0;
+     pon_site_t *panel = NULL;
+     int64_t num_panel = 0;
+     static int no_baq = 0;
+     static int use_orphan = 0;
+     pon_tid_t *t, *t_tmp;
+     int rc = 0;
+     int i;
+
+     memset(& conf, 0, sizeof(pon_build_conf_t));
+     conf.min_alt = DEFAULT_PON_MIN_ALT;
+     init_mplp_conf(& mplp_conf);
+
+    while (1) {
+         int c;
+         static struct option long_opts[] = {
+              /* see usage sync */
+              {"help", no_argument, NULL, 'h'},
+              {"verbose", no_argument, &verbose, 1},
+              {"debug", no_argument, &debug, 1},
+              {"use-orphan", no_argument, &use_orphan, 1},
+              {"ref", required_argument, NULL, 'f'},
+              {"out", required_argument, NULL, 'o'},
+              {"bam-list", required_argument, NULL, 'L'},
+              {"bed", required_argument, NULL, 'l'},
+              {"min-alt-count", required_argument, NULL, 'a'},
+              {"min-bq", required_argument, NULL, 'q'},
+              {"min-mq", required_argument, NULL, 'm'},
+              {"no-baq", no_argument, NULL, 'B'},
+              {0, 0, 0, 0} /* sentinel */
+         };
+
+         /* keep in sync with long_opts and usage */
+         static const char *long_opts_str = "hf:o:L:l:a:q:m:B";
+
+         /* getopt_long stores the option index here. */
+         int long_opts_index = 0;
+         c = getopt_long(argc-2, argv+2, /* skipping 'lofreq pon' */
+                         long_opts_str, long_opts, & long_opts_index);
+         if (c == -1) {
+              break;
+         }
+
+         switch (c) {
+         /* keep in sync with long_opts etc */
+         case 'h':
+              usage_build();
+              return 0;
+
+         case 'f':
+              if (! file_exists(optarg)) {
+                   LOG_FATAL("Reference fasta file '%s' does not exist. Exiting...\n", optarg);
+                   return 1;
+              }
+              mplp_conf.fa = strdup(optarg);
+              if (NULL == (mplp_conf.fai = fai_load(optarg))) {
+                   LOG_FATAL("Couldn't load index for %s\n", optarg);
+                   return 1;
+              }
+              break;
+
+         case 'o':
+              if (file_exists(optarg)) {
+                   LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                   return 1;
+              }
+              db_out = strdup(optarg);
+              break;
+
+         case 'L':
+              bam_list = strdup(optarg);
+              break;
+
+         case 'l':
+              bed_file = strdup(optarg);
+              break;
+
+         case 'a':
+              conf.min_alt = atoi(optarg);
+              if (conf.min_alt < 1) {
+                   LOG_FATAL("%s\n", "Minimum alt count has to be at least 1");
+                   return 1;
+              }
+              break;
+
+         case 'q':
+              mplp_conf.min_plp_bq = atoi(optarg);
+              break;
+
+         case 'm':
+              mplp_conf.min_mq = atoi(optarg);
+              break;
+
+         case 'B':
+              no_baq = 1;
+              break;
+
+         case '?':
+              LOG_FATAL("%s\n", "unrecognized arguments found. Exiting...\n");
+              return 1;
+
+         default:
+              break;
+         }
+    }
+    if (no_baq) {
+         mplp_conf.flag &= ~MPLP_BAQ;
+    }
+    if (use_orphan) {
+         mplp_conf.flag &= ~MPLP_NO_ORPHAN;
+    }
+
+    for (i=optind+2; i<argc; i++) {
+         bams = realloc(bams, (num_bams+1) * sizeof(char *));
+         bams[num_bams++] = strdup(argv[i]);
+    }
+    if (bam_list && read_bam_list(bam_list, & bams, & num_bams)) {
+         rc = 1;
+         goto free_and_exit;
+    }
+    if (! mplp_conf.fa || ! db_out || 0 == num_bams) {
+         usage_build();
+         LOG_FATAL("%s\n", "Need reference, output file and at least one BAM file");
+         rc = 1;
+         goto free_and_exit;
+    }
+    for (i=0; i<num_bams; i++) {
+         if (! file_exists(bams[i])) {
+              LOG_FATAL("BAM file %s does not exist. Exiting...\n", bams[i]);
+              rc = 1;
+              goto free_and_exit;
+         }
+    }
+    if (bed_file && NULL == (mplp_conf.bed = bed_read(bed_file))) {
+         LOG_ERROR("Couldn't read %s\n", bed_file);
+         rc = 1;
+         goto free_and_exit;
+    }
+    if (debug) {
+         dump_mplp_conf(& mplp_conf, stderr);
+    }
+
+    /* sites are indexed and sorted by target as in reference */
+    num_targets = faidx_nseq(mplp_conf.fai);
+    target_names = malloc(num_targets * sizeof(char *));
+    target_lens = malloc(num_targets * sizeof(int));
+    for (i=0; i<num_targets; i++) {
+         t = malloc(sizeof(pon_tid_t));
+         t->name = strdup(faidx_iseq(mplp_conf.fai, i));
+         t->tid = i;
+         HASH_ADD_KEYPTR(hh, conf.tids, t->name, strlen(t->name), t);
+         target_names[i] = t->name;
+         target_lens[i] = faidx_seq_len(mplp_conf.fai, t->name);
+    }
+
+    for (i=0; i<num_bams; i++) {
+         int64_t j;
+
+         LOG_VERBOSE("Processing normal %d of %d: %s\n", i+1, num_bams, bams[i]);
+         conf.num_sites = 0;
+         conf.last_target = NULL;
+         if (mpileup(& mplp_conf, pon_build_col, (void*)& conf,
+                     1, (const char **) & bams[i])) {
+              LOG_ERROR("Pileup of %s failed\n", bams[i]);
+              rc = 1;
+              goto free_and_exit;
+         }
+         /* BAM targets might be ordered differently than in reference */
+         for (j=1; j<conf.num_sites; j++) {
+              if (pon_site_cmp(& conf.sites[j-1], & conf.sites[j]) > 0) {
+                   qsort(conf.sites, conf.num_sites, sizeof(pon_site_t), pon_site_qsort_cmp);
+                   break;
+              }
+         }
+         pon_merge_sites(& panel, & num_panel, conf.sites, conf.num_sites);
+         LOG_VERBOSE("%lld sites with alt evidence in %s. %lld in panel\n",
+                     (long long int)conf.num_sites, bams[i], (long long int)num_panel);
+    }
+
+    rc = pon_db_write(db_out, num_bams, target_names, target_lens, num_targets,
+                      panel, num_panel);
+    if (0 == rc) {
+         LOG_VERBOSE("Wrote %lld sites to %s\n", (long long int)num_panel, db_out);
+    }
+
+free_and_exit:
+    HASH_ITER(hh, conf.tids, t, t_tmp) {
+         HASH_DEL(conf.tids, t);
+         free(t->name);
+         free(t);
+    }
+    free(target_names);
+    free(target_lens);
+    free(conf.sites);
+    free(panel);
+    for (i=0; i<num_bams; i++) {
+         free(bams[i]);
+    }
+    free(bams);
+    if (mplp_conf.bed) {
+         bed_destroy(mplp_conf.bed);
+    }
+    if (mplp_conf.fai) {
+         fai_destroy(mplp_conf.fai);
+    }
+    free(mplp_conf.fa);
+    free(bed_file);
+    free(bam_list);
+    free(db_out);
+    return rc;
+}
+/* main_pon_build() */
+
+
+static int
+main_pon_filter(int argc, char *argv[])
+{
+     char *db_in = NULL;
+     char *vcf_in = NULL;
+     char *vcf_out = NULL;
+     int min_normals = DEFAULT_PON_MIN_NORMALS;
+     float min_af = 0.0;
+     static int annotate_only = 0;
+     pon_db_t *db = NULL;
+     vcf_file_t vcf_in_fh, vcf_out_fh;
+     char *vcf_header = NULL;
+     long int num_vars = 0, num_in_pon = 0, num_filtered = 0;
+     int rc = 0;
+
+    while (1) {
+         int c;
+         static struct option long_opts[] = {
+              /* see usage sync */
+              {"help", no_argument, NULL, 'h'},
+              {"verbose", no_argument, &verbose, 1},
+              {"debug", no_argument, &debug, 1},
+              {"annotate-only", no_argument, &annotate_only, 1},
+              {"pon", required_argument, NULL, 'p'},
+              {"vcf-in", required_argument, NULL, 'i'},
+              {"vcf-out", required_argument, NULL, 'o'},
+              {"min-normals", required_argument, NULL, 'n'},
+              {"min-af", required_argument, NULL, 'a'},
+              {0, 0, 0, 0} /* sentinel */
+         };
+
+         /* keep in sync with long_opts and usage */
+         static const char *long_opts_str = "hp:i:o:n:a:";
+
+         /* getopt_long stores the option index here. */
+         int long_opts_index = 0;
+         c = getopt_long(argc-2, argv+2, /* skipping 'lofreq pon' */
+                         long_opts_str, long_opts, & long_opts_index);
+         if (c == -1) {
+              break;
+         }
+
+         switch (c) {
+         /* keep in sync with long_opts etc */
+         case 'h':
+              usage_filter();
+              return 0;
+
+         case 'p':
+              db_in = strdup(optarg);
+              break;
+
+         case 'i':
+              if (0 != strcmp(optarg, "-")) {
+                   if (! file_exists(optarg)) {
+                        LOG_FATAL("Input file '%s' does not exist. Exiting...\n", optarg);
+                        return 1;
+                   }
+              }
+              vcf_in = strdup(optarg);
+              break;
+
+         case 'o':
+              if (0 != strcmp(optarg, "-")) {
+                   if (file_exists(optarg)) {
+                        LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                        return 1;
+                   }
+              }
+              vcf_out = strdup(optarg);
+              break;
+
+         case 'n':
+              if (! isdigit(optarg[0])) {
+                   LOG_FATAL("Non-numeric argument provided: %s\n", optarg);
+                   return 1;
+              }
+              min_normals = atoi(optarg);
+              break;
+
+         case 'a':
+              min_af = strtof(optarg, NULL);
+              break;
+
+         case '?':
+              LOG_FATAL("%s\n", "unrecognized arguments found. Exiting...\n");
+              return 1;
+
+         default:
+              break;
+         }
+    }
+
+    if (! db_in) {
+         usage_filter();
+         LOG_FATAL("%s\n", "No panel of normals database given");
+         free(vcf_in); free(vcf_out);
+         return 1;
+    }
+    if (! vcf_in) {
+         vcf_in = strdup("-");
+    }
+    if (! vcf_out) {
+         vcf_out = strdup("-");
+    }
+
+    if (NULL == (db = pon_db_open(db_in))) {
+         rc = 1;
+         goto free_and_exit;
+    }
+    if (min_normals > db->num_normals) {
+         LOG_WARN("Panel only contains %d normals, so nothing will be filtered with --min-normals %d\n",
+                  db->num_normals, min_normals);
+    }
+
+    if (vcf_file_open(& vcf_in_fh, vcf_in, HAS_GZIP_EXT(vcf_in), 'r')) {
+         LOG_ERROR("Couldn't open %s\n", vcf_in);
+         rc = 1;
+         goto free_and_exit;
+    }
+    if (vcf_file_open(& vcf_out_fh, vcf_out, HAS_GZIP_EXT(vcf_out), 'w')) {
+         LOG_ERROR("Couldn't open %s\n", vcf_out);
+         vcf_file_close(& vcf_in_fh);
+         rc = 1;
+         goto free_and_exit;
+    }
+
+    if (0 != vcf_parse_header(&vcf_header, & vcf_in_fh)) {
+         if (vcf_file_seek(& vcf_in_fh, 0, SEEK_SET)) {
+              LOG_FATAL("%s\n", "Couldn't rewind file to parse variants"
+                        " after header parsing failed");
+              rc = 1;
+              goto close_and_exit;
+         }
+    } else {
+         char buf[BUF_SIZE];
+         vcf_header_add(&vcf_header, "##INFO=<ID=PON,Number=1,Type=Integer,Description=\"Number of normals in panel with alt evidence\">\n");
+         vcf_header_add(&vcf_header, "##INFO=<ID=PON_AC,Number=1,Type=Integer,Description=\"Alt read count summed over normals with evidence\">\n");
+         vcf_header_add(&vcf_header, "##INFO=<ID=PON_DP,Number=1,Type=Integer,Description=\"Depth summed over normals with evidence\">\n");
+         vcf_header_add(&vcf_header, "##INFO=<ID=PON_AQ,Number=1,Type=Float,Description=\"Mean quality of alt evidence in normals\">\n");
+         vcf_header_add(&vcf_header, "##INFO=<ID=PON_MAXAF,Number=1,Type=Float,Description=\"Maximum AF among normals with evidence\">\n");
+         if (! annotate_only) {
+              snprintf(buf, sizeof(buf),
+                       "##FILTER=<ID=%s,Description=\"Alt evidence in at least %d normals of panel (with AF>=%f in one)\">\n",
+                       PON_FILTER_ID, min_normals, min_af);
+              vcf_header_add(&vcf_header, buf);
+         }
+         vcf_write_header(& vcf_out_fh, vcf_header);
+         free(vcf_header);
+    }
+
+    while (1) {
+         var_t *var;
+         const pon_site_t *site = NULL;
+         int allele;
+         uint32_t indel_hash;
+
+         vcf_new_var(&var);
+         if (vcf_parse_var(& vcf_in_fh, var)) {
+              vcf_free_var(&var);
+              break;
+         }
+         num_vars++;
+
+         if (0 == pon_var_key(var, & allele, & indel_hash)) {
+              site = pon_db_lookup(db, var->chrom, var->pos, allele, indel_hash);
+         } else {
+              LOG_DEBUG("Can't look up %s:%ld %s>%s in panel\n",
+                        var->chrom, var->pos+1, var->ref, var->alt);
+         }
+         if (site) {
+              char info[BUF_SIZE];
+              snprintf(info, sizeof(info), "PON=%d;PON_AC=%u;PON_DP=%u;PON_AQ=%.1f;PON_MAXAF=%f",
+                       site->num_normals, site->alt_count, site->depth,
+                       site->alt_qual_mean, site->max_af);
+              vcf_var_add_to_info(var, info);
+              num_in_pon++;
+              if (! annotate_only && site->num_normals >= min_normals
+                  && site->max_af >= min_af) {
+                   vcf_var_add_to_filter(var, PON_FILTER_ID);
+                   num_filtered++;
+              }
+         }
+         vcf_write_var(& vcf_out_fh, var);
+         vcf_free_var(&var);
+    }
+    LOG_VERBOSE("%ld of %ld variants found in panel. %ld filtered\n",
+                num_in_pon, num_vars, num_filtered);
+
+close_and_exit:
+    vcf_file_close(& vcf_in_fh);
+    vcf_file_close(& vcf_out_fh);
+
+free_and_exit:
+    pon_db_close(db);
+    free(db_in);
+    free(vcf_in);
+    free(vcf_out);
+    return rc;
+}
+/* main_pon_filter() */
+
+
+int
+main_pon(int argc, char *argv[])
+{
+     if (argc < 3) {
+          usage();
+          return 1;
+     }
+     if (0 == strcmp(argv[2], "build")) {
+          return main_pon_build(argc, argv);
+     } else if (0 == strcmp(argv[2], "filter")) {
+          return main_pon_filter(argc, argv);
+     } else if (0 == strcmp(argv[2], "-h") || 0 == strcmp(argv[2], "--help")) {
+          usage();
+          return 0;
+     }
+     LOG_FATAL("Unknown %s command '%s'\n", MYNAME, argv[2]);
+     usage();
+     return 1;
+}
+/* main_pon() */
@@ -0,0 +1,489 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Fused BAM preprocessing: viterbi realignment, alnqual (BAQ/IDAQ)
+ * and indelqual --dindel in one process, i.e. without serializing
+ * and parsing each record between the steps.
+ *
+ * Realignment can move a read's start, which is why the output of
+ * 'lofreq viterbi' had to be re-sorted. Reads never move left by more
+ * than VITERBI_RWIN though, so records are kept in a small heap
+ * ordered like samtools sort orders them, and are written as soon as
+ * no later input read can end up before them.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <getopt.h>
+
+#include "htslib/faidx.h"
+#include "htslib/sam.h"
+
+#include "log.h"
+#include "utils.h"
+#include "bam_md_ext.h"
+#include "samutils.h"
+#include "lofreq_viterbi.h"
+#include "lofreq_indelqual.h"
+#include "lofreq_preprocess.h"
+#include "thread_budget.h"
+
+
+#define MYNAME "lofreq preprocess"
+
+
+typedef struct {
+     bam1_t *b;
+     uint64_t key; /* as used by samtools sort */
+     uint64_t idx; /* input order. keeps the sort stable */
+} resort_rec_t;
+
+
+/* min heap of records waiting to be written, plus a pool of
+ * records to recycle */
+typedef struct {
+     resort_rec_t *recs;
+     int n, m;
+     bam1_t **pool;
+     int n_pool, m_pool;
+     uint64_t num_in;
+     int max_n;
+} resort_t;
+
+
+/* samtools sort's coordinate key: unmapped (tid -1) last, reverse
+ * after forward strand at same position */
+static inline uint64_t
+resort_key(const bam1_t *b)
+{
+     return ((uint64_t)(uint32_t)b->core.tid<<32)
+          | ((uint64_t)(uint32_t)(b->core.pos+1)<<1) | bam_is_rev(b);
+}
+
+
+static inline int
+resort_lt(const resort_rec_t *a, const resort_rec_t *b)
+{
+     return a->key < b->key || (a->key == b->key && a->idx < b->idx);
+}
+
+
+/* takes ownership of *b and replaces it with a fresh record */
+static void
+resort_push(resort_t *r, bam1_t **b)
+{
+     resort_rec_t rec;
+     int i;
+
+     rec.b = *b;
+     rec.key = resort_key(*b);
+     rec.idx = r->num_in++;
+     *b = r->n_pool ? r->pool[--r->n_pool] : bam_init1();
+
+     if (r->n == r->m) {
+          r->m = r->m ? r->m*2 : 256;
+          r->recs = realloc(r->recs, r->m * sizeof(resort_rec_t));
+     }
+     /* sift up */
+     i = r->n++;
+     while (i > 0 && resort_lt(&rec, &r->recs[(i-1)/2])) {
+          r->recs[i] = r->recs[(i-1)/2];
+          i = (i-1)/2;
+     }
+     r->recs[i] = rec;
+     if (r->n > r->max_n) {
+          r->max_n = r->n;
+     }
+}
+
+
+/* writes the smallest record and recycles it. returns non-zero on
+ * write error */
+static int
+resort_pop(resort_t *r, samFile *out, const bam_hdr_t *h)
+{
+     bam1_t *b = r->recs[0].b;
+     resort_rec_t last = r->recs[--r->n];
+     int i = 0;
+
+     /* sift down */
+     while (2*i+1 < r->n) {
+          int c = 2*i+1;
+          if (c+1 < r->n && resort_lt(&r->recs[c+1], &r->recs[c])) {
+               c++;
+          }
+          if (! resort_lt(&r->recs[c], &last)) {
+               break;
+          }
+          r->recs[i] = r->recs[c];
+          i = c;
+     }
+     r->recs[i] = last;
+
+     if (r->n_pool == r->m_pool) {
+          r->m_pool = r->m_pool ? r->m_pool*2 : 256;
+          r->pool = realloc(r->pool, r->m_pool * sizeof(bam1_t *));
+     }
+     r->pool[r->n_pool++] = b;
+     return sam_write1(out, h, b) < 0;
+}
+
+
+/* writes all records on tid that start before pos (all records if tid
+ * is -1) */
+static int
+resort_flush(resort_t *r, samFile *out, const bam_hdr_t *h, int tid, int pos)
+{
+     while (r->n) {
+          const bam1_t *b = r->recs[0].b;
+          if (tid >= 0 && b->core.tid == tid && b->core.pos >= pos) {
+               break;
+          }
+          if (resort_pop(r, out, h)) {
+               return -1;
+          }
+     }
+     return 0;
+}
+
+
+static void
+resort_free(resort_t *r)
+{
+     int i;
+     for (i=0; i<r->n; i++) {
+          bam_destroy1(r->recs[i].b);
+     }
+     for (i=0; i<r->n_pool; i++) {
+          bam_destroy1(r->pool[i]);
+     }
+     free(r->recs);
+     free(r->pool);
+}
+
+
+static void
+usage()
+{
+     fprintf(stderr, "%s: Viterbi realignment, alnqual and indelqual --dindel in one go\n\n", MYNAME);
+     fprintf(stderr, "Usage: %s [options] -f ref.fa in.bam\n", MYNAME);
+     fprintf(stderr, "Options:\n");
+     fprintf(stderr, "  -f | --ref FILE       Indexed reference fasta file [null]\n");
+     fprintf(stderr, "  -o | --out FILE       Output BAM file [- = stdout = default]\n");
+     fprintf(stderr, "  -k | --keepflags      Don't delete flags MC, MD, NM and A after realignment (see viterbi)\n");
+     fprintf(stderr, "  -q | --defqual INT    Assume INT as quality for all bases with BQ2 (see viterbi) [-1]\n");
+     fprintf(stderr, "  -e | --no-ext-baq     Use default instead of extended BAQ (see alnqual)\n");
+     fprintf(stderr, "  -B | --no-baq         Don't compute base alignment qualities\n");
+     fprintf(stderr, "  -A | --no-idaq        Don't compute indel alignment qualities\n");
+     fprintf(stderr, "  -r | --redo           Recompute i.e. overwrite existing BAQ and IDAQ values\n");
+     fprintf(stderr, "  -u | --uncompressed   Uncompressed BAM output (for piping)\n");
+     fprintf(stderr, "       --threads INT    Number of threads, shared by BAM (de)compression and processing [$%s or 1]\n", THREAD_BUDGET_ENV);
+     fprintf(stderr, "       --verbose        Be verbose\n");
+     fprintf(stderr, "       --debug          Enable debugging\n");
+     fprintf(stderr, "\n");
+     fprintf(stderr, "Gives the same records as 'lofreq viterbi | lofreq alnqual -u - | lofreq indelqual --dindel - | samtools sort'.\n");
+     fprintf(stderr, "Input has to be coordinate sorted and output will be coordinate sorted as well.\n");
+     fprintf(stderr, "Output written to a file is indexed on the fly (no need for 'lofreq index').\n");
+}
+/* usage() */
+
+
+int
+main_preprocess(int argc, char *argv[])
+{
+     char *bam_out = NULL;
+     char *bam_in = NULL;
+     faidx_t *fai = NULL;
+     samFile *in = NULL, *out = NULL;
+     bam_hdr_t *h = NULL;
+     bam1_t *b = NULL;
+     resort_t resort;
+     char *ref = NULL;
+     int *hpcount = NULL;
+     int ref_len = 0, ref_tid = -1;
+     int32_t in_tid = 0, in_pos = -1; /* of last input read */
+     int del_flag = 1, q2def = -1;
+     int baq_flag = 1, ext_baq = 1, idaq_flag = 1, redo = 0;
+     int uncompressed = 0, num_threads = 0;
+     long long int num_skipped = 0;
+     int rc = 0, ret;
+     char *fnidx = NULL;
+     char mode_w[8];
+
+     memset(&resort, 0, sizeof(resort_t));
+     while (1) {
+          int c;
+          static struct option long_opts[] = {
+               /* see usage sync */
+               {"help", no_argument, NULL, 'h'},
+               {"verbose", no_argument, &verbose, 1},
+               {"debug", no_argument, &debug, 1},
+               {"ref", required_argument, NULL, 'f'},
+               {"out", required_argument, NULL, 'o'},
+               {"keepflags", no_argument, NULL, 'k'},
+               {"defqual", required_argument, NULL, 'q'},
+               {"no-ext-baq", no_argument, NULL, 'e'},
+               {"no-baq", no_argument, NULL, 'B'},
+               {"no-idaq", no_argument, NULL, 'A'},
+               {"redo", no_argument, NULL, 'r'},
+               {"uncompressed", no_argument, NULL, 'u'},
+               {"threads", required_argument, NULL, 't'},
+               {0, 0, 0, 0} /* sentinel */
+          };
+
+          /* keep in sync with long_opts and usage */
+          static const char *long_opts_str = "hf:o:kq:eBAru";
+
+          /* getopt_long stores the option index here. */
+          int long_opts_index = 0;
+          c = getopt_long(argc-1, argv+1, /* skipping 'lofreq', just leaving 'command', i.e. call */
+                          long_opts_str, long_opts, & long_opts_index);
+          if (c == -1) {
+               break;
+          }
+
+          switch (c) {
+          /* keep in sync with long_opts etc */
+          case 'h':
+               usage();
+               free(bam_out);
+               if (fai) fai_destroy(fai);
+               return 0;
+          case 'f':
+               if (! file_exists(optarg)) {
+                    LOG_FATAL("Reference fasta file '%s' does not exist. Exiting...\n", optarg);
+                    return 1;
+               }
+               if (NULL == (fai = fai_load(optarg))) {
+                    LOG_FATAL("Couldn't load reference fasta file %s\n", optarg);
+                    return 1;
+               }
+               break;
+          case 'o':
+               if (0 != strcmp(optarg, "-")) {
+                    if (file_exists(optarg)) {
+                         LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                         return 1;
+                    }
+               }
+               bam_out = strdup(optarg);
+               break;
+          case 'k':
+               del_flag = 0;
+               break;
+          case 'q':
+               q2def = atoi(optarg);
+               break;
+          case 'e':
+               ext_baq = 0;
+               break;
+          case 'B':
+               baq_flag = 0;
+               break;
+          case 'A':
+               idaq_flag = 0;
+               break;
+          case 'r':
+               redo = 1;
+               break;
+          case 'u':
+               uncompressed = 1;
+               break;
+          case 't':
+               if (! isdigit(optarg[0]) || (num_threads = atoi(optarg)) < 1) {
+                    LOG_FATAL("Invalid number of threads: %s\n", optarg);
+                    return 1;
+               }
+               break;
+          case '?':
+               LOG_FATAL("%s\n", "Unrecognized arguments found. Exiting...\n");
+               return 1;
+          default:
+               break;
+          }
+     }
+
+     if (! fai) {
+          LOG_FATAL("%s\n", "Need reference fasta file (-f)");
+          usage();
+          return 1;
+     }
+     if (1 != argc - optind - 1) {
+          LOG_FATAL("%s\n", "Need exactly one BAM file as last argument");
+          usage();
+          fai_destroy(fai);
+          return 1;
+     }
+     bam_in = (argv + optind + 1)[0];
+     if (redo) {
+          baq_flag = baq_flag ? 2 : 0;
+          idaq_flag = idaq_flag ? 2 : 0;
+     }
+
+     if (NULL == (in = sam_open(bam_in, "rb"))) {
+          LOG_FATAL("Failed to open BAM file %s\n", bam_in);
+          fai_destroy(fai);
+          return 1;
+     }
+     if (NULL == (h = sam_hdr_read(in))) {
+          LOG_FATAL("Failed to read headers from BAM file %s\n", bam_in);
+          sam_close(in);
+          fai_destroy(fai);
+          return 1;
+     }
+     strcpy(mode_w, uncompressed ? "wbu" : "wb");
+     if (NULL == (out = sam_open(bam_out ? bam_out : "-", mode_w))) {
+          LOG_FATAL("Failed to open output BAM file %s\n", bam_out ? bam_out : "-");
+          bam_hdr_destroy(h);
+          sam_close(in);
+          fai_destroy(fai);
+          return 1;
+     }
+     if (thread_budget_init(num_threads)) {
+          bam_hdr_destroy(h);
+          sam_close(in);
+          sam_close(out);
+          fai_destroy(fai);
+          return 1;
+     }
+     thread_budget_hts(in);
+     if (! uncompressed) {
+          thread_budget_hts(out);
+     }
+     if (sam_hdr_write(out, h) < 0) {
+          LOG_FATAL("%s\n", "Failed to write BAM header");
+          rc = 1;
+          goto cleanup;
+     }
+     /* output is sorted by construction (see resort_t) */
+     if (sam_idx_out_init(out, h, bam_out, &fnidx) < 0) {
+          rc = 1;
+          goto cleanup;
+     }
+
+     b = bam_init1();
+     while ((ret = sam_read1(in, h, b)) >= 0) {
+          bam1_core_t *c = &b->core;
+
+          /* unmapped reads without position are sorted last */
+          if (((uint32_t)c->tid < (uint32_t)in_tid)
+              || (c->tid == in_tid && c->pos < in_pos)) {
+               LOG_FATAL("Input BAM %s is not coordinate sorted (read %s)\n",
+                         bam_in, bam_get_qname(b));
+               rc = 1;
+               goto cleanup;
+          }
+          if (c->tid != in_tid) {
+               /* nothing of an earlier sequence can move past this read */
+               if (resort_flush(&resort, out, h, -1, 0)) {
+                    rc = 1;
+                    goto cleanup;
+               }
+          }
+          in_tid = c->tid;
+          in_pos = c->pos;
+
+          if (c->tid >= 0 && c->tid != ref_tid) {
+               free(ref);
+               free(hpcount);
+               hpcount = NULL;
+               if (NULL == (ref = fai_fetch(fai, h->target_name[c->tid], &ref_len))) {
+                    LOG_FATAL("Failed to find sequence %s in reference\n", h->target_name[c->tid]);
+                    rc = 1;
+                    goto cleanup;
+               }
+               strtoupper(ref);/* safeguard */
+               ref_len = strlen(ref);
+               hpcount = malloc(ref_len * sizeof(int));
+               find_homopolymers(ref, hpcount, ref_len);
+               ref_tid = c->tid;
+          }
+
+          /* same order of transformations as in the piped version */
+          if (viterbi_realign(b, c->tid >= 0 ? ref : NULL, ref_len,
+                              c->tid >= 0 ? h->target_name[c->tid] : NULL,
+                              del_flag, q2def, 0)) {
+               num_skipped++;
+          }
+          if (c->tid >= 0) {
+               bam_prob_realn_core_ext(b, ref, baq_flag, ext_baq, idaq_flag);
+               if (! (c->flag & DINDEL_SKIP_MASK)) {
+                    dindel_add_indelqual(b, hpcount, ref_len);
+               }
+          }
+
+          resort_push(&resort, &b);
+          if (in_tid >= 0 && resort_flush(&resort, out, h, in_tid, in_pos - VITERBI_RWIN)) {
+               rc = 1;
+               goto cleanup;
+          }
+     }
+     if (ret < -1) {
+          LOG_FATAL("Failed to read from BAM file %s\n", bam_in);
+          rc = 1;
+          goto cleanup;
+     }
+     if (resort_flush(&resort, out, h, -1, 0)) {
+          rc = 1;
+          goto cleanup;
+     }
+
+     if (num_skipped) {
+          LOG_WARN("%lld reads with unsupported cigar operations were not realigned\n", num_skipped);
+     }
+     LOG_VERBOSE("Processed %llu reads (max. %d kept for re-sorting)\n",
+                 (unsigned long long int)resort.num_in, resort.max_n);
+
+cleanup:
+     if (rc) {
+          LOG_FATAL("%s\n", "Preprocessing failed");
+     }
+     resort_free(&resort);
+     bam_destroy1(b);
+     free(ref);
+     free(hpcount);
+     bam_hdr_destroy(h);
+     sam_close(in);
+     if (! rc && fnidx && sam_idx_save(out) < 0) {
+          LOG_FATAL("Failed to save index %s\n", fnidx);
+          rc = 1;
+     }
+     if (sam_close(out) < 0) {
+          LOG_FATAL("%s\n", "Failed to close output BAM file");
+          rc = 1;
+     }
+     thread_budget_destroy();
+     fai_destroy(fai);
+     free(bam_out);
+     free(fnidx);
+     return rc;
+}
+/* main_preprocess() */
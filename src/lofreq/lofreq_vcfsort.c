@@ -0,0 +1,932 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Sort VCF files of arbitrary size in bounded memory.
+ *
+ * Input is read in chunks of at most max_mem/(workers+1) bytes. Each
+ * chunk is sorted and written to a temporary run file by a worker of
+ * the thread budget while the next one is read. The runs are then k-way merged
+ * into the output. Run files are only open while merged and a merge
+ * reads at most VCFSORT_MAX_FANIN runs (less if their buffers don't
+ * fit into max_mem), so more runs are merged in several passes. Sort
+ * keys (contig index, position, ref, alt) are computed once per
+ * record when it's read and stored with it in the runs, so records
+ * are never parsed again.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <getopt.h>
+#include <unistd.h>
+
+#include "htslib/bgzf.h"
+#include "htslib/kstring.h"
+#include "uthash.h"
+
+#include "lofreq_vcfsort.h"
+#include "vcf.h"
+#include "log.h"
+#include "utils.h"
+#include "thread_budget.h"
+
+
+#if 1
+#define MYNAME "lofreq vcfsort"
+#else
+#define MYNAME PACKAGE
+#endif
+
+#define BUF_SIZE 1024
+
+#define VCFSORT_DEFAULT_MEM (768LL<<20)
+
+/* runs merged at once, keeping clear of open file limits */
+#define VCFSORT_MAX_FANIN 128
+/* stdio buffer per run while merging */
+#define VCFSORT_RUN_BUF (64<<10)
+
+
+/* contig name to sort index */
+typedef struct {
+     char *name;
+     int idx;
+     UT_hash_handle hh;
+} contig_t;
+
+/* sort key of a record. ref and alt are given as offset and length
+ * into the vcf line */
+typedef struct {
+     int32_t tid;
+     int32_t ref_off, ref_len;
+     int32_t alt_off, alt_len;
+     uint32_t len; /* line length (without newline) */
+     int64_t pos;
+     uint64_t seq; /* input order: keeps the sort stable */
+} sort_key_t;
+
+typedef struct {
+     sort_key_t k;
+     size_t off; /* offset of line in chunk buffer */
+     const char *line; /* only valid once the chunk is complete */
+} sort_rec_t;
+
+typedef struct {
+     char *buf;
+     size_t len, cap;
+     sort_rec_t *recs;
+     size_t n, m;
+} chunk_t;
+
+/* a sorted run in a temporary file. the file is closed once
+ * written (fn set) and opened again (and removed) for merging (fh
+ * set) */
+typedef struct {
+     char *fn;
+     FILE *fh;
+     char *fh_buf;
+     sort_rec_t rec; /* current record while merging */
+     kstring_t line;
+} run_t;
+
+/* job turning a chunk into a run */
+typedef struct {
+     chunk_t *chunk;
+     run_t *run;
+     const char *tmp_dir;
+     int rc;
+} sort_job_t;
+
+typedef struct {
+     contig_t *contigs;
+     int num_contigs;
+     char *header;
+     size_t header_len;
+     uint64_t num_recs;
+} vcfsort_t;
+
+
+static void
+usage(void)
+{
+     fprintf(stderr, "%s: Sort VCF files (in bounded memory)\n\n", MYNAME);
+     fprintf(stderr, "Usage: %s [options] [in.vcf ...]\n", MYNAME);
+     fprintf(stderr,"Options:\n");
+     fprintf(stderr, "  -o | --vcfout FILE   VCF output file (default: - for stdout). bgzipped and tabix indexed if ending in .gz\n");
+     fprintf(stderr, "  -f | --ref FILE      Sort contigs as in this (faidx indexed) reference. Default: as in ##contig header lines,\n"
+                     "                       then in order of appearance\n");
+     fprintf(stderr, "  -m | --max-mem SIZE  Memory to use for sorting, e.g. 500M or 2G [%lldM]\n", VCFSORT_DEFAULT_MEM>>20);
+     fprintf(stderr, "  -T | --tmp-dir DIR   Directory for temporary files [$TMPDIR or /tmp]\n");
+     fprintf(stderr, "       --threads INT   Sort and compress with this many threads [$%s or 1]\n", THREAD_BUDGET_ENV);
+     fprintf(stderr, "       --verbose       Be verbose\n");
+     fprintf(stderr, "       --debug         Enable debugging\n");
+     fprintf(stderr, "\nInput (bgzip supported, default: - for stdin) can be several files, e.g. shards of a call. Header and\n");
+     fprintf(stderr, "meta-data are taken from the first one.\n");
+}
+/* usage() */
+
+
+/* parses sizes like 100K, 500M or 2G. returns -1 on error */
+static long long int
+parse_mem(const char *str)
+{
+     char *end;
+     double val = strtod(str, &end);
+
+     if (end == str || val <= 0) {
+          return -1;
+     }
+     switch (*end) {
+     case 'k': case 'K': val *= 1<<10; end++; break;
+     case 'm': case 'M': val *= 1<<20; end++; break;
+     case 'g': case 'G': val *= 1<<30; end++; break;
+     default: break;
+     }
+     if (*end != '\0') {
+          return -1;
+     }
+     return (long long int)val;
+}
+
+
+static int
+contig_idx(vcfsort_t *vs, const char *name, size_t len, int add)
+{
+     contig_t *c;
+
+     HASH_FIND(hh, vs->contigs, name, len, c);
+     if (c) {
+          return c->idx;
+     }
+     if (! add) {
+          return -1;
+     }
+     c = malloc(sizeof(contig_t));
+     c->name = strndup(name, len);
+     c->idx = vs->num_contigs++;
+     HASH_ADD_KEYPTR(hh, vs->contigs, c->name, len, c);
+     return c->idx;
+}
+
+
+static void
+contigs_free(vcfsort_t *vs)
+{
+     contig_t *c, *c_tmp;
+     HASH_ITER(hh, vs->contigs, c, c_tmp) {
+          HASH_DEL(vs->contigs, c);
+          free(c->name);
+          free(c);
+     }
+}
+
+
+/* contig order from a reference's fai. returns non-zero on error */
+static int
+contigs_from_fai(vcfsort_t *vs, const char *ref)
+{
+     char *fai = malloc(strlen(ref) + 5);
+     char line[BUF_SIZE];
+     FILE *fh;
+
+     sprintf(fai, "%s.fai", ref);
+     if (NULL == (fh = fopen(fai, "r"))) {
+          LOG_ERROR("Couldn't open %s. Please index reference with samtools faidx\n", fai);
+          free(fai);
+          return 1;
+     }
+     while (NULL != fgets(line, sizeof(line), fh)) {
+          size_t len = strcspn(line, "\t\n");
+          if (len) {
+               contig_idx(vs, line, len, 1);
+          }
+     }
+     fclose(fh);
+     free(fai);
+     return 0;
+}
+
+
+/* contig order from ##contig=<ID=...> header lines */
+static void
+contigs_from_header_line(vcfsort_t *vs, const char *line)
+{
+     const char *id;
+
+     if (strncmp(line, "##contig=<", 10)) {
+          return;
+     }
+     if (NULL == (id = strstr(line, "ID="))) {
+          return;
+     }
+     id += 3;
+     contig_idx(vs, id, strcspn(id, ",>"), 1);
+}
+
+
+/* computes the sort key of line. returns non-zero if line is
+ * malformed */
+static int
+parse_key(vcfsort_t *vs, const char *line, size_t len, sort_key_t *k)
+{
+     const char *f[5]; /* start of first five fields */
+     const char *p = line;
+     char *end;
+     int i;
+
+     for (i=0; i<5; i++) {
+          f[i] = p;
+          if (i<4) {
+               if (NULL == (p = memchr(p, '\t', len - (p-line)))) {
+                    return 1;
+               }
+               p++;
+          }
+     }
+     k->tid = contig_idx(vs, f[0], f[1]-f[0]-1, 1);
+     k->pos = strtoll(f[1], &end, 10);
+     if (end == f[1] || *end != '\t') {
+          return 1;
+     }
+     k->ref_off = f[3] - line;
+     k->ref_len = f[4] - f[3] - 1;
+     k->alt_off = f[4] - line;
+     k->alt_len = strcspn(f[4], "\t"); /* line is nul terminated */
+     k->len = len;
+     k->seq = vs->num_recs++;
+     return 0;
+}
+
+
+static int
+field_cmp(const char *a, int a_len, const char *b, int b_len)
+{
+     int c = memcmp(a, b, a_len < b_len ? a_len : b_len);
+     if (c) {
+          return c;
+     }
+     return a_len - b_len;
+}
+
+
+static int
+rec_cmp(const sort_rec_t *a, const sort_rec_t *b)
+{
+     int c;
+
+     if (a->k.tid != b->k.tid) {
+          return a->k.tid < b->k.tid ? -1 : 1;
+     }
+     if (a->k.pos != b->k.pos) {
+          return a->k.pos < b->k.pos ? -1 : 1;
+     }
+     if ((c = field_cmp(a->line + a->k.ref_off, a->k.ref_len,
+                        b->line + b->k.ref_off, b->k.ref_len))) {
+          return c;
+     }
+     if ((c = field_cmp(a->line + a->k.alt_off, a->k.alt_len,
+                        b->line + b->k.alt_off, b->k.alt_len))) {
+          return c;
+     }
+     return a->k.seq < b->k.seq ? -1 : (a->k.seq > b->k.seq);
+}
+
+
+static int
+rec_qsort_cmp(const void *a, const void *b)
+{
+     return rec_cmp((const sort_rec_t *)a, (const sort_rec_t *)b);
+}
+
+
+static void
+chunk_add(chunk_t *c, const sort_key_t *k, const char *line)
+{
+     if (c->n == c->m) {
+          c->m = c->m ? c->m*2 : 1024;
+          c->recs = realloc(c->recs, c->m * sizeof(sort_rec_t));
+     }
+     if (c->len + k->len + 1 > c->cap) {
+          c->cap = (c->len + k->len + 1) * 2;
+          c->buf = realloc(c->buf, c->cap);
+     }
+     c->recs[c->n].k = *k;
+     c->recs[c->n].off = c->len;
+     memcpy(c->buf + c->len, line, k->len + 1);
+     c->len += k->len + 1;
+     c->n++;
+}
+
+
+static size_t
+chunk_mem(const chunk_t *c)
+{
+     return c->cap + c->m * sizeof(sort_rec_t);
+}
+
+
+static void
+chunk_free(chunk_t *c)
+{
+     if (c) {
+          free(c->buf);
+          free(c->recs);
+          free(c);
+     }
+}
+
+
+/* sorts chunk, i.e. sets line pointers (buffer is final now) and
+ * sorts */
+static void
+chunk_sort(chunk_t *c)
+{
+     size_t i;
+     for (i=0; i<c->n; i++) {
+          c->recs[i].line = c->buf + c->recs[i].off;
+     }
+     qsort(c->recs, c->n, sizeof(sort_rec_t), rec_qsort_cmp);
+}
+
+
+/* creates the temporary file of run and opens it for writing.
+ * returns non-zero on error */
+static int
+run_create(run_t *run, const char *tmp_dir)
+{
+     int fd;
+
+     run->fn = malloc(strlen(tmp_dir) + 32);
+     sprintf(run->fn, "%s/lofreq2-vcfsort.XXXXXX", tmp_dir);
+     if (-1 == (fd = mkstemp(run->fn))) {
+          LOG_ERROR("Couldn't create temporary file in %s: %s\n", tmp_dir, strerror(errno));
+          free(run->fn);
+          run->fn = NULL;
+          return 1;
+     }
+     if (NULL == (run->fh = fdopen(fd, "w"))) {
+          LOG_ERROR("Couldn't open temporary file %s\n", run->fn);
+          close(fd);
+          return 1;
+     }
+     return 0;
+}
+
+
+static int
+run_write_rec(run_t *run, const sort_rec_t *r)
+{
+     if (fwrite(& r->k, sizeof(sort_key_t), 1, run->fh) != 1
+         || fwrite(r->line, 1, r->k.len, run->fh) != r->k.len) {
+          LOG_ERROR("Couldn't write to temporary file %s\n", run->fn);
+          return 1;
+     }
+     return 0;
+}
+
+
+/* closes run after writing. returns non-zero on error */
+static int
+run_finish(run_t *run)
+{
+     int rc = fclose(run->fh);
+     run->fh = NULL;
+     if (rc) {
+          LOG_ERROR("Couldn't write to temporary file %s\n", run->fn);
+          return 1;
+     }
+     return 0;
+}
+
+
+/* opens run for merging. the file is removed right away, i.e. once
+ * closed. returns non-zero on error */
+static int
+run_open(run_t *run)
+{
+     if (NULL == (run->fh = fopen(run->fn, "r"))) {
+          LOG_ERROR("Couldn't open temporary file %s: %s\n", run->fn, strerror(errno));
+          return 1;
+     }
+     run->fh_buf = malloc(VCFSORT_RUN_BUF);
+     setvbuf(run->fh, run->fh_buf, _IOFBF, VCFSORT_RUN_BUF);
+     unlink(run->fn);
+     free(run->fn);
+     run->fn = NULL;
+     return 0;
+}
+
+
+static void
+run_free(run_t *run)
+{
+     if (run->fh) {
+          fclose(run->fh);
+     }
+     if (run->fn) {
+          unlink(run->fn);
+          free(run->fn);
+     }
+     free(run->fh_buf);
+     free(run->line.s);
+     free(run);
+}
+
+
+/* sorts chunk and writes it to a new run file. returns job */
+static void *
+sort_job(void *arg)
+{
+     sort_job_t *w = (sort_job_t *)arg;
+     chunk_t *c = w->chunk;
+     size_t i;
+
+     chunk_sort(c);
+
+     if (run_create(w->run, w->tmp_dir)) {
+          w->rc = 1;
+     }
+     for (i=0; i<c->n && ! w->rc; i++) {
+          w->rc = run_write_rec(w->run, & c->recs[i]);
+     }
+     if (w->run->fh && run_finish(w->run)) {
+          w->rc = 1;
+     }
+     chunk_free(c);
+     w->chunk = NULL;
+     return w;
+}
+
+
+/* collects the result of a finished job. returns its rc */
+static int
+sort_job_collect(sort_job_t *job)
+{
+     int rc = job->rc;
+     free(job);
+     return rc;
+}
+
+
+/* hands chunk over to a new job writing run */
+static int
+sort_job_dispatch(thread_budget_queue_t *q, chunk_t *chunk, run_t *run,
+                  const char *tmp_dir)
+{
+     sort_job_t *job = calloc(1, sizeof(sort_job_t));
+
+     job->chunk = chunk;
+     job->run = run;
+     job->tmp_dir = tmp_dir;
+     if (thread_budget_dispatch(q, sort_job, job)) {
+          free(job);
+          return 1;
+     }
+     return 0;
+}
+
+
+/* reads the next record of a run. returns 1 on success, 0 at end and
+ * -1 on error */
+static int
+run_next(run_t *r)
+{
+     size_t n = fread(& r->rec.k, sizeof(sort_key_t), 1, r->fh);
+     if (n != 1) {
+          return ferror(r->fh) ? -1 : 0;
+     }
+     ks_resize(& r->line, r->rec.k.len + 1);
+     if (fread(r->line.s, 1, r->rec.k.len, r->fh) != r->rec.k.len) {
+          return -1;
+     }
+     r->line.s[r->rec.k.len] = '\0';
+     r->line.l = r->rec.k.len;
+     r->rec.line = r->line.s;
+     return 1;
+}
+
+
+static int
+out_write(vcf_file_t *out, const char *data, size_t len)
+{
+     if (out->is_bgz) {
+          return bgzf_write(out->fh_bgz, data, len) == (ssize_t)len ? 0 : 1;
+     } else {
+          return fwrite(data, 1, len, out->fh) == len ? 0 : 1;
+     }
+}
+
+
+static int
+out_write_rec(vcf_file_t *out, const sort_rec_t *r)
+{
+     if (out_write(out, r->line, r->k.len) || out_write(out, "\n", 1)) {
+          LOG_ERROR("%s\n", "Couldn't write output");
+          return 1;
+     }
+     return 0;
+}
+
+
+/* heap of run indices ordered by their current record */
+static void
+heap_down(int *heap, int n, int i, run_t **runs)
+{
+     while (1) {
+          int l = 2*i+1, r = l+1, min = i, tmp;
+          if (l < n && rec_cmp(& runs[heap[l]]->rec, & runs[heap[min]]->rec) < 0) {
+               min = l;
+          }
+          if (r < n && rec_cmp(& runs[heap[r]]->rec, & runs[heap[min]]->rec) < 0) {
+               min = r;
+          }
+          if (min == i) {
+               return;
+          }
+          tmp = heap[i]; heap[i] = heap[min]; heap[min] = tmp;
+          i = min;
+     }
+}
+
+
+/* k-way merge of runs into out or, if out is NULL, into the new run
+ * dst. merged runs are freed. returns non-zero on error */
+static int
+merge_runs(run_t **runs, int num_runs, vcf_file_t *out, run_t *dst)
+{
+     int *heap = malloc(num_runs * sizeof(int));
+     int n = 0, i, ret;
+     int rc = 0;
+
+     for (i=0; i<num_runs && ! rc; i++) {
+          if (run_open(runs[i])) {
+               rc = 1;
+          } else if ((ret = run_next(runs[i])) < 0) {
+               LOG_ERROR("%s\n", "Couldn't read temporary file");
+               rc = 1;
+          } else if (ret) {
+               heap[n++] = i;
+          }
+     }
+     for (i=n/2-1; i>=0; i--) {
+          heap_down(heap, n, i, runs);
+     }
+     while (n && ! rc) {
+          run_t *r = runs[heap[0]];
+          if (out ? out_write_rec(out, & r->rec) : run_write_rec(dst, & r->rec)) {
+               rc = 1;
+          } else if ((ret = run_next(r)) < 0) {
+               LOG_ERROR("%s\n", "Couldn't read temporary file");
+               rc = 1;
+          } else if (0 == ret) {
+               heap[0] = heap[--n];
+          }
+          heap_down(heap, n, 0, runs);
+     }
+     free(heap);
+     for (i=0; i<num_runs; i++) {
+          run_free(runs[i]);
+          runs[i] = NULL;
+     }
+     return rc;
+}
+
+
+/* merges runs into out, in several passes if there are more than
+ * fan_in. *runs and *num_runs are updated (all runs are freed in the
+ * end). returns non-zero on error */
+static int
+merge_passes(run_t ***runs, int *num_runs, int fan_in, const char *tmp_dir,
+             vcf_file_t *out)
+{
+     int rc;
+
+     while (*num_runs > fan_in) {
+          /* oldest runs first, so that passes stay balanced */
+          run_t *dst = calloc(1, sizeof(run_t));
+          if (run_create(dst, tmp_dir)) {
+               run_free(dst);
+               return 1;
+          }
+          dst->fh_buf = malloc(VCFSORT_RUN_BUF);
+          setvbuf(dst->fh, dst->fh_buf, _IOFBF, VCFSORT_RUN_BUF);
+          LOG_DEBUG("Merging %d of %d runs into temporary run\n", fan_in, *num_runs);
+          rc = merge_runs(*runs, fan_in, NULL, dst);
+          memmove(*runs, *runs + fan_in, (*num_runs - fan_in) * sizeof(run_t *));
+          *num_runs -= fan_in;
+          if (rc || run_finish(dst)) {
+               run_free(dst);
+               return 1;
+          }
+          free(dst->fh_buf);
+          dst->fh_buf = NULL;
+          (*runs)[(*num_runs)++] = dst;
+     }
+     rc = merge_runs(*runs, *num_runs, out, NULL);
+     *num_runs = 0;
+     return rc;
+}
+
+
+int
+main_vcfsort(int argc, char *argv[])
+{
+     vcfsort_t vs;
+     char *vcf_out = NULL;
+     char *ref = NULL;
+     char *tmp_dir = NULL;
+     long long int max_mem = VCFSORT_DEFAULT_MEM;
+     int num_threads = 0; /* thread budget default */
+     const char **vcf_in;
+     int num_vcf_in;
+     thread_budget_queue_t *jobs = NULL;
+     sort_job_t *job;
+     run_t **runs = NULL;
+     int num_runs = 0;
+     int fan_in;
+     chunk_t *chunk;
+     size_t chunk_max;
+     kstring_t line = {0, 0, NULL};
+     vcf_file_t out;
+     int rc = 0;
+     int i;
+
+     memset(& vs, 0, sizeof(vcfsort_t));
+
+    /* keep in sync with long_opts_str and usage
+     */
+    while (1) {
+         int c;
+         static struct option long_opts[] = {
+              /* see usage sync */
+              {"help", no_argument, NULL, 'h'},
+              {"verbose", no_argument, &verbose, 1},
+              {"debug", no_argument, &debug, 1},
+              {"vcfout", required_argument, NULL, 'o'},
+              {"ref", required_argument, NULL, 'f'},
+              {"max-mem", required_argument, NULL, 'm'},
+              {"tmp-dir", required_argument, NULL, 'T'},
+              {"threads", required_argument, NULL, '@'},
+              {0, 0, 0, 0} /* sentinel */
+         };
+
+         /* keep in sync with long_opts and usage */
+         static const char *long_opts_str = "ho:f:m:T:";
+
+         /* getopt_long stores the option index here. */
+         int long_opts_index = 0;
+         c = getopt_long(argc-1, argv+1, /* skipping 'lofreq', just leaving 'command', i.e. call */
+                         long_opts_str, long_opts, & long_opts_index);
+         if (c == -1) {
+              break;
+         }
+
+         switch (c) {
+         /* keep in sync with long_opts etc */
+         case 'h':
+              usage();
+              free(vcf_out); free(ref); free(tmp_dir);
+              return 0;
+
+         case 'o':
+              if (0 != strcmp(optarg, "-")) {
+                   if (file_exists(optarg)) {
+                        LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                        free(ref); free(tmp_dir);
+                        return 1;
+                   }
+              }
+              vcf_out = strdup(optarg);
+              break;
+
+         case 'f':
+              ref = strdup(optarg);
+              break;
+
+         case 'm':
+              if ((max_mem = parse_mem(optarg)) < 1) {
+                   LOG_FATAL("Invalid memory size '%s'\n", optarg);
+                   free(vcf_out); free(ref); free(tmp_dir);
+                   return 1;
+              }
+              break;
+
+         case 'T':
+              tmp_dir = strdup(optarg);
+              break;
+
+         case '@':
+              num_threads = atoi(optarg);
+              if (num_threads < 1) {
+                   LOG_FATAL("%s\n", "Number of threads has to be at least 1");
+                   free(vcf_out); free(ref); free(tmp_dir);
+                   return 1;
+              }
+              break;
+
+         case '?':
+              LOG_FATAL("%s\n", "unrecognized arguments found. Exiting...\n");
+              free(vcf_out); free(ref); free(tmp_dir);
+              return 1;
+
+         default:
+              break;
+         }
+    }
+
+    if (optind+1 < argc) {
+         vcf_in = (const char **)argv + optind + 1;
+         num_vcf_in = argc - optind - 1;
+    } else {
+         static const char *vcf_stdin[] = {"-"};
+         vcf_in = vcf_stdin;
+         num_vcf_in = 1;
+    }
+    if (NULL == vcf_out) {
+         vcf_out = strdup("-");
+    }
+    if (NULL == tmp_dir) {
+         tmp_dir = strdup(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    }
+    if (ref && contigs_from_fai(& vs, ref)) {
+         free(vcf_out); free(ref); free(tmp_dir);
+         return 1;
+    }
+
+    if (thread_budget_init(num_threads)
+        || NULL == (jobs = thread_budget_queue_init())) {
+         thread_budget_destroy();
+         free(vcf_out); free(ref); free(tmp_dir);
+         contigs_free(& vs);
+         return 1;
+    }
+    /* one chunk is read while the workers sort theirs */
+    chunk_max = max_mem / (thread_budget_workers() + 1);
+    /* merge buffers (one per run plus the one for a temporary run)
+     * plus the runs' current lines count as well */
+    if (max_mem / (2*VCFSORT_RUN_BUF) - 1 > VCFSORT_MAX_FANIN) {
+         fan_in = VCFSORT_MAX_FANIN;
+    } else {
+         fan_in = (int)(max_mem / (2*VCFSORT_RUN_BUF) - 1);
+    }
+    if (fan_in < 2) {
+         fan_in = 2;
+    }
+    chunk = calloc(1, sizeof(chunk_t));
+
+    for (i=0; i<num_vcf_in && ! rc; i++) {
+         BGZF *fp;
+         int is_first_line = 1;
+
+         if (NULL == (fp = bgzf_open(vcf_in[i], "r"))) {
+              LOG_ERROR("Couldn't open %s\n", vcf_in[i]);
+              rc = 1;
+              break;
+         }
+         while (bgzf_getline(fp, '\n', & line) >= 0) {
+              sort_key_t k;
+
+              if (is_first_line && line.l >= 3 && 0 == strncmp(line.s, "BCF", 3)) {
+                   LOG_ERROR("%s is in BCF format, which is not supported\n", vcf_in[i]);
+                   rc = 1;
+                   break;
+              }
+              is_first_line = 0;
+              if (line.l && line.s[line.l-1] == '\r') {
+                   line.s[--line.l] = '\0';
+              }
+              if (0 == line.l) {
+                   continue;
+              }
+              if (line.s[0] == '#') {
+                   /* header of first input only */
+                   if (0 == i) {
+                        contigs_from_header_line(& vs, line.s);
+                        vs.header = realloc(vs.header, vs.header_len + line.l + 1);
+                        memcpy(vs.header + vs.header_len, line.s, line.l);
+                        vs.header[vs.header_len + line.l] = '\n';
+                        vs.header_len += line.l + 1;
+                   }
+                   continue;
+              }
+              if (parse_key(& vs, line.s, line.l, & k)) {
+                   LOG_ERROR("Malformed line in %s: %s\n", vcf_in[i], line.s);
+                   rc = 1;
+                   break;
+              }
+              chunk_add(chunk, & k, line.s);
+
+              if (chunk_mem(chunk) >= chunk_max) {
+                   /* hand over to a worker, waiting for the oldest
+                    * job to finish if all are busy (without workers
+                    * the job is done right away) */
+                   if (thread_budget_pending(jobs) >= thread_budget_workers()
+                       && (job = thread_budget_next_result(jobs))
+                       && (rc = sort_job_collect(job))) {
+                        break;
+                   }
+                   runs = realloc(runs, (num_runs+1) * sizeof(run_t *));
+                   runs[num_runs] = calloc(1, sizeof(run_t));
+                   num_runs++;
+                   if ((rc = sort_job_dispatch(jobs, chunk, runs[num_runs-1], tmp_dir))) {
+                        break;
+                   }
+                   chunk = calloc(1, sizeof(chunk_t));
+              }
+         }
+         bgzf_close(fp);
+    }
+    free(line.s);
+
+    /* collect runs still being sorted */
+    while (NULL != (job = thread_budget_next_result(jobs))) {
+         if (sort_job_collect(job)) {
+              rc = 1;
+         }
+    }
+    LOG_VERBOSE("Read %llu records. Using %d run(s)\n",
+                (unsigned long long)vs.num_recs, num_runs + (chunk->n ? 1 : 0));
+
+    if (0 == rc && vcf_file_open(& out, vcf_out, HAS_GZIP_EXT(vcf_out), 'w')) {
+         LOG_ERROR("Couldn't open %s\n", vcf_out);
+         rc = 1;
+    } else if (0 == rc) {
+         if (out.is_bgz) {
+              thread_budget_bgzf(out.fh_bgz);
+         }
+         if (vs.header_len && out_write(& out, vs.header, vs.header_len)) {
+              LOG_ERROR("%s\n", "Couldn't write output");
+              rc = 1;
+         }
+         if (0 == rc && 0 == num_runs) {
+              /* everything fit into memory */
+              size_t j;
+              chunk_sort(chunk);
+              for (j=0; j<chunk->n && 0 == rc; j++) {
+                   rc = out_write_rec(& out, & chunk->recs[j]);
+              }
+         } else if (0 == rc) {
+              /* last chunk becomes a run as well */
+              if (chunk->n) {
+                   runs = realloc(runs, (num_runs+1) * sizeof(run_t *));
+                   runs[num_runs] = calloc(1, sizeof(run_t));
+                   num_runs++;
+                   if (0 == (rc = sort_job_dispatch(jobs, chunk, runs[num_runs-1], tmp_dir))) {
+                        chunk = NULL;
+                        rc = sort_job_collect(thread_budget_next_result(jobs));
+                   }
+              }
+              if (0 == rc) {
+                   LOG_VERBOSE("Merging %d runs, at most %d at once\n", num_runs, fan_in);
+                   rc = merge_passes(& runs, & num_runs, fan_in, tmp_dir, & out);
+              }
+         }
+         if (vcf_file_close(& out)) {
+              LOG_ERROR("Couldn't close %s\n", vcf_out);
+              rc = 1;
+         }
+    }
+
+    for (i=0; i<num_runs; i++) {
+         run_free(runs[i]);
+    }
+    free(runs);
+    thread_budget_queue_destroy(jobs);
+    thread_budget_destroy();
+    chunk_free(chunk);
+    contigs_free(& vs);
+    free(vs.header);
+    free(vcf_out);
+    free(ref);
+    free(tmp_dir);
+    return rc;
+}
+/* main_vcfsort() */
@@ -0,0 +1,791 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+/* Call-set summary statistics as computed by lofreq2_vcfplot.py
+ * (ts_tv_ratio(), subst_perc(), calc_dist_left(), calc_dist_min() and
+ * the AF/DP/QUAL distributions), but in one streaming pass with fixed
+ * size histograms. Per variant values in input order (vcfplot's
+ * scatter plots) are kept as means of blocks of consecutive variants.
+ * Output is TSV (or JSON) for plotting.
+ */
+
+#include <stdio.h>
+#include <ctype.h>
+#include <float.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <math.h>
+
+/* lofreq includes */
+#include "lofreq_vcfstats.h"
+#include "vcf.h"
+#include "log.h"
+#include "utils.h"
+#include "defaults.h"
+
+
+#if 1
+#define MYNAME "lofreq vcfstats"
+#else
+#define MYNAME PACKAGE
+#endif
+
+#define HIST_NUM_BINS 100
+/* 2d histograms use every HIST2D_COARSEN bins of the 1d ones */
+#define HIST2D_COARSEN 5
+#define HIST2D_NUM_BINS (HIST_NUM_BINS/HIST2D_COARSEN)
+
+#define DEFAULT_DP_HIST_MAX 10000
+#define QUAL_HIST_MAX 2000
+/* distances are binned as log10 */
+#define DIST_HIST_MAX 10
+/* blocks of consecutive variants. block size doubles once all are
+ * used */
+#define SERIES_MAX_BLOCKS 1024
+
+typedef enum {
+     PROP_AF,
+     PROP_DP,
+     PROP_QUAL,
+     PROP_DIST_LEFT,
+     PROP_DIST_MIN,
+     NUM_PROPS
+} prop_t;
+
+static const char *prop_names[NUM_PROPS] = {
+     "AF", "DP", "QUAL", "dist_left_log10", "dist_min_log10"
+};
+
+/* combinations of props for 2d histograms (as the heatmaps in
+ * lofreq2_vcfplot.py) */
+static const prop_t hist2d_props[][2] = {
+     {PROP_AF, PROP_DP},
+     {PROP_AF, PROP_DIST_LEFT},
+     {PROP_DP, PROP_DIST_LEFT},
+};
+#define NUM_HIST2D (sizeof(hist2d_props)/sizeof(hist2d_props[0]))
+
+/* strand collapsed substitution types as in
+ * lofreq2_vcfplot.py:subst_type_str() */
+#define NUM_SUBST_TYPES 6
+static const char *subst_type_names[NUM_SUBST_TYPES] = {
+     "A>C|T>G", "A>G|T>C", "A>T|T>A", "C>A|G>T", "C>G|G>C", "C>T|G>A"
+};
+
+
+typedef struct {
+     double lo, hi;
+     long int bins[HIST_NUM_BINS];
+     long int below, above; /* outside [lo, hi) */
+     long int missing;
+     long int n; /* excl. missing */
+     double sum, min, max;
+} hist_t;
+
+typedef struct {
+     long int bins[HIST2D_NUM_BINS][HIST2D_NUM_BINS];
+} hist2d_t;
+
+/* props of variants in input order, averaged over blocks of
+ * block_size variants */
+typedef struct {
+     long int block_size;
+     int num_blocks; /* incl. the one being filled */
+     long int num_vars[SERIES_MAX_BLOCKS];
+     long int n[NUM_PROPS][SERIES_MAX_BLOCKS]; /* excl. missing */
+     double sum[NUM_PROPS][SERIES_MAX_BLOCKS];
+} series_t;
+
+typedef struct {
+     long int num_vars_in;
+     long int num_ign_filtered;
+     long int num_ign_type;
+     long int num_ign_maxdp;
+     long int num_vars;
+     long int num_consvars;
+     long int num_ts;
+     long int num_tv;
+     long int subst_counts[NUM_SUBST_TYPES];
+     hist_t hist[NUM_PROPS];
+     hist2d_t hist2d[NUM_HIST2D];
+     series_t series;
+} vcfstats_t;
+
+/* per chromosome sweep state for distance computation. for
+ * dist_min we need to wait for the next variant before we can report
+ * the previous one. this holds props of the previous variant until
+ * then */
+typedef struct {
+     char *chrom;
+     long int pos;
+     long int left_dist; /* LONG_MAX if first on chrom */
+     double prop_vals[NUM_PROPS];
+     int have_prev;
+     int unsorted_warning_printed;
+} dist_sweep_t;
+
+
+
+static void
+usage()
+{
+     fprintf(stderr, "%s: Compute summary statistics for variants in VCF file\n\n", MYNAME);
+     fprintf(stderr, "Usage: %s [options] -i input.vcf\n", MYNAME);
+
+     fprintf(stderr,"Options:\n");
+     fprintf(stderr, "  -i | --vcf FILE     VCF input file (- for stdin; gzip supported). Needs to be sorted\n");
+     fprintf(stderr, "  -o | --out FILE     Output file (default: - for stdout)\n");
+     fprintf(stderr, "       --json         Output JSON instead of TSV\n");
+     fprintf(stderr, "       --ign-filter   Use all, not just passed variants\n");
+     fprintf(stderr, "       --indels       Work on indels only and ignore substitutions (default is the reverse)\n");
+     fprintf(stderr, "       --maxdp INT    Ignore variants with DP above this value\n");
+     fprintf(stderr, "       --verbose      Be verbose\n");
+     fprintf(stderr, "       --debug        Enable debugging\n");
+}
+/* usage() */
+
+
+static void
+hist_init(hist_t *h, double lo, double hi)
+{
+     memset(h, 0, sizeof(hist_t));
+     h->lo = lo;
+     h->hi = hi;
+     h->min = DBL_MAX;
+     h->max = -DBL_MAX;
+}
+
+
+/* returns bin index or -1 if below or HIST_NUM_BINS if above range */
+static int
+hist_bin(const hist_t *h, double val)
+{
+     int bin;
+     if (val < h->lo) {
+          return -1;
+     }
+     bin = (int)((val - h->lo) / (h->hi - h->lo) * HIST_NUM_BINS);
+     return MIN(bin, HIST_NUM_BINS);
+}
+
+
+static void
+hist_add(hist_t *h, double val)
+{
+     int bin;
+
+     if (isnan(val)) {
+          h->missing += 1;
+          return;
+     }
+     h->n += 1;
+     h->sum += val;
+     h->min = MIN(h->min, val);
+     h->max = MAX(h->max, val);
+
+     bin = hist_bin(h, val);
+     if (bin < 0) {
+          h->below += 1;
+     } else if (bin >= HIST_NUM_BINS) {
+          h->above += 1;
+     } else {
+          h->bins[bin] += 1;
+     }
+}
+
+
+static double
+hist_bin_lo(const hist_t *h, int bin)
+{
+     return h->lo + bin * (h->hi - h->lo) / HIST_NUM_BINS;
+}
+
+
+/* values outside range are clamped to first or last bin. missing
+ * values are ignored */
+static void
+hist2d_add(hist2d_t *h2, const hist_t *hx, const hist_t *hy,
+           double x, double y)
+{
+     int bx, by;
+     if (isnan(x) || isnan(y)) {
+          return;
+     }
+     bx = MIN(MAX(hist_bin(hx, x), 0), HIST_NUM_BINS-1) / HIST2D_COARSEN;
+     by = MIN(MAX(hist_bin(hy, y), 0), HIST_NUM_BINS-1) / HIST2D_COARSEN;
+     h2->bins[bx][by] += 1;
+}
+
+
+static void
+series_add(series_t *s, const double *vals)
+{
+     int b, i;
+
+     if (0 == s->num_blocks) {
+          s->block_size = 1;
+          s->num_blocks = 1;
+     }
+     b = s->num_blocks-1;
+     if (s->num_vars[b] == s->block_size) {
+          if (s->num_blocks == SERIES_MAX_BLOCKS) {
+               /* merge neighbouring blocks */
+               for (b=0; b<SERIES_MAX_BLOCKS/2; b++) {
+                    s->num_vars[b] = s->num_vars[2*b] + s->num_vars[2*b+1];
+                    for (i=0; i<NUM_PROPS; i++) {
+                         s->n[i][b] = s->n[i][2*b] + s->n[i][2*b+1];
+                         s->sum[i][b] = s->sum[i][2*b] + s->sum[i][2*b+1];
+                    }
+               }
+               s->num_blocks = SERIES_MAX_BLOCKS/2;
+               s->block_size *= 2;
+          }
+          b = s->num_blocks++;
+          s->num_vars[b] = 0;
+          for (i=0; i<NUM_PROPS; i++) {
+               s->n[i][b] = 0;
+               s->sum[i][b] = 0.0;
+          }
+     }
+     s->num_vars[b] += 1;
+     for (i=0; i<NUM_PROPS; i++) {
+          if (! isnan(vals[i])) {
+               s->n[i][b] += 1;
+               s->sum[i][b] += vals[i];
+          }
+     }
+}
+
+
+static double
+dist_to_log10(long int dist)
+{
+     /* same as lofreq2_vcfplot.py: first on chrom (-1) and
+      * multi-allelic (0) can't be logged */
+     if (dist <= 0) {
+          return NAN;
+     }
+     return log10(dist);
+}
+
+
+/* adds the props of one variant to all histograms */
+static void
+stats_add_props(vcfstats_t *stats, double *vals)
+{
+     int i;
+     for (i=0; i<NUM_PROPS; i++) {
+          hist_add(& stats->hist[i], vals[i]);
+     }
+     for (i=0; i<NUM_HIST2D; i++) {
+          prop_t px = hist2d_props[i][0];
+          prop_t py = hist2d_props[i][1];
+          hist2d_add(& stats->hist2d[i], & stats->hist[px], & stats->hist[py],
+                     vals[px], vals[py]);
+     }
+     series_add(& stats->series, vals);
+}
+
+
+/* reports the pending variant (if any) with the given right hand
+ * distance (LONG_MAX if there is none) */
+static void
+dist_sweep_flush(vcfstats_t *stats, dist_sweep_t *sweep, long int right_dist)
+{
+     long int min_dist;
+
+     if (! sweep->have_prev) {
+          return;
+     }
+     min_dist = MIN(sweep->left_dist, right_dist);
+     if (LONG_MAX == min_dist) {
+          /* single variant on chrom */
+          min_dist = -1;
+     }
+     sweep->prop_vals[PROP_DIST_MIN] = dist_to_log10(min_dist);
+     stats_add_props(stats, sweep->prop_vals);
+     sweep->have_prev = 0;
+}
+
+
+static void
+stats_add_var(vcfstats_t *stats, dist_sweep_t *sweep, const var_t *var,
+              double af, double dp)
+{
+     long int left_dist = LONG_MAX;
+     double vals[NUM_PROPS];
+
+     if (sweep->chrom && 0 == strcmp(sweep->chrom, var->chrom)) {
+          if (var->pos < sweep->pos && ! sweep->unsorted_warning_printed) {
+               LOG_WARN("%s\n", "Variants don't seem to be sorted. Distances will be wrong");
+               sweep->unsorted_warning_printed = 1;
+          }
+          left_dist = var->pos - sweep->pos;
+          dist_sweep_flush(stats, sweep, left_dist);
+     } else {
+          dist_sweep_flush(stats, sweep, LONG_MAX);
+          free(sweep->chrom);
+          sweep->chrom = strdup(var->chrom);
+     }
+
+     vals[PROP_AF] = af;
+     vals[PROP_DP] = dp;
+     vals[PROP_QUAL] = var->qual < 0 ? NAN : var->qual;
+     vals[PROP_DIST_LEFT] = dist_to_log10(LONG_MAX == left_dist ? -1 : left_dist);
+     vals[PROP_DIST_MIN] = NAN; /* set on flush */
+
+     memcpy(sweep->prop_vals, vals, sizeof(vals));
+     sweep->pos = var->pos;
+     sweep->left_dist = left_dist;
+     sweep->have_prev = 1;
+}
+
+
+/* substitution type index (see subst_type_names) or -1 if not ACGT.
+ * sets *is_ts */
+static int
+subst_type(char ref, char alt, int *is_ts)
+{
+     const char *bases = "ACGT";
+     const char *r, *a;
+     int ri, ai;
+
+     if (NULL == (r = strchr(bases, toupper(ref))) || ! ref
+         || NULL == (a = strchr(bases, toupper(alt))) || ! alt) {
+          return -1;
+     }
+     ri = r - bases;
+     ai = a - bases;
+     if (ri == ai) {
+          return -1;
+     }
+     /* A<->G and C<->T are transitions */
+     *is_ts = (ri + 2 == ai || ai + 2 == ri);
+
+     /* collapse to A or C as ref by complementing */
+     if (ri >= 2) {
+          ri = 3 - ri;
+          ai = 3 - ai;
+     }
+     /* index into subst_type_names: A>C A>G A>T C>A C>G C>T */
+     if (0 == ri) {
+          return ai - 1;
+     } else {
+          return 3 + (ai == 0 ? 0 : ai - 1);
+     }
+}
+
+
+static double
+info_val(const var_t *var, const char *key)
+{
+     char *val_char = NULL;
+     double val;
+
+     if (! vcf_var_has_info_key(&val_char, var, key) || ! val_char) {
+          return NAN;
+     }
+     val = strtod(val_char, (char **)NULL);
+     free(val_char);
+     return val;
+}
+
+
+static void
+write_tsv(FILE *fh, const vcfstats_t *stats)
+{
+     int i, j, k;
+
+     fprintf(fh, "# count\tname\tvalue\n");
+     fprintf(fh, "count\tnum_vars_in\t%ld\n", stats->num_vars_in);
+     fprintf(fh, "count\tnum_ign_filtered\t%ld\n", stats->num_ign_filtered);
+     fprintf(fh, "count\tnum_ign_type\t%ld\n", stats->num_ign_type);
+     fprintf(fh, "count\tnum_ign_maxdp\t%ld\n", stats->num_ign_maxdp);
+     fprintf(fh, "count\tnum_vars\t%ld\n", stats->num_vars);
+     fprintf(fh, "count\tnum_consvars\t%ld\n", stats->num_consvars);
+     fprintf(fh, "count\tnum_ts\t%ld\n", stats->num_ts);
+     fprintf(fh, "count\tnum_tv\t%ld\n", stats->num_tv);
+     if (stats->num_tv) {
+          fprintf(fh, "ratio\tts_tv\t%f\n", stats->num_ts/(double)stats->num_tv);
+     } else {
+          fprintf(fh, "ratio\tts_tv\tNA\n");
+     }
+
+     fprintf(fh, "# subst\ttype\tcount\n");
+     for (i=0; i<NUM_SUBST_TYPES; i++) {
+          fprintf(fh, "subst\t%s\t%ld\n", subst_type_names[i], stats->subst_counts[i]);
+     }
+
+     fprintf(fh, "# summary\tprop\tn\tmissing\tmin\tmax\tmean\n");
+     for (i=0; i<NUM_PROPS; i++) {
+          const hist_t *h = & stats->hist[i];
+          if (h->n) {
+               fprintf(fh, "summary\t%s\t%ld\t%ld\t%f\t%f\t%f\n", prop_names[i],
+                       h->n, h->missing, h->min, h->max, h->sum/h->n);
+          } else {
+               fprintf(fh, "summary\t%s\t0\t%ld\tNA\tNA\tNA\n", prop_names[i], h->missing);
+          }
+     }
+
+     fprintf(fh, "# hist\tprop\trange-min\trange-max\tcount\n");
+     for (i=0; i<NUM_PROPS; i++) {
+          const hist_t *h = & stats->hist[i];
+          fprintf(fh, "hist\t%s\t-inf\t%f\t%ld\n", prop_names[i], h->lo, h->below);
+          for (j=0; j<HIST_NUM_BINS; j++) {
+               fprintf(fh, "hist\t%s\t%f\t%f\t%ld\n", prop_names[i],
+                       hist_bin_lo(h, j), hist_bin_lo(h, j+1), h->bins[j]);
+          }
+          fprintf(fh, "hist\t%s\t%f\tinf\t%ld\n", prop_names[i], h->hi, h->above);
+     }
+
+     fprintf(fh, "# hist2d\tprop-x:prop-y\tx-range-min\tx-range-max\ty-range-min\ty-range-max\tcount\n");
+     for (i=0; i<NUM_HIST2D; i++) {
+          const hist_t *hx = & stats->hist[hist2d_props[i][0]];
+          const hist_t *hy = & stats->hist[hist2d_props[i][1]];
+          for (j=0; j<HIST2D_NUM_BINS; j++) {
+               for (k=0; k<HIST2D_NUM_BINS; k++) {
+                    fprintf(fh, "hist2d\t%s:%s\t%f\t%f\t%f\t%f\t%ld\n",
+                            prop_names[hist2d_props[i][0]], prop_names[hist2d_props[i][1]],
+                            hist_bin_lo(hx, j*HIST2D_COARSEN), hist_bin_lo(hx, (j+1)*HIST2D_COARSEN),
+                            hist_bin_lo(hy, k*HIST2D_COARSEN), hist_bin_lo(hy, (k+1)*HIST2D_COARSEN),
+                            stats->hist2d[i].bins[j][k]);
+               }
+          }
+     }
+
+     fprintf(fh, "# series\tprop\tfirst-var\tnum-vars\tmean\n");
+     for (i=0; i<NUM_PROPS; i++) {
+          const series_t *sr = & stats->series;
+          long int first = 0;
+          for (j=0; j<sr->num_blocks; j++) {
+               if (sr->n[i][j]) {
+                    fprintf(fh, "series\t%s\t%ld\t%ld\t%f\n", prop_names[i], first,
+                            sr->num_vars[j], sr->sum[i][j]/sr->n[i][j]);
+               } else {
+                    fprintf(fh, "series\t%s\t%ld\t%ld\tNA\n", prop_names[i], first,
+                            sr->num_vars[j]);
+               }
+               first += sr->num_vars[j];
+          }
+     }
+}
+/* write_tsv() */
+
+
+static void
+write_json(FILE *fh, const vcfstats_t *stats)
+{
+     int i, j, k;
+
+     fprintf(fh, "{\n");
+     fprintf(fh, "  \"counts\": {\"num_vars_in\": %ld, \"num_ign_filtered\": %ld, \"num_ign_type\": %ld, "
+             "\"num_ign_maxdp\": %ld, \"num_vars\": %ld, \"num_consvars\": %ld, \"num_ts\": %ld, \"num_tv\": %ld},\n",
+             stats->num_vars_in, stats->num_ign_filtered, stats->num_ign_type,
+             stats->num_ign_maxdp, stats->num_vars, stats->num_consvars,
+             stats->num_ts, stats->num_tv);
+     if (stats->num_tv) {
+          fprintf(fh, "  \"ts_tv_ratio\": %f,\n", stats->num_ts/(double)stats->num_tv);
+     } else {
+          fprintf(fh, "  \"ts_tv_ratio\": null,\n");
+     }
+
+     fprintf(fh, "  \"subst\": {");
+     for (i=0; i<NUM_SUBST_TYPES; i++) {
+          fprintf(fh, "%s\"%s\": %ld", i ? ", " : "", subst_type_names[i], stats->subst_counts[i]);
+     }
+     fprintf(fh, "},\n");
+
+     fprintf(fh, "  \"props\": {\n");
+     for (i=0; i<NUM_PROPS; i++) {
+          const hist_t *h = & stats->hist[i];
+          fprintf(fh, "    \"%s\": {\"n\": %ld, \"missing\": %ld, ", prop_names[i], h->n, h->missing);
+          if (h->n) {
+               fprintf(fh, "\"min\": %f, \"max\": %f, \"mean\": %f, ", h->min, h->max, h->sum/h->n);
+          } else {
+               fprintf(fh, "\"min\": null, \"max\": null, \"mean\": null, ");
+          }
+          fprintf(fh, "\"range_min\": %f, \"range_max\": %f, \"below\": %ld, \"above\": %ld, \"bins\": [",
+                  h->lo, h->hi, h->below, h->above);
+          for (j=0; j<HIST_NUM_BINS; j++) {
+               fprintf(fh, "%s%ld", j ? ", " : "", h->bins[j]);
+          }
+          fprintf(fh, "]}%s\n", i < NUM_PROPS-1 ? "," : "");
+     }
+     fprintf(fh, "  },\n");
+
+     fprintf(fh, "  \"hist2d\": {\n");
+     for (i=0; i<NUM_HIST2D; i++) {
+          fprintf(fh, "    \"%s:%s\": [", prop_names[hist2d_props[i][0]], prop_names[hist2d_props[i][1]]);
+          for (j=0; j<HIST2D_NUM_BINS; j++) {
+               fprintf(fh, "%s[", j ? ", " : "");
+               for (k=0; k<HIST2D_NUM_BINS; k++) {
+                    fprintf(fh, "%s%ld", k ? ", " : "", stats->hist2d[i].bins[j][k]);
+               }
+               fprintf(fh, "]");
+          }
+          fprintf(fh, "]%s\n", i < NUM_HIST2D-1 ? "," : "");
+     }
+     fprintf(fh, "  },\n");
+
+     fprintf(fh, "  \"series\": {\"block_size\": %ld, \"num_vars\": [", stats->series.block_size);
+     for (j=0; j<stats->series.num_blocks; j++) {
+          fprintf(fh, "%s%ld", j ? ", " : "", stats->series.num_vars[j]);
+     }
+     fprintf(fh, "]");
+     for (i=0; i<NUM_PROPS; i++) {
+          const series_t *sr = & stats->series;
+          fprintf(fh, ",\n    \"%s\": [", prop_names[i]);
+          for (j=0; j<sr->num_blocks; j++) {
+               if (sr->n[i][j]) {
+                    fprintf(fh, "%s%f", j ? ", " : "", sr->sum[i][j]/sr->n[i][j]);
+               } else {
+                    fprintf(fh, "%snull", j ? ", " : "");
+               }
+          }
+          fprintf(fh, "]");
+     }
+     fprintf(fh, "}\n");
+     fprintf(fh, "}\n");
+}
+/* write_json() */
+
+
+int
+main_vcfstats(int argc, char *argv[])
+{
+     char *vcf_in = NULL, *out = NULL;
+     static int ign_filter = 0;
+     static int indels_only = 0;
+     static int json = 0;
+     int maxdp = -1;
+     vcf_file_t vcf_file;
+     FILE *out_fh = stdout;
+     vcfstats_t *stats;
+     dist_sweep_t sweep;
+     int i;
+
+    /* keep in sync with long_opts_str and usage
+     *
+     * getopt is a pain in the whole when it comes to syncing of long
+     * and short args and usage. check out gopt, libcfu...
+     */
+    while (1) {
+         int c;
+         static struct option long_opts[] = {
+              /* see usage sync */
+              {"help", no_argument, NULL, 'h'},
+              {"verbose", no_argument, &verbose, 1},
+              {"debug", no_argument, &debug, 1},
+              {"ign-filter", no_argument, &ign_filter, 1},
+              {"indels", no_argument, &indels_only, 1},
+              {"json", no_argument, &json, 1},
+
+              {"vcf", required_argument, NULL, 'i'},
+              {"out", required_argument, NULL, 'o'},
+              {"maxdp", required_argument, NULL, 'D'},
+
+              {0, 0, 0, 0} /* sentinel */
+         };
+
+         /* keep in sync with long_opts and usage */
+         static const char *long_opts_str = "hi:o:";
+
+         /* getopt_long stores the option index here. */
+         int long_opts_index = 0;
+         c = getopt_long(argc-1, argv+1, /* skipping 'lofreq', just leaving 'command', i.e. call */
+                         long_opts_str, long_opts, & long_opts_index);
+         if (c == -1) {
+              break;
+         }
+
+         switch (c) {
+         /* keep in sync with long_opts etc */
+         case 'h':
+              usage();
+              free(vcf_in); free(out);
+              return 0;
+
+         case 'i':
+              vcf_in = strdup(optarg);
+              break;
+
+         case 'o':
+              if (0 != strcmp(optarg, "-")) {
+                   if (file_exists(optarg)) {
+                        LOG_FATAL("Cowardly refusing to overwrite file '%s'. Exiting...\n", optarg);
+                        free(vcf_in);
+                        return 1;
+                   }
+              }
+              out = strdup(optarg);
+              break;
+
+         case 'D':
+              if (! isdigit(optarg[0])) {
+                   LOG_FATAL("Non-numeric argument provided: %s\n", optarg);
+                   return 1;
+              }
+              maxdp = atoi(optarg);
+              break;
+
+         case '?':
+              LOG_FATAL("%s\n", "Unrecognized argument found. Exiting...\n");
+              return 1;
+
+         default:
+              break;
+         }
+    }
+
+    if (argc == 2) {
+        fprintf(stderr, "\n");
+        usage();
+        return 1;
+    }
+    if (0 != argc - optind - 1) {
+         LOG_FATAL("%s\n", "Unrecognized argument found. Exiting...\n");
+         return 1;
+    }
+    if (! vcf_in) {
+         LOG_FATAL("%s\n", "Input VCF missing");
+         return 1;
+    }
+
+    if (vcf_file_open(& vcf_file, vcf_in, HAS_GZIP_EXT(vcf_in), 'r')) {
+         LOG_ERROR("Couldn't open %s\n", vcf_in);
+         free(vcf_in); free(out);
+         return 1;
+    }
+    if (vcf_skip_header(& vcf_file)) {
+         LOG_WARN("%s\n", "vcf_skip_header() failed");
+         free(vcf_in); free(out);
+         return 1;
+    }
+    if (out && 0 != strcmp(out, "-")) {
+         if (NULL == (out_fh = fopen(out, "w"))) {
+              LOG_ERROR("Couldn't open %s for writing\n", out);
+              free(vcf_in); free(out);
+              return 1;
+         }
+    }
+
+    if (NULL == (stats = calloc(1, sizeof(vcfstats_t)))) {
+         LOG_FATAL("%s\n", "memory allocation failed");
+         return 1;
+    }
+    memset(&sweep, 0, sizeof(dist_sweep_t));
+    hist_init(& stats->hist[PROP_AF], 0.0, 1.0);
+    hist_init(& stats->hist[PROP_DP], 0.0, maxdp > 0 ? maxdp : DEFAULT_DP_HIST_MAX);
+    hist_init(& stats->hist[PROP_QUAL], 0.0, QUAL_HIST_MAX);
+    hist_init(& stats->hist[PROP_DIST_LEFT], 0.0, DIST_HIST_MAX);
+    hist_init(& stats->hist[PROP_DIST_MIN], 0.0, DIST_HIST_MAX);
+
+    while (1) {
+         var_t *var;
+         double af, dp;
+         int is_indel;
+
+         vcf_new_var(&var);
+         if (vcf_parse_var(& vcf_file, var)) {
+              vcf_free_var(&var);
+              break;
+         }
+         stats->num_vars_in += 1;
+
+         if (! ign_filter && ! VCF_VAR_PASSES(var)) {
+              stats->num_ign_filtered += 1;
+              vcf_free_var(&var);
+              continue;
+         }
+         is_indel = vcf_var_is_indel(var);
+         if ((indels_only && ! is_indel) || (! indels_only && is_indel)) {
+              stats->num_ign_type += 1;
+              vcf_free_var(&var);
+              continue;
+         }
+         dp = info_val(var, "DP");
+         if (maxdp > 0 && ! isnan(dp) && dp > maxdp) {
+              stats->num_ign_maxdp += 1;
+              vcf_free_var(&var);
+              continue;
+         }
+         af = info_val(var, "AF");
+
+         stats->num_vars += 1;
+         if (vcf_var_has_info_key(NULL, var, "CONSVAR")) {
+              stats->num_consvars += 1;
+         }
+         if (! is_indel && 1 == strlen(var->ref) && 1 == strlen(var->alt)) {
+              int is_ts = 0;
+              int t = subst_type(var->ref[0], var->alt[0], &is_ts);
+              if (t >= 0) {
+                   stats->subst_counts[t] += 1;
+                   if (is_ts) {
+                        stats->num_ts += 1;
+                   } else {
+                        stats->num_tv += 1;
+                   }
+              }
+         }
+         stats_add_var(stats, &sweep, var, af, dp);
+
+         vcf_free_var(&var);
+    }
+    dist_sweep_flush(stats, &sweep, LONG_MAX);
+    free(sweep.chrom);
+    vcf_file_close(& vcf_file);
+
+    LOG_VERBOSE("Parsed %ld variants of which %ld were used\n",
+                stats->num_vars_in, stats->num_vars);
+    for (i=0; i<NUM_PROPS; i++) {
+         LOG_DEBUG("%s: n=%ld missing=%ld below=%ld above=%ld\n", prop_names[i],
+                   stats->hist[i].n, stats->hist[i].missing,
+                   stats->hist[i].below, stats->hist[i].above);
+    }
+
+    if (json) {
+         write_json(out_fh, stats);
+    } else {
+         write_tsv(out_fh, stats);
+    }
+    if (out_fh != stdout) {
+         fclose(out_fh);
+    }
+
+    free(stats);
+    free(vcf_in);
+    free(out);
+
+    LOG_VERBOSE("%s\n", "Successful exit.");
+    return 0;
+}
+/* main_vcfstats() */
@@ -38,13 +38,12 @@
 #include "log.h"
 #include "lofreq_viterbi.h"
 #include "utils.h"
+#include "samutils.h"
 
 #define SANGERQUAL_TO_PHRED(c) ((int)(c)-33)
 
 /* FIXME: implement auto clipping of Q2 tails */
 
-#define RWIN 10
-
 typedef struct {
      samFile *in;
      samFile *out;
@@ -104,17 +103,16 @@ void remain(char *bqual, int *remaining){
      }   
 }
 
-static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip)
+int viterbi_realign(bam1_t *b, const char *refseq, int reflen,
+                    const char *chrom, int del_flag, int q2def, int reclip)
 {
      /* see
       https://github.com/lh3/bwa/blob/426e54740ca2b9b08e013f28560d01a570a0ab15/ksw.c
       for optimizations and speedups
      */
-     tmpstruct_t *tmp = (tmpstruct_t*)data;
      bam1_core_t *c = &b->core;
      uint8_t *seq = bam_get_seq(b);
      uint32_t *cigar = bam_get_cigar(b);
-     int reflen;
     
      if (del_flag) {
           uint8_t *old_nm;
@@ -145,23 +143,9 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
           }
      }
 
-     if (c->flag & BAM_FUNMAP) {
-          sam_write1(tmp->out, tmp->header, b);
+     if (c->flag & BAM_FUNMAP || ! refseq) {
           return 0;
      }
-
-     /* fetch reference sequence if incorrect tid */
-     if (tmp->tid != c->tid) {
-          if (tmp->ref) free(tmp->ref);
-          if ((tmp->ref = 
-               fai_fetch(tmp->fai, tmp->header->target_name[c->tid], &reflen)) == 0) {
-               fprintf(stderr, "failed to find reference sequence %s\n", 
-                                tmp->header->target_name[c->tid]);
-          }
-          strtoupper(tmp->ref);/* safeguard */
-          tmp->tid = c->tid;
-          tmp->reflen = reflen;
-     }
      int i;
 
      // remove soft clipped bases
@@ -188,7 +172,6 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
           } else if (op == BAM_CHARD_CLIP) {
                /* in theory we should do nothing here but hard clipping info gets lost here FIXME
                 */               
-               sam_write1(tmp->out, tmp->header, b);
                return 1;
           } else if (op == BAM_CDEL) {
                x += oplen;
@@ -207,14 +190,12 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
                }
           } else {
                LOG_WARN("Unknown cigar op %d. Not touching read %s\n", op, bam_get_qname(b));
-               sam_write1(tmp->out, tmp->header, b);
                return 1;
           }
      }
      query[z] = bqual[z] = '\0';
 
      if (indels == 0) {
-          sam_write1(tmp->out, tmp->header, b);
           return 0;
      }
     int len_remaining = 0;
@@ -237,7 +218,6 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
 			
 			replace_cigar(b,c->n_cigar,cigar);
 		}
-        sam_write1(tmp->out, tmp->header, b);
         return 0;
     }
     int remaining[len_remaining+1];
@@ -247,14 +227,14 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
         q2def = int_median(remaining, len_remaining);
     }
     
-     /* get reference with RWIN padding */
-     char ref[c->l_qseq+1+indels+RWIN*2];
-     int lower = c->pos - RWIN;
+     /* get reference with VITERBI_RWIN padding */
+     char ref[c->l_qseq+1+indels+VITERBI_RWIN*2];
+     int lower = c->pos - VITERBI_RWIN;
      lower = lower < 0? 0: lower;
-     int upper = x + RWIN;
-     upper = upper > tmp->reflen? tmp->reflen: upper;
+     int upper = x + VITERBI_RWIN;
+     upper = upper > reflen? reflen: upper;
      for (z = 0, i = lower; i < upper; z++, i++) {
-          ref[z] = tmp->ref[i];
+          ref[z] = refseq[i];
      }
      ref[z] = '\0';
 
@@ -316,7 +296,7 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
      if (shift-(c->pos-lower) != 0) {
           LOG_VERBOSE("Read %s with shift of %d at original pos %s:%d\n", 
                       bam_get_qname(b), shift-(c->pos-lower),
-                      tmp->header->target_name[c->tid], c->pos);
+                      chrom, c->pos);
           c->pos = c->pos + (shift - (c->pos - lower));
      }
      
@@ -338,12 +318,36 @@ static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip
 		}
 	}
      replace_cigar(b, realn_n_cigar, realn_cigar);
-     sam_write1(tmp->out, tmp->header, b);
      free(aln);
      free(realn_cigar);
      return 0;
 }
 
+static int fetch_func(bam1_t *b, void *data, int del_flag, int q2def, int reclip)
+{
+     tmpstruct_t *tmp = (tmpstruct_t*)data;
+     bam1_core_t *c = &b->core;
+     int reflen, rc;
+
+     /* fetch reference sequence if incorrect tid */
+     if (! (c->flag & BAM_FUNMAP) && tmp->tid != c->tid) {
+          if (tmp->ref) free(tmp->ref);
+          if ((tmp->ref = 
+               fai_fetch(tmp->fai, tmp->header->target_name[c->tid], &reflen)) == 0) {
+               fprintf(stderr, "failed to find reference sequence %s\n", 
+                                tmp->header->target_name[c->tid]);
+          }
+          strtoupper(tmp->ref);/* safeguard */
+          tmp->tid = c->tid;
+          tmp->reflen = reflen;
+     }
+     rc = viterbi_realign(b, tmp->ref, tmp->reflen,
+                          c->tid >= 0 ? tmp->header->target_name[c->tid] : NULL,
+                          del_flag, q2def, reclip);
+     sam_write1(tmp->out, tmp->header, b);
+     return rc;
+}
+
 static void usage()
 {
      fprintf(stderr, "Usage: lofreq viterbi [options] in.bam\n");
@@ -453,6 +457,13 @@ int main_viterbi(int argc, char *argv[])
           LOG_FATAL("Failed to read headers from BAM file %s. Exiting...\n", (argv+optind+1)[0]);
           return 1;
      }
+     /* realignment shifts reads, so sorted input doesn't give sorted
+      * output. don't claim otherwise, or downstream tools indexing on
+      * the fly (e.g. indelqual) fail on the first misplaced read */
+     if (sam_hdr_is_coord_sorted(tmp.header)
+         && sam_hdr_update_hd(tmp.header, "SO", "unsorted") < 0) {
+          LOG_WARN("%s\n", "Couldn't mark output header as unsorted");
+     }
 
      if (!bam_out || bam_out[0] == '-') {
           tmp.out = sam_open("-", "wb");
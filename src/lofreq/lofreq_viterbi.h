@@ -29,7 +29,21 @@
 #ifndef LOFREQ_VITERBI_FILE
 #define LOFREQ_VITERBI_FILE
 
+#include "htslib/sam.h"
+
+/* reference padding used for realignment. realigned reads can start
+ * at most this many positions before their original start */
+#define VITERBI_RWIN 10
+
 /* funcion prototypes here */
 int main_viterbi(int argc, char *argv[]);
 
+/* realigns b in place. refseq (upper case) of length reflen is the
+ * whole sequence b is aligned to and chrom its name. unmapped reads
+ * and reads without indels are left untouched (apart from deleting
+ * tags if del_flag is set). returns 1 if b was skipped because of
+ * unsupported cigar operations, 0 otherwise */
+int viterbi_realign(bam1_t *b, const char *refseq, int reflen,
+                    const char *chrom, int del_flag, int q2def, int reclip);
+
 #endif
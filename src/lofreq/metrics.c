@@ -0,0 +1,336 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Live metrics snapshots. See metrics.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "metrics.h"
+
+
+#define METRICS_MAX_LABELS 4
+
+
+typedef struct {
+     char *name;
+     char *help;
+     int type;
+     double value;
+     double last_value; /* value at last snapshot (for rates) */
+} metric_t;
+
+
+struct metrics {
+     char *fn;
+     char *tmp_fn;
+     char *prefix;
+     int is_json;
+     int interval;
+     time_t start;
+     time_t last;
+     int done;
+     metric_t *metrics;
+     int num_metrics;
+     char *label_keys[METRICS_MAX_LABELS];
+     char *label_values[METRICS_MAX_LABELS];
+     int num_labels;
+};
+
+
+/* resident set size in bytes or -1 if unknown */
+static long int
+rss_bytes(void)
+{
+     long int size, resident = -1;
+     FILE *fh = fopen("/proc/self/statm", "r");
+
+     if (! fh) {
+          return -1;
+     }
+     if (2 != fscanf(fh, "%ld %ld", &size, &resident)) {
+          resident = -1;
+     }
+     fclose(fh);
+     return resident < 0 ? -1 : resident * sysconf(_SC_PAGESIZE);
+}
+
+
+/* escapes the few characters that are special in both, prometheus
+ * label values and json strings */
+static void
+fputs_escaped(const char *s, FILE *fh)
+{
+     for (; *s; s++) {
+          if (*s == '"' || *s == '\\') {
+               fputc('\\', fh);
+               fputc(*s, fh);
+          } else if (*s == '\n') {
+               fputs("\\n", fh);
+          } else {
+               fputc(*s, fh);
+          }
+     }
+}
+
+
+static void
+prom_labels(const metrics_t *m, FILE *fh)
+{
+     int i;
+
+     if (! m->num_labels) {
+          return;
+     }
+     fputc('{', fh);
+     for (i=0; i<m->num_labels; i++) {
+          fprintf(fh, "%s%s=\"", i ? "," : "", m->label_keys[i]);
+          fputs_escaped(m->label_values[i], fh);
+          fputc('"', fh);
+     }
+     fputc('}', fh);
+}
+
+
+static void
+prom_write(const metrics_t *m, FILE *fh, const char *name, const char *help,
+           const char *type, double value)
+{
+     fprintf(fh, "# HELP %s_%s %s\n", m->prefix, name, help);
+     fprintf(fh, "# TYPE %s_%s %s\n", m->prefix, name, type);
+     fprintf(fh, "%s_%s", m->prefix, name);
+     prom_labels(m, fh);
+     fprintf(fh, " %.15g\n", value);
+}
+
+
+static void
+json_write(FILE *fh, const char *name, double value)
+{
+     fprintf(fh, ",\n  \"%s\": %.15g", name, value);
+}
+
+
+static int
+metrics_write(metrics_t *m, time_t now)
+{
+     FILE *fh;
+     double secs = difftime(now, m->last);
+     long int rss = rss_bytes();
+     char buf[1024];
+     int i;
+
+     if (NULL == (fh = fopen(m->tmp_fn, "w"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", m->tmp_fn);
+          return -1;
+     }
+
+     if (m->is_json) {
+          fprintf(fh, "{\n  \"timestamp\": %ld", (long int)now);
+          for (i=0; i<m->num_labels; i++) {
+               fprintf(fh, ",\n  \"%s\": \"", m->label_keys[i]);
+               fputs_escaped(m->label_values[i], fh);
+               fputc('"', fh);
+          }
+     }
+
+     for (i=0; i<m->num_metrics; i++) {
+          metric_t *x = &m->metrics[i];
+          double rate = secs > 0 ? (x->value - x->last_value) / secs : 0.0;
+          if (m->is_json) {
+               json_write(fh, x->name, x->value);
+          } else {
+               prom_write(m, fh, x->name, x->help,
+                          x->type == METRICS_COUNTER ? "counter" : "gauge", x->value);
+          }
+          if (x->type == METRICS_COUNTER) {
+               snprintf(buf, sizeof(buf), "%s_per_second", x->name);
+               if (m->is_json) {
+                    json_write(fh, buf, rate);
+               } else {
+                    char help[1024];
+                    snprintf(help, sizeof(help), "%s (rate over last snapshot interval)", x->help);
+                    prom_write(m, fh, buf, help, "gauge", rate);
+               }
+          }
+          x->last_value = x->value;
+     }
+
+     if (m->is_json) {
+          json_write(fh, "rss_bytes", rss);
+          json_write(fh, "uptime_seconds", difftime(now, m->start));
+          json_write(fh, "done", m->done);
+          fprintf(fh, "\n}\n");
+     } else {
+          prom_write(m, fh, "rss_bytes", "Resident set size in bytes", "gauge", rss);
+          prom_write(m, fh, "uptime_seconds", "Seconds since start", "gauge", difftime(now, m->start));
+          prom_write(m, fh, "done", "1 if the job has finished", "gauge", m->done);
+     }
+
+     if (fclose(fh)) {
+          LOG_ERROR("Couldn't write to %s\n", m->tmp_fn);
+          return -1;
+     }
+     if (rename(m->tmp_fn, m->fn)) {
+          LOG_ERROR("Couldn't rename %s to %s\n", m->tmp_fn, m->fn);
+          return -1;
+     }
+     m->last = now;
+     return 0;
+}
+/* metrics_write() */
+
+
+static void
+metrics_free(metrics_t *m)
+{
+     int i;
+
+     for (i=0; i<m->num_metrics; i++) {
+          free(m->metrics[i].name);
+          free(m->metrics[i].help);
+     }
+     free(m->metrics);
+     for (i=0; i<m->num_labels; i++) {
+          free(m->label_keys[i]);
+          free(m->label_values[i]);
+     }
+     free(m->fn);
+     free(m->tmp_fn);
+     free(m->prefix);
+     free(m);
+}
+
+
+metrics_t *
+metrics_open(const char *fn, const char *prefix, int interval_sec)
+{
+     metrics_t *m = calloc(1, sizeof(metrics_t));
+     size_t len = strlen(fn);
+
+     m->fn = strdup(fn);
+     /* same directory, so that rename() is atomic */
+     m->tmp_fn = malloc(len + 5);
+     sprintf(m->tmp_fn, "%s.tmp", fn);
+     m->prefix = strdup(prefix);
+     m->is_json = (len >= 5 && 0 == strcmp(fn + len - 5, ".json"));
+     m->interval = interval_sec;
+     m->start = m->last = time(NULL);
+
+     /* fail early instead of hours into the run */
+     if (metrics_write(m, m->start)) {
+          metrics_free(m);
+          return NULL;
+     }
+     return m;
+}
+/* metrics_open() */
+
+
+int
+metrics_register(metrics_t *m, const char *name, const char *help, int type)
+{
+     metric_t *x;
+
+     m->metrics = realloc(m->metrics, (m->num_metrics+1) * sizeof(metric_t));
+     x = &m->metrics[m->num_metrics];
+     x->name = strdup(name);
+     x->help = strdup(help);
+     x->type = type;
+     x->value = x->last_value = 0.0;
+     return m->num_metrics++;
+}
+/* metrics_register() */
+
+
+void
+metrics_set_label(metrics_t *m, const char *key, const char *value)
+{
+     int i;
+
+     for (i=0; i<m->num_labels; i++) {
+          if (0 == strcmp(m->label_keys[i], key)) {
+               free(m->label_values[i]);
+               m->label_values[i] = strdup(value);
+               return;
+          }
+     }
+     if (m->num_labels == METRICS_MAX_LABELS) {
+          LOG_WARN("Too many metrics labels. Ignoring %s\n", key);
+          return;
+     }
+     m->label_keys[m->num_labels] = strdup(key);
+     m->label_values[m->num_labels] = strdup(value);
+     m->num_labels++;
+}
+/* metrics_set_label() */
+
+
+void
+metrics_set(metrics_t *m, int id, double value)
+{
+     m->metrics[id].value = value;
+}
+
+
+void
+metrics_add(metrics_t *m, int id, double value)
+{
+     m->metrics[id].value += value;
+}
+
+
+int
+metrics_tick(metrics_t *m)
+{
+     time_t now = time(NULL);
+
+     if (difftime(now, m->last) < m->interval) {
+          return 0;
+     }
+     return metrics_write(m, now);
+}
+/* metrics_tick() */
+
+
+void
+metrics_close(metrics_t *m)
+{
+     if (! m) {
+          return;
+     }
+     m->done = 1;
+     (void) metrics_write(m, time(NULL));
+     metrics_free(m);
+}
+/* metrics_close() */
@@ -0,0 +1,84 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef METRICS_H
+#define METRICS_H
+
+
+/* Live metrics snapshots for monitoring long running jobs.
+ *
+ * Metrics are registered once and then updated cheaply in the inner
+ * loops. metrics_tick() rewrites the snapshot file whenever the
+ * configured interval has passed. Files are written to a temporary
+ * file first and then renamed, so that readers (e.g. node_exporter's
+ * textfile collector) never see partial snapshots. The format is JSON
+ * if the file name ends in ".json" and Prometheus' text format
+ * otherwise. Each snapshot also lists the resident set size, the
+ * uptime and, for each counter, its rate over the last interval.
+ */
+
+#define METRICS_GAUGE   0
+#define METRICS_COUNTER 1
+
+#define METRICS_DEFAULT_INTERVAL 5 /* seconds */
+
+typedef struct metrics metrics_t;
+
+/* prefix is prepended to all metric names, e.g. "lofreq_call".
+ * returns NULL on error */
+metrics_t *
+metrics_open(const char *fn, const char *prefix, int interval_sec);
+
+/* name must be a valid Prometheus metric name. returns the metric's
+ * handle or -1 on error */
+int
+metrics_register(metrics_t *m, const char *name, const char *help, int type);
+
+/* label attached to all metrics, e.g. the current chromosome.
+ * setting an existing key overwrites its value */
+void
+metrics_set_label(metrics_t *m, const char *key, const char *value);
+
+void
+metrics_set(metrics_t *m, int id, double value);
+
+void
+metrics_add(metrics_t *m, int id, double value);
+
+/* writes a snapshot if the interval has passed since the last one.
+ * returns non-zero on write error */
+int
+metrics_tick(metrics_t *m);
+
+/* writes a final snapshot (with done set to 1) and frees m. m may be
+ * NULL */
+void
+metrics_close(metrics_t *m);
+
+#endif
@@ -0,0 +1,947 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "log.h"
+#include "utils.h"
+#include "snpcaller.h"
+#include "metrics.h"
+#include "pbin_owner.h"
+
+#ifdef USE_FPGA
+#include "fpga.h"
+#endif
+
+#define MYNAME "lofreq pbin-owner"
+
+/* set by owner once shared memory is fully initialized */
+#define PBIN_MAGIC 0x6e69627071666c00ULL
+
+/* slot states */
+#define PBIN_SLOT_FREE 0 /* not claimed by any client */
+#define PBIN_SLOT_IDLE 1 /* claimed but no job */
+#define PBIN_SLOT_SUBMITTED 2 /* job waiting for owner */
+#define PBIN_SLOT_DONE 3 /* result written by owner */
+
+/* seconds between checks whether the other side is still alive */
+#define PBIN_POLL_SEC 1
+
+
+typedef struct {
+     int state;
+     pid_t client_pid; /* claiming client, 0 if none (yet) */
+     int N;
+     int K;
+     long long int bonf_factor;
+     double sig_level;
+     int accept_counts[PBIN_MAX_ACCEPT];
+     int num_accept_counts;
+     int is_bound;
+     int status; /* non-zero if job failed */
+     sem_t done; /* posted by owner once job is done */
+     double in[PBIN_MAX_N];
+     double out[PBIN_MAX_K+1];
+} pbin_slot_t;
+
+typedef struct {
+     unsigned long long magic;
+     pid_t owner_pid;
+     int num_slots;
+     sem_t pending; /* posted by clients once per submitted job */
+} pbin_shm_hdr_t;
+
+struct pbin_client {
+     void *shm;
+     size_t shm_size;
+     int fd;
+     pid_t owner_pid;
+     pbin_slot_t *slot;
+     int owner_gone;
+};
+
+
+pbin_client_t *pbin_client = NULL;
+
+static volatile sig_atomic_t owner_stop = 0;
+
+
+static size_t
+shm_size(int num_slots)
+{
+     /* keep slots aligned */
+     size_t hdr_size = (sizeof(pbin_shm_hdr_t) + 63) & ~((size_t)63);
+     return hdr_size + (size_t)num_slots * sizeof(pbin_slot_t);
+}
+
+
+static pbin_slot_t *
+shm_slot(void *shm, int i)
+{
+     size_t hdr_size = (sizeof(pbin_shm_hdr_t) + 63) & ~((size_t)63);
+     return (pbin_slot_t *)((char *)shm + hdr_size + (size_t)i * sizeof(pbin_slot_t));
+}
+
+
+/* the owner holds a write lock on the shared memory object for as
+ * long as it lives. unlike kill(pid, 0) this also works if it's a
+ * zombie */
+static int
+owner_alive(int fd)
+{
+     struct flock fl;
+     memset(&fl, 0, sizeof(fl));
+     fl.l_type = F_WRLCK;
+     fl.l_whence = SEEK_SET;
+     if (fcntl(fd, F_GETLK, &fl)) {
+          return 0;
+     }
+     return fl.l_type != F_UNLCK;
+}
+
+
+/* sem_wait() with timeout that retries on interrupts. returns 0 on
+ * success, 1 on timeout, -1 on error */
+static int
+sem_wait_sec(sem_t *sem, int sec)
+{
+     struct timespec ts;
+     if (clock_gettime(CLOCK_REALTIME, &ts)) {
+          return -1;
+     }
+     ts.tv_sec += sec;
+     while (sem_timedwait(sem, &ts)) {
+          if (errno == EINTR) {
+               if (owner_stop) {
+                    return 1;
+               }
+               continue;
+          }
+          return errno == ETIMEDOUT ? 1 : -1;
+     }
+     return 0;
+}
+
+
+
+/* --- client ------------------------------------------------------ */
+
+
+/* takes over a slot whose client died without detaching. slots with a
+ * job still in the works are left alone: the owner finishes it and the
+ * slot can be taken next time. returns the slot's index or -1 */
+static int
+reclaim_slot(void *shm, int num_slots)
+{
+     pid_t me = getpid();
+     int i;
+
+     for (i=0; i<num_slots; i++) {
+          pbin_slot_t *slot = shm_slot(shm, i);
+          pid_t pid = __atomic_load_n(&slot->client_pid, __ATOMIC_ACQUIRE);
+          int state = __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE);
+
+          if (pid <= 0 || pid == me
+              || (state != PBIN_SLOT_IDLE && state != PBIN_SLOT_DONE)) {
+               continue;
+          }
+          if (0 == kill(pid, 0) || errno != ESRCH) {
+               continue;
+          }
+          /* the pid is the token: only one client can take it over */
+          if (! __atomic_compare_exchange_n(&slot->client_pid, &pid, me,
+                                            0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+               continue;
+          }
+          /* drop the unclaimed result of a finished job */
+          while (0 == sem_trywait(&slot->done)) {
+               ;
+          }
+          __atomic_store_n(&slot->state, PBIN_SLOT_IDLE, __ATOMIC_RELEASE);
+          LOG_VERBOSE("Took over slot %d of dead client (pid %d)\n", i, (int)pid);
+          return i;
+     }
+     return -1;
+}
+
+
+pbin_client_t *
+pbin_client_attach(const char *name, int timeout_sec)
+{
+     pbin_client_t *c = NULL;
+     pbin_shm_hdr_t *hdr = NULL;
+     int fd = -1;
+     int waited;
+     int i;
+
+     /* owner might still be starting up, e.g. loading the device
+      * binary */
+     for (waited=0; waited<=timeout_sec; waited+=PBIN_POLL_SEC) {
+          struct stat st;
+
+          if (fd < 0 && (fd = shm_open(name, O_RDWR, 0)) < 0) {
+               if (errno != ENOENT) {
+                    LOG_ERROR("Couldn't open shared memory object %s: %s\n",
+                              name, strerror(errno));
+                    return NULL;
+               }
+          } else if (0 == fstat(fd, &st) && st.st_size >= (off_t)sizeof(pbin_shm_hdr_t)) {
+               hdr = mmap(NULL, sizeof(pbin_shm_hdr_t), PROT_READ,
+                          MAP_SHARED, fd, 0);
+               if (MAP_FAILED == hdr) {
+                    LOG_ERROR("mmap failed: %s\n", strerror(errno));
+                    close(fd);
+                    return NULL;
+               }
+               if (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) == PBIN_MAGIC) {
+                    break;
+               }
+               munmap(hdr, sizeof(pbin_shm_hdr_t));
+               hdr = NULL;
+          }
+          sleep(PBIN_POLL_SEC);
+     }
+     if (NULL == hdr) {
+          LOG_ERROR("Timeout while waiting for pbin-owner %s\n", name);
+          if (fd >= 0) {
+               close(fd);
+          }
+          return NULL;
+     }
+
+     if (NULL == (c = calloc(1, sizeof(pbin_client_t)))) {
+          LOG_FATAL("%s\n", "Memory allocation failed");
+          munmap(hdr, sizeof(pbin_shm_hdr_t));
+          close(fd);
+          return NULL;
+     }
+     c->fd = fd;
+     c->owner_pid = hdr->owner_pid;
+     c->shm_size = shm_size(hdr->num_slots);
+     munmap(hdr, sizeof(pbin_shm_hdr_t));
+
+     c->shm = mmap(NULL, c->shm_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED, fd, 0);
+     if (MAP_FAILED == c->shm) {
+          LOG_ERROR("mmap failed: %s\n", strerror(errno));
+          close(fd);
+          free(c);
+          return NULL;
+     }
+
+     hdr = (pbin_shm_hdr_t *)c->shm;
+     for (i=0; i<hdr->num_slots; i++) {
+          int expected = PBIN_SLOT_FREE;
+          pbin_slot_t *slot = shm_slot(c->shm, i);
+          if (__atomic_compare_exchange_n(&slot->state, &expected, PBIN_SLOT_IDLE,
+                                          0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+               __atomic_store_n(&slot->client_pid, getpid(), __ATOMIC_RELEASE);
+               c->slot = slot;
+               break;
+          }
+     }
+     if (NULL == c->slot && (i = reclaim_slot(c->shm, hdr->num_slots)) >= 0) {
+          c->slot = shm_slot(c->shm, i);
+     }
+     if (NULL == c->slot) {
+          LOG_ERROR("All %d slots of pbin-owner %s are in use\n", hdr->num_slots, name);
+          munmap(c->shm, c->shm_size);
+          close(c->fd);
+          free(c);
+          return NULL;
+     }
+     LOG_VERBOSE("Attached to slot %d of pbin-owner %s (pid %d)\n",
+                 i, name, (int)c->owner_pid);
+     return c;
+}
+/* pbin_client_attach() */
+
+
+void
+pbin_client_detach(pbin_client_t *c)
+{
+     if (NULL == c) {
+          return;
+     }
+     if (! c->owner_gone) {
+          __atomic_store_n(&c->slot->client_pid, 0, __ATOMIC_RELEASE);
+          __atomic_store_n(&c->slot->state, PBIN_SLOT_FREE, __ATOMIC_RELEASE);
+     }
+     munmap(c->shm, c->shm_size);
+     close(c->fd);
+     free(c);
+}
+/* pbin_client_detach() */
+
+
+double *
+pbin_client_calc_prob_dist(pbin_client_t *c,
+                           const double *err_probs, int N, int K,
+                           long long int bonf_factor, double sig_level,
+                           const int *accept_counts, int num_accept_counts,
+                           int *is_bound)
+{
+     pbin_shm_hdr_t *hdr = (pbin_shm_hdr_t *)c->shm;
+     pbin_slot_t *slot = c->slot;
+     double *probvec;
+     int rc;
+
+     if (c->owner_gone || N > PBIN_MAX_N || K > PBIN_MAX_K
+         || num_accept_counts > PBIN_MAX_ACCEPT) {
+          return NULL;
+     }
+
+     memcpy(slot->in, err_probs, N * sizeof(double));
+     slot->N = N;
+     slot->K = K;
+     slot->bonf_factor = bonf_factor;
+     slot->sig_level = sig_level;
+     slot->num_accept_counts = accept_counts ? num_accept_counts : 0;
+     if (slot->num_accept_counts) {
+          memcpy(slot->accept_counts, accept_counts, num_accept_counts * sizeof(int));
+     }
+     slot->is_bound = 0;
+     slot->status = 0;
+     __atomic_store_n(&slot->state, PBIN_SLOT_SUBMITTED, __ATOMIC_RELEASE);
+     sem_post(&hdr->pending);
+
+     while (1 == (rc = sem_wait_sec(&slot->done, PBIN_POLL_SEC))) {
+          if (! owner_alive(c->fd)) {
+               break;
+          }
+     }
+     if (rc || PBIN_SLOT_DONE != __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)) {
+          LOG_WARN("pbin-owner (pid %d) is gone. Computing locally from now on\n",
+                   (int)c->owner_pid);
+          c->owner_gone = 1;
+          return NULL;
+     }
+
+     probvec = NULL;
+     if (0 == slot->status) {
+          if (NULL == (probvec = malloc((K+1) * sizeof(double)))) {
+               LOG_FATAL("%s\n", "Memory allocation failed");
+          } else {
+               memcpy(probvec, slot->out, (K+1) * sizeof(double));
+               if (is_bound) {
+                    *is_bound = slot->is_bound;
+               }
+          }
+     }
+     __atomic_store_n(&slot->state, PBIN_SLOT_IDLE, __ATOMIC_RELEASE);
+     return probvec;
+}
+/* pbin_client_calc_prob_dist() */
+
+
+
+/* --- owner backends ---------------------------------------------- */
+
+
+static void
+cpu_run_job(pbin_slot_t *job)
+{
+     double *probvec;
+     int is_bound = 0;
+
+     probvec = pruned_calc_prob_dist(job->in, job->N, job->K,
+                                     job->bonf_factor, job->sig_level,
+                                     job->num_accept_counts ? job->accept_counts : NULL,
+                                     job->num_accept_counts, &is_bound);
+     if (NULL == probvec) {
+          job->status = 1;
+          return;
+     }
+     memcpy(job->out, probvec, (job->K+1) * sizeof(double));
+     job->is_bound = is_bound;
+     free(probvec);
+}
+
+
+#ifdef USE_FPGA
+
+/* OpenCL objects. owned by this process only */
+static cl_device_id devices;
+static cl_context context;
+static cl_program program;
+static cl_command_queue cmd_queue;
+static cl_kernel kernel1;
+static unsigned char *kernelBinary;
+
+/* The name of the kernel function */
+static char *krnl_func = "krnl";
+
+
+/* Helper function to initialize OpenCL platforms and devices.
+ * Adapted from the Xilinx Vitis doc:
+ * https://docs.xilinx.com/r/2021.1-English/ug1393-vitis-application-acceleration/OpenCL-Host-Application
+ * */
+static int
+get_xilinx_device(cl_device_id * devices, cl_uint *num_devices)
+{
+     cl_uint num_entries = MAX_DEVICE_ENTIRES;
+     cl_uint platform_count;
+
+     cl_platform_id platforms[MAX_DEVICE_ENTIRES];
+     char cl_platform_vendor[NAME_LENGTH];
+
+     cl_int err;
+
+     // Set up the OpenCL platform.
+     err = clGetPlatformIDs(num_entries, platforms, &platform_count);
+     if (err != CL_SUCCESS) {
+          LOG_ERROR("%s\n", "clGetPlatformIDs failed");
+          return -1;
+     }
+
+     // Looking for the Xilinx Platform
+     for (unsigned int iplat=0; iplat < platform_count; iplat++) {
+          err = clGetPlatformInfo(platforms[iplat],
+          CL_PLATFORM_VENDOR, PLATFORM_PARAM_SIZE,
+          cl_platform_vendor, NULL);
+
+          if (err != CL_SUCCESS) {
+               LOG_ERROR("%s\n", "clGetPlatformInfo failed");
+               return -1;
+          }
+
+          if (strcmp(cl_platform_vendor, "Xilinx") == 0) {
+               LOG_VERBOSE("%d %s platform(s) found\n",
+                    platform_count, cl_platform_vendor);
+
+               err = clGetDeviceIDs(platforms[iplat],
+                    CL_DEVICE_TYPE_ACCELERATOR, MAX_DEVICE_ENTIRES,
+                    devices, num_devices);
+               if (err != CL_SUCCESS) {
+                    LOG_ERROR("%s\n", "clGetDeviceIDs failed");
+                    return -1;
+               }
+               LOG_VERBOSE("Found %d device(s)\n", *num_devices);
+               return 0;
+          }
+     }
+     LOG_ERROR("%s\n", "Failed to find Xilinx devices");
+     return -1;
+}
+
+
+/* the one and only OpenCL initialization, which used to be done by
+ * each call process */
+static int
+fpga_init(const char *xclbin)
+{
+     char cl_device_name[NAME_LENGTH];
+     cl_int err = CL_SUCCESS;
+     cl_int status = CL_SUCCESS;
+     cl_uint num_devices = 0;
+     size_t size_var;
+     int size;
+
+     if (get_xilinx_device(&devices, &num_devices)) {
+          return -1;
+     }
+     err = clGetDeviceInfo(devices, CL_DEVICE_NAME,
+          PLATFORM_PARAM_SIZE, cl_device_name, 0);
+     if (err != CL_SUCCESS) {
+          LOG_ERROR("%s\n", "clGetDeviceInfo failed");
+          return -1;
+     }
+     LOG_VERBOSE("Device: %s\n", cl_device_name);
+
+     context = clCreateContext(0, num_devices, &devices, NULL, NULL, &err);
+     if (err != CL_SUCCESS) {
+          LOG_ERROR("%s\n", "clCreateContext failed");
+          return -1;
+     }
+
+     // Load the XCLBIN.
+     size = ae_load_file_to_memory(xclbin, (char **) &kernelBinary);
+     if (size < 0) {
+          LOG_ERROR("Loading binary %s failed\n", xclbin);
+          return -1;
+     }
+     LOG_VERBOSE("XCLBIN %s loaded\n", xclbin);
+
+     // Create an OpenCL Program from the loaded XCLBIN.
+     size_var = size;
+     program = clCreateProgramWithBinary(context, num_devices,
+          &devices, &size_var,(const unsigned char **) &kernelBinary, &status, &err);
+     if (status != CL_SUCCESS || err != CL_SUCCESS) {
+          LOG_ERROR("%s\n", "clCreateProgramWithBinary failed");
+          return -1;
+     }
+
+     // Set up an OpenCL Command Queue. Out of order, so that the jobs
+     // of one batch can run on several compute units concurrently
+     cmd_queue = clCreateCommandQueue(context, devices,
+          CL_QUEUE_PROFILING_ENABLE | CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE, &err);
+     if (err != CL_SUCCESS) {
+          LOG_ERROR("%s\n", "clCreateCommandQueue failed");
+          return -1;
+     }
+
+     kernel1 = clCreateKernel(program, krnl_func, &err);
+     if (err != CL_SUCCESS) {
+          LOG_ERROR("%s\n", "clCreateKernel failed");
+          return -1;
+     }
+     return 0;
+}
+
+
+static void
+fpga_free(void)
+{
+     clReleaseCommandQueue(cmd_queue);
+     clReleaseContext(context);
+     clReleaseDevice(devices);
+     clReleaseKernel(kernel1);
+     clReleaseProgram(program);
+     free(kernelBinary);
+}
+
+
+/* enqueues all jobs of the batch before waiting for any of them */
+static void
+fpga_run_batch(pbin_slot_t **jobs, int num_jobs)
+{
+     cl_mem *in_bufs = calloc(num_jobs, sizeof(cl_mem));
+     cl_mem *out_bufs = calloc(num_jobs, sizeof(cl_mem));
+     double **out_hosts = calloc(num_jobs, sizeof(double *));
+     cl_event *d2h_events = calloc(num_jobs, sizeof(cl_event));
+     int *enqueued = calloc(num_jobs, sizeof(int));
+     int num_events = 0;
+     int j;
+#if PROFILING
+     struct timespec kernel_s, kernel_t;
+     clock_gettime(CLOCK_REALTIME, &kernel_s);
+#endif
+
+     if (! in_bufs || ! out_bufs || ! out_hosts || ! d2h_events || ! enqueued) {
+          LOG_FATAL("%s\n", "Memory allocation failed");
+          for (j=0; j<num_jobs; j++) {
+               jobs[j]->status = 1;
+          }
+          goto free_and_exit;
+     }
+
+     for (j=0; j<num_jobs; j++) {
+          pbin_slot_t *job = jobs[j];
+          cl_mem_ext_ptr_t in_buffer_ext = {0};
+          cl_mem_ext_ptr_t out_buffer_ext = {0};
+          cl_event host_2_device;
+          cl_event exec_event;
+          cl_int err = CL_SUCCESS;
+          double *in_host;
+          /* By default, each compute unit connects to DDR bank 1. */
+          int bank_id = 1;
+
+          if (job->K > MAX_BUFFER_SIZE) {
+               continue;
+          }
+#if USE_MANY_COMPUTE_UNITS
+          /* Each memory port can connect at most 15 CUs. If the
+           * design contains more than 15 CUs, some need to connect
+           * to DDR bank 3 instead of 1. Alternate within the batch. */
+          if (j % 2 == 0) {
+               bank_id = 3;
+          }
+#endif
+          in_buffer_ext.banks = bank_id | XCL_MEM_TOPOLOGY;
+          out_buffer_ext.banks = bank_id | XCL_MEM_TOPOLOGY;
+          in_buffer_ext.flags = bank_id | XCL_MEM_TOPOLOGY;
+          out_buffer_ext.flags = bank_id | XCL_MEM_TOPOLOGY;
+
+          in_bufs[j] = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX,
+                                      sizeof(double) * job->N, &in_buffer_ext, &err);
+          out_bufs[j] = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_EXT_PTR_XILINX,
+                                       sizeof(double) * (job->K+1), &out_buffer_ext, &err);
+          if (err != CL_SUCCESS) {
+               LOG_ERROR("%s\n", "clCreateBuffer failed");
+               continue;
+          }
+
+          err |= clSetKernelArg(kernel1, 0, sizeof(cl_mem), &in_bufs[j]);
+          err |= clSetKernelArg(kernel1, 1, sizeof(int), &job->N);
+          err |= clSetKernelArg(kernel1, 2, sizeof(int), &job->K);
+          err |= clSetKernelArg(kernel1, 3, sizeof(cl_mem), &out_bufs[j]);
+          if (err != CL_SUCCESS) {
+               LOG_ERROR("%s\n", "clSetKernelArg failed");
+               continue;
+          }
+
+          in_host = (double *) clEnqueueMapBuffer(cmd_queue, in_bufs[j],
+               CL_TRUE, CL_MAP_WRITE, 0, sizeof(double) * job->N, 0, NULL, NULL, &err);
+          out_hosts[j] = (double *) clEnqueueMapBuffer(cmd_queue, out_bufs[j],
+               CL_TRUE, CL_MAP_READ, 0, sizeof(double) * (job->K+1), 0, NULL, NULL, &err);
+          if (err != CL_SUCCESS) {
+               LOG_ERROR("%s\n", "clEnqueueMapBuffer failed");
+               continue;
+          }
+          memcpy(in_host, job->in, sizeof(double) * job->N);
+
+          err = clEnqueueMigrateMemObjects(cmd_queue, 1, &in_bufs[j], 0, 0, NULL,
+                                           &host_2_device);
+          err |= clEnqueueTask(cmd_queue, kernel1, 1, &host_2_device, &exec_event);
+          err |= clEnqueueMigrateMemObjects(cmd_queue, 1, &out_bufs[j],
+                                            CL_MIGRATE_MEM_OBJECT_HOST, 1, &exec_event,
+                                            &d2h_events[num_events]);
+          clReleaseEvent(host_2_device);
+          clReleaseEvent(exec_event);
+          if (err != CL_SUCCESS) {
+               LOG_ERROR("%s\n", "Enqueuing kernel failed");
+               continue;
+          }
+          num_events++;
+          enqueued[j] = 1;
+     }
+
+     /* Synchronization point: wait until all results are ready */
+     if (num_events) {
+          clWaitForEvents(num_events, d2h_events);
+     }
+#if PROFILING
+     clock_gettime(CLOCK_REALTIME, &kernel_t);
+     LOG_NOTE("krnl batch of %d: %g\n", num_events,
+              (kernel_t.tv_sec - kernel_s.tv_sec) + (kernel_t.tv_nsec - kernel_s.tv_nsec)*1e-9);
+#endif
+
+     for (j=0; j<num_jobs; j++) {
+          if (enqueued[j]) {
+               memcpy(jobs[j]->out, out_hosts[j], sizeof(double) * (jobs[j]->K+1));
+               jobs[j]->is_bound = 0;
+          } else {
+               /* too large for the device or device errors */
+               cpu_run_job(jobs[j]);
+          }
+     }
+
+free_and_exit:
+     for (j=0; j<num_events; j++) {
+          clReleaseEvent(d2h_events[j]);
+     }
+     for (j=0; in_bufs && j<num_jobs; j++) {
+          if (in_bufs[j]) {
+               clReleaseMemObject(in_bufs[j]);
+          }
+          if (out_bufs[j]) {
+               clReleaseMemObject(out_bufs[j]);
+          }
+     }
+     free(in_bufs);
+     free(out_bufs);
+     free(out_hosts);
+     free(d2h_events);
+     free(enqueued);
+}
+
+#endif
+
+
+
+/* --- owner ------------------------------------------------------- */
+
+
+static void
+owner_sig_handler(int sig)
+{
+     owner_stop = 1;
+}
+
+
+static void
+usage()
+{
+     fprintf(stderr, "%s: Serve Poisson-binomial jobs of several 'lofreq call' processes\n\n", MYNAME);
+     fprintf(stderr, "Used internally by call-parallel. Runs until terminated (SIGTERM).\n\n");
+     fprintf(stderr, "Usage: %s [options] -n /name\n", MYNAME);
+
+     fprintf(stderr,"Options:\n");
+     fprintf(stderr, "  -n | --name NAME    Name of shared memory object to create\n");
+     fprintf(stderr, "  -s | --slots INT    Maximum number of attached call processes (default: 1)\n");
+#ifdef USE_FPGA
+     fprintf(stderr, "  -x | --xclbin FILE  FPGA binary (default: krnl.xclbin)\n");
+#endif
+     fprintf(stderr, "       --cpu          Compute on CPU (always the case without FPGA support)\n");
+     fprintf(stderr, "       --metrics-file FILE  Rewrite a snapshot of job metrics (jobs, batches, queue depth) to this file\n"
+                     "                      every %d seconds (JSON if ending in .json, Prometheus text format otherwise)\n", METRICS_DEFAULT_INTERVAL);
+     fprintf(stderr, "       --verbose      Be verbose\n");
+     fprintf(stderr, "       --debug        Enable debugging\n");
+}
+/* usage() */
+
+
+int
+main_pbin_owner(int argc, char *argv[])
+{
+     char *name = NULL;
+     char *xclbin = NULL;
+     char *metrics_file = NULL;
+     metrics_t *metrics = NULL;
+     int metrics_jobs = -1, metrics_batches = -1, metrics_depth = -1;
+     static int use_cpu = 0;
+     int num_slots = 1;
+     int fd;
+     struct flock fl;
+     void *shm;
+     size_t size;
+     pbin_shm_hdr_t *hdr;
+     pbin_slot_t **batch;
+     pid_t parent_pid = getppid();
+     long int num_jobs = 0, num_batches = 0;
+     struct sigaction sa;
+     int i;
+     int rc = 0;
+
+    while (1) {
+         int c;
+         static struct option long_opts[] = {
+              /* see usage sync */
+              {"help", no_argument, NULL, 'h'},
+              {"verbose", no_argument, &verbose, 1},
+              {"debug", no_argument, &debug, 1},
+              {"cpu", no_argument, &use_cpu, 1},
+
+              {"name", required_argument, NULL, 'n'},
+              {"slots", required_argument, NULL, 's'},
+              {"xclbin", required_argument, NULL, 'x'},
+              {"metrics-file", required_argument, NULL, 'X'},
+
+              {0, 0, 0, 0} /* sentinel */
+         };
+
+         /* keep in sync with long_opts and usage */
+         static const char *long_opts_str = "hn:s:x:";
+
+         /* getopt_long stores the option index here. */
+         int long_opts_index = 0;
+         c = getopt_long(argc-1, argv+1, /* skipping 'lofreq', just leaving 'command', i.e. call */
+                         long_opts_str, long_opts, & long_opts_index);
+         if (c == -1) {
+              break;
+         }
+
+         switch (c) {
+         /* keep in sync with long_opts etc */
+         case 'h':
+              usage();
+              free(name); free(xclbin);
+              return 0;
+
+         case 'n':
+              name = strdup(optarg);
+              break;
+
+         case 's':
+              if (! isdigit(optarg[0])) {
+                   LOG_FATAL("Non-numeric argument provided: %s\n", optarg);
+                   return 1;
+              }
+              num_slots = atoi(optarg);
+              break;
+
+         case 'x':
+              xclbin = strdup(optarg);
+              break;
+
+         case 'X':
+              metrics_file = strdup(optarg);
+              break;
+
+         case '?':
+              LOG_FATAL("%s\n", "Unrecognized argument found. Exiting...\n");
+              return 1;
+
+         default:
+              break;
+         }
+    }
+
+    if (NULL == name || name[0] != '/' || num_slots < 1) {
+         usage();
+         free(name); free(xclbin);
+         return 1;
+    }
+#ifdef USE_FPGA
+    if (! use_cpu && fpga_init(xclbin ? xclbin : "krnl.xclbin")) {
+         LOG_FATAL("%s\n", "FPGA initialization failed");
+         free(name); free(xclbin);
+         return 1;
+    }
+#else
+    use_cpu = 1;
+    if (xclbin) {
+         LOG_WARN("%s\n", "Not compiled with FPGA support. Ignoring xclbin");
+    }
+#endif
+    free(xclbin);
+
+    size = shm_size(num_slots);
+    if ((fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600)) < 0) {
+         LOG_FATAL("Couldn't create shared memory object %s: %s\n", name, strerror(errno));
+         free(name);
+         return 1;
+    }
+    /* pages of unused slot capacity are never touched */
+    memset(&fl, 0, sizeof(fl));
+    fl.l_type = F_WRLCK;
+    fl.l_whence = SEEK_SET;
+    if (ftruncate(fd, size) || fcntl(fd, F_SETLK, &fl)
+        || MAP_FAILED == (shm = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0))) {
+         LOG_FATAL("Couldn't set up shared memory object %s: %s\n", name, strerror(errno));
+         close(fd);
+         shm_unlink(name);
+         free(name);
+         return 1;
+    }
+
+    hdr = (pbin_shm_hdr_t *)shm;
+    hdr->owner_pid = getpid();
+    hdr->num_slots = num_slots;
+    sem_init(&hdr->pending, 1, 0);
+    for (i=0; i<num_slots; i++) {
+         pbin_slot_t *slot = shm_slot(shm, i);
+         slot->state = PBIN_SLOT_FREE;
+         slot->client_pid = 0;
+         sem_init(&slot->done, 1, 0);
+    }
+    batch = malloc(num_slots * sizeof(pbin_slot_t *));
+
+    if (metrics_file) {
+         if (NULL == (metrics = metrics_open(metrics_file, "lofreq_pbin_owner",
+                                             METRICS_DEFAULT_INTERVAL))) {
+              LOG_WARN("Couldn't write metrics to %s. Continuing without\n", metrics_file);
+         } else {
+              metrics_jobs = metrics_register(metrics, "jobs", "Jobs served", METRICS_COUNTER);
+              metrics_batches = metrics_register(metrics, "batches", "Batches served", METRICS_COUNTER);
+              metrics_depth = metrics_register(metrics, "queue_depth",
+                                               "Jobs pending when the last batch was collected", METRICS_GAUGE);
+         }
+         free(metrics_file);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = owner_sig_handler;
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGHUP, &sa, NULL);
+
+    /* ready */
+    __atomic_store_n(&hdr->magic, PBIN_MAGIC, __ATOMIC_RELEASE);
+    LOG_VERBOSE("pbin-owner %s ready with %d slots (%s)\n", name, num_slots,
+                use_cpu ? "CPU" : "FPGA");
+
+    while (! owner_stop) {
+         int num_batch = 0;
+         int wrc = sem_wait_sec(&hdr->pending, PBIN_POLL_SEC);
+         if (metrics) {
+              if (wrc == 1) {
+                   metrics_set(metrics, metrics_depth, 0);
+              }
+              (void) metrics_tick(metrics);
+         }
+         if (wrc == 1) {
+              /* don't outlive call-parallel */
+              if (getppid() != parent_pid) {
+                   LOG_WARN("%s\n", "Parent process gone. Exiting");
+                   break;
+              }
+              continue;
+         } else if (wrc) {
+              LOG_FATAL("Waiting for jobs failed: %s\n", strerror(errno));
+              rc = 1;
+              break;
+         }
+         /* collect everything pending into one batch */
+         while (0 == sem_trywait(&hdr->pending)) {
+              ;
+         }
+         for (i=0; i<num_slots; i++) {
+              pbin_slot_t *slot = shm_slot(shm, i);
+              if (PBIN_SLOT_SUBMITTED == __atomic_load_n(&slot->state, __ATOMIC_ACQUIRE)) {
+                   batch[num_batch++] = slot;
+              }
+         }
+         if (! num_batch) {
+              continue; /* already served with an earlier batch */
+         }
+
+#ifdef USE_FPGA
+         if (! use_cpu) {
+              fpga_run_batch(batch, num_batch);
+         } else
+#endif
+         for (i=0; i<num_batch; i++) {
+              cpu_run_job(batch[i]);
+         }
+
+         for (i=0; i<num_batch; i++) {
+              __atomic_store_n(&batch[i]->state, PBIN_SLOT_DONE, __ATOMIC_RELEASE);
+              sem_post(&batch[i]->done);
+         }
+         num_jobs += num_batch;
+         num_batches++;
+         if (metrics) {
+              metrics_set(metrics, metrics_jobs, num_jobs);
+              metrics_set(metrics, metrics_batches, num_batches);
+              metrics_set(metrics, metrics_depth, num_batch);
+         }
+         LOG_DEBUG("Served batch of %d jobs\n", num_batch);
+    }
+
+    LOG_VERBOSE("pbin-owner %s served %ld jobs in %ld batches\n", name, num_jobs, num_batches);
+    metrics_close(metrics);
+#ifdef USE_FPGA
+    if (! use_cpu) {
+         fpga_free();
+    }
+#endif
+    /* clients still attached keep their mapping and notice that we're
+     * gone */
+    shm_unlink(name);
+    munmap(shm, size);
+    close(fd); /* releases lock */
+    free(batch);
+    free(name);
+    return rc;
+}
+/* main_pbin_owner() */
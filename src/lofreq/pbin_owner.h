@@ -0,0 +1,87 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef PBIN_OWNER_H
+#define PBIN_OWNER_H
+
+/* Poisson-binomial job server.
+ *
+ * A single owner process ('lofreq pbin-owner', started by
+ * call-parallel) holds the accelerator context and serves probability
+ * distribution jobs (see pruned_calc_prob_dist()) submitted by all
+ * 'lofreq call' shard processes. Jobs are passed through POSIX shared
+ * memory: each client attaches to one slot of its own, writes its
+ * error probabilities there and waits until the owner, which collects
+ * all pending slots into one batch, has written back the result.
+ *
+ * Without FPGA support (or with --cpu) the owner computes jobs on the
+ * CPU, which gives the same results as calling without owner.
+ */
+
+/* largest number of failures (K) a job may have. corresponds to
+ * the FPGA kernel's on-chip buffer size (MAX_BUFFER_SIZE in fpga.h) */
+#define PBIN_MAX_K 65536
+/* largest number of error probabilities (N) a job may have */
+#define PBIN_MAX_N (1<<20)
+/* largest number of accept counts passed down (see snpcaller()) */
+#define PBIN_MAX_ACCEPT 8
+/* seconds clients wait for the owner to come up (loading the FPGA
+ * binary can take a while) */
+#define PBIN_ATTACH_TIMEOUT 300
+
+
+typedef struct pbin_client pbin_client_t;
+
+/* client used by poissbin() if set. NULL means compute locally */
+extern pbin_client_t *pbin_client;
+
+/* attaches to the owner's shared memory object 'name' and claims a
+ * slot, taking over the one of a client that died without detaching
+ * if none is free. waits up to timeout_sec for the owner to become
+ * ready. returns NULL on error */
+pbin_client_t *
+pbin_client_attach(const char *name, int timeout_sec);
+
+void
+pbin_client_detach(pbin_client_t *c);
+
+/* same semantics as pruned_calc_prob_dist(). returns NULL if the job
+ * can't be served by the owner (too large or owner gone), in which
+ * case the caller has to compute it locally */
+double *
+pbin_client_calc_prob_dist(pbin_client_t *c,
+                           const double *err_probs, int N, int K,
+                           long long int bonf_factor, double sig_level,
+                           const int *accept_counts, int num_accept_counts,
+                           int *is_bound);
+
+int
+main_pbin_owner(int argc, char *argv[]);
+
+#endif
@@ -45,6 +45,11 @@
 #include "samutils.h"
 #include "snpcaller.h"
 #include "bam_md_ext.h"
+#include "plp_sweep.h"
+#include "sidecar.h"
+#include "consensus.h"
+#include "cost_profile.h"
+#include "evidence.h"
 
 const char *bam_nt4_rev_table = "ACGTN";
 
@@ -56,12 +61,6 @@ void *bed_read(const char *fn);
 void bed_destroy(void *_h);
 int bed_overlap(const void *_h, const char *chr, int beg, int end);
 
-/* From the SAM spec: "tags starting with `X', `Y' and `Z' or tags
- * containing lowercase letters in either position are reserved for
- * local use".
-*/
-#define SRC_QUAL_TAG "sq"
-
 /* results on icga dream syn1.2 suggest that somatic calls made extra
  * with this settings are likely fp whereas the ones missing a likely
  * tp, therefore disabled */
@@ -90,18 +89,15 @@ const unsigned char bam_nt4_table[256] = {
 typedef struct {
      samFile *fp;
      hts_itr_t* iter;
+     hts_idx_t *idx; /* only kept for multi-region iterators */
      bam_hdr_t *h;
      int ref_id;
      char *ref;
      const mplp_conf_t *conf;
+     sidecar_t **sidecars; /* one per conf->sidecar_fns */
+     long long int num_reads; /* reads passed on to the pileup */
 } mplp_aux_t;
 
-typedef struct {
-    int n;
-    int *n_plp, *m_plp;
-    bam_pileup1_t **plp;
-} mplp_pileup_t;
-
 
 #ifdef USE_ALNERRPROF
 static alnerrprof_t *alnerrprof = NULL;
@@ -157,17 +153,20 @@ plp_col_init(plp_col_t *p) {
 #endif
          p->fw_counts[i] = 0;
          p->rv_counts[i] = 0;
+         p->cons_counts[i] = 0.0;
     }
 
     p->num_heads = p->num_tails = 0;
 
     p->num_ins = p->sum_ins = 0;
+    p->num_ins_evicted = 0;
     int_varray_init(& p->ins_quals, grow_by_size);
     int_varray_init(& p->ins_map_quals, grow_by_size);
     int_varray_init(& p->ins_source_quals, grow_by_size);
     p->ins_event_counts = NULL;
 
     p->num_dels = p->sum_dels = 0;
+    p->num_dels_evicted = 0;
     int_varray_init(& p->del_quals, grow_by_size);
     int_varray_init(& p->del_map_quals, grow_by_size);
     int_varray_init(& p->del_source_quals, grow_by_size);
@@ -268,6 +267,8 @@ plp_col_mpileup_print(const plp_col_t *p, FILE *stream)
 void
 dump_mplp_conf(const mplp_conf_t *c, FILE *stream)
 {
+     int i;
+
      fprintf(stream, "mplp options\n");
      fprintf(stream, "  max_mq       = %d\n", c->max_mq);
      fprintf(stream, "  min_mq       = %d\n", c->min_mq);
@@ -281,15 +282,27 @@ dump_mplp_conf(const mplp_conf_t *c, FILE *stream)
      fprintf(stream, "  flag & MPLP_REDO_IDAQ = %d\n", c->flag & MPLP_REDO_IDAQ ? 1:0);
      fprintf(stream, "  flag & MPLP_USE_SQ     = %d\n", c->flag & MPLP_USE_SQ ? 1:0);
      fprintf(stream, "  flag & MPLP_ILLUMINA13 = %d\n", c->flag & MPLP_ILLUMINA13 ? 1:0);
+     fprintf(stream, "  flag & MPLP_MERGE_MATES = %d\n", c->flag & MPLP_MERGE_MATES ? 1:0);
 
      fprintf(stream, "  max_depth    = %d\n", c->max_depth);
      fprintf(stream, "  min_plp_bq   = %d\n", c->min_plp_bq);
      fprintf(stream, "  min_plp_idq  = %d\n", c->min_plp_idq);
+     fprintf(stream, "  max_indel_alleles = %d\n", c->max_indel_alleles);
      fprintf(stream, "  def_nm_q     = %d\n", c->def_nm_q);
      fprintf(stream, "  reg          = %s\n", c->reg);
+     fprintf(stream, "  num_regs     = %d\n", c->num_regs);
      fprintf(stream, "  fa           = %p\n", c->fa);
      /*fprintf(stream, "  fai          = %p\n", c->fai);*/
      fprintf(stream, "  bed          = %p\n", c->bed);
+     fprintf(stream, "  primers      = %p\n", c->primers);
+     fprintf(stream, "  recal        = %p\n", c->recal);
+     fprintf(stream, "  metrics      = %p\n", c->metrics);
+     fprintf(stream, "  consensus    = %p\n", c->consensus);
+     fprintf(stream, "  cost_profile = %p\n", c->cost_profile);
+     fprintf(stream, "  evidence     = %p\n", c->evidence);
+     for (i=0; i<c->num_sidecars; i++) {
+          fprintf(stream, "  sidecar      = %s\n", c->sidecar_fns[i]);
+     }
      fprintf(stream, "  cmdline      = %s\n", c->cmdline);
 }
 /* dump_mplp_conf() */
@@ -552,7 +565,8 @@ source_qual(const bam1_t *b, const char *ref,
       * make poissbin faster */
      qsort(err_probs, num_err_probs, sizeof(double), dbl_cmp);
      probvec = poissbin(&unused_pval, err_probs,
-                        num_err_probs, num_non_matches, 1.0, 0.05);
+                        num_err_probs, num_non_matches, 1.0, 0.05,
+                        NULL, 0, NULL);
      /* need prob not pv */
      errno = 0;
      feclearexcept(FE_ALL_EXCEPT);
@@ -599,7 +613,7 @@ static int
 mplp_func(void *data, bam1_t *b)
 {
      mplp_aux_t *ma = (mplp_aux_t*)data;
-     int ret, skip = 0;
+     int ret, skip = 0, i;
 
      do {
           int has_ref;
@@ -622,6 +636,23 @@ mplp_func(void *data, bam1_t *b)
                skip = 1; 
                continue;
           }
+          /* attach tags from sidecars while the read is still as
+           * stored in the bam (sidecar records are keyed by position) */
+          for (i = 0; i < ma->conf->num_sidecars; i++) {
+               if (sidecar_attach(ma->sidecars[i], b) < 0) {
+                    LOG_FATAL("Failed to attach tags from sidecar %s to read %s\n",
+                              ma->conf->sidecar_fns[i], bam_get_qname(b));
+                    exit(1);
+               }
+          }
+          /* clip primers before anything else looks at the read, so
+           * that results are the same as for a pre-clipped bam */
+          if (ma->conf->primers) {
+               skip = primer_idx_clip(ma->conf->primers, ma->h->target_name[b->core.tid], b);
+               if (skip) {
+                    continue;
+               }
+          }
           if (ma->conf->bed) { /* test overlap */
                skip = !bed_overlap(ma->conf->bed, ma->h->target_name[b->core.tid], b->core.pos, bam_endpos(b));
                if (skip)
@@ -634,6 +665,10 @@ mplp_func(void *data, bam1_t *b)
                for (i = 0; i < b->core.l_qseq; ++i)
                     qual[i] = qual[i] > 31? qual[i] - 31 : 0;
           }
+          /* before BAQ etc. which all depend on base qualities */
+          if (ma->conf->recal) {
+               recal_table_apply(ma->conf->recal, b);
+          }
           has_ref = (ma->ref && ma->ref_id == b->core.tid)? 1 : 0;
 
           /* lofreq fix to original samtools routines which ensures that
@@ -740,6 +775,9 @@ mplp_func(void *data, bam1_t *b)
 #endif
     }
 
+    if (ret >= 0) {
+         ma->num_reads++;
+    }
     return ret;
 }
 
@@ -786,6 +824,386 @@ get_hrun(const int pos, const char *ref, const int ref_len)
      return hrun;
 }
 
+/* determines the consensus of p from p->cons_counts and the indel
+ * events. ins_nonevent_qual and del_nonevent_qual are the sums of
+ * qualities of all non-insertion and non-deletion events.
+ */
+static void
+plp_col_find_cons(plp_col_t *p, int ins_nonevent_qual, int del_nonevent_qual)
+{
+     /* ****************** FINDING CONSENSUS **************** */
+     /* consensus is saved as a char array starting with '+' or '-'
+      * if the consensus is an insertion or deletion. there is an
+      * insertion event if the sum of qualities for that insertion event
+      * is greater than the sum of qualities for all non-insertion events.
+      * there is a deletion event if the sum of qualities for that
+      * deletion event is greater than the sum of qualities for all non-deletion
+      * events. otherwise, the consensus base is not an indel and is given
+      * by the nucleotide with the greatest sum of qualities.
+      *
+      *
+      * YHT 2/10/14: """the idea is to find the event which has the highest probability of
+      * occurring the number of times it was observed. For example, if I see
+      * 2 +A events at a position, the probability that those 2 events are real
+      * and occurred together is (1 - the probability that the +A event occurred
+      * due to error for the first supporting read)*(1 - the probability that the
+      * +A event occurred due to error for the second supporting read). I keep
+      * track of this for each insertion event, for e.g. +AA, +T etc. at that
+      * position. I guess in theory this should incorporate errors from other sources.
+      *
+      * I also find the probability of seeing n number of non-insertions at that
+      * position, which is the product of (1 - the probability of seeing an insertion
+      * error at that position for each of those reads).
+      *
+      * I then compare the probabilities of each of these events. It turns out that
+      * comparing the products of (1 - error probability) is the same as comparing
+      * the log sum of the qualities, because qualities are the negative log of the
+      * error probabilities."""
+      *
+      * FIXME: check consensus indel against minimum consensus quality
+      * FIXME: merge indel qualities when determining consensus indel event
+      * FIXME(AW): why are we using max qualities here and not errprob corrected counts?
+      */
+
+     ins_event *ins_it, *ins_it_tmp;
+     char *ins_maxevent_key = NULL;
+     int ins_maxevent_qual = 0;
+     HASH_ITER(hh_ins, p->ins_event_counts, ins_it, ins_it_tmp) {
+          if (ins_it->cons_quals > ins_maxevent_qual) {
+               ins_maxevent_key = ins_it->key;
+               ins_maxevent_qual = ins_it->cons_quals;
+          }
+     }
+     del_event *del_it, *del_it_tmp;
+     char *del_maxevent_key = NULL;
+     int del_maxevent_qual = 0;
+     HASH_ITER(hh_del, p->del_event_counts, del_it, del_it_tmp) {
+          if (del_it->cons_quals > del_maxevent_qual) {
+               del_maxevent_key = del_it->key;
+               del_maxevent_qual = del_it->cons_quals;
+          }
+     }
+
+     /* LOG_DEBUG("ins_maxevent_qual:%d ins_nonevent_qual:%d "
+               "del_maxevent_qual:%d del_nonevent_qual:%d\n",
+               ins_maxevent_qual, ins_nonevent_qual,
+               del_maxevent_qual, del_nonevent_qual); */
+
+     if (!(ins_maxevent_qual > ins_nonevent_qual) &&
+         !(del_maxevent_qual > del_nonevent_qual)) {
+          /* determine consensus from 'counts'. will never produce N on tie  */
+          p->cons_base[0] = bam_nt4_rev_table[
+               argmax_d(p->cons_counts, NUM_NT4)];
+          p->cons_base[1] = '\0';
+     } else if (ins_maxevent_qual > ins_nonevent_qual) {  // consensus insertion
+          /* LOG_DEBUG("cons ins: ins_maxevent_qual=%d > ins_nonevent_qual=%d\n", ins_maxevent_qual, ins_nonevent_qual); */
+          p->cons_base[0] = '+';
+          strcpy(p->cons_base+1, ins_maxevent_key);
+     } else if (del_maxevent_qual > del_nonevent_qual) { // consensus deletion
+          /* LOG_DEBUG("cons del: del_maxevent_qual=%d > del_nonevent_qual=%d\n", del_maxevent_qual, del_nonevent_qual); */
+          p->cons_base[0] = '-';
+          strcpy(p->cons_base+1, del_maxevent_key);
+     } else {
+          LOG_FATAL("internal error...");
+          exit(1);
+     }
+}
+/* plp_col_find_cons() */
+
+
+static void
+int_varray_append(int_varray_t *dst, const int_varray_t *src)
+{
+     unsigned long int i;
+     for (i=0; i<src->n; i++) {
+          int_varray_add_value(dst, src->data[i]);
+     }
+}
+
+
+/* adds all pileup information of src to dst, which has to be a
+ * column at the same position, and determines the consensus of the
+ * merged column. used for incremental calling (see plp_store.h).
+ */
+void
+plp_col_merge(plp_col_t *dst, const plp_col_t *src)
+{
+     ins_event *ins_it, *ins_it_tmp;
+     del_event *del_it, *del_it_tmp;
+     int ins_nonevent_qual = 0, del_nonevent_qual = 0;
+     unsigned long int j;
+     int i;
+
+     assert(dst->pos == src->pos);
+
+     dst->coverage_plp += src->coverage_plp;
+     dst->num_bases += src->num_bases;
+     dst->num_ign_indels += src->num_ign_indels;
+     dst->num_non_indels += src->num_non_indels;
+     for (i=0; i<NUM_NT4; i++) {
+          int_varray_append(& dst->base_quals[i], & src->base_quals[i]);
+          int_varray_append(& dst->baq_quals[i], & src->baq_quals[i]);
+          int_varray_append(& dst->map_quals[i], & src->map_quals[i]);
+          int_varray_append(& dst->source_quals[i], & src->source_quals[i]);
+#ifdef USE_ALNERRPROF
+          int_varray_append(& dst->alnerr_qual[i], & src->alnerr_qual[i]);
+#endif
+          dst->fw_counts[i] += src->fw_counts[i];
+          dst->rv_counts[i] += src->rv_counts[i];
+          dst->cons_counts[i] += src->cons_counts[i];
+     }
+     dst->num_heads += src->num_heads;
+     dst->num_tails += src->num_tails;
+
+     dst->num_ins += src->num_ins;
+     dst->sum_ins += src->sum_ins;
+     dst->num_ins_evicted += src->num_ins_evicted;
+     int_varray_append(& dst->ins_quals, & src->ins_quals);
+     int_varray_append(& dst->ins_map_quals, & src->ins_map_quals);
+     int_varray_append(& dst->ins_source_quals, & src->ins_source_quals);
+     HASH_ITER(hh_ins, src->ins_event_counts, ins_it, ins_it_tmp) {
+          ins_event *it = get_ins_sequence(& dst->ins_event_counts, ins_it->key);
+          it->count += ins_it->count;
+          it->cons_quals += ins_it->cons_quals;
+          it->fw_rv[0] += ins_it->fw_rv[0];
+          it->fw_rv[1] += ins_it->fw_rv[1];
+          int_varray_append(& it->ins_quals, & ins_it->ins_quals);
+          int_varray_append(& it->ins_aln_quals, & ins_it->ins_aln_quals);
+          int_varray_append(& it->ins_map_quals, & ins_it->ins_map_quals);
+          int_varray_append(& it->ins_source_quals, & ins_it->ins_source_quals);
+     }
+
+     dst->num_dels += src->num_dels;
+     dst->sum_dels += src->sum_dels;
+     dst->num_dels_evicted += src->num_dels_evicted;
+     int_varray_append(& dst->del_quals, & src->del_quals);
+     int_varray_append(& dst->del_map_quals, & src->del_map_quals);
+     int_varray_append(& dst->del_source_quals, & src->del_source_quals);
+     HASH_ITER(hh_del, src->del_event_counts, del_it, del_it_tmp) {
+          del_event *it = get_del_sequence(& dst->del_event_counts, del_it->key);
+          it->count += del_it->count;
+          it->cons_quals += del_it->cons_quals;
+          it->fw_rv[0] += del_it->fw_rv[0];
+          it->fw_rv[1] += del_it->fw_rv[1];
+          int_varray_append(& it->del_quals, & del_it->del_quals);
+          int_varray_append(& it->del_aln_quals, & del_it->del_aln_quals);
+          int_varray_append(& it->del_map_quals, & del_it->del_map_quals);
+          int_varray_append(& it->del_source_quals, & del_it->del_source_quals);
+     }
+
+     for (i=0; i<2; i++) {
+          dst->non_ins_fw_rv[i] += src->non_ins_fw_rv[i];
+          dst->non_del_fw_rv[i] += src->non_del_fw_rv[i];
+     }
+     dst->has_indel_aqs |= src->has_indel_aqs;
+
+     /* ins_quals and del_quals hold the qualities of all non-events */
+     for (j=0; j<dst->ins_quals.n; j++) {
+          ins_nonevent_qual += dst->ins_quals.data[j];
+     }
+     for (j=0; j<dst->del_quals.n; j++) {
+          del_nonevent_qual += dst->del_quals.data[j];
+     }
+     plp_col_find_cons(dst, ins_nonevent_qual, del_nonevent_qual);
+}
+/* plp_col_merge() */
+
+
+/* Top-k indel allele tracking (conf->max_indel_alleles).
+ *
+ * In long homopolymers and STRs a column can have hundreds of
+ * distinct indel alleles, each with its own quality lists and test.
+ * With a limit of k, the alleles of a column are counted first and
+ * only the k most frequent insertion and deletion alleles (ties
+ * broken by first occurrence) are tracked. Their counts and quality
+ * lists are exact. The reads of all other alleles become non-events
+ * (their qualities go to ins_quals etc.), i.e. they are treated like
+ * any other read not supporting the allele being tested. Dropped
+ * alleles are counted in num_ins_evicted and num_dels_evicted so that
+ * they can still be counted as tests.
+ */
+typedef struct {
+     char key[MAX_INDELSIZE]; /* see indel_allele_key() */
+     int count;
+     int first; /* entry of first occurrence */
+     int keep;
+     UT_hash_handle hh;
+} indel_allele_t;
+
+
+/* keys as those of ins_event and del_event (truncated to
+ * MAX_INDELSIZE-1). deleted bases are reference, so deletions are
+ * keyed by their length */
+static void
+indel_allele_key(char *key, const plp_sweep_reads_t *r, int slot, int qpos, int indel)
+{
+     int j;
+
+     if (indel > 0) {
+          for (j = 1; j <= indel && j < MAX_INDELSIZE; ++j) {
+               key[j-1] = toupper(seq_nt16_str[r->nt16[slot][qpos+j]]);
+          }
+          key[j-1] = '\0';
+     } else {
+          snprintf(key, MAX_INDELSIZE, "-%d", MIN(-indel, MAX_INDELSIZE-1));
+     }
+}
+/* indel_allele_key() */
+
+
+/* indel qualities of an entry as used in compile_plp_col() */
+static void
+entry_indel_quals(const plp_sweep_reads_t *r, int slot, int qpos, int hrun,
+                  int *iq, int *dq)
+{
+     *iq = 0;
+     *dq = 0;
+     if (r->bi[slot]) {
+          /* adding 1 value representing whole insert */
+          *iq = r->bi[slot][qpos];
+     } /* else default to 0 */
+
+     if (r->bd[slot]) {
+          /* adding 1 value representing whole del */
+          *dq = r->bd[slot][qpos];
+#ifdef PACBIO_REALN_HRUNDQ7
+          /* FIXME temp artifically decreasing pacbio del quals in hruns */
+          if (hrun>1) {
+               if (*dq>7) *dq=7;
+          }
+#elif PACBIO_REALN
+          /* FIXME temp artifically decreasing pacbio del quals in hruns */
+          if (*dq>=10) *dq-=10;
+#endif
+     } /* else default to 0 */
+}
+/* entry_indel_quals() */
+
+
+static int
+indel_allele_cmp(const void *a, const void *b)
+{
+     const indel_allele_t *x = *(const indel_allele_t * const *)a;
+     const indel_allele_t *y = *(const indel_allele_t * const *)b;
+
+     if (x->count != y->count) {
+          return x->count > y->count ? -1 : 1;
+     }
+     return x->first - y->first;
+}
+/* indel_allele_cmp() */
+
+
+/* marks the k most frequent alleles to be kept and returns the
+ * number of dropped ones */
+static int
+indel_alleles_select(indel_allele_t *alleles, int k)
+{
+     indel_allele_t *it, *it_tmp, **sorted;
+     int n = HASH_COUNT(alleles);
+     int i;
+
+     if (n <= k) {
+          HASH_ITER(hh, alleles, it, it_tmp) {
+               it->keep = 1;
+          }
+          return 0;
+     }
+     if (NULL == (sorted = malloc(n * sizeof(indel_allele_t *)))) {
+          LOG_FATAL("%s\n", "Memory allocation failed");
+          exit(1);
+     }
+     i = 0;
+     HASH_ITER(hh, alleles, it, it_tmp) {
+          sorted[i++] = it;
+     }
+     qsort(sorted, n, sizeof(indel_allele_t *), indel_allele_cmp);
+     for (i=0; i<n; i++) {
+          sorted[i]->keep = (i < k);
+     }
+     free(sorted);
+     return n - k;
+}
+/* indel_alleles_select() */
+
+
+/* counts the indel alleles of column col that compile_plp_col() would
+ * record and selects the top-k of each type */
+static void
+indel_alleles_count(const plp_sweep_win_t *w, const int col,
+                    const mplp_conf_t *conf, plp_col_t *plp_col,
+                    indel_allele_t **ins, indel_allele_t **dels)
+{
+     const plp_sweep_reads_t *r = w->reads;
+     int e;
+
+     for (e = w->off[col]; e < w->off[col+1]; e++) {
+          const int slot = w->slot[e];
+          const int qpos = w->qpos[e];
+          const int indel = w->indel[e];
+          indel_allele_t **alleles = indel > 0 ? ins : dels;
+          indel_allele_t *it;
+          char key[MAX_INDELSIZE];
+          int iq, dq;
+
+          if (0 == indel) {
+               continue;
+          }
+          entry_indel_quals(r, slot, qpos, plp_col->hrun, &iq, &dq);
+          if (iq < conf->min_plp_idq || dq < conf->min_plp_idq) {
+               continue; /* ignored, see compile_plp_col() */
+          }
+          indel_allele_key(key, r, slot, qpos, indel);
+          HASH_FIND_STR(*alleles, key, it);
+          if (! it) {
+               if (NULL == (it = calloc(1, sizeof(indel_allele_t)))) {
+                    LOG_FATAL("%s\n", "Memory allocation failed");
+                    exit(1);
+               }
+               strcpy(it->key, key);
+               it->first = e;
+               HASH_ADD_STR(*alleles, key, it);
+          }
+          it->count += 1;
+     }
+     plp_col->num_ins_evicted = indel_alleles_select(*ins, conf->max_indel_alleles);
+     plp_col->num_dels_evicted = indel_alleles_select(*dels, conf->max_indel_alleles);
+}
+/* indel_alleles_count() */
+
+
+/* whether the allele of an entry is tracked. all are if alleles were
+ * not counted (no limit) */
+static int
+indel_allele_kept(indel_allele_t *alleles, const plp_sweep_reads_t *r,
+                  int slot, int qpos, int indel)
+{
+     indel_allele_t *it;
+     char key[MAX_INDELSIZE];
+
+     if (! alleles) {
+          return 1;
+     }
+     indel_allele_key(key, r, slot, qpos, indel);
+     HASH_FIND_STR(alleles, key, it);
+     return it && it->keep;
+}
+/* indel_allele_kept() */
+
+
+static void
+indel_alleles_free(indel_allele_t **alleles)
+{
+     indel_allele_t *it, *it_tmp;
+
+     HASH_ITER(hh, *alleles, it, it_tmp) {
+          HASH_DEL(*alleles, it);
+          free(it);
+     }
+}
+/* indel_alleles_free() */
+
+
 /* Press pileup info into one data-structure. plp_col members
  * allocated here. Called must free with plp_col_free();
  *
@@ -795,12 +1213,14 @@ get_hrun(const int pos, const char *ref, const int ref_len)
  * not needed). Needs optimization.
  */
 void compile_plp_col(plp_col_t *plp_col,
-                 const bam_pileup1_t *plp, const int n_plp,
+                 const plp_sweep_win_t *w, const int col,
                  const mplp_conf_t *conf, const char *ref, const int pos,
                  const int ref_len, const char *target_name)
 {
      int i;
      char ref_base;
+     const plp_sweep_reads_t *r = w->reads;
+     const int n_plp = w->off[col+1] - w->off[col];
 
      /* "base counts" minus error-probs before base-level filtering
       * for each base. temporary data-structure for cheaply determining
@@ -808,6 +1228,7 @@ void compile_plp_col(plp_col_t *plp_col,
      double base_counts[NUM_NT4] = { 0 };
      /* sum of qualities for all non-indel events */
      int ins_nonevent_qual = 0, del_nonevent_qual = 0;
+     indel_allele_t *ins_alleles = NULL, *del_alleles = NULL; /* top-k tracking */
 
      /* computation of depth (after read-level *and* base-level filtering)
       * samtools-0.1.18/bam2depth.c:
@@ -838,6 +1259,10 @@ void compile_plp_col(plp_col_t *plp_col,
           plp_col->hrun = -1;
      }
 
+     if (conf->max_indel_alleles) {
+          indel_alleles_count(w, col, conf, plp_col, &ins_alleles, &del_alleles);
+     }
+
      for (i = 0; i < n_plp; ++i) {
           /* inserted parts of pileup_seq() here.
            * logic there goes like this:
@@ -852,39 +1277,34 @@ void compile_plp_col(plp_col_t *plp_col,
            *
            * if is_tail: put $
            */
-          const bam_pileup1_t *p = plp + i;
+          const int e = w->off[col] + i;
+          const int slot = w->slot[e];
+          const int qpos = w->qpos[e];
+          const int indel = w->indel[e];
+          const int is_del = w->flag[e] & PLP_SWEEP_IS_DEL;
+          const int is_refskip = w->flag[e] & PLP_SWEEP_IS_REFSKIP;
+          const int is_rev = r->flag[slot] & PLP_SWEEP_IS_REV;
           int nt4;
           int mq=-1, bq, baq; /* phred scores */
           int iq = 0, dq = 0;
           int iaq = -1, daq = -1;
           int base_skip = 0; /* boolean */
+          int mate_baq = 0; /* > 0: add to baq, < 0: scale baq down (overlapping mates) */
           int sq = -1;
 #ifdef USE_ALNERRPROF
           int aq = 0;
 #endif
-          uint8_t *bi = bam_aux_get(p->b, BI_TAG);
-          uint8_t *bd = bam_aux_get(p->b, BD_TAG);
-          uint8_t *ai = bam_aux_get(p->b, AI_TAG);
-          uint8_t *ad = bam_aux_get(p->b, AD_TAG);
-          uint8_t *baq_aux = NULL; /* full baq value (not offset as "BQ"!) */
-
-#ifdef USE_OLD_AI_AD
-          /* temporary fix preventing problems due to the fact that we changed AI AD to ai ad
-           * to be deleted soon
-           */
-          if (! ai) {
-               ai = bam_aux_get(p->b, "AI");
-          }
-          if (! ad) {
-               ad = bam_aux_get(p->b, "AD");
-          }
-#endif
+          /* tag values are already phred values (see plp_sweep.c) */
+          const int8_t *ai = r->ai[slot];
+          const int8_t *ad = r->ad[slot];
+          const int8_t *baq_aux = NULL; /* full baq value (not offset as "BQ"!) */
+
           if (conf->flag & MPLP_USE_SQ) {
-               sq = bam_aux2i(bam_aux_get(p->b, SRC_QUAL_TAG)); /* lofreq internally computed on the fly */
+               sq = r->sq[slot]; /* lofreq internally computed on the fly */
           }
 
           if (conf->flag & MPLP_BAQ) {
-               baq_aux = bam_aux_get(p->b, BAQ_TAG);
+               baq_aux = r->baq[slot];
                /* should have been recomputed already */
                if (! baq_aux) {
                     if (! missing_baq_warning_printed) {
@@ -892,43 +1312,68 @@ void compile_plp_col(plp_col_t *plp_col,
                          /*LOG_FATAL("%s\n", "Please pre-process your BAM file with lofreq alnqual first");*/
                          missing_baq_warning_printed = 1;
                     }
-               } else {
-                    baq_aux++; /* first char is type (same for bd and bi done below) */
                }
           }
 
 #if 0
-          LOG_FIXME("At %s:%d %c: p->is_del=%d p->is_refskip=%d p->indel=%d p->is_head=%d p->is_tail=%d\n",
+          LOG_FIXME("At %s:%d %c: is_del=%d is_refskip=%d indel=%d flag=%d\n",
                     plp_col->target,
                     plp_col->pos+1,
-                    seq_nt16_str[bam_seqi(bam_get_seq(p->b), p->qpos)],
-                    p->is_del, p->is_refskip, p->indel, p->is_head, p->is_tail);
+                    seq_nt16_str[r->nt16[slot][qpos]],
+                    is_del, is_refskip, indel, w->flag[e]);
 #endif
           /* no need for check if mq is within user defined
            * limits. check was done in mplp_func */
-          mq = p->b->core.qual;
+          mq = r->mq[slot];
 
-          /* p->is_del mean there was a deletion (already printed before this column). */
-          if (! p->is_del) {
+          /* is_del means there was a deletion (already printed before this column). */
+          if (! is_del) {
                double count_incr;
 
-               if (p->is_head) {
+               if (w->flag[e] & PLP_SWEEP_IS_HEAD) {
                     plp_col->num_heads += 1;
                }
-               if (p->is_tail) {
+               if (w->flag[e] & PLP_SWEEP_IS_TAIL) {
                     plp_col->num_tails += 1;
                }
 
 #if 0
                /* nt for printing */
-               nt = seq_nt16_str[bam_seqi(bam_get_seq(p->b), p->qpos)];
-               nt = bam_is_rev(p->b)? tolower(nt) : toupper(nt);
+               nt = seq_nt16_str[r->nt16[slot][qpos]];
+               nt = is_rev ? tolower(nt) : toupper(nt);
 #endif
 
                /* nt4 for indexing */
-               nt4 = seq_nt16_int[bam_seqi(bam_get_seq(p->b), p->qpos)];
-
-               bq = bam_get_qual(p->b)[p->qpos];
+               nt4 = seq_nt16_int[r->nt16[slot][qpos]];
+
+               bq = r->bq[slot][qpos];
+
+               /* overlapping mates contribute one base. if they agree
+                * the first one carries the summed quality. otherwise
+                * the one with the higher quality wins with 80% of it
+                * (as in samtools' tweak_overlap_quality()) */
+               if (w->mate && w->mate[e] >= 0 && ! (w->flag[w->mate[e]] & PLP_SWEEP_IS_DEL)) {
+                    const int me = w->mate[e];
+                    const int mslot = w->slot[me];
+                    const int mqpos = w->qpos[me];
+                    const int mbq = r->bq[mslot][mqpos];
+
+                    if (r->nt16[slot][qpos] == r->nt16[mslot][mqpos]) {
+                         if (me < e) {
+                              base_skip = 1;
+                              goto check_indel;
+                         }
+                         bq = MIN(bq + mbq, SANGER_PHRED_MAX);
+                         mate_baq = r->baq[mslot] ? r->baq[mslot][mqpos] : 0;
+                    } else {
+                         if (mbq > bq || (mbq == bq && me < e)) {
+                              base_skip = 1;
+                              goto check_indel;
+                         }
+                         bq = 0.8 * bq;
+                         mate_baq = -1;
+                    }
+               }
 
                /* minimal base-call quality filtering. doing this here
                 * will make all downstream analysis blind to filtering
@@ -948,13 +1393,18 @@ void compile_plp_col(plp_col_t *plp_col,
                 */
                if (bq > SANGER_PHRED_MAX) {
                     /* bq = SANGER_PHRED_MAX; /@ Sanger/Phred max */
-                    LOG_WARN("Base quality above allowed maximum detected (%d > %d). Using max instead\n", bq, SANGER_PHRED_MAX, bam_get_qname(p->b));
+                    LOG_WARN("Base quality above allowed maximum detected (%d > %d). Using max instead\n", bq, SANGER_PHRED_MAX);
                     bq = SANGER_PHRED_MAX;
                }
                PLP_COL_ADD_QUAL(& plp_col->base_quals[nt4], bq);
 
                if (baq_aux) {
-                    baq = baq_aux[p->qpos]-33;
+                    baq = baq_aux[qpos];
+                    if (mate_baq > 0) {
+                         baq = MIN(baq + mate_baq, SANGER_PHRED_MAX);
+                    } else if (mate_baq < 0) {
+                         baq = 0.8 * baq;
+                    }
                     PLP_COL_ADD_QUAL(& plp_col->baq_quals[nt4], baq);
                } else if (conf->flag & MPLP_BAQ)  {
                     /* baq was enabled but failed. set to -1 */
@@ -975,13 +1425,13 @@ void compile_plp_col(plp_col_t *plp_col,
                }
 #ifdef USE_ALNERRPROF
                if (alnerrprof) {
-                    int tid = p->b->core.tid;
+                    int tid = w->tid;
                     assert(tid < alnerrprof->num_targets);
-                    if (alnerrprof->prop_len[tid] > p->qpos) {
-                         aq = PROB_TO_PHREDQUAL_SAFE(alnerrprof->props[tid][p->qpos]);
+                    if (alnerrprof->prop_len[tid] > qpos) {
+                         aq = PROB_TO_PHREDQUAL_SAFE(alnerrprof->props[tid][qpos]);
                          PLP_COL_ADD_QUAL(& plp_col->alnerr_qual[nt4], aq);
                     } else {
-                         LOG_ERROR("alnerror for tid=%d too small for qpos=%d. Setting to 0\n", tid, p->qpos+1);
+                         LOG_ERROR("alnerror for tid=%d too small for qpos=%d. Setting to 0\n", tid, qpos+1);
                          PLP_COL_ADD_QUAL(& plp_col->alnerr_qual[nt4], PROB_TO_PHREDQUAL(LDBL_MIN));
                     }
                }
@@ -1005,106 +1455,79 @@ void compile_plp_col(plp_col_t *plp_col,
                }
 
                base_counts[nt4] += count_incr;
-               if (bam_is_rev(p->b)) {
+               if (is_rev) {
                     plp_col->rv_counts[nt4] += 1;
                } else {
                     plp_col->fw_counts[nt4] += 1;
                }
 
-          } /* ! p->is_del */
+          } /* ! is_del */
           /* else {deletion (already printed before this column), i.e. we got physical coverage (if no terminal indels are allowed} */
 
 check_indel:
 
           /* for post read- and base-level coverage. FIXME review */
-          if (! (p->is_del || p->is_refskip || 1 == base_skip)) {/* FIXME also use p->indel? */
+          if (! (is_del || is_refskip || 1 == base_skip)) {/* FIXME also use indel? */
                plp_col->num_bases += 1;
           }
 
-          if (bi) {
-               char *t = (char*)(bi+1); /* 1 is type */
-#if 0
-               int j;
-               printf("At %d qpos %d: %s=%s", plp_col->pos+1, p->qpos+1, BI_TAG, t);
-               for (j = 0; j < p->indel; ++j) {
-                    printf(" %c:%d-%d-%d", t[p->qpos+j], t[p->qpos+j-1]-33, t[p->qpos+j]-33, t[p->qpos+j+1]-33);
-               }
-               printf("\n");
-#endif
-               /* adding 1 value representing whole insert */
-               iq = t[p->qpos] - 33;
-          } /* else default to 0 */
-
-          if (bd) {
-               char *t = (char*)(bd+1);  /* 1 is type */
-#if 0
-               int j;
-               printf("At %d qpos %d: %s=%sx", plp_col->pos+1, p->qpos+1, BD_TAG, t);
-               for (j = 0; j < p->indel; ++j) {
-                    printf(" %c:%d-%d-%d", t[p->qpos+j], t[p->qpos+j-1]-33, t[p->qpos+j]-33, t[p->qpos+j+1]-33);
-               }
-               printf("\n");
-#endif
-               /* adding 1 value representing whole del */
-               dq = t[p->qpos] - 33;
-#ifdef PACBIO_REALN_HRUNDQ7
-               /* FIXME temp artifically decreasing pacbio del quals in hruns */
-               if (plp_col->hrun>1) {
-                    if (dq>7) dq=7;
-               }
-#elif PACBIO_REALN
-               /* FIXME temp artifically decreasing pacbio del quals in hruns */
-               if (dq>=10) dq-=10;
-#endif
-          } /* else default to 0 */
+          entry_indel_quals(r, slot, qpos, plp_col->hrun, &iq, &dq);
 
 
           if (iq < conf->min_plp_idq || dq < conf->min_plp_idq) {
                /* LOG_DEBUG("iq=%d < conf->min_plp_idq=%d || dq=%d < conf->min_plp_idq=%d\n", iq, conf->min_plp_idq, dq, conf->min_plp_idq); */
-               if (p->indel != 0 || p->is_del != 0) {
+               if (indel != 0 || is_del != 0) {
                   plp_col->num_ign_indels += 1;
                }
           } else {
 
-               if (p->indel != 0) {
+               if (indel != 0) {
                     /* insertion (+)
                      */
-                    if (p->indel > 0) {
+                    if (indel > 0) {
                          char *ins_seq;
                          int j;
 
                          if (ai) {
-                              char *a = (char*)(ai+1);
-                              iaq = a[p->qpos] - 33;
+                              iaq = ai[qpos];
                               plp_col->has_indel_aqs = 1;
                          }
 
                          plp_col->num_ins += 1;
-                         plp_col->sum_ins += p->indel;
+                         plp_col->sum_ins += indel;
 
-                         if ((ins_seq = malloc((p->indel+1) * sizeof(char)))==NULL) {
+                         if ((ins_seq = malloc((indel+1) * sizeof(char)))==NULL) {
                               LOG_FATAL("%s\n", "Memory allocation failed");
                               exit(1);
                          }
 
                          /* get inserted sequence */
-                         for (j = 1; j <= p->indel; ++j) {
-                              int c = seq_nt16_str[bam_seqi(bam_get_seq(p->b), p->qpos+j)];
+                         for (j = 1; j <= indel; ++j) {
+                              int c = seq_nt16_str[r->nt16[slot][qpos+j]];
                               ins_seq[j-1] = toupper(c);
                          }
                          ins_seq[j-1] = '\0';
 
 
                          /*LOG_DEBUG("Insertion of %s at %d with iq %d iaq %d\n", ins_seq, pos, iq, iaq);*/
-                         add_ins_sequence(&plp_col->ins_event_counts,
-                              ins_seq, iq, iaq, mq, sq,
-                              bam_is_rev(p->b)? 1: 0);
+                         if (indel_allele_kept(ins_alleles, r, slot, qpos, indel)) {
+                              add_ins_sequence(&plp_col->ins_event_counts,
+                                   ins_seq, iq, iaq, mq, sq,
+                                   is_rev ? 1: 0);
+                         } else {
+                              /* dropped by top-k tracking: non-event */
+                              PLP_COL_ADD_QUAL(& plp_col->ins_quals, iq);
+                              PLP_COL_ADD_QUAL(& plp_col->ins_map_quals, mq);
+                              PLP_COL_ADD_QUAL(& plp_col->ins_source_quals, sq);
+                              ins_nonevent_qual += iq;
+                              plp_col->non_ins_fw_rv[is_rev ? 1 : 0] += 1;
+                         }
 
                          PLP_COL_ADD_QUAL(& plp_col->del_quals, dq);
                          PLP_COL_ADD_QUAL(& plp_col->del_map_quals, mq);
                          PLP_COL_ADD_QUAL(& plp_col->del_source_quals, sq);
                          del_nonevent_qual += dq;
-                         if (bam_is_rev(p->b)) {
+                         if (is_rev) {
                               plp_col->non_del_fw_rv[1] += 1;
                          } else {
                               plp_col->non_del_fw_rv[0] += 1;
@@ -1113,26 +1536,25 @@ check_indel:
 
                     /* deletion (-)
                      */
-                    } else if (p->indel < 0) {
+                    } else if (indel < 0) {
                          /* get deleted sequence */
                          char *del_seq;
                          int j;
 
                          if (ad) {
-                              char *a = (char*)(ad+1);
-                              daq = a[p->qpos] - 33;
+                              daq = ad[qpos];
                               plp_col->has_indel_aqs = 1;
                          }
 
                          plp_col->num_dels += 1;
-                         plp_col->sum_dels -= p->indel;
+                         plp_col->sum_dels -= indel;
 
-                         if ((del_seq = malloc(((-p->indel)+1) * sizeof(char)))==NULL) {
+                         if ((del_seq = malloc(((-indel)+1) * sizeof(char)))==NULL) {
                               LOG_FATAL("%s\n", "Memory allocation failed");
                               exit(1);
                          }
 
-                         for (j = 1; j <= -p->indel; ++j) {
+                         for (j = 1; j <= -indel; ++j) {
                               int c =  (ref && (int)pos+j < ref_len)? ref[pos+j] : 'N';
                               del_seq[j-1] = toupper(c);
                          }
@@ -1152,14 +1574,23 @@ check_indel:
                               }
                          }
 #endif
-                         add_del_sequence(&plp_col->del_event_counts,
-                              del_seq, dq, daq, mq, sq,
-                              bam_is_rev(p->b)? 1: 0);
+                         if (indel_allele_kept(del_alleles, r, slot, qpos, indel)) {
+                              add_del_sequence(&plp_col->del_event_counts,
+                                   del_seq, dq, daq, mq, sq,
+                                   is_rev ? 1: 0);
+                         } else {
+                              /* dropped by top-k tracking: non-event */
+                              PLP_COL_ADD_QUAL(& plp_col->del_quals, dq);
+                              PLP_COL_ADD_QUAL(& plp_col->del_map_quals, mq);
+                              PLP_COL_ADD_QUAL(& plp_col->del_source_quals, sq);
+                              del_nonevent_qual += dq;
+                              plp_col->non_del_fw_rv[is_rev ? 1 : 0] += 1;
+                         }
                          PLP_COL_ADD_QUAL(& plp_col->ins_quals, iq);
                          PLP_COL_ADD_QUAL(& plp_col->ins_map_quals, mq);
                          PLP_COL_ADD_QUAL(& plp_col->ins_source_quals, sq);
                          ins_nonevent_qual += iq;
-                         if (bam_is_rev(p->b)) {
+                         if (is_rev) {
                               plp_col->non_ins_fw_rv[1] += 1;
                          } else {
                               plp_col->non_ins_fw_rv[0] += 1;
@@ -1167,13 +1598,13 @@ check_indel:
                          free(del_seq);
                     }
 
-               } else { /* if (p->indel != 0) ... */
+               } else { /* if (indel != 0) ... */
                     plp_col->num_non_indels += 1;
                     /* neither deletion, nor insertion. need the qualities anyway */
                     PLP_COL_ADD_QUAL(& plp_col->ins_quals, iq);
                     PLP_COL_ADD_QUAL(& plp_col->ins_map_quals, mq);
                     ins_nonevent_qual += iq;
-                    if (bam_is_rev(p->b)) {
+                    if (is_rev) {
                          plp_col->non_ins_fw_rv[1] += 1;
                     } else {
                          plp_col->non_ins_fw_rv[0] += 1;
@@ -1183,7 +1614,7 @@ check_indel:
                     PLP_COL_ADD_QUAL(& plp_col->del_quals, dq);
                     PLP_COL_ADD_QUAL(& plp_col->del_map_quals, mq);
                     del_nonevent_qual += dq;
-                    if (bam_is_rev(p->b)) {
+                    if (is_rev) {
                          plp_col->non_del_fw_rv[1] += 1;
                     } else {
                          plp_col->non_del_fw_rv[0] += 1;
@@ -1192,84 +1623,12 @@ check_indel:
           }
 
      }  /* end: for (i = 0; i < n_plp; ++i) { */
+     indel_alleles_free(& ins_alleles);
+     indel_alleles_free(& del_alleles);
 
 
-     /* ****************** FINDING CONSENSUS **************** */
-     /* consensus is saved as a char array starting with '+' or '-'
-      * if the consensus is an insertion or deletion. there is an
-      * insertion event if the sum of qualities for that insertion event
-      * is greater than the sum of qualities for all non-insertion events.
-      * there is a deletion event if the sum of qualities for that
-      * deletion event is greater than the sum of qualities for all non-deletion
-      * events. otherwise, the consensus base is not an indel and is given
-      * by the nucleotide with the greatest sum of qualities.
-      *
-      *
-      * YHT 2/10/14: """the idea is to find the event which has the highest probability of
-      * occurring the number of times it was observed. For example, if I see
-      * 2 +A events at a position, the probability that those 2 events are real
-      * and occurred together is (1 - the probability that the +A event occurred
-      * due to error for the first supporting read)*(1 - the probability that the
-      * +A event occurred due to error for the second supporting read). I keep
-      * track of this for each insertion event, for e.g. +AA, +T etc. at that
-      * position. I guess in theory this should incorporate errors from other sources.
-      *
-      * I also find the probability of seeing n number of non-insertions at that
-      * position, which is the product of (1 - the probability of seeing an insertion
-      * error at that position for each of those reads).
-      *
-      * I then compare the probabilities of each of these events. It turns out that
-      * comparing the products of (1 - error probability) is the same as comparing
-      * the log sum of the qualities, because qualities are the negative log of the
-      * error probabilities."""
-      *
-      * FIXME: check consensus indel against minimum consensus quality
-      * FIXME: merge indel qualities when determining consensus indel event
-      * FIXME(AW): why are we using max qualities here and not errprob corrected counts?
-      */
-
-     ins_event *ins_it, *ins_it_tmp;
-     char *ins_maxevent_key = NULL;
-     int ins_maxevent_qual = 0;
-     HASH_ITER(hh_ins, plp_col->ins_event_counts, ins_it, ins_it_tmp) {
-          if (ins_it->cons_quals > ins_maxevent_qual) {
-               ins_maxevent_key = ins_it->key;
-               ins_maxevent_qual = ins_it->cons_quals;
-          }
-     }
-     del_event *del_it, *del_it_tmp;
-     char *del_maxevent_key = NULL;
-     int del_maxevent_qual = 0;
-     HASH_ITER(hh_del, plp_col->del_event_counts, del_it, del_it_tmp) {
-          if (del_it->cons_quals > del_maxevent_qual) {
-               del_maxevent_key = del_it->key;
-               del_maxevent_qual = del_it->cons_quals;
-          }
-     }
-
-     /* LOG_DEBUG("ins_maxevent_qual:%d ins_nonevent_qual:%d "
-               "del_maxevent_qual:%d del_nonevent_qual:%d\n",
-               ins_maxevent_qual, ins_nonevent_qual,
-               del_maxevent_qual, del_nonevent_qual); */
-
-     if (!(ins_maxevent_qual > ins_nonevent_qual) &&
-         !(del_maxevent_qual > del_nonevent_qual)) {
-          /* determine consensus from 'counts'. will never produce N on tie  */
-          plp_col->cons_base[0] = bam_nt4_rev_table[
-               argmax_d(base_counts, NUM_NT4)];
-          plp_col->cons_base[1] = '\0';
-     } else if (ins_maxevent_qual > ins_nonevent_qual) {  // consensus insertion
-          /* LOG_DEBUG("cons ins: ins_maxevent_qual=%d > ins_nonevent_qual=%d\n", ins_maxevent_qual, ins_nonevent_qual); */
-          plp_col->cons_base[0] = '+';
-          strcpy(plp_col->cons_base+1, ins_maxevent_key);
-     } else if (del_maxevent_qual > del_nonevent_qual) { // consensus deletion
-          /* LOG_DEBUG("cons del: del_maxevent_qual=%d > del_nonevent_qual=%d\n", del_maxevent_qual, del_nonevent_qual); */
-          plp_col->cons_base[0] = '-';
-          strcpy(plp_col->cons_base+1, del_maxevent_key);
-     } else {
-          LOG_FATAL("internal error...");
-          exit(1);
-     }
+     memcpy(plp_col->cons_counts, base_counts, sizeof(base_counts));
+     plp_col_find_cons(plp_col, ins_nonevent_qual, del_nonevent_qual);
 
      if (debug) {
           plp_col_debug_print(plp_col, stderr);
@@ -1297,13 +1656,15 @@ mpileup(const mplp_conf_t *mplp_conf,
         const int n, const char **fn)
 {
     mplp_aux_t **data;
-    int i, tid, pos, *n_plp, tid0 = -1, beg0 = 0, end0 = 1u<<29, ref_len = -1, ref_tid = -1, max_depth;
-    const bam_pileup1_t **plp;
-    bam_mplp_t iter;
+    int i, tid, pos, tid0 = -1, beg0 = 0, end0 = 1u<<29, ref_len = -1, ref_tid = -1, max_depth;
+    int col, ret;
+    const plp_sweep_win_t *win;
+    plp_sweep_t *sweep;
     bam_hdr_t *h = 0;
     char *ref;
     kstring_t buf;
     long long int plp_counter = 0; /* note: some cols are simply skipped */
+    int metrics_cols = -1, metrics_reads = -1, metrics_pos = -1;
 
     /* paranoid exit. n only allowed to be one in our case (not much
      * of an *m*pileup, I know...) */
@@ -1318,8 +1679,6 @@ mpileup(const mplp_conf_t *mplp_conf,
 
     memset(&buf, 0, sizeof(kstring_t));
     data = calloc(n, sizeof(mplp_aux_t*));
-    plp = calloc(n, sizeof(bam_pileup1_t*));
-    n_plp = calloc(n, sizeof(int));
 
 
     /* read the header and initialize data
@@ -1347,6 +1706,16 @@ mpileup(const mplp_conf_t *mplp_conf,
              exit(1);
         }
         data[i]->h = i? h : h_tmp; /* for i==0, "h" has not been set yet */
+        if (mplp_conf->num_sidecars) {
+            int j;
+            data[i]->sidecars = calloc(mplp_conf->num_sidecars, sizeof(sidecar_t*));
+            for (j = 0; j < mplp_conf->num_sidecars; j++) {
+                if (NULL == (data[i]->sidecars[j] = sidecar_open(mplp_conf->sidecar_fns[j]))) {
+                    fprintf(stderr, "[%s] failed to open sidecar %s\n", __func__, mplp_conf->sidecar_fns[j]);
+                    exit(1);
+                }
+            }
+        }
 
         if (mplp_conf->reg) {
             hts_idx_t *idx;
@@ -1361,6 +1730,17 @@ mpileup(const mplp_conf_t *mplp_conf,
             }
             if (i == 0) tid0 = data[i]->iter->tid, beg0 = data[i]->iter->beg, end0 = data[i]->iter->end;
             hts_idx_destroy(idx);
+        } else if (mplp_conf->num_regs) {
+            /* reads overlapping any of the regions. columns outside
+             * have to be skipped by the caller */
+            if (NULL == (data[i]->idx = sam_index_load(data[i]->fp, fn[i]))) {
+                fprintf(stderr, "[%s] fail to load index for %d-th input.\n", __func__, i+1);
+                exit(1);
+            }
+            if ((data[i]->iter = sam_itr_regarray(data[i]->idx, h_tmp, mplp_conf->regs, mplp_conf->num_regs)) == NULL) {
+                fprintf(stderr, "[%s] malformatted region or wrong seqname for %d-th input.\n", __func__, i+1);
+                exit(1);
+            }
         }
         if (i == 0) {
              h = h_tmp;
@@ -1387,9 +1767,30 @@ mpileup(const mplp_conf_t *mplp_conf,
          ref_tid = -1;
          ref = 0;
     }
-    iter = bam_mplp_init(n, mplp_func, (void**)data);
     max_depth = mplp_conf->max_depth;
-    bam_mplp_set_maxcnt(iter, max_depth);
+    /* n is always 1 (see above) */
+    if (NULL == (sweep = plp_sweep_init(mplp_func, data[0], max_depth))) {
+         return -1;
+    }
+    if (mplp_conf->flag & MPLP_MERGE_MATES) {
+         plp_sweep_set_find_mates(sweep, 1);
+    }
+    if (mplp_conf->evidence) {
+         /* supporting reads are written as they were read */
+         plp_sweep_set_keep_records(sweep, 1);
+    }
+    if (mplp_conf->metrics) {
+         metrics_cols = metrics_register(mplp_conf->metrics, "columns",
+                                         "Pileup columns processed", METRICS_COUNTER);
+         metrics_reads = metrics_register(mplp_conf->metrics, "reads",
+                                          "Reads passed on to the pileup", METRICS_COUNTER);
+         metrics_pos = metrics_register(mplp_conf->metrics, "position",
+                                        "Current position (1-based) on chrom", METRICS_GAUGE);
+    }
+    if (mplp_conf->primers) {
+         /* clipping moves read starts */
+         plp_sweep_set_max_shift(sweep, primer_idx_max_shift(mplp_conf->primers));
+    }
 
 #ifdef USE_ALNERRPROF
     if (mplp_conf->alnerrprof_file) {
@@ -1403,48 +1804,79 @@ mpileup(const mplp_conf_t *mplp_conf,
 #endif
 
     LOG_DEBUG("%s\n", "Starting pileup loop");
-    while (bam_mplp_auto(iter, &tid, &pos, n_plp, plp) > 0) {
-        plp_col_t plp_col;
-        int i=0; /* NOTE: mpileup originally iterated over n */
-
-        if (mplp_conf->reg && (pos < beg0 || pos >= end0))
-             continue; /* out of the region requested */
-        if (mplp_conf->bed && tid >= 0 && !bed_overlap(mplp_conf->bed, h->target_name[tid], pos, pos+1))
-             continue;
-        if (tid != ref_tid) {
-            free(ref); ref = 0;
-            if (mplp_conf->fai) {
-                 ref = faidx_fetch_seq(mplp_conf->fai, h->target_name[tid], 0, 0x7fffffff, &ref_len);
-                 if (NULL == ref || h->target_len[tid] != ref_len) {
-                      LOG_DEBUG("ref %s at %p h->target_len[tid]=%d ref_len=%d\n", h->target_name[tid], ref, h->target_name[tid], ref_len)
-                      LOG_FATAL("Reference fasta file doesn't seem to contain the right sequence(s) for this BAM file. (mismatch for seq %s listed in BAM header).\n", h->target_name[tid]);
-                      return -1;
-                 }
-                 strtoupper(ref);/* safeguard */
-                 LOG_DEBUG("%s\n", "sequence fetched");
+    while ((ret = plp_sweep_next(sweep, &win)) > 0) {
+        tid = win->tid;
+        for (col = 0; col < win->n_cols; col++) {
+            plp_col_t plp_col;
+            int i=0; /* NOTE: mpileup originally iterated over n */
+
+            pos = win->beg + col;
+            if (win->off[col] == win->off[col+1])
+                 continue; /* no coverage */
+
+            if (mplp_conf->reg && (pos < beg0 || pos >= end0))
+                 continue; /* out of the region requested */
+            if (mplp_conf->bed && tid >= 0 && !bed_overlap(mplp_conf->bed, h->target_name[tid], pos, pos+1))
+                 continue;
+            if (tid != ref_tid) {
+                free(ref); ref = 0;
+                if (mplp_conf->fai) {
+                     ref = faidx_fetch_seq(mplp_conf->fai, h->target_name[tid], 0, 0x7fffffff, &ref_len);
+                     if (NULL == ref || h->target_len[tid] != ref_len) {
+                          LOG_DEBUG("ref %s at %p h->target_len[tid]=%d ref_len=%d\n", h->target_name[tid], ref, h->target_name[tid], ref_len)
+                          LOG_FATAL("Reference fasta file doesn't seem to contain the right sequence(s) for this BAM file. (mismatch for seq %s listed in BAM header).\n", h->target_name[tid]);
+                          return -1;
+                     }
+                     strtoupper(ref);/* safeguard */
+                     LOG_DEBUG("%s\n", "sequence fetched");
+                }
+                for (i = 0; i < n; ++i)  {
+                     data[i]->ref = ref, data[i]->ref_id = tid;
+                }
+                ref_tid = tid;
+                if (mplp_conf->metrics) {
+                     metrics_set_label(mplp_conf->metrics, "chrom", h->target_name[tid]);
+                }
             }
-            for (i = 0; i < n; ++i)  {
-                 data[i]->ref = ref, data[i]->ref_id = tid;
-            }
-            ref_tid = tid;
-        }
-        i=0; /* i is 1 for first pos which is a bug due to the removal
-              * of one of the loops, so reset here */
+            i=0; /* i is 1 for first pos which is a bug due to the removal
+                  * of one of the loops, so reset here */
 
-        plp_counter += 1;
-        if (1 == plp_counter%100000) {
-             LOG_VERBOSE("Alive and happily crunching away on pos"
-                         " %d of %s...\n", pos+1, h->target_name[tid]);
-        }
-
-        compile_plp_col(&plp_col, plp[i], n_plp[i], mplp_conf,
-                        ref, pos, ref_len, h->target_name[tid]);
+            plp_counter += 1;
+            if (1 == plp_counter%100000) {
+                 LOG_VERBOSE("Alive and happily crunching away on pos"
+                             " %d of %s...\n", pos+1, h->target_name[tid]);
+            }
+            if (mplp_conf->metrics) {
+                 metrics_set(mplp_conf->metrics, metrics_cols, plp_counter);
+                 metrics_set(mplp_conf->metrics, metrics_reads, data[0]->num_reads);
+                 metrics_set(mplp_conf->metrics, metrics_pos, pos+1);
+                 if (metrics_tick(mplp_conf->metrics)) {
+                      LOG_WARN("%s\n", "Couldn't write metrics snapshot");
+                 }
+            }
 
-        (*plp_proc_func)(& plp_col, plp_proc_conf);
+            compile_plp_col(&plp_col, win, col, mplp_conf,
+                            ref, pos, ref_len, h->target_name[tid]);
 
-        plp_col_free(& plp_col);
+            if (mplp_conf->consensus) {
+                 consensus_add_col(mplp_conf->consensus, & plp_col, h->target_len[tid]);
+            }
+            (*plp_proc_func)(& plp_col, plp_proc_conf);
 
-    } /* while bam_mplp_auto */
+            if (mplp_conf->evidence) {
+                 evidence_add_col(mplp_conf->evidence, win, col);
+            }
+            if (mplp_conf->cost_profile) {
+                 cost_profile_add_col(mplp_conf->cost_profile, h->target_name[tid],
+                                      pos, plp_col.coverage_plp);
+            }
+            plp_col_free(& plp_col);
+        }
+    } /* while plp_sweep_next */
+    if (ret < 0) {
+         LOG_FATAL("%s\n", "Pileup failed");
+         return -1;
+    }
 
 #ifdef USE_ALNERRPROF
     if (alnerrprof) {
@@ -1453,14 +1885,22 @@ mpileup(const mplp_conf_t *mplp_conf,
     }
 #endif
     free(buf.s);
-    bam_mplp_destroy(iter);
+    plp_sweep_destroy(sweep);
     bam_hdr_destroy(h);
     for (i = 0; i < n; ++i) {
         sam_close(data[i]->fp);
         if (data[i]->iter) bam_itr_destroy(data[i]->iter);
+        if (data[i]->idx) hts_idx_destroy(data[i]->idx);
+        if (data[i]->sidecars) {
+            int j;
+            for (j = 0; j < mplp_conf->num_sidecars; j++) {
+                sidecar_close(data[i]->sidecars[j]);
+            }
+            free(data[i]->sidecars);
+        }
         free(data[i]);
     }
-    free(data); free(plp); free(ref); free(n_plp);
+    free(data); free(ref);
     return 0;
 }
 /* mpileup() */
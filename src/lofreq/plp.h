@@ -33,6 +33,9 @@
 #include "utils.h"
 #include "vcf.h"
 #include "utils.h"
+#include "primer_clip.h"
+#include "recal_table.h"
+#include "metrics.h"
 
 /* mpileup configuration flags 
  */
@@ -44,6 +47,7 @@
 #define MPLP_REDO_IDAQ   0x200
 #define MPLP_USE_SQ      0x400
 #define MPLP_ILLUMINA13  0x800
+#define MPLP_MERGE_MATES 0x1000
 
 
 extern const char *bam_nt4_rev_table; /* similar to bam_nt16_rev_table */
@@ -61,10 +65,21 @@ typedef struct {
      int min_plp_bq; /* use with caution: this makes lofreq blind to any bases below this value */
      int min_plp_idq;
      int def_nm_q;
+     int max_indel_alleles; /* track at most this many ins and del alleles per column (0: all). see compile_plp_col() */
      char *reg;
+     char **regs; /* several regions read via the index (instead of reg) */
+     int num_regs;
      char *fa;
      faidx_t *fai;
      void *bed;
+     primer_idx_t *primers; /* amplicon primers to clip on the fly */
+     recal_table_t *recal; /* base quality recalibration table */
+     char **sidecar_fns; /* tag sidecar files (see sidecar.h) */
+     int num_sidecars;
+     metrics_t *metrics; /* live metrics snapshots if set */
+     void *consensus; /* consensus_t: consensus fasta written on the fly if set (see consensus.h) */
+     void *cost_profile; /* cost_profile_t: per window cost written if set (see cost_profile.h) */
+     void *evidence; /* evidence_t: supporting reads of calls written if set (see evidence.h) */
      char *alnerrprof_file; /* logically belongs to varcall_conf, but we need it here since only here the bam header is known */
      char cmdline[1024];
 } mplp_conf_t;
@@ -94,6 +109,9 @@ typedef struct {
      long int fw_counts[NUM_NT4]; 
      long int rv_counts[NUM_NT4]; 
      /* fw_counts[b] + rv_counts[b] = x_quals.n = coverage */
+     double cons_counts[NUM_NT4]; /* error-prob corrected counts (before
+                                   * base-level filtering) used for
+                                   * determining the consensus */
 
      int num_heads; /* number of read starts at this pos */
      int num_tails; /* number of read ends at this pos */
@@ -112,12 +130,14 @@ typedef struct {
      int num_non_indels;/* non-indel events for which we have indel qualities */
 
      int num_ins, sum_ins;
+     int num_ins_evicted; /* alleles dropped by top-k tracking. their reads count as non-events */
      int_varray_t ins_quals; 
      int_varray_t ins_map_quals;
      int_varray_t ins_source_quals;
      ins_event *ins_event_counts;
 
      int num_dels, sum_dels;
+     int num_dels_evicted; /* see num_ins_evicted */
      int_varray_t del_quals; 
      int_varray_t del_map_quals;
      int_varray_t del_source_quals;
@@ -146,6 +166,15 @@ typedef struct {
 
 #define PLP_COL_ADD_QUAL(p, q)   int_varray_add_value((p), (q))
 
+void
+plp_col_init(plp_col_t *p);
+
+void
+plp_col_free(plp_col_t *p);
+
+void
+plp_col_merge(plp_col_t *dst, const plp_col_t *src);
+
 /* initialize members of preallocated varcall_conf */
 void init_mplp_conf(mplp_conf_t *c);
 
@@ -0,0 +1,529 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Persistent pileup summaries for incremental calling. See plp_store.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "htslib/bgzf.h"
+#include "htslib/sam.h"
+
+#include "log.h"
+#include "utils.h"
+#include "plp_store.h"
+
+
+#define PLP_STORE_MAGIC "LPS\3"
+
+
+struct plp_store {
+     char *fn;
+     BGZF *fp;
+     int is_write;
+     int err;
+     int32_t n_targets;
+     char **target_names;
+     int32_t last_tid;
+     int32_t last_pos;
+};
+
+
+/* low level i/o. errors are remembered in s->err, so that callers
+ * only need to check once per record
+ */
+static void
+put(plp_store_t *s, const void *data, size_t len)
+{
+     if (! s->err && bgzf_write(s->fp, data, len) != (ssize_t)len) {
+          s->err = 1;
+     }
+}
+
+static void
+get(plp_store_t *s, void *data, size_t len)
+{
+     if (! s->err && bgzf_read(s->fp, data, len) != (ssize_t)len) {
+          s->err = 1;
+     }
+}
+
+static void
+put_i32(plp_store_t *s, int32_t v)
+{
+     put(s, &v, 4);
+}
+
+static int32_t
+get_i32(plp_store_t *s)
+{
+     int32_t v = 0;
+     get(s, &v, 4);
+     return v;
+}
+
+static void
+put_i64(plp_store_t *s, int64_t v)
+{
+     put(s, &v, 8);
+}
+
+static int64_t
+get_i64(plp_store_t *s)
+{
+     int64_t v = 0;
+     get(s, &v, 8);
+     return v;
+}
+
+static void
+put_str(plp_store_t *s, const char *str)
+{
+     uint32_t len = strlen(str);
+     put(s, &len, 4);
+     put(s, str, len);
+}
+
+/* returns a newly allocated string */
+static char *
+get_str(plp_store_t *s)
+{
+     uint32_t len = 0;
+     char *str;
+
+     get(s, &len, 4);
+     if (s->err) {
+          return NULL;
+     }
+     str = malloc(len+1);
+     get(s, str, len);
+     str[len] = '\0';
+     return str;
+}
+
+/* reads a string into a buffer of size bufsize */
+static void
+get_str_buf(plp_store_t *s, char *buf, size_t bufsize)
+{
+     char *str = get_str(s);
+     if (str) {
+          if (strlen(str) >= bufsize) {
+               s->err = 1;
+          } else {
+               strcpy(buf, str);
+          }
+          free(str);
+     }
+}
+
+static void
+put_varray(plp_store_t *s, const int_varray_t *a)
+{
+     uint32_t n = a->n;
+     put(s, &n, 4);
+     if (n) {
+          put(s, a->data, n * sizeof(int));
+     }
+}
+
+/* a has to be initialized and empty */
+static void
+get_varray(plp_store_t *s, int_varray_t *a)
+{
+     uint32_t n = 0;
+
+     get(s, &n, 4);
+     if (s->err || 0 == n) {
+          return;
+     }
+     assert(0 == a->n);
+     a->data = realloc(a->data, n * sizeof(int));
+     a->alloced = n * sizeof(int);
+     get(s, a->data, n * sizeof(int));
+     a->n = s->err ? 0 : n;
+}
+
+
+static void
+put_col(plp_store_t *s, const plp_col_t *p)
+{
+     ins_event *ins_it, *ins_it_tmp;
+     del_event *del_it, *del_it_tmp;
+     int i;
+
+     put_i32(s, p->pos);
+     put(s, &p->ref_base, 1);
+     put_str(s, p->cons_base);
+     put_i32(s, p->coverage_plp);
+     put_i32(s, p->num_bases);
+     put_i32(s, p->num_ign_indels);
+     put_i32(s, p->num_non_indels);
+     put(s, p->cons_counts, sizeof(p->cons_counts));
+     for (i=0; i<NUM_NT4; i++) {
+          put_varray(s, & p->base_quals[i]);
+          put_varray(s, & p->baq_quals[i]);
+          put_varray(s, & p->map_quals[i]);
+          put_varray(s, & p->source_quals[i]);
+#ifdef USE_ALNERRPROF
+          put_varray(s, & p->alnerr_qual[i]);
+#endif
+          put_i64(s, p->fw_counts[i]);
+          put_i64(s, p->rv_counts[i]);
+     }
+     put_i32(s, p->num_heads);
+     put_i32(s, p->num_tails);
+
+     put_i32(s, p->num_ins);
+     put_i32(s, p->sum_ins);
+     put_varray(s, & p->ins_quals);
+     put_varray(s, & p->ins_map_quals);
+     put_varray(s, & p->ins_source_quals);
+     put_i32(s, HASH_CNT(hh_ins, p->ins_event_counts));
+     HASH_ITER(hh_ins, p->ins_event_counts, ins_it, ins_it_tmp) {
+          put_str(s, ins_it->key);
+          put_i32(s, ins_it->count);
+          put_i32(s, ins_it->cons_quals);
+          put_varray(s, & ins_it->ins_quals);
+          put_varray(s, & ins_it->ins_aln_quals);
+          put_varray(s, & ins_it->ins_map_quals);
+          put_varray(s, & ins_it->ins_source_quals);
+          put_i64(s, ins_it->fw_rv[0]);
+          put_i64(s, ins_it->fw_rv[1]);
+     }
+
+     put_i32(s, p->num_dels);
+     put_i32(s, p->sum_dels);
+     put_varray(s, & p->del_quals);
+     put_varray(s, & p->del_map_quals);
+     put_varray(s, & p->del_source_quals);
+     put_i32(s, HASH_CNT(hh_del, p->del_event_counts));
+     HASH_ITER(hh_del, p->del_event_counts, del_it, del_it_tmp) {
+          put_str(s, del_it->key);
+          put_i32(s, del_it->count);
+          put_i32(s, del_it->cons_quals);
+          put_varray(s, & del_it->del_quals);
+          put_varray(s, & del_it->del_aln_quals);
+          put_varray(s, & del_it->del_map_quals);
+          put_varray(s, & del_it->del_source_quals);
+          put_i64(s, del_it->fw_rv[0]);
+          put_i64(s, del_it->fw_rv[1]);
+     }
+
+     put_i64(s, p->non_ins_fw_rv[0]);
+     put_i64(s, p->non_ins_fw_rv[1]);
+     put_i64(s, p->non_del_fw_rv[0]);
+     put_i64(s, p->non_del_fw_rv[1]);
+     put_i32(s, p->has_indel_aqs);
+     put_i32(s, p->num_ins_evicted);
+     put_i32(s, p->num_dels_evicted);
+     put_i32(s, p->hrun);
+}
+/* put_col() */
+
+
+/* p has to be initialized with plp_col_init() */
+static void
+get_col(plp_store_t *s, plp_col_t *p)
+{
+     char key[MAX_INDELSIZE];
+     int i, n;
+
+     p->pos = get_i32(s);
+     get(s, &p->ref_base, 1);
+     get_str_buf(s, p->cons_base, sizeof(p->cons_base));
+     p->coverage_plp = get_i32(s);
+     p->num_bases = get_i32(s);
+     p->num_ign_indels = get_i32(s);
+     p->num_non_indels = get_i32(s);
+     get(s, p->cons_counts, sizeof(p->cons_counts));
+     for (i=0; i<NUM_NT4; i++) {
+          get_varray(s, & p->base_quals[i]);
+          get_varray(s, & p->baq_quals[i]);
+          get_varray(s, & p->map_quals[i]);
+          get_varray(s, & p->source_quals[i]);
+#ifdef USE_ALNERRPROF
+          get_varray(s, & p->alnerr_qual[i]);
+#endif
+          p->fw_counts[i] = get_i64(s);
+          p->rv_counts[i] = get_i64(s);
+     }
+     p->num_heads = get_i32(s);
+     p->num_tails = get_i32(s);
+
+     p->num_ins = get_i32(s);
+     p->sum_ins = get_i32(s);
+     get_varray(s, & p->ins_quals);
+     get_varray(s, & p->ins_map_quals);
+     get_varray(s, & p->ins_source_quals);
+     n = get_i32(s);
+     for (i=0; i<n && ! s->err; i++) {
+          ins_event *it;
+          get_str_buf(s, key, sizeof(key));
+          if (s->err) {
+               break;
+          }
+          it = get_ins_sequence(& p->ins_event_counts, key);
+          it->count = get_i32(s);
+          it->cons_quals = get_i32(s);
+          get_varray(s, & it->ins_quals);
+          get_varray(s, & it->ins_aln_quals);
+          get_varray(s, & it->ins_map_quals);
+          get_varray(s, & it->ins_source_quals);
+          it->fw_rv[0] = get_i64(s);
+          it->fw_rv[1] = get_i64(s);
+     }
+
+     p->num_dels = get_i32(s);
+     p->sum_dels = get_i32(s);
+     get_varray(s, & p->del_quals);
+     get_varray(s, & p->del_map_quals);
+     get_varray(s, & p->del_source_quals);
+     n = get_i32(s);
+     for (i=0; i<n && ! s->err; i++) {
+          del_event *it;
+          get_str_buf(s, key, sizeof(key));
+          if (s->err) {
+               break;
+          }
+          it = get_del_sequence(& p->del_event_counts, key);
+          it->count = get_i32(s);
+          it->cons_quals = get_i32(s);
+          get_varray(s, & it->del_quals);
+          get_varray(s, & it->del_aln_quals);
+          get_varray(s, & it->del_map_quals);
+          get_varray(s, & it->del_source_quals);
+          it->fw_rv[0] = get_i64(s);
+          it->fw_rv[1] = get_i64(s);
+     }
+
+     p->non_ins_fw_rv[0] = get_i64(s);
+     p->non_ins_fw_rv[1] = get_i64(s);
+     p->non_del_fw_rv[0] = get_i64(s);
+     p->non_del_fw_rv[1] = get_i64(s);
+     p->has_indel_aqs = get_i32(s);
+     p->num_ins_evicted = get_i32(s);
+     p->num_dels_evicted = get_i32(s);
+     p->hrun = get_i32(s);
+}
+/* get_col() */
+
+
+static void
+store_free(plp_store_t *s)
+{
+     int i;
+
+     for (i=0; i<s->n_targets; i++) {
+          free(s->target_names[i]);
+     }
+     free(s->target_names);
+     free(s->fn);
+     free(s);
+}
+
+
+plp_store_t *
+plp_store_open(const char *fn, const char *mode,
+               const bam_hdr_t *header, const char *params)
+{
+     plp_store_t *s;
+     char magic[4];
+     char *stored_params;
+     int i;
+
+     s = calloc(1, sizeof(plp_store_t));
+     s->fn = strdup(fn);
+     s->is_write = (mode[0] == 'w');
+     s->last_tid = s->last_pos = -1;
+     if (NULL == (s->fp = bgzf_open(fn, s->is_write ? "w" : "r"))) {
+          LOG_ERROR("Couldn't open state file %s\n", fn);
+          store_free(s);
+          return NULL;
+     }
+
+     if (s->is_write) {
+          put(s, PLP_STORE_MAGIC, 4);
+          put_str(s, params);
+          put_i32(s, header->n_targets);
+          for (i=0; i<header->n_targets; i++) {
+               put_str(s, header->target_name[i]);
+          }
+          if (s->err) {
+               LOG_ERROR("Couldn't write to %s\n", fn);
+               bgzf_close(s->fp);
+               store_free(s);
+               return NULL;
+          }
+          s->n_targets = header->n_targets;
+          s->target_names = calloc(s->n_targets, sizeof(char *));
+          for (i=0; i<s->n_targets; i++) {
+               s->target_names[i] = strdup(header->target_name[i]);
+          }
+          return s;
+     }
+
+     get(s, magic, 4);
+     if (s->err || memcmp(magic, PLP_STORE_MAGIC, 4)) {
+          LOG_ERROR("%s is not a state file\n", fn);
+          bgzf_close(s->fp);
+          store_free(s);
+          return NULL;
+     }
+     stored_params = get_str(s);
+     if (s->err || strcmp(stored_params, params)) {
+          LOG_ERROR("State file %s was written with different parameters (%s) than the current ones (%s)\n",
+                    fn, stored_params ? stored_params : "?", params);
+          free(stored_params);
+          bgzf_close(s->fp);
+          store_free(s);
+          return NULL;
+     }
+     free(stored_params);
+
+     s->n_targets = get_i32(s);
+     if (! s->err && s->n_targets == header->n_targets) {
+          s->target_names = calloc(s->n_targets, sizeof(char *));
+          for (i=0; i<s->n_targets && ! s->err; i++) {
+               s->target_names[i] = get_str(s);
+               if (! s->target_names[i] || strcmp(s->target_names[i], header->target_name[i])) {
+                    s->err = 1;
+               }
+          }
+     } else {
+          s->n_targets = 0;
+          s->err = 1;
+     }
+     if (s->err) {
+          LOG_ERROR("Targets stored in %s don't match the ones of the BAM header\n", fn);
+          bgzf_close(s->fp);
+          store_free(s);
+          return NULL;
+     }
+     return s;
+}
+/* plp_store_open() */
+
+
+int
+plp_store_read(plp_store_t *s, plp_store_rec_t *rec)
+{
+     int32_t tid;
+     ssize_t ret;
+
+     assert(! s->is_write);
+     plp_col_init(& rec->col);
+     rec->calls = NULL;
+     if (s->err) {
+          return -1;
+     }
+
+     if (0 == (ret = bgzf_read(s->fp, &tid, 4))) {
+          return 0;
+     } else if (ret != 4 || tid < 0 || tid >= s->n_targets) {
+          s->err = 1;
+     }
+     if (! s->err) {
+          rec->tid = tid;
+          rec->col.target = strdup(s->target_names[tid]);
+          get_col(s, & rec->col);
+          rec->num_snv_tests = get_i64(s);
+          rec->num_indel_tests = get_i64(s);
+          rec->calls = get_str(s);
+     }
+     if (! s->err && (tid < s->last_tid
+                      || (tid == s->last_tid && rec->col.pos <= s->last_pos))) {
+          LOG_ERROR("State file %s is not sorted\n", s->fn);
+          s->err = 1;
+     }
+     if (s->err) {
+          LOG_ERROR("Couldn't read record from %s\n", s->fn);
+          return -1;
+     }
+     s->last_tid = tid;
+     s->last_pos = rec->col.pos;
+     return 1;
+}
+/* plp_store_read() */
+
+
+int
+plp_store_write(plp_store_t *s, const plp_store_rec_t *rec)
+{
+     assert(s->is_write);
+     if (rec->tid < s->last_tid
+         || (rec->tid == s->last_tid && rec->col.pos <= s->last_pos)) {
+          LOG_ERROR("Records written to %s are not sorted\n", s->fn);
+          s->err = 1;
+          return -1;
+     }
+     put_i32(s, rec->tid);
+     put_col(s, & rec->col);
+     put_i64(s, rec->num_snv_tests);
+     put_i64(s, rec->num_indel_tests);
+     put_str(s, rec->calls ? rec->calls : "");
+     if (s->err) {
+          LOG_ERROR("Couldn't write record to %s\n", s->fn);
+          return -1;
+     }
+     s->last_tid = rec->tid;
+     s->last_pos = rec->col.pos;
+     return 0;
+}
+/* plp_store_write() */
+
+
+int
+plp_store_close(plp_store_t *s)
+{
+     int rc;
+
+     if (NULL == s) {
+          return 0;
+     }
+     rc = s->err;
+     if (bgzf_close(s->fp)) {
+          LOG_ERROR("Couldn't close %s\n", s->fn);
+          rc = 1;
+     }
+     store_free(s);
+     return rc;
+}
+/* plp_store_close() */
+
+
+void
+plp_store_rec_free(plp_store_rec_t *rec)
+{
+     plp_col_free(& rec->col);
+     free(rec->calls);
+     rec->calls = NULL;
+}
+/* plp_store_rec_free() */
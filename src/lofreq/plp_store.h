@@ -0,0 +1,91 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef PLP_STORE_H
+#define PLP_STORE_H
+
+#include <stdint.h>
+
+#include "htslib/sam.h"
+#include "plp.h"
+
+
+/* Persistent pileup summaries for incremental calling (see lofreq
+ * call --state).
+ *
+ * A store is a BGZF compressed file holding one record per covered
+ * position: the compiled pileup column (qualities, strand counts,
+ * indel events), the number of tests performed for it and the
+ * (unfiltered) variant calls made for it. Records are sorted by
+ * target (in BAM header order) and position, so that updating a store
+ * with new reads is a single streaming pass: records not covered by
+ * the new reads are copied as is, covered ones are merged with the
+ * new column (plp_col_merge()) and called again.
+ *
+ * The store also records the BAM header targets and a string of
+ * calling parameters, which both have to match when it's read again.
+ */
+
+
+typedef struct {
+     int32_t tid;
+     plp_col_t col;
+     long long int num_snv_tests;
+     long long int num_indel_tests;
+     char *calls; /* vcf lines (unfiltered). might be empty but not NULL */
+} plp_store_rec_t;
+
+typedef struct plp_store plp_store_t;
+
+
+/* opens a store for reading (mode "r") or writing ("w"). targets of
+ * header and params have to match the ones the store was written
+ * with. returns NULL on error */
+plp_store_t *
+plp_store_open(const char *fn, const char *mode,
+               const bam_hdr_t *header, const char *params);
+
+/* reads the next record into rec, which has to be freed with
+ * plp_store_rec_free(). returns 1 if a record was read, 0 at end of
+ * file and -1 on error */
+int
+plp_store_read(plp_store_t *s, plp_store_rec_t *rec);
+
+/* records have to be written in order. returns non-zero on error */
+int
+plp_store_write(plp_store_t *s, const plp_store_rec_t *rec);
+
+/* returns non-zero if closing failed or an error occured before */
+int
+plp_store_close(plp_store_t *s);
+
+void
+plp_store_rec_free(plp_store_rec_t *rec);
+
+#endif
@@ -0,0 +1,827 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+/* Structure-of-arrays pileup engine. See plp_sweep.h
+ *
+ * The per column semantics (qpos, indel, is_del, is_refskip,
+ * is_head, is_tail) follow htslib's resolve_cigar2() and the depth
+ * limit follows bam_plp_push(), i.e. reads are dropped if they start
+ * at a position that is already covered by max_depth reads.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "htslib/sam.h"
+#include <uthash.h>
+
+#include "log.h"
+#include "defaults.h"
+#include "plp_sweep.h"
+
+
+/* columns per window. shrunk in deep regions so that a window holds
+ * roughly PLP_SWEEP_ENTRY_BUDGET pileup entries */
+#define PLP_SWEEP_MAX_WIN 1024
+#define PLP_SWEEP_ENTRY_BUDGET (1<<22)
+#define PLP_SWEEP_INIT_SLOTS 1024
+
+
+/* read waiting for its overlapping mate, keyed by read name */
+typedef struct {
+     char *qname;
+     int slot;
+     uint16_t flag;
+     UT_hash_handle hh;
+} mate_wait_t;
+
+
+struct plp_sweep {
+     int (*func)(void *data, bam1_t *b);
+     void *data;
+     int max_depth;
+     int max_shift; /* see plp_sweep_set_max_shift() */
+     int find_mates; /* see plp_sweep_set_find_mates() */
+     int keep_records; /* see plp_sweep_set_keep_records() */
+
+     bam1_t *b; /* read buffer. holds the pending read if has_pending */
+     int has_pending;
+     int is_eof;
+
+     /* ring buffer of active reads: slots head ... head+n-1 (mod
+      * reads.m) in input order. retired reads leave holes (live=0)
+      * which are removed once they reach head or on grow */
+     plp_sweep_reads_t reads;
+     uint8_t *live;
+     int head;
+     int n;
+     int num_live;
+     mate_wait_t *mate_waits; /* hash */
+     int *ent_of; /* per slot scratch for build_window() */
+
+     int tid; /* current target */
+     int32_t pos; /* first column not produced yet */
+     int32_t last_beg; /* for sortedness check */
+
+     plp_sweep_win_t win;
+     int m_cols;
+     int m_ents;
+};
+
+
+
+static void *
+sweep_realloc(void *ptr, size_t size)
+{
+     void *p;
+     if (NULL == (p = realloc(ptr, size))) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          exit(1);
+     }
+     return p;
+}
+
+
+/* (re)allocates the reads SoA to m slots, moving the live reads to the
+ * front (in order) */
+static void
+reads_resize(plp_sweep_t *s, int m)
+{
+     plp_sweep_reads_t old = s->reads;
+     uint8_t *old_live = s->live;
+     plp_sweep_reads_t *r = &s->reads;
+     int *new_slot;
+     int k, j;
+
+     r->m = m;
+     r->beg = malloc(m * sizeof(int32_t));
+     r->end = malloc(m * sizeof(int32_t));
+     r->mq = malloc(m * sizeof(uint8_t));
+     r->flag = malloc(m * sizeof(uint8_t));
+     r->sq = malloc(m * sizeof(int));
+     r->l_qseq = malloc(m * sizeof(int));
+     r->nt16 = malloc(m * sizeof(uint8_t *));
+     r->bq = malloc(m * sizeof(uint8_t *));
+     r->baq = malloc(m * sizeof(int8_t *));
+     r->bi = malloc(m * sizeof(int8_t *));
+     r->bd = malloc(m * sizeof(int8_t *));
+     r->ai = malloc(m * sizeof(int8_t *));
+     r->ad = malloc(m * sizeof(int8_t *));
+     r->ref_qpos = malloc(m * sizeof(int32_t *));
+     r->ref_indel = malloc(m * sizeof(int32_t *));
+     r->ref_op = malloc(m * sizeof(uint8_t *));
+     r->mate = malloc(m * sizeof(int));
+     r->wait = malloc(m * sizeof(void *));
+     r->mem = malloc(m * sizeof(void *));
+     r->rec = malloc(m * sizeof(bam1_t *));
+     s->live = calloc(m, sizeof(uint8_t));
+     s->ent_of = sweep_realloc(s->ent_of, m * sizeof(int));
+     new_slot = malloc((old.m+1) * sizeof(int));
+     if (! r->beg || ! r->end || ! r->mq || ! r->flag || ! r->sq || ! r->l_qseq
+         || ! r->nt16 || ! r->bq || ! r->baq || ! r->bi || ! r->bd || ! r->ai || ! r->ad
+         || ! r->ref_qpos || ! r->ref_indel || ! r->ref_op || ! r->mate || ! r->wait
+         || ! r->mem || ! r->rec || ! s->live || ! new_slot) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          exit(1);
+     }
+
+     for (k=0, j=0; k<s->n; k++) {
+          int i = (s->head + k) & (old.m - 1);
+          if (! old_live[i]) {
+               continue;
+          }
+          r->beg[j] = old.beg[i];
+          r->end[j] = old.end[i];
+          r->mq[j] = old.mq[i];
+          r->flag[j] = old.flag[i];
+          r->sq[j] = old.sq[i];
+          r->l_qseq[j] = old.l_qseq[i];
+          r->nt16[j] = old.nt16[i];
+          r->bq[j] = old.bq[i];
+          r->baq[j] = old.baq[i];
+          r->bi[j] = old.bi[i];
+          r->bd[j] = old.bd[i];
+          r->ai[j] = old.ai[i];
+          r->ad[j] = old.ad[i];
+          r->ref_qpos[j] = old.ref_qpos[i];
+          r->ref_indel[j] = old.ref_indel[i];
+          r->ref_op[j] = old.ref_op[i];
+          r->mate[j] = old.mate[i];
+          r->wait[j] = old.wait[i];
+          r->mem[j] = old.mem[i];
+          r->rec[j] = old.rec[i];
+          s->live[j] = 1;
+          new_slot[i] = j;
+          j++;
+     }
+     assert(j == s->num_live);
+     s->head = 0;
+     s->n = j;
+
+     /* mate links and waits refer to slots */
+     for (j=0; j<s->n; j++) {
+          if (r->mate[j] >= 0) {
+               r->mate[j] = new_slot[r->mate[j]];
+          }
+          if (r->wait[j]) {
+               ((mate_wait_t *)r->wait[j])->slot = j;
+          }
+     }
+     free(new_slot);
+
+     free(old.beg); free(old.end); free(old.mq); free(old.flag);
+     free(old.sq); free(old.l_qseq); free(old.nt16); free(old.bq);
+     free(old.baq); free(old.bi); free(old.bd); free(old.ai); free(old.ad);
+     free(old.ref_qpos); free(old.ref_indel); free(old.ref_op);
+     free(old.mate); free(old.wait); free(old.mem); free(old.rec);
+     free(old_live);
+}
+/* reads_resize() */
+
+
+/* copies a per base quality tag (phred+33 string) to dst as proper
+ * phred values. returns NULL if tag is missing */
+static int8_t *
+decode_qual_tag(const bam1_t *b, const char tag[2], int8_t *dst, int len)
+{
+     uint8_t *aux = bam_aux_get(b, tag);
+     const char *t;
+     int i;
+
+     if (! aux) {
+          return NULL;
+     }
+     t = (const char *)(aux+1); /* first char is type */
+     for (i=0; i<len && t[i]; i++) {
+          dst[i] = t[i] - 33;
+     }
+     /* tag too short: shouldn't happen */
+     for (; i<len; i++) {
+          dst[i] = 0;
+     }
+     return dst;
+}
+/* decode_qual_tag() */
+
+
+/* the bits of htslib's resolve_cigar2() which determine the indel
+ * following the ref position at the end of cigar op k */
+static int
+cigar_indel_after(const uint32_t *cigar, int n_cigar, int k)
+{
+     int op = bam_cigar_op(cigar[k]);
+     int op2, l2, j;
+     int indel = 0;
+
+     if (k + 1 >= n_cigar) {
+          return 0;
+     }
+     op2 = bam_cigar_op(cigar[k+1]);
+     l2 = bam_cigar_oplen(cigar[k+1]);
+
+     if (op2 == BAM_CDEL && op != BAM_CDEL) {
+          /* merge e.g. 1D2D to 3D */
+          indel = -l2;
+          for (j = k+2; j < n_cigar; ++j) {
+               if (bam_cigar_op(cigar[j]) != BAM_CDEL) {
+                    break;
+               }
+               indel -= bam_cigar_oplen(cigar[j]);
+          }
+     } else if (op2 == BAM_CINS) {
+          indel = l2;
+          for (j = k+2; j < n_cigar; ++j) {
+               op2 = bam_cigar_op(cigar[j]);
+               if (op2 == BAM_CINS) {
+                    indel += bam_cigar_oplen(cigar[j]);
+               } else if (op2 != BAM_CPAD) {
+                    break;
+               }
+          }
+     } else if (op2 == BAM_CPAD) {
+          int l3 = 0;
+          for (j = k+2; j < n_cigar; ++j) {
+               op2 = bam_cigar_op(cigar[j]);
+               if (op2 == BAM_CINS) {
+                    l3 += bam_cigar_oplen(cigar[j]);
+               } else if (op2 == BAM_CDEL || op2 == BAM_CMATCH || op2 == BAM_CREF_SKIP
+                          || op2 == BAM_CEQUAL || op2 == BAM_CDIFF) {
+                    break;
+               }
+          }
+          indel = l3;
+     }
+     return indel;
+}
+/* cigar_indel_after() */
+
+
+/* links read in slot to its mate if the mate is live and waiting for
+ * it. otherwise lets the read wait for its mate if that one might
+ * still come and overlap. supplementary alignments are ignored, as
+ * are pairs not flagged as first and second read */
+static void
+link_mate(plp_sweep_t *s, const bam1_t *b, int slot)
+{
+     const char *qname = bam_get_qname(b);
+     const uint16_t rmask = BAM_FREAD1 | BAM_FREAD2;
+     mate_wait_t *mw;
+
+     if (! (b->core.flag & BAM_FPAIRED) || (b->core.flag & BAM_FSUPPLEMENTARY)) {
+          return;
+     }
+
+     HASH_FIND_STR(s->mate_waits, qname, mw);
+     if (mw) {
+          if ((mw->flag & rmask) == (b->core.flag & rmask)) {
+               return;
+          }
+          s->reads.mate[slot] = mw->slot;
+          s->reads.mate[mw->slot] = slot;
+          s->reads.wait[mw->slot] = NULL;
+          HASH_DEL(s->mate_waits, mw);
+          free(mw->qname);
+          free(mw);
+          return;
+     }
+
+     if ((b->core.flag & BAM_FMUNMAP) || b->core.mtid != b->core.tid
+         || b->core.mpos >= s->reads.end[slot]) {
+          return;
+     }
+     mw = sweep_realloc(NULL, sizeof(mate_wait_t));
+     mw->qname = strdup(qname);
+     mw->slot = slot;
+     mw->flag = b->core.flag;
+     HASH_ADD_KEYPTR(hh, s->mate_waits, mw->qname, strlen(mw->qname), mw);
+     s->reads.wait[slot] = mw;
+}
+/* link_mate() */
+
+
+/* decode read into a new slot at the end of the ring. returns 0 if
+ * added, 1 if the read doesn't cover any reference position. */
+static int
+add_read(plp_sweep_t *s, const bam1_t *b)
+{
+     plp_sweep_reads_t *r = &s->reads;
+     const uint32_t *cigar = bam_get_cigar(b);
+     const uint8_t *seq = bam_get_seq(b);
+     const uint8_t *qual = bam_get_qual(b);
+     int n_cigar = b->core.n_cigar;
+     int l_qseq = b->core.l_qseq;
+     int32_t beg = b->core.pos;
+     int32_t end, rlen = 0;
+     int32_t x, y;
+     size_t size;
+     char *mem;
+     uint8_t *aux;
+     int i, k, slot;
+
+     for (k=0; k<n_cigar; k++) {
+          if (bam_cigar_type(bam_cigar_op(cigar[k])) & 2) {
+               rlen += bam_cigar_oplen(cigar[k]);
+          }
+     }
+     if (0 == rlen) {
+          return 1;
+     }
+     end = beg + rlen;
+
+     if (s->n == r->m) {
+          /* no free slot: compact if worth it, otherwise grow */
+          reads_resize(s, s->num_live < r->m/2 ? r->m : 2*r->m);
+     }
+     slot = (s->head + s->n) & (r->m - 1);
+
+     /* one block per read: int32 arrays first for alignment */
+     size = rlen * (2*sizeof(int32_t) + sizeof(uint8_t)) + (l_qseq+1) * 7;
+     if (NULL == (mem = malloc(size))) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          exit(1);
+     }
+     r->mem[slot] = mem;
+     r->ref_qpos[slot] = (int32_t *)mem; mem += rlen * sizeof(int32_t);
+     r->ref_indel[slot] = (int32_t *)mem; mem += rlen * sizeof(int32_t);
+     r->ref_op[slot] = (uint8_t *)mem; mem += rlen;
+     r->nt16[slot] = (uint8_t *)mem; mem += l_qseq+1;
+     r->bq[slot] = (uint8_t *)mem; mem += l_qseq+1;
+
+     r->beg[slot] = beg;
+     r->end[slot] = end;
+     r->mq[slot] = b->core.qual;
+     r->flag[slot] = bam_is_rev(b) ? PLP_SWEEP_IS_REV : 0;
+     r->l_qseq[slot] = l_qseq;
+     aux = bam_aux_get(b, SRC_QUAL_TAG);
+     r->sq[slot] = aux ? bam_aux2i(aux) : 0;
+
+     for (i=0; i<l_qseq; i++) {
+          r->nt16[slot][i] = bam_seqi(seq, i);
+     }
+     memcpy(r->bq[slot], qual, l_qseq);
+     /* one extra (N) base, as deletions at the very end of a read
+      * point past the query */
+     r->nt16[slot][l_qseq] = 15;
+     r->bq[slot][l_qseq] = 0;
+     r->baq[slot] = decode_qual_tag(b, BAQ_TAG, (int8_t *)mem, l_qseq+1); mem += l_qseq+1;
+     r->bi[slot] = decode_qual_tag(b, BI_TAG, (int8_t *)mem, l_qseq+1); mem += l_qseq+1;
+     r->bd[slot] = decode_qual_tag(b, BD_TAG, (int8_t *)mem, l_qseq+1); mem += l_qseq+1;
+     r->ai[slot] = decode_qual_tag(b, AI_TAG, (int8_t *)mem, l_qseq+1);
+#ifdef USE_OLD_AI_AD
+     if (! r->ai[slot]) {
+          r->ai[slot] = decode_qual_tag(b, "AI", (int8_t *)mem, l_qseq+1);
+     }
+#endif
+     mem += l_qseq+1;
+     r->ad[slot] = decode_qual_tag(b, AD_TAG, (int8_t *)mem, l_qseq+1);
+#ifdef USE_OLD_AI_AD
+     if (! r->ad[slot]) {
+          r->ad[slot] = decode_qual_tag(b, "AD", (int8_t *)mem, l_qseq+1);
+     }
+#endif
+
+     /* reference offset to query position map. leading I and S only
+      * advance the query position, as in resolve_cigar2() */
+     for (k=0, x=0, y=0; k<n_cigar; k++) {
+          int op = bam_cigar_op(cigar[k]);
+          int32_t l = bam_cigar_oplen(cigar[k]);
+          int32_t j;
+
+          if (op == BAM_CMATCH || op == BAM_CEQUAL || op == BAM_CDIFF) {
+               for (j=0; j<l; j++) {
+                    r->ref_qpos[slot][x+j] = y+j;
+                    r->ref_indel[slot][x+j] = 0;
+                    r->ref_op[slot][x+j] = 0;
+               }
+          } else if (op == BAM_CDEL || op == BAM_CREF_SKIP) {
+               uint8_t f = PLP_SWEEP_IS_DEL | (op == BAM_CREF_SKIP ? PLP_SWEEP_IS_REFSKIP : 0);
+               for (j=0; j<l; j++) {
+                    r->ref_qpos[slot][x+j] = y;
+                    r->ref_indel[slot][x+j] = 0;
+                    r->ref_op[slot][x+j] = f;
+               }
+          } else if (op == BAM_CINS || op == BAM_CSOFT_CLIP) {
+               y += l;
+               continue;
+          } else {
+               continue; /* H, P */
+          }
+          if (l > 0) {
+               r->ref_indel[slot][x+l-1] = cigar_indel_after(cigar, n_cigar, k);
+          }
+          x += l;
+          if (op != BAM_CDEL && op != BAM_CREF_SKIP) {
+               y += l;
+          }
+     }
+
+     r->rec[slot] = NULL;
+     if (s->keep_records && NULL == (r->rec[slot] = bam_dup1(b))) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          exit(1);
+     }
+
+     r->mate[slot] = -1;
+     r->wait[slot] = NULL;
+     if (s->find_mates) {
+          link_mate(s, b, slot);
+     }
+
+     s->live[slot] = 1;
+     s->n += 1;
+     s->num_live += 1;
+     return 0;
+}
+/* add_read() */
+
+
+static void
+retire_read(plp_sweep_t *s, int slot)
+{
+     plp_sweep_reads_t *r = &s->reads;
+
+     if (r->mate[slot] >= 0) {
+          r->mate[r->mate[slot]] = -1;
+          r->mate[slot] = -1;
+     }
+     if (r->wait[slot]) {
+          mate_wait_t *mw = (mate_wait_t *)r->wait[slot];
+          HASH_DEL(s->mate_waits, mw);
+          free(mw->qname);
+          free(mw);
+          r->wait[slot] = NULL;
+     }
+     free(s->reads.mem[slot]);
+     s->reads.mem[slot] = NULL;
+     if (r->rec[slot]) {
+          bam_destroy1(r->rec[slot]);
+          r->rec[slot] = NULL;
+     }
+     s->live[slot] = 0;
+     s->num_live -= 1;
+}
+
+
+/* retires all reads ending before pos and advances head over holes */
+static void
+retire_reads(plp_sweep_t *s, int32_t pos)
+{
+     int k;
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (s->reads.m - 1);
+          if (s->live[i] && s->reads.end[i] <= pos) {
+               retire_read(s, i);
+          }
+     }
+     while (s->n && ! s->live[s->head]) {
+          s->head = (s->head + 1) & (s->reads.m - 1);
+          s->n -= 1;
+     }
+}
+
+
+/* number of live reads covering pos */
+static int
+depth_at(const plp_sweep_t *s, int32_t pos)
+{
+     int k, d = 0;
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (s->reads.m - 1);
+          if (s->live[i] && s->reads.beg[i] <= pos && s->reads.end[i] > pos) {
+               d++;
+          }
+     }
+     return d;
+}
+
+
+/* makes sure the next read is pending unless eof. returns -1 on
+ * error */
+static int
+fetch_read(plp_sweep_t *s)
+{
+     int ret;
+
+     if (s->has_pending || s->is_eof) {
+          return 0;
+     }
+     ret = s->func(s->data, s->b);
+     if (ret < -1) {
+          LOG_ERROR("Reading alignments failed (%d)\n", ret);
+          return -1;
+     } else if (ret < 0) {
+          s->is_eof = 1;
+          return 0;
+     }
+     if (s->b->core.tid < s->tid
+         || (s->b->core.tid == s->tid && s->b->core.pos + s->max_shift < s->last_beg)) {
+          LOG_ERROR("%s\n", "Unsorted input. Please sort your BAM file first");
+          return -1;
+     }
+     s->has_pending = 1;
+     return 0;
+}
+
+
+plp_sweep_t *
+plp_sweep_init(int (*func)(void *data, bam1_t *b), void *data, int max_depth)
+{
+     plp_sweep_t *s;
+
+     if (NULL == (s = calloc(1, sizeof(plp_sweep_t)))) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          return NULL;
+     }
+     s->func = func;
+     s->data = data;
+     s->max_depth = max_depth;
+     s->b = bam_init1();
+     s->tid = -1;
+     s->pos = 0;
+     s->last_beg = -1;
+     reads_resize(s, PLP_SWEEP_INIT_SLOTS);
+     s->win.reads = &s->reads;
+     return s;
+}
+
+
+void
+plp_sweep_set_max_shift(plp_sweep_t *s, int max_shift)
+{
+     s->max_shift = max_shift;
+}
+
+
+void
+plp_sweep_set_find_mates(plp_sweep_t *s, int find_mates)
+{
+     s->find_mates = find_mates;
+}
+
+
+void
+plp_sweep_set_keep_records(plp_sweep_t *s, int keep_records)
+{
+     s->keep_records = keep_records;
+}
+
+
+void
+plp_sweep_destroy(plp_sweep_t *s)
+{
+     plp_sweep_reads_t *r;
+     int k;
+
+     if (! s) {
+          return;
+     }
+     r = &s->reads;
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (r->m - 1);
+          if (s->live[i]) {
+               retire_read(s, i);
+          }
+     }
+     free(r->beg); free(r->end); free(r->mq); free(r->flag);
+     free(r->sq); free(r->l_qseq); free(r->nt16); free(r->bq);
+     free(r->baq); free(r->bi); free(r->bd); free(r->ai); free(r->ad);
+     free(r->ref_qpos); free(r->ref_indel); free(r->ref_op);
+     free(r->mate); free(r->wait); free(r->mem); free(r->rec);
+     free(s->live);
+     free(s->ent_of);
+
+     free(s->win.off); free(s->win.slot); free(s->win.qpos);
+     free(s->win.indel); free(s->win.flag); free(s->win.mate);
+     bam_destroy1(s->b);
+     free(s);
+}
+
+
+/* fills the window for columns [beg, end) from the live reads. two
+ * passes: counting via difference array, then filling in input
+ * order */
+static void
+build_window(plp_sweep_t *s, int32_t beg, int32_t end)
+{
+     plp_sweep_win_t *w = &s->win;
+     const plp_sweep_reads_t *r = &s->reads;
+     int n_cols = end - beg;
+     int *fill;
+     int c, k, n_ents;
+
+     if (n_cols + 1 > s->m_cols) {
+          s->m_cols = n_cols + 1;
+          w->off = sweep_realloc(w->off, 2 * s->m_cols * sizeof(int));
+     }
+     fill = w->off + s->m_cols;
+     memset(w->off, 0, (n_cols + 1) * sizeof(int));
+
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (r->m - 1);
+          int32_t a, z;
+          if (! s->live[i]) {
+               continue;
+          }
+          a = MAX(r->beg[i], beg);
+          z = MIN(r->end[i], end);
+          if (a < z) {
+               w->off[a-beg] += 1;
+               w->off[z-beg] -= 1;
+          }
+     }
+     /* difference array -> depth -> offsets */
+     for (c=0, k=0, n_ents=0; c<n_cols; c++) {
+          k += w->off[c];
+          w->off[c] = n_ents;
+          fill[c] = n_ents;
+          n_ents += k;
+     }
+     w->off[n_cols] = n_ents;
+
+     if (n_ents > s->m_ents) {
+          s->m_ents = n_ents;
+          w->slot = sweep_realloc(w->slot, s->m_ents * sizeof(int));
+          w->qpos = sweep_realloc(w->qpos, s->m_ents * sizeof(int32_t));
+          w->indel = sweep_realloc(w->indel, s->m_ents * sizeof(int32_t));
+          w->flag = sweep_realloc(w->flag, s->m_ents * sizeof(uint8_t));
+          if (s->find_mates) {
+               w->mate = sweep_realloc(w->mate, s->m_ents * sizeof(int));
+          }
+     }
+
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (r->m - 1);
+          int32_t a, z, x;
+          if (! s->live[i]) {
+               continue;
+          }
+          a = MAX(r->beg[i], beg);
+          z = MIN(r->end[i], end);
+          for (x=a; x<z; x++) {
+               int e = fill[x-beg]++;
+               int32_t o = x - r->beg[i];
+               w->slot[e] = i;
+               w->qpos[e] = r->ref_qpos[i][o];
+               w->indel[e] = r->ref_indel[i][o];
+               w->flag[e] = r->ref_op[i][o]
+                    | (x == r->beg[i] ? PLP_SWEEP_IS_HEAD : 0)
+                    | (x == r->end[i]-1 ? PLP_SWEEP_IS_TAIL : 0);
+          }
+     }
+
+     if (s->find_mates) {
+          /* a live mate covering the column has an entry there */
+          for (c=0; c<n_cols; c++) {
+               int32_t x = beg + c;
+               int e;
+               for (e=w->off[c]; e<w->off[c+1]; e++) {
+                    s->ent_of[w->slot[e]] = e;
+               }
+               for (e=w->off[c]; e<w->off[c+1]; e++) {
+                    int m = r->mate[w->slot[e]];
+                    w->mate[e] = (m >= 0 && r->beg[m] <= x && r->end[m] > x) ? s->ent_of[m] : -1;
+               }
+          }
+     }
+
+     w->tid = s->tid;
+     w->beg = beg;
+     w->n_cols = n_cols;
+}
+/* build_window() */
+
+
+/* number of pileup entries read in slot adds to window s->pos ... end */
+static inline int
+win_overlap(const plp_sweep_t *s, int slot, int32_t end)
+{
+     int32_t b = MAX(s->reads.beg[slot], s->pos);
+     int32_t e = MIN(s->reads.end[slot], end);
+     return e > b ? e - b : 0;
+}
+
+
+int
+plp_sweep_next(plp_sweep_t *s, const plp_sweep_win_t **win)
+{
+     int32_t win_end, max_end;
+     int win_len;
+     long int num_ents;
+     int k;
+
+     *win = NULL;
+     retire_reads(s, s->pos);
+
+     if (fetch_read(s)) {
+          return -1;
+     }
+
+     /* nothing active: jump to next read. with shifted starts,
+      * reads following the pending one can start up to max_shift
+      * earlier */
+     if (0 == s->num_live) {
+          if (! s->has_pending) {
+               return 0;
+          }
+          if (s->b->core.tid != s->tid) {
+               s->tid = s->b->core.tid;
+               s->pos = 0;
+          }
+          s->pos = MAX(s->pos, s->b->core.pos - s->max_shift);
+     }
+
+     win_len = PLP_SWEEP_ENTRY_BUDGET / MAX(s->num_live, 1);
+     win_len = MAX(1, MIN(win_len, PLP_SWEEP_MAX_WIN));
+     win_end = s->pos + win_len;
+
+     num_ents = 0;
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (s->reads.m - 1);
+          if (s->live[i]) {
+               num_ents += win_overlap(s, i, win_end);
+          }
+     }
+
+     /* load all reads starting within window (and the ones that
+      * might be followed by such reads) */
+     while (s->has_pending && s->b->core.tid == s->tid && s->b->core.pos - s->max_shift < win_end) {
+          bam1_t *b = s->b;
+          int skip = 0;
+
+          /* window based on coverage before loading can be far too
+           * long if coverage jumps up: once the budget is used, end
+           * the window where the pending read (or the ones following
+           * it) might start */
+          if (num_ents >= PLP_SWEEP_ENTRY_BUDGET && b->core.pos - s->max_shift > s->pos) {
+               win_end = b->core.pos - s->max_shift;
+               break;
+          }
+
+          s->has_pending = 0;
+          s->last_beg = b->core.pos;
+          if (s->max_depth > 0 && s->num_live >= s->max_depth) {
+               skip = depth_at(s, b->core.pos) >= s->max_depth;
+          }
+          if (! skip) {
+               if (add_read(s, b)) {
+                    LOG_DEBUG("Ignoring read %s that doesn't cover any reference position\n",
+                              bam_get_qname(b));
+               } else {
+                    num_ents += win_overlap(s, (s->head + s->n - 1) & (s->reads.m - 1), win_end);
+               }
+          }
+          if (fetch_read(s)) {
+               return -1;
+          }
+     }
+     if (s->has_pending && s->b->core.tid != s->tid) {
+          s->last_beg = -1;
+     }
+
+     /* no need to go beyond last read end */
+     max_end = s->pos;
+     for (k=0; k<s->n; k++) {
+          int i = (s->head + k) & (s->reads.m - 1);
+          if (s->live[i] && s->reads.end[i] > max_end) {
+               max_end = s->reads.end[i];
+          }
+     }
+     win_end = MIN(win_end, max_end);
+     if (win_end <= s->pos) {
+          /* can only happen if all reads were dropped */
+          return plp_sweep_next(s, win);
+     }
+
+     build_window(s, s->pos, win_end);
+     s->pos = win_end;
+
+     *win = &s->win;
+     return 1;
+}
+/* plp_sweep_next() */
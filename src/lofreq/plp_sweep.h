@@ -0,0 +1,142 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+#ifndef PLP_SWEEP_H
+#define PLP_SWEEP_H
+
+#include <stdint.h>
+
+#include "htslib/sam.h"
+
+
+/* Pileup engine replacing htslib's bam_plp/bam_mplp iterators.
+ *
+ * Reads are decoded once when they enter the sweep (bases, base
+ * qualities, lofreq's per-base tags and a reference offset to query
+ * position map) and kept in a structure-of-arrays ring buffer until
+ * the sweep has passed their end. Columns are then produced a whole
+ * window at a time, again as structure of arrays, in the same order
+ * and with the same per read information (qpos, indel, is_del, etc.)
+ * as bam_pileup1_t.
+ */
+
+
+/* flags of a pileup entry (see bam_pileup1_t) */
+#define PLP_SWEEP_IS_DEL     0x1
+#define PLP_SWEEP_IS_REFSKIP 0x2
+#define PLP_SWEEP_IS_HEAD    0x4
+#define PLP_SWEEP_IS_TAIL    0x8
+
+/* per read flags */
+#define PLP_SWEEP_IS_REV     0x1
+
+
+/* active reads. all arrays are indexed by slot. per base arrays
+ * (nt16, bq, baq, bi, bd, ai, ad) are indexed by query position and
+ * are NULL if the corresponding tag was missing. qualities taken from
+ * tags are already offset corrected, i.e. proper phred values.
+ */
+typedef struct {
+     int m; /* allocated slots */
+     int32_t *beg; /* reference start (0-based, incl.) */
+     int32_t *end; /* reference end (excl.) */
+     uint8_t *mq;
+     uint8_t *flag;
+     int *sq; /* source quality as stored in SRC_QUAL_TAG (0 if missing) */
+     int *l_qseq;
+     uint8_t **nt16; /* bases as 4-bit codes (see seq_nt16_str) */
+     uint8_t **bq;
+     int8_t **baq;
+     int8_t **bi;
+     int8_t **bd;
+     int8_t **ai;
+     int8_t **ad;
+     bam1_t **rec; /* the read as passed in. NULL unless records are kept (see plp_sweep_set_keep_records()) */
+     /* private */
+     int32_t **ref_qpos; /* per ref offset */
+     int32_t **ref_indel; /* per ref offset */
+     uint8_t **ref_op; /* per ref offset */
+     int *mate; /* slot of live mate or -1 */
+     void **wait; /* mate_wait_t if waiting for mate */
+     void **mem; /* one block per read holding all of the above */
+} plp_sweep_reads_t;
+
+
+/* a window of consecutive columns on one target. entries of column c
+ * are found at off[c]...off[c+1]-1 of slot, qpos, indel and flag.
+ * columns without coverage (off[c]==off[c+1]) have to be skipped by
+ * the caller.
+ */
+typedef struct {
+     int tid;
+     int beg; /* position of first column */
+     int n_cols;
+     int *off; /* n_cols+1 */
+     int *slot; /* read slot in plp_sweep_reads_t */
+     int32_t *qpos;
+     int32_t *indel;
+     uint8_t *flag;
+     int *mate; /* entry of the mate in the same column or -1. only set if mates are searched for */
+     const plp_sweep_reads_t *reads;
+} plp_sweep_win_t;
+
+
+typedef struct plp_sweep plp_sweep_t;
+
+/* func is called to get the next read (sorted!) and has to return <0
+ * when done. same semantics as bam_plp_auto_f */
+plp_sweep_t *
+plp_sweep_init(int (*func)(void *data, bam1_t *b), void *data, int max_depth);
+
+/* allow reads to start up to max_shift positions after the position
+ * the input is sorted by, e.g. because their start was clipped on the
+ * fly by func. default is 0 */
+void
+plp_sweep_set_max_shift(plp_sweep_t *s, int max_shift);
+
+/* link overlapping mates, so that plp_sweep_win_t.mate is set. call
+ * before the first plp_sweep_next() */
+void
+plp_sweep_set_find_mates(plp_sweep_t *s, int find_mates);
+
+/* keep a copy of each read as passed in for as long as it is active
+ * (plp_sweep_reads_t.rec), e.g. to write it out again. costs memory
+ * and time, so off by default. call before the first
+ * plp_sweep_next() */
+void
+plp_sweep_set_keep_records(plp_sweep_t *s, int keep_records);
+
+void
+plp_sweep_destroy(plp_sweep_t *s);
+
+/* produces the next window with at least one covered column. returns
+ * 1 if a window was produced, 0 if done and -1 on error */
+int
+plp_sweep_next(plp_sweep_t *s, const plp_sweep_win_t **win);
+
+#endif
@@ -0,0 +1,338 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pon.h"
+#include "log.h"
+#include "plp.h"
+
+
+#define PON_MAGIC "LPON"
+#define PON_VERSION 1
+
+
+/* file header. followed by target names and lengths, the bin index
+ * at bins_off and the sites at sites_off (both 8 byte aligned) */
+typedef struct {
+     char magic[4];
+     int32_t version;
+     int32_t num_normals;
+     int32_t num_targets;
+     int64_t num_sites;
+     int64_t bins_off;
+     int64_t sites_off;
+} pon_hdr_t;
+
+
+#define ALIGN8(x) (((x)+7) & ~((int64_t)7))
+
+
+/* FNV-1a */
+uint32_t
+pon_indel_hash(const char *seq)
+{
+     uint32_t h = 2166136261U;
+     while (*seq) {
+          h ^= (unsigned char)*seq++;
+          h *= 16777619U;
+     }
+     /* 0 is reserved for substitutions */
+     return h ? h : 1;
+}
+
+
+int
+pon_var_key(const var_t *var, int *allele, uint32_t *indel_hash)
+{
+     size_t ref_len = strlen(var->ref);
+     size_t alt_len = strlen(var->alt);
+
+     if (strchr(var->alt, ',')) {
+          return 1;
+     }
+     if (ref_len == 1 && alt_len == 1) {
+          int b = bam_nt4_table[(int)var->alt[0]];
+          if (b > 3) {
+               return 1;
+          }
+          *allele = b;
+          *indel_hash = 0;
+     } else if (ref_len == 1) {
+          /* insertion as reported by call: X>XSEQ */
+          *allele = PON_ALLELE_INS;
+          *indel_hash = pon_indel_hash(var->alt+1);
+     } else if (alt_len == 1) {
+          /* deletion as reported by call: XSEQ>X */
+          *allele = PON_ALLELE_DEL;
+          *indel_hash = pon_indel_hash(var->ref+1);
+     } else {
+          return 1;
+     }
+     return 0;
+}
+
+
+int
+pon_site_cmp(const pon_site_t *a, const pon_site_t *b)
+{
+     if (a->tid != b->tid) {
+          return a->tid < b->tid ? -1 : 1;
+     }
+     if (a->pos != b->pos) {
+          return a->pos < b->pos ? -1 : 1;
+     }
+     if (a->allele != b->allele) {
+          return a->allele < b->allele ? -1 : 1;
+     }
+     if (a->indel_hash != b->indel_hash) {
+          return a->indel_hash < b->indel_hash ? -1 : 1;
+     }
+     return 0;
+}
+
+
+static int
+num_bins(int len)
+{
+     return (len >> PON_BIN_SHIFT) + 1;
+}
+
+
+static int
+pos_to_bin(int pos, int nbins)
+{
+     int b = pos >> PON_BIN_SHIFT;
+     return b < nbins ? b : nbins-1;
+}
+
+
+int
+pon_db_write(const char *path, int num_normals,
+             char **target_names, const int *target_lens, int num_targets,
+             const pon_site_t *sites, int64_t num_sites)
+{
+     pon_hdr_t hdr;
+     FILE *fh;
+     int64_t off;
+     int64_t s = 0;
+     int t;
+     const char pad[8] = {0};
+     int rc = 0;
+
+     memset(& hdr, 0, sizeof(pon_hdr_t));
+     memcpy(hdr.magic, PON_MAGIC, 4);
+     hdr.version = PON_VERSION;
+     hdr.num_normals = num_normals;
+     hdr.num_targets = num_targets;
+     hdr.num_sites = num_sites;
+
+     off = sizeof(pon_hdr_t);
+     for (t=0; t<num_targets; t++) {
+          off += sizeof(int32_t) + strlen(target_names[t]) + 1;
+     }
+     hdr.bins_off = ALIGN8(off);
+     off = hdr.bins_off;
+     for (t=0; t<num_targets; t++) {
+          off += (num_bins(target_lens[t])+1) * sizeof(uint64_t);
+     }
+     hdr.sites_off = off;
+
+     if (NULL == (fh = fopen(path, "wb"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", path);
+          return 1;
+     }
+
+     fwrite(& hdr, sizeof(pon_hdr_t), 1, fh);
+     off = sizeof(pon_hdr_t);
+     for (t=0; t<num_targets; t++) {
+          int32_t len = target_lens[t];
+          fwrite(& len, sizeof(int32_t), 1, fh);
+          fwrite(target_names[t], 1, strlen(target_names[t]) + 1, fh);
+          off += sizeof(int32_t) + strlen(target_names[t]) + 1;
+     }
+     fwrite(pad, 1, hdr.bins_off - off, fh);
+
+     /* bin index: record index of first site in each bin plus end */
+     for (t=0; t<num_targets; t++) {
+          int nbins = num_bins(target_lens[t]);
+          int b;
+          for (b=0; b<nbins; b++) {
+               uint64_t idx;
+               while (s < num_sites && (sites[s].tid < t ||
+                                        (sites[s].tid == t && pos_to_bin(sites[s].pos, nbins) < b))) {
+                    s++;
+               }
+               idx = s;
+               fwrite(& idx, sizeof(uint64_t), 1, fh);
+          }
+          while (s < num_sites && sites[s].tid <= t) {
+               s++;
+          }
+          fwrite(& s, sizeof(uint64_t), 1, fh);
+     }
+
+     if (num_sites && fwrite(sites, sizeof(pon_site_t), num_sites, fh) != (size_t)num_sites) {
+          rc = 1;
+     }
+     if (ferror(fh)) {
+          rc = 1;
+     }
+     if (fclose(fh)) {
+          rc = 1;
+     }
+     if (rc) {
+          LOG_ERROR("Couldn't write %s\n", path);
+     }
+     return rc;
+}
+/* pon_db_write() */
+
+
+pon_db_t *
+pon_db_open(const char *path)
+{
+     pon_db_t *db;
+     const pon_hdr_t *hdr;
+     const char *p;
+     const uint64_t *bins;
+     struct stat st;
+     int fd;
+     int t;
+
+     if (-1 == (fd = open(path, O_RDONLY))) {
+          LOG_ERROR("Couldn't open %s\n", path);
+          return NULL;
+     }
+     if (fstat(fd, & st) || st.st_size < (off_t)sizeof(pon_hdr_t)) {
+          LOG_ERROR("%s is not a panel of normals database\n", path);
+          close(fd);
+          return NULL;
+     }
+
+     db = calloc(1, sizeof(pon_db_t));
+     db->map_size = st.st_size;
+     db->map = mmap(NULL, db->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+     close(fd);
+     if (MAP_FAILED == db->map) {
+          LOG_ERROR("Couldn't map %s\n", path);
+          free(db);
+          return NULL;
+     }
+
+     hdr = (const pon_hdr_t *)db->map;
+     if (memcmp(hdr->magic, PON_MAGIC, 4) || hdr->version != PON_VERSION
+         || hdr->sites_off + hdr->num_sites * (int64_t)sizeof(pon_site_t) != (int64_t)db->map_size) {
+          LOG_ERROR("%s is not a panel of normals database (or of an incompatible version)\n", path);
+          munmap(db->map, db->map_size);
+          free(db);
+          return NULL;
+     }
+     db->num_normals = hdr->num_normals;
+     db->num_targets = hdr->num_targets;
+     db->num_sites = hdr->num_sites;
+     db->sites = (const pon_site_t *)((const char *)db->map + hdr->sites_off);
+
+     db->targets = calloc(db->num_targets, sizeof(pon_target_t));
+     p = (const char *)db->map + sizeof(pon_hdr_t);
+     bins = (const uint64_t *)((const char *)db->map + hdr->bins_off);
+     for (t=0; t<db->num_targets; t++) {
+          pon_target_t *target = & db->targets[t];
+          int32_t len;
+          memcpy(& len, p, sizeof(int32_t));
+          p += sizeof(int32_t);
+          target->name = (char *)p;
+          target->len = len;
+          target->nbins = num_bins(len);
+          target->bins = bins;
+          bins += target->nbins + 1;
+          p += strlen(p) + 1;
+          HASH_ADD_KEYPTR(hh, db->target_hash, target->name, strlen(target->name), target);
+     }
+     LOG_VERBOSE("Loaded panel of normals %s with %lld sites from %d normals\n",
+                 path, (long long int)db->num_sites, db->num_normals);
+     return db;
+}
+/* pon_db_open() */
+
+
+void
+pon_db_close(pon_db_t *db)
+{
+     if (! db) {
+          return;
+     }
+     HASH_CLEAR(hh, db->target_hash);
+     free(db->targets);
+     munmap(db->map, db->map_size);
+     free(db);
+}
+
+
+const pon_site_t *
+pon_db_lookup(const pon_db_t *db, const char *target, int pos,
+              int allele, uint32_t indel_hash)
+{
+     pon_target_t *t;
+     pon_site_t key;
+     int64_t lo, hi;
+     int b;
+
+     HASH_FIND_STR(db->target_hash, target, t);
+     if (! t || pos < 0) {
+          return NULL;
+     }
+     key.tid = t - db->targets;
+     key.pos = pos;
+     key.allele = allele;
+     key.indel_hash = indel_hash;
+
+     b = pos_to_bin(pos, t->nbins);
+     lo = t->bins[b];
+     hi = t->bins[b+1];
+     while (lo < hi) {
+          int64_t mid = lo + (hi-lo)/2;
+          int c = pon_site_cmp(& db->sites[mid], & key);
+          if (0 == c) {
+               return & db->sites[mid];
+          } else if (c < 0) {
+               lo = mid+1;
+          } else {
+               hi = mid;
+          }
+     }
+     return NULL;
+}
+/* pon_db_lookup() */
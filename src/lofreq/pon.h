@@ -0,0 +1,120 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef PON_H
+#define PON_H
+
+#include <stdint.h>
+
+#include "uthash.h"
+#include "vcf.h"
+
+
+/* Panel-of-normals site database.
+ *
+ * Sites with alt evidence in at least one normal are stored as fixed
+ * size records sorted by target, position and allele, together with a
+ * per target bin index (one entry per 2^PON_BIN_SHIFT bp) pointing to
+ * the first record of each bin. The file is meant to be memory-mapped
+ * as is, so lookups need no parsing and only touch one bin. Numbers
+ * are stored in native byte order.
+ */
+
+#define PON_BIN_SHIFT 14
+
+/* alleles: 0-3 as in bam_nt4_table for substitutions, plus */
+#define PON_ALLELE_INS 4
+#define PON_ALLELE_DEL 5
+
+
+typedef struct {
+     int32_t tid;
+     int32_t pos; /* 0-based */
+     uint32_t indel_hash; /* hash of inserted/deleted sequence. 0 for substitutions */
+     uint32_t alt_count; /* sum over normals with evidence */
+     uint32_t depth; /* sum over normals with evidence */
+     float alt_qual_mean; /* mean base or indel quality of alt evidence */
+     float max_af; /* maximum AF among normals */
+     uint16_t num_normals; /* number of normals with evidence */
+     uint8_t allele;
+     uint8_t pad;
+} pon_site_t;
+
+
+typedef struct {
+     char *name; /* points into mapped file */
+     int len;
+     const uint64_t *bins; /* nbins+1 record indices */
+     int nbins;
+     UT_hash_handle hh;
+} pon_target_t;
+
+
+typedef struct {
+     void *map;
+     size_t map_size;
+     int num_normals;
+     int num_targets;
+     int64_t num_sites;
+     pon_target_t *targets; /* array */
+     pon_target_t *target_hash; /* name lookup */
+     const pon_site_t *sites;
+} pon_db_t;
+
+
+uint32_t
+pon_indel_hash(const char *seq);
+
+/* computes allele and indel hash of var as stored in the database.
+ * returns non-zero if var can't be represented, e.g. multi-allelic or
+ * complex variants */
+int
+pon_var_key(const var_t *var, int *allele, uint32_t *indel_hash);
+
+/* sites have to be sorted (see pon_site_cmp) */
+int
+pon_db_write(const char *path, int num_normals,
+             char **target_names, const int *target_lens, int num_targets,
+             const pon_site_t *sites, int64_t num_sites);
+
+int
+pon_site_cmp(const pon_site_t *a, const pon_site_t *b);
+
+pon_db_t *
+pon_db_open(const char *path);
+
+void
+pon_db_close(pon_db_t *db);
+
+/* returns NULL if site is not in database */
+const pon_site_t *
+pon_db_lookup(const pon_db_t *db, const char *target, int pos,
+              int allele, uint32_t indel_hash);
+
+#endif
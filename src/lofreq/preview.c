@@ -0,0 +1,410 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Sampled preview. See preview.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "htslib/sam.h"
+
+#include "log.h"
+#include "utils.h"
+#include "vcf.h"
+#include "preview.h"
+
+
+/* fixed, so that repeated previews look at the same windows */
+#define PREVIEW_SEED 0x5eed1e55U
+
+/* normal quantile for 95% confidence intervals */
+#define Z95 1.959964
+
+
+/* splitmix64 finalizer: deterministic pseudo-random value for x */
+static uint64_t
+mix(uint64_t x)
+{
+     x += 0x9e3779b97f4a7c15ULL;
+     x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+     x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+     return x ^ (x >> 31);
+}
+
+
+preview_t *
+preview_init(const char *bam, double fraction)
+{
+     preview_t *pv;
+     samFile *fp;
+     hts_idx_t *idx;
+     int *use_target;
+     long long int total_len = 0;
+     long int w = 0;
+     int stratum_size;
+     int tid;
+
+     if (fraction <= 0.0 || fraction > 1.0) {
+          LOG_ERROR("Invalid preview fraction %f (must be >0 and <=1)\n", fraction);
+          return NULL;
+     }
+     if (NULL == (fp = sam_open(bam, "r"))) {
+          LOG_ERROR("Couldn't open %s\n", bam);
+          return NULL;
+     }
+     pv = calloc(1, sizeof(preview_t));
+     if (NULL == (pv->header = sam_hdr_read(fp))) {
+          LOG_ERROR("Couldn't read header of %s\n", bam);
+          sam_close(fp);
+          free(pv);
+          return NULL;
+     }
+     if (NULL == (idx = sam_index_load(fp, bam))) {
+          LOG_ERROR("Preview needs an index for %s\n", bam);
+          sam_close(fp);
+          preview_free(pv);
+          return NULL;
+     }
+
+     /* sampling frame: targets with mapped reads. if the index has
+      * no stats (e.g. CRAM) all targets are used */
+     use_target = calloc(pv->header->n_targets, sizeof(int));
+     for (tid=0; tid<pv->header->n_targets; tid++) {
+          uint64_t mapped = 1, unmapped = 0;
+          if (0 == hts_idx_get_stat(idx, tid, &mapped, &unmapped) && 0 == mapped) {
+               continue;
+          }
+          use_target[tid] = 1;
+          total_len += pv->header->target_len[tid];
+     }
+     hts_idx_destroy(idx);
+     sam_close(fp);
+
+     pv->win_size = total_len / PREVIEW_NUM_WINDOWS;
+     if (pv->win_size < PREVIEW_MIN_WIN_SIZE) {
+          pv->win_size = PREVIEW_MIN_WIN_SIZE;
+     } else if (pv->win_size > PREVIEW_MAX_WIN_SIZE) {
+          pv->win_size = PREVIEW_MAX_WIN_SIZE;
+     }
+     stratum_size = (int)(1.0/fraction + 0.5);
+     if (stratum_size < 1) {
+          stratum_size = 1;
+     }
+
+     for (tid=0; tid<pv->header->n_targets; tid++) {
+          int beg;
+          if (! use_target[tid]) {
+               continue;
+          }
+          for (beg=0; beg<(int)pv->header->target_len[tid]; beg+=pv->win_size, w++) {
+               preview_win_t *win;
+               long int stratum = w / stratum_size;
+               if (w % stratum_size != (long int)(mix(PREVIEW_SEED ^ (uint64_t)stratum) % stratum_size)) {
+                    continue;
+               }
+               pv->wins = realloc(pv->wins, (pv->n+1) * sizeof(preview_win_t));
+               win = & pv->wins[pv->n++];
+               memset(win, 0, sizeof(preview_win_t));
+               win->tid = tid;
+               win->beg = beg;
+               win->end = beg + pv->win_size;
+               if (win->end > (int)pv->header->target_len[tid]) {
+                    win->end = pv->header->target_len[tid];
+               }
+          }
+     }
+     pv->num_frame_wins = w;
+     free(use_target);
+
+     if (0 == pv->n) {
+          LOG_ERROR("No windows to sample from %s (no mapped reads?)\n", bam);
+          preview_free(pv);
+          return NULL;
+     }
+     LOG_VERBOSE("Preview: sampled %d of %ld windows of %d bp\n",
+                 pv->n, pv->num_frame_wins, pv->win_size);
+     return pv;
+}
+/* preview_init() */
+
+
+char **
+preview_regions(const preview_t *pv)
+{
+     char **regs = malloc(pv->n * sizeof(char *));
+     int i;
+
+     for (i=0; i<pv->n; i++) {
+          const preview_win_t *win = & pv->wins[i];
+          const char *name = pv->header->target_name[win->tid];
+          regs[i] = malloc(strlen(name) + 32);
+          sprintf(regs[i], "%s:%d-%d", name, win->beg+1, win->end);
+     }
+     return regs;
+}
+/* preview_regions() */
+
+
+/* index of window containing tid:pos or -1 */
+static int
+find_win(const preview_t *pv, int tid, int pos)
+{
+     int lo = 0, hi = pv->n-1;
+
+     while (lo <= hi) {
+          int mid = (lo+hi)/2;
+          const preview_win_t *win = & pv->wins[mid];
+          if (win->tid < tid || (win->tid == tid && win->end <= pos)) {
+               lo = mid+1;
+          } else if (win->tid > tid || win->beg > pos) {
+               hi = mid-1;
+          } else {
+               return mid;
+          }
+     }
+     return -1;
+}
+
+
+int
+preview_add_col(preview_t *pv, const plp_col_t *p)
+{
+     int tid = bam_name2id(pv->header, p->target);
+     preview_win_t *win;
+
+     while (pv->cur < pv->n
+            && (pv->wins[pv->cur].tid < tid
+                || (pv->wins[pv->cur].tid == tid && pv->wins[pv->cur].end <= p->pos))) {
+          pv->cur++;
+     }
+     if (pv->cur >= pv->n) {
+          return 0;
+     }
+     win = & pv->wins[pv->cur];
+     if (win->tid != tid || p->pos < win->beg) {
+          return 0;
+     }
+     win->num_cols += 1;
+     win->depth_sum += p->coverage_plp;
+     return 1;
+}
+/* preview_add_col() */
+
+
+int
+preview_add_vcf(preview_t *pv, const char *vcf)
+{
+     vcf_file_t vcf_file;
+
+     if (vcf_file_open(& vcf_file, vcf, HAS_GZIP_EXT(vcf), 'r')) {
+          LOG_ERROR("Couldn't open %s\n", vcf);
+          return 1;
+     }
+     if (vcf_skip_header(& vcf_file)) {
+          LOG_ERROR("Couldn't skip header of %s\n", vcf);
+          vcf_file_close(& vcf_file);
+          return 1;
+     }
+     while (1) {
+          var_t *var;
+          preview_win_t *win;
+          int tid, w;
+
+          vcf_new_var(&var);
+          if (vcf_parse_var(& vcf_file, var)) {
+               vcf_free_var(&var);
+               break;
+          }
+          if (! VCF_VAR_PASSES(var)
+              || (tid = bam_name2id(pv->header, var->chrom)) < 0
+              || (w = find_win(pv, tid, var->pos)) < 0) {
+               vcf_free_var(&var);
+               continue;
+          }
+          win = & pv->wins[w];
+          if (vcf_var_is_indel(var)) {
+               win->num_indels += 1;
+          } else {
+               char *sb = NULL;
+               win->num_snvs += 1;
+               if (1 == strlen(var->ref) && 1 == strlen(var->alt)) {
+                    /* A<->G and C<->T are transitions */
+                    const char *pur = "AG", *pyr = "CT";
+                    char r = var->ref[0], a = var->alt[0];
+                    if ((strchr(pur, r) && strchr(pur, a)) || (strchr(pyr, r) && strchr(pyr, a))) {
+                         win->num_ts += 1;
+                    } else {
+                         win->num_tv += 1;
+                    }
+               }
+               if (vcf_var_has_info_key(&sb, var, "SB") && sb) {
+                    win->sb_sum += atof(sb);
+               }
+               free(sb);
+          }
+          vcf_free_var(&var);
+     }
+     vcf_file_close(& vcf_file);
+     return 0;
+}
+/* preview_add_vcf() */
+
+
+double
+preview_sampled_fraction(const preview_t *pv)
+{
+     return pv->n / (double)pv->num_frame_wins;
+}
+
+
+/* estimate of the total of y over all windows (expansion estimator
+ * with finite population correction) */
+static void
+est_total(const preview_t *pv, const double *y, double *est, double *se)
+{
+     const double N = pv->num_frame_wins;
+     const int n = pv->n;
+     double mean = 0.0, ss = 0.0;
+     int i;
+
+     for (i=0; i<n; i++) {
+          mean += y[i];
+     }
+     mean /= n;
+     for (i=0; i<n; i++) {
+          ss += (y[i]-mean)*(y[i]-mean);
+     }
+     *est = N * mean;
+     *se = n > 1 ? N * sqrt((1.0 - n/N) * ss/(n-1) / n) : NAN;
+}
+
+
+/* ratio estimator sum(y)/sum(x) */
+static void
+est_ratio(const preview_t *pv, const double *y, const double *x,
+          double *est, double *se)
+{
+     const double N = pv->num_frame_wins;
+     const int n = pv->n;
+     double sum_x = 0.0, sum_y = 0.0, ss = 0.0, r;
+     int i;
+
+     for (i=0; i<n; i++) {
+          sum_x += x[i];
+          sum_y += y[i];
+     }
+     if (sum_x == 0.0) {
+          *est = *se = NAN;
+          return;
+     }
+     r = sum_y / sum_x;
+     for (i=0; i<n; i++) {
+          ss += (y[i] - r*x[i])*(y[i] - r*x[i]);
+     }
+     *est = r;
+     *se = n > 1 ? sqrt((1.0 - n/N) * ss/(n-1) / n) / (sum_x/n) : NAN;
+}
+
+
+static void
+report_line(FILE *stream, const char *name, double est, double se)
+{
+     if (isnan(est)) {
+          fprintf(stream, "%s\tNA\tNA\tNA\n", name);
+     } else if (isnan(se)) {
+          fprintf(stream, "%s\t%g\tNA\tNA\n", name, est);
+     } else {
+          double lo = est - Z95*se;
+          fprintf(stream, "%s\t%g\t%g\t%g\n", name, est,
+                  lo < 0.0 ? 0.0 : lo, est + Z95*se);
+     }
+}
+
+
+void
+preview_report(const preview_t *pv, FILE *stream)
+{
+     enum { SNVS, INDELS, TS, TV, COLS, DEPTH, SB, NUM_VALS };
+     double *v[NUM_VALS];
+     double est, se;
+     int i, j;
+
+     for (j=0; j<NUM_VALS; j++) {
+          v[j] = malloc(pv->n * sizeof(double));
+     }
+     for (i=0; i<pv->n; i++) {
+          const preview_win_t *win = & pv->wins[i];
+          v[SNVS][i] = win->num_snvs;
+          v[INDELS][i] = win->num_indels;
+          v[TS][i] = win->num_ts;
+          v[TV][i] = win->num_tv;
+          v[COLS][i] = win->num_cols;
+          v[DEPTH][i] = win->depth_sum;
+          v[SB][i] = win->sb_sum;
+     }
+
+     fprintf(stream, "# preview: %d of %ld windows of %d bp (fraction %g). estimates for all windows with 95%% CI\n",
+             pv->n, pv->num_frame_wins, pv->win_size, preview_sampled_fraction(pv));
+     fprintf(stream, "#estimate\tvalue\tci95_low\tci95_high\n");
+     est_total(pv, v[SNVS], &est, &se);
+     report_line(stream, "snvs", est, se);
+     est_total(pv, v[INDELS], &est, &se);
+     report_line(stream, "indels", est, se);
+     est_ratio(pv, v[TS], v[TV], &est, &se);
+     report_line(stream, "ts_tv", est, se);
+     est_total(pv, v[COLS], &est, &se);
+     report_line(stream, "covered_positions", est, se);
+     est_ratio(pv, v[DEPTH], v[COLS], &est, &se);
+     report_line(stream, "mean_depth", est, se);
+     est_ratio(pv, v[SB], v[SNVS], &est, &se);
+     report_line(stream, "mean_snv_sb", est, se);
+
+     for (j=0; j<NUM_VALS; j++) {
+          free(v[j]);
+     }
+}
+/* preview_report() */
+
+
+void
+preview_free(preview_t *pv)
+{
+     if (NULL == pv) {
+          return;
+     }
+     if (pv->header) {
+          bam_hdr_destroy(pv->header);
+     }
+     free(pv->wins);
+     free(pv);
+}
+/* preview_free() */
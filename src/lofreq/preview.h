@@ -0,0 +1,109 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <stdio.h>
+
+#include "htslib/sam.h"
+#include "plp.h"
+
+
+/* Sampled preview (lofreq call --preview).
+ *
+ * Targets with mapped reads (according to the BAM index) are tiled
+ * into windows. The windows are split into consecutive strata of
+ * 1/fraction windows and one window per stratum is picked at a
+ * deterministic pseudo-random offset. Only reads overlapping those
+ * windows are read (see mplp_conf_t.regs). Per window depth and call
+ * statistics are then extrapolated to all windows, with 95%
+ * confidence intervals.
+ */
+
+/* aim for this many windows over all targets */
+#define PREVIEW_NUM_WINDOWS 1000
+#define PREVIEW_MIN_WIN_SIZE 100
+#define PREVIEW_MAX_WIN_SIZE 100000
+
+
+typedef struct {
+     int tid;
+     int beg; /* 0-based, incl. */
+     int end; /* excl. */
+     /* statistics collected for this window */
+     long long int num_cols; /* covered columns */
+     double depth_sum;
+     long int num_snvs;
+     long int num_indels;
+     long int num_ts;
+     long int num_tv;
+     double sb_sum; /* strand bias of snvs */
+} preview_win_t;
+
+typedef struct {
+     bam_hdr_t *header;
+     int win_size;
+     long int num_frame_wins; /* all windows */
+     int n; /* sampled windows */
+     preview_win_t *wins; /* sorted by tid and position */
+     int cur; /* window of last column */
+} preview_t;
+
+
+/* samples windows from the indexed bam. returns NULL on error */
+preview_t *
+preview_init(const char *bam, double fraction);
+
+/* region strings of sampled windows, for mplp_conf_t.regs. caller
+ * has to free each and the array */
+char **
+preview_regions(const preview_t *pv);
+
+/* adds a column to the statistics. columns have to come sorted.
+ * returns 1 if it lies within a sampled window, 0 otherwise */
+int
+preview_add_col(preview_t *pv, const plp_col_t *p);
+
+/* adds the passed variants of a vcf file. returns non-zero on
+ * error */
+int
+preview_add_vcf(preview_t *pv, const char *vcf);
+
+/* fraction of windows actually sampled */
+double
+preview_sampled_fraction(const preview_t *pv);
+
+void
+preview_report(const preview_t *pv, FILE *stream);
+
+void
+preview_free(preview_t *pv);
+
+#endif
@@ -0,0 +1,482 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Amplicon primer clipping on the fly. See primer_clip.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "htslib/sam.h"
+#include "htslib/kstring.h"
+
+#include "log.h"
+#include "defaults.h"
+#include "utils.h"
+#include "primer_clip.h"
+
+
+#define BUF_SIZE 1024
+
+#define PRIMER_SUFFIX_LEFT "_LEFT"
+#define PRIMER_SUFFIX_RIGHT "_RIGHT"
+
+
+/* amplicons of one chromosome, sorted by start */
+typedef struct {
+     char *chrom;
+     amplicon_t *amplicons;
+     int n;
+     int32_t max_len; /* longest amplicon: bounds the backward scan in primer_idx_match() */
+} primer_chrom_t;
+
+struct primer_idx {
+     primer_chrom_t *chroms;
+     int n_chroms;
+     int max_shift;
+
+     /* lookup cache: chrom is usually a pointer into the bam header */
+     const char *last_chrom;
+     const primer_chrom_t *last_pc;
+
+     uint32_t *cigar_buf;
+     int m_cigar_buf;
+
+     long int num_reads;
+     long int num_clipped;
+     long int num_unmatched;
+     long int num_rejected;
+};
+
+
+/* temporary representation while parsing */
+typedef struct {
+     char *chrom;
+     char *prefix;
+     int32_t beg[2]; /* left, right */
+     int32_t end[2];
+} primer_pair_t;
+
+
+static int
+amplicon_cmp(const void *a, const void *b)
+{
+     const amplicon_t *x = (const amplicon_t *)a;
+     const amplicon_t *y = (const amplicon_t *)b;
+     if (x->beg != y->beg) {
+          return x->beg < y->beg ? -1 : 1;
+     }
+     return x->end < y->end ? -1 : (x->end > y->end);
+}
+
+
+/* splits primer name into amplicon prefix and side (0: left, 1:
+ * right). returns -1 if name doesn't contain either suffix */
+static int
+primer_name_side(char *name)
+{
+     char *l = strstr(name, PRIMER_SUFFIX_LEFT);
+     char *r = strstr(name, PRIMER_SUFFIX_RIGHT);
+
+     if (l && (! r || l < r)) {
+          *l = '\0';
+          return 0;
+     } else if (r) {
+          *r = '\0';
+          return 1;
+     }
+     return -1;
+}
+
+
+primer_idx_t *
+primer_idx_load(const char *bed_file)
+{
+     FILE *fh;
+     char line[BUF_SIZE];
+     int line_no = 0;
+     primer_pair_t *pairs = NULL;
+     int n_pairs = 0;
+     primer_idx_t *idx = NULL;
+     const char *delim = " \t\r\n";
+     int i, j;
+     int rc = 0;
+
+     if (NULL == (fh = fopen(bed_file, "r"))) {
+          LOG_ERROR("Couldn't open %s\n", bed_file);
+          return NULL;
+     }
+
+     while (NULL != fgets(line, sizeof(line), fh)) {
+          char *saveptr = NULL;
+          char *chrom, *sbeg, *send, *name;
+          int32_t beg, end;
+          int side;
+          primer_pair_t *p = NULL;
+
+          line_no++;
+          if (NULL == (chrom = strtok_r(line, delim, &saveptr))
+              || chrom[0] == '#'
+              || 0 == strncmp(chrom, "track", 5) || 0 == strncmp(chrom, "browser", 7)) {
+               continue;
+          }
+          sbeg = strtok_r(NULL, delim, &saveptr);
+          send = strtok_r(NULL, delim, &saveptr);
+          name = strtok_r(NULL, delim, &saveptr);
+          if (! sbeg || ! send || ! name) {
+               LOG_ERROR("Expected at least four columns (chrom, start, end, name) in line %d of %s\n",
+                         line_no, bed_file);
+               rc = 1;
+               goto done;
+          }
+          beg = atoi(sbeg);
+          end = atoi(send);
+          if (beg < 0 || end <= beg) {
+               LOG_ERROR("Invalid primer coordinates in line %d of %s\n", line_no, bed_file);
+               rc = 1;
+               goto done;
+          }
+          if (-1 == (side = primer_name_side(name))) {
+               LOG_ERROR("Primer name %s in line %d of %s ends neither in %s nor %s\n",
+                         name, line_no, bed_file, PRIMER_SUFFIX_LEFT, PRIMER_SUFFIX_RIGHT);
+               rc = 1;
+               goto done;
+          }
+
+          for (i=0; i<n_pairs; i++) {
+               if (0 == strcmp(pairs[i].prefix, name) && 0 == strcmp(pairs[i].chrom, chrom)) {
+                    p = &pairs[i];
+                    break;
+               }
+          }
+          if (! p) {
+               n_pairs++;
+               pairs = realloc(pairs, n_pairs * sizeof(primer_pair_t));
+               p = &pairs[n_pairs-1];
+               p->chrom = strdup(chrom);
+               p->prefix = strdup(name);
+               p->beg[0] = p->beg[1] = p->end[0] = p->end[1] = -1;
+          }
+          /* alternative primers widen the primer region */
+          if (p->beg[side] < 0) {
+               p->beg[side] = beg;
+               p->end[side] = end;
+          } else {
+               p->beg[side] = MIN(p->beg[side], beg);
+               p->end[side] = MAX(p->end[side], end);
+          }
+     }
+     if (0 == n_pairs) {
+          LOG_ERROR("No primers found in %s\n", bed_file);
+          rc = 1;
+          goto done;
+     }
+
+     idx = calloc(1, sizeof(primer_idx_t));
+     for (i=0; i<n_pairs; i++) {
+          primer_pair_t *p = &pairs[i];
+          primer_chrom_t *pc = NULL;
+          amplicon_t *a;
+
+          if (p->beg[0] < 0 || p->beg[1] < 0) {
+               LOG_ERROR("Amplicon %s in %s is missing its %s primer\n",
+                         p->prefix, bed_file, p->beg[0] < 0 ? "left" : "right");
+               rc = 1;
+               goto done;
+          }
+          if (p->end[0] > p->beg[1]) {
+               LOG_ERROR("Primers of amplicon %s in %s overlap\n", p->prefix, bed_file);
+               rc = 1;
+               goto done;
+          }
+
+          for (j=0; j<idx->n_chroms; j++) {
+               if (0 == strcmp(idx->chroms[j].chrom, p->chrom)) {
+                    pc = &idx->chroms[j];
+                    break;
+               }
+          }
+          if (! pc) {
+               idx->n_chroms++;
+               idx->chroms = realloc(idx->chroms, idx->n_chroms * sizeof(primer_chrom_t));
+               pc = &idx->chroms[idx->n_chroms-1];
+               memset(pc, 0, sizeof(primer_chrom_t));
+               pc->chrom = strdup(p->chrom);
+          }
+          pc->n++;
+          pc->amplicons = realloc(pc->amplicons, pc->n * sizeof(amplicon_t));
+          a = &pc->amplicons[pc->n-1];
+          a->beg = p->beg[0];
+          a->ins_beg = p->end[0];
+          a->ins_end = p->beg[1];
+          a->end = p->end[1];
+
+          pc->max_len = MAX(pc->max_len, a->end - a->beg);
+          idx->max_shift = MAX(idx->max_shift, a->ins_beg - a->beg);
+     }
+     for (j=0; j<idx->n_chroms; j++) {
+          qsort(idx->chroms[j].amplicons, idx->chroms[j].n, sizeof(amplicon_t), amplicon_cmp);
+     }
+     LOG_VERBOSE("Loaded %d amplicons on %d sequence(s) from %s\n", n_pairs, idx->n_chroms, bed_file);
+
+done:
+     fclose(fh);
+     for (i=0; i<n_pairs; i++) {
+          free(pairs[i].chrom);
+          free(pairs[i].prefix);
+     }
+     free(pairs);
+     if (rc) {
+          primer_idx_free(idx);
+          return NULL;
+     }
+     return idx;
+}
+/* primer_idx_load() */
+
+
+void
+primer_idx_free(primer_idx_t *idx)
+{
+     int i;
+
+     if (! idx) {
+          return;
+     }
+     for (i=0; i<idx->n_chroms; i++) {
+          free(idx->chroms[i].chrom);
+          free(idx->chroms[i].amplicons);
+     }
+     free(idx->chroms);
+     free(idx->cigar_buf);
+     free(idx);
+}
+
+
+int
+primer_idx_max_shift(const primer_idx_t *idx)
+{
+     return idx->max_shift;
+}
+
+
+const amplicon_t *
+primer_idx_match(primer_idx_t *idx, const char *chrom, int32_t beg, int32_t end)
+{
+     const primer_chrom_t *pc = NULL;
+     const amplicon_t *best = NULL;
+     int32_t best_ovlp = 0;
+     int lo, hi, i;
+
+     if (chrom == idx->last_chrom) {
+          pc = idx->last_pc;
+     } else {
+          for (i=0; i<idx->n_chroms; i++) {
+               if (0 == strcmp(idx->chroms[i].chrom, chrom)) {
+                    pc = &idx->chroms[i];
+                    break;
+               }
+          }
+          idx->last_chrom = chrom;
+          idx->last_pc = pc;
+     }
+     if (! pc) {
+          return NULL;
+     }
+
+     /* first amplicon starting at or after end */
+     lo = 0;
+     hi = pc->n;
+     while (lo < hi) {
+          int mid = lo + (hi-lo)/2;
+          if (pc->amplicons[mid].beg < end) {
+               lo = mid+1;
+          } else {
+               hi = mid;
+          }
+     }
+     /* amplicons before can only overlap if they start less than
+      * max_len before beg. ties are resolved in favour of the amplicon
+      * whose start is closest to the read start */
+     for (i=lo-1; i>=0 && pc->amplicons[i].beg + pc->max_len > beg; i--) {
+          const amplicon_t *a = &pc->amplicons[i];
+          int32_t ovlp = MIN(a->end, end) - MAX(a->beg, beg);
+          if (ovlp > best_ovlp
+              || (ovlp == best_ovlp && best && abs(a->beg - beg) < abs(best->beg - beg))) {
+               best = a;
+               best_ovlp = ovlp;
+          }
+     }
+     return best;
+}
+/* primer_idx_match() */
+
+
+/* replaces the cigar of b, shifting sequence, qualities and aux
+ * data */
+static void
+bam_replace_cigar(bam1_t *b, const uint32_t *cigar, int n_cigar)
+{
+     int diff = (n_cigar - (int)b->core.n_cigar) * sizeof(uint32_t);
+     uint8_t *old_end = b->data + b->core.l_qname + b->core.n_cigar * sizeof(uint32_t);
+
+     if (diff > 0 && b->l_data + diff > b->m_data) {
+          size_t old_off = old_end - b->data;
+          b->m_data = b->l_data + diff;
+          kroundup32(b->m_data);
+          if (NULL == (b->data = realloc(b->data, b->m_data))) {
+               LOG_FATAL("%s\n", "memory allocation failed");
+               exit(1);
+          }
+          old_end = b->data + old_off;
+     }
+     memmove(old_end + diff, old_end, b->l_data - (old_end - b->data));
+     memcpy(bam_get_cigar(b), cigar, n_cigar * sizeof(uint32_t));
+     b->l_data += diff;
+     b->core.n_cigar = n_cigar;
+}
+/* bam_replace_cigar() */
+
+
+int
+primer_idx_clip(primer_idx_t *idx, const char *chrom, bam1_t *b)
+{
+     const uint32_t *cigar = bam_get_cigar(b);
+     int n_cigar = b->core.n_cigar;
+     const amplicon_t *a;
+     int32_t x, y;
+     int32_t qb = -1, qe = -1; /* query range to keep */
+     int32_t new_pos = -1;
+     int32_t l_qseq = b->core.l_qseq;
+     int k, n;
+     uint32_t *c;
+
+     idx->num_reads++;
+     if (NULL == (a = primer_idx_match(idx, chrom, b->core.pos, bam_endpos(b)))) {
+          idx->num_unmatched++;
+          return 0;
+     }
+
+     /* keep everything between the first and last base aligned to the
+      * insert */
+     x = b->core.pos;
+     y = 0;
+     for (k=0; k<n_cigar; k++) {
+          int op = bam_cigar_op(cigar[k]);
+          int len = bam_cigar_oplen(cigar[k]);
+          int type = bam_cigar_type(op);
+
+          if ((type & 3) == 3) {
+               int32_t f = MAX(x, a->ins_beg);
+               int32_t l = MIN(x+len, a->ins_end);
+               if (f < l) {
+                    if (qb < 0) {
+                         qb = y + f-x;
+                         new_pos = f;
+                    }
+                    qe = y + l-x;
+               }
+          }
+          if (type & 1) {
+               y += len;
+          }
+          if (type & 2) {
+               x += len;
+          }
+     }
+     if (qb < 0) {
+          idx->num_rejected++;
+          return 1;
+     }
+     if (new_pos - b->core.pos > idx->max_shift) {
+          idx->num_rejected++;
+          return 1;
+     }
+
+     /* new cigar: hard clips, soft clip, kept ops, soft clip, hard
+      * clips. at most two more ops than before */
+     if (idx->m_cigar_buf < n_cigar+2) {
+          idx->m_cigar_buf = n_cigar+2;
+          idx->cigar_buf = realloc(idx->cigar_buf, idx->m_cigar_buf * sizeof(uint32_t));
+     }
+     c = idx->cigar_buf;
+     n = 0;
+     if (n_cigar && bam_cigar_op(cigar[0]) == BAM_CHARD_CLIP) {
+          c[n++] = cigar[0];
+     }
+     if (qb > 0) {
+          c[n++] = bam_cigar_gen(qb, BAM_CSOFT_CLIP);
+     }
+     y = 0;
+     for (k=0; k<n_cigar; k++) {
+          int op = bam_cigar_op(cigar[k]);
+          int len = bam_cigar_oplen(cigar[k]);
+          int type = bam_cigar_type(op);
+
+          if (op == BAM_CHARD_CLIP || op == BAM_CSOFT_CLIP) {
+               /* absorbed by new soft clips */
+          } else if (type & 1) {
+               int32_t f = MAX(y, qb);
+               int32_t l = MIN(y+len, qe);
+               if (f < l) {
+                    c[n++] = bam_cigar_gen(l-f, op);
+               }
+          } else if (y > qb && y < qe) {
+               /* deletions, ref skips, paddings inside kept range */
+               c[n++] = cigar[k];
+          }
+          if (type & 1) {
+               y += len;
+          }
+     }
+     if (qe < l_qseq) {
+          c[n++] = bam_cigar_gen(l_qseq-qe, BAM_CSOFT_CLIP);
+     }
+     if (n_cigar > 1 && bam_cigar_op(cigar[n_cigar-1]) == BAM_CHARD_CLIP) {
+          c[n++] = cigar[n_cigar-1];
+     }
+
+     if (new_pos != b->core.pos || n != n_cigar || memcmp(c, cigar, n * sizeof(uint32_t))) {
+          bam_replace_cigar(b, c, n);
+          b->core.pos = new_pos;
+          /* bin depends on pos and end. a stale one breaks indexing */
+          b->core.bin = hts_reg2bin(b->core.pos, bam_endpos(b), 14, 5);
+          idx->num_clipped++;
+     }
+     return 0;
+}
+/* primer_idx_clip() */
+
+
+void
+primer_idx_log_stats(const primer_idx_t *idx)
+{
+     LOG_VERBOSE("Primer clipping: %ld reads, %ld clipped, %ld outside amplicons (kept as is), %ld rejected\n",
+                 idx->num_reads, idx->num_clipped, idx->num_unmatched, idx->num_rejected);
+}
@@ -0,0 +1,86 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef PRIMER_CLIP_H
+#define PRIMER_CLIP_H
+
+#include <stdint.h>
+
+#include "htslib/sam.h"
+
+
+/* Amplicon primer clipping on the fly.
+ *
+ * Primers are read from a BED file (chrom, start, end, name, ...) as
+ * used by ARTIC-style protocols, where names end in _LEFT or _RIGHT,
+ * optionally followed by a suffix like _alt1. Primers sharing the
+ * name prefix form one amplicon.
+ *
+ * Each read is assigned to the amplicon it overlaps most and all its
+ * bases aligned outside that amplicon's insert (i.e. to a primer or
+ * beyond) are soft-clipped in memory, as a clip-then-call workflow
+ * would do.
+ */
+
+typedef struct {
+     int32_t beg; /* start of left primer(s) */
+     int32_t ins_beg; /* end of left primer(s) */
+     int32_t ins_end; /* start of right primer(s) */
+     int32_t end; /* end of right primer(s) */
+} amplicon_t;
+
+typedef struct primer_idx primer_idx_t;
+
+primer_idx_t *
+primer_idx_load(const char *bed_file);
+
+void
+primer_idx_free(primer_idx_t *idx);
+
+/* maximum number of positions a read start can be moved by
+ * primer_idx_clip(). reads that would be moved further are
+ * rejected */
+int
+primer_idx_max_shift(const primer_idx_t *idx);
+
+/* returns the amplicon overlapping [beg, end) most or NULL */
+const amplicon_t *
+primer_idx_match(primer_idx_t *idx, const char *chrom, int32_t beg, int32_t end);
+
+/* soft-clips primer derived bases of b. returns 0 on success (b
+ * might be unchanged) or 1 if b should be skipped, because nothing
+ * is left after clipping or its start moved by more than
+ * primer_idx_max_shift() */
+int
+primer_idx_clip(primer_idx_t *idx, const char *chrom, bam1_t *b);
+
+void
+primer_idx_log_stats(const primer_idx_t *idx);
+
+#endif
@@ -0,0 +1,443 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Base quality recalibration on the fly. See recal_table.h
+ *
+ * The recalibrated quality of a base follows ApplyBQSR's sequential
+ * computation: the empirical quality of its reported quality within
+ * its read group, plus the deltas of its cycle and its dinucleotide
+ * context, each relative to the former. Per read group and reported
+ * quality these are precomputed into lookup tables when loading, so
+ * that applying them costs two lookups per base.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "htslib/sam.h"
+
+#include "log.h"
+#include "defaults.h"
+#include "recal_table.h"
+
+
+#define BUF_SIZE 4096
+#define RECAL_MAX_Q SANGER_PHRED_MAX
+/* ApplyBQSR's default for --preserve-qscores-less-than */
+#define RECAL_PRESERVE_Q_BELOW 6
+#define RECAL_NUM_CTX 16
+
+#define RECAL_TABLE_NONE  -1
+#define RECAL_TABLE_ARGS  -2
+
+
+typedef struct {
+     char *name;
+     double emp_q; /* empirical quality of read group */
+     double base[RECAL_MAX_Q+1]; /* recalibrated quality before covariates */
+     float *cycle; /* per quality: cycles -max_cycle...max_cycle */
+     float ctx[RECAL_MAX_Q+1][RECAL_NUM_CTX]; /* per quality: dinucleotide */
+} recal_rg_t;
+
+struct recal_table {
+     recal_rg_t *rgs;
+     int n_rgs;
+     int max_cycle;
+     int low_qual_tail;
+     int ctx_size;
+     int missing_rg_warned;
+};
+
+
+static int
+nt16_to_idx(int nt16)
+{
+     switch (nt16) {
+     case 1: return 0; /* A */
+     case 2: return 1; /* C */
+     case 4: return 2; /* G */
+     case 8: return 3; /* T */
+     default: return -1;
+     }
+}
+
+
+static int
+ctx_idx(const char *ctx)
+{
+     const char *acgt = "ACGT";
+     const char *a, *b;
+
+     if (strlen(ctx) != 2 || ! (a = strchr(acgt, ctx[0])) || ! (b = strchr(acgt, ctx[1]))) {
+          return -1;
+     }
+     return 4*(a-acgt) + (b-acgt);
+}
+
+
+static recal_rg_t *
+rg_get(recal_table_t *t, const char *name, int create)
+{
+     recal_rg_t *rg;
+     int i, q, c;
+
+     for (i=0; i<t->n_rgs; i++) {
+          if (0 == strcmp(t->rgs[i].name, name)) {
+               return &t->rgs[i];
+          }
+     }
+     if (! create) {
+          return NULL;
+     }
+     t->n_rgs++;
+     t->rgs = realloc(t->rgs, t->n_rgs * sizeof(recal_rg_t));
+     rg = &t->rgs[t->n_rgs-1];
+     rg->name = strdup(name);
+     rg->emp_q = NAN;
+     rg->cycle = NULL;
+     for (q=0; q<=RECAL_MAX_Q; q++) {
+          rg->base[q] = NAN;
+          for (c=0; c<RECAL_NUM_CTX; c++) {
+               rg->ctx[q][c] = NAN;
+          }
+     }
+     return rg;
+}
+
+
+/* column index of name in header or -1 */
+static int
+col_idx(char **cols, int n_cols, const char *name)
+{
+     int i;
+     for (i=0; i<n_cols; i++) {
+          if (0 == strcmp(cols[i], name)) {
+               return i;
+          }
+     }
+     return -1;
+}
+
+
+/* turns empirical qualities into the lookup tables */
+static void
+finalize(recal_table_t *t)
+{
+     int i, q, c;
+
+     for (i=0; i<t->n_rgs; i++) {
+          recal_rg_t *rg = &t->rgs[i];
+          for (q=0; q<=RECAL_MAX_Q; q++) {
+               if (isnan(rg->base[q])) {
+                    rg->base[q] = rg->emp_q;
+               }
+               for (c=0; c<RECAL_NUM_CTX; c++) {
+                    rg->ctx[q][c] = isnan(rg->ctx[q][c]) ? 0.0 : rg->ctx[q][c] - rg->base[q];
+               }
+               if (rg->cycle) {
+                    float *cyc = &rg->cycle[q * (2*t->max_cycle+1)];
+                    for (c=0; c<2*t->max_cycle+1; c++) {
+                         cyc[c] = isnan(cyc[c]) ? 0.0 : cyc[c] - rg->base[q];
+                    }
+               }
+          }
+     }
+}
+/* finalize() */
+
+
+recal_table_t *
+recal_table_load(const char *fn)
+{
+     FILE *fh;
+     char line[BUF_SIZE];
+     int line_no = 0;
+     recal_table_t *t;
+     int table = RECAL_TABLE_NONE;
+     int in_body = 0;
+     char *cols[32];
+     char *hdr[32];
+     int n_hdr = 0;
+     int i_rg = -1, i_ev = -1, i_emp = -1, i_q = -1, i_val = -1, i_name = -1;
+     int rc = 0;
+     int i;
+
+     if (NULL == (fh = fopen(fn, "r"))) {
+          LOG_ERROR("Couldn't open %s\n", fn);
+          return NULL;
+     }
+     t = calloc(1, sizeof(recal_table_t));
+     /* BaseRecalibrator defaults, overwritten by Arguments table */
+     t->max_cycle = 500;
+     t->low_qual_tail = 2;
+     t->ctx_size = 2;
+
+     while (NULL != fgets(line, sizeof(line), fh)) {
+          char *saveptr = NULL;
+          char *tok;
+          int n_cols = 0;
+
+          line_no++;
+          if (0 == strncmp(line, "#:GATKTable:", 12)) {
+               /* format line (numeric) or name line */
+               char *name = line + 12;
+               name[strcspn(name, ":\r\n")] = '\0';
+               if (0 == strcmp(name, "Arguments")) {
+                    table = RECAL_TABLE_ARGS;
+               } else if (0 == strncmp(name, "RecalTable", 10)) {
+                    table = atoi(name + 10);
+               } else if (name[0] < '0' || name[0] > '9') {
+                    table = RECAL_TABLE_NONE;
+               }
+               in_body = 0;
+               continue;
+          }
+          if (line[0] == '#') {
+               continue;
+          }
+          for (tok = strtok_r(line, " \t\r\n", &saveptr); tok && n_cols < 32;
+               tok = strtok_r(NULL, " \t\r\n", &saveptr)) {
+               cols[n_cols++] = tok;
+          }
+          if (0 == n_cols) {
+               /* tables are separated by empty lines */
+               table = RECAL_TABLE_NONE;
+               in_body = 0;
+               continue;
+          }
+          if (table == RECAL_TABLE_NONE) {
+               continue;
+          }
+
+          if (! in_body) {
+               for (i=0; i<n_hdr; i++) {
+                    free(hdr[i]);
+               }
+               for (i=0; i<n_cols; i++) {
+                    hdr[i] = strdup(cols[i]);
+               }
+               n_hdr = n_cols;
+               i_rg = col_idx(hdr, n_hdr, "ReadGroup");
+               i_ev = col_idx(hdr, n_hdr, "EventType");
+               i_emp = col_idx(hdr, n_hdr, "EmpiricalQuality");
+               i_q = col_idx(hdr, n_hdr, "QualityScore");
+               i_val = col_idx(hdr, n_hdr, "CovariateValue");
+               i_name = col_idx(hdr, n_hdr, "CovariateName");
+               if (table >= 0 && (i_rg < 0 || i_ev < 0 || i_emp < 0
+                                  || (table >= 1 && i_q < 0)
+                                  || (table >= 2 && (i_val < 0 || i_name < 0)))) {
+                    LOG_ERROR("Missing columns in header of RecalTable%d in %s (line %d)\n", table, fn, line_no);
+                    rc = 1;
+                    goto done;
+               }
+               in_body = 1;
+               continue;
+          }
+          if (n_cols != n_hdr) {
+               LOG_ERROR("Expected %d columns but got %d in line %d of %s\n", n_hdr, n_cols, line_no, fn);
+               rc = 1;
+               goto done;
+          }
+
+          if (table == RECAL_TABLE_ARGS) {
+               if (0 == strcmp(cols[0], "maximum_cycle_value")) {
+                    t->max_cycle = atoi(cols[1]);
+               } else if (0 == strcmp(cols[0], "low_quality_tail")) {
+                    t->low_qual_tail = atoi(cols[1]);
+               } else if (0 == strcmp(cols[0], "mismatches_context_size")) {
+                    t->ctx_size = atoi(cols[1]);
+               }
+
+          } else if (0 == strcmp(cols[i_ev], "M")) {
+               recal_rg_t *rg = rg_get(t, cols[i_rg], 1);
+               double emp = atof(cols[i_emp]);
+               int q = -1;
+
+               if (table >= 1) {
+                    q = atoi(cols[i_q]);
+                    if (q < 0 || q > RECAL_MAX_Q) {
+                         LOG_WARN("Ignoring quality %d out of range in line %d of %s\n", q, line_no, fn);
+                         continue;
+                    }
+               }
+               if (table == 0) {
+                    rg->emp_q = emp;
+               } else if (table == 1) {
+                    rg->base[q] = emp;
+               } else if (table == 2 && 0 == strcmp(cols[i_name], "Context")) {
+                    int c = ctx_idx(cols[i_val]);
+                    if (c < 0) {
+                         LOG_ERROR("Only dinucleotide contexts are supported, but got %s in line %d of %s\n",
+                                   cols[i_val], line_no, fn);
+                         rc = 1;
+                         goto done;
+                    }
+                    rg->ctx[q][c] = emp;
+               } else if (table == 2 && 0 == strcmp(cols[i_name], "Cycle")) {
+                    int c = atoi(cols[i_val]);
+                    if (abs(c) > t->max_cycle) {
+                         continue;
+                    }
+                    if (! rg->cycle) {
+                         int j, n = (RECAL_MAX_Q+1) * (2*t->max_cycle+1);
+                         rg->cycle = malloc(n * sizeof(float));
+                         for (j=0; j<n; j++) {
+                              rg->cycle[j] = NAN;
+                         }
+                    }
+                    rg->cycle[q * (2*t->max_cycle+1) + c + t->max_cycle] = emp;
+               }
+          }
+     }
+
+     if (t->ctx_size != 2) {
+          LOG_ERROR("Only dinucleotide contexts are supported, but %s was created with context size %d\n",
+                    fn, t->ctx_size);
+          rc = 1;
+          goto done;
+     }
+     for (i=0; i<t->n_rgs; i++) {
+          if (isnan(t->rgs[i].emp_q)) {
+               LOG_ERROR("Read group %s missing from RecalTable0 in %s\n", t->rgs[i].name, fn);
+               rc = 1;
+               goto done;
+          }
+     }
+     if (0 == t->n_rgs) {
+          LOG_ERROR("No recalibration data found in %s\n", fn);
+          rc = 1;
+          goto done;
+     }
+     finalize(t);
+     LOG_VERBOSE("Loaded recalibration table for %d read group(s) from %s\n", t->n_rgs, fn);
+
+done:
+     fclose(fh);
+     for (i=0; i<n_hdr; i++) {
+          free(hdr[i]);
+     }
+     if (rc) {
+          recal_table_free(t);
+          return NULL;
+     }
+     return t;
+}
+/* recal_table_load() */
+
+
+void
+recal_table_free(recal_table_t *t)
+{
+     int i;
+
+     if (! t) {
+          return;
+     }
+     for (i=0; i<t->n_rgs; i++) {
+          free(t->rgs[i].name);
+          free(t->rgs[i].cycle);
+     }
+     free(t->rgs);
+     free(t);
+}
+
+
+void
+recal_table_apply(recal_table_t *t, bam1_t *b)
+{
+     const uint8_t *seq = bam_get_seq(b);
+     uint8_t *qual = bam_get_qual(b);
+     const int len = b->core.l_qseq;
+     const int rev = bam_is_rev(b);
+     const int order = ((b->core.flag & BAM_FPAIRED) && (b->core.flag & BAM_FREAD2)) ? -1 : 1;
+     const int n_cyc = 2*t->max_cycle+1;
+     recal_rg_t *rg = NULL;
+     uint8_t *aux;
+     int lo, hi; /* bases outside have low quality tails and no context */
+     int i;
+
+     if (NULL != (aux = bam_aux_get(b, "RG"))) {
+          rg = rg_get(t, bam_aux2Z(aux), 0);
+     }
+     if (! rg) {
+          if (! t->missing_rg_warned) {
+               LOG_WARN("Read %s has no read group or one that's not in the recalibration table."
+                        " Not recalibrating such reads\n", bam_get_qname(b));
+               t->missing_rg_warned = 1;
+          }
+          return;
+     }
+     if (len == 0 || qual[0] == 0xff) {
+          return;
+     }
+
+     for (lo=0; lo<len && qual[lo] <= t->low_qual_tail; lo++) {
+     }
+     for (hi=len; hi>lo && qual[hi-1] <= t->low_qual_tail; hi--) {
+     }
+
+     for (i=0; i<len; i++) {
+          const int q = qual[i];
+          int cycle, n1 = -1, n2 = -1;
+          double v;
+
+          if (q < RECAL_PRESERVE_Q_BELOW || q > RECAL_MAX_Q) {
+               continue;
+          }
+          v = rg->base[q];
+
+          /* cycles count in sequencing direction, negative for second reads */
+          cycle = order * (rev ? len-i : i+1);
+          if (rg->cycle && abs(cycle) <= t->max_cycle) {
+               v += rg->cycle[q*n_cyc + cycle + t->max_cycle];
+          }
+
+          /* context of previous and current base in sequencing direction */
+          if (i >= lo && i < hi) {
+               if (rev && i+1 < hi) {
+                    n1 = nt16_to_idx(bam_seqi(seq, i+1));
+                    n2 = nt16_to_idx(bam_seqi(seq, i));
+                    n1 = n1 < 0 ? -1 : 3-n1;
+                    n2 = n2 < 0 ? -1 : 3-n2;
+               } else if (! rev && i > lo) {
+                    n1 = nt16_to_idx(bam_seqi(seq, i-1));
+                    n2 = nt16_to_idx(bam_seqi(seq, i));
+               }
+          }
+          if (n1 >= 0 && n2 >= 0) {
+               v += rg->ctx[q][4*n1+n2];
+          }
+
+          v = floor(v + 0.5);
+          qual[i] = v < 1 ? 1 : (v > RECAL_MAX_Q ? RECAL_MAX_Q : (int)v);
+     }
+}
+/* recal_table_apply() */
@@ -0,0 +1,59 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef RECAL_TABLE_H
+#define RECAL_TABLE_H
+
+#include "htslib/sam.h"
+
+
+/* Base quality recalibration on the fly.
+ *
+ * Reads the recalibration table as written by GATK's
+ * BaseRecalibrator (GATKReport with RecalTable0-2, i.e. by read
+ * group, reported quality, cycle and dinucleotide context) and
+ * recomputes base qualities the way ApplyBQSR would, without
+ * rewriting the BAM. Only the mismatch (M) tables are used and
+ * qualities are not quantized.
+ */
+
+typedef struct recal_table recal_table_t;
+
+recal_table_t *
+recal_table_load(const char *fn);
+
+void
+recal_table_free(recal_table_t *t);
+
+/* recalibrates base qualities of b in place. reads of unknown read
+ * groups are left untouched */
+void
+recal_table_apply(recal_table_t *t, bam1_t *b);
+
+#endif
@@ -29,6 +29,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <ctype.h>
 #include <assert.h>
 
@@ -674,3 +675,74 @@ int checkref(char *fasta_file, char *bam_file)
 
      return 0;
 }
+
+
+/* returns 1 if the @HD line of h declares coordinate order, 0
+ * otherwise */
+int
+sam_hdr_is_coord_sorted(const bam_hdr_t *h)
+{
+     const char *hd, *eol, *so;
+
+     if (! h->text || h->l_text < 3 || strncmp(h->text, "@HD", 3)) {
+          return 0;
+     }
+     hd = h->text;
+     if (NULL == (eol = strchr(hd, '\n'))) {
+          eol = hd + strlen(hd);
+     }
+     for (so = strstr(hd, "\tSO:"); so && so < eol; so = strstr(so+1, "\tSO:")) {
+          if (0 == strncmp(so+4, "coordinate", 10)) {
+               return 1;
+          }
+     }
+     return 0;
+}
+/* sam_hdr_is_coord_sorted() */
+
+
+/* Starts building an index for the BAM output fp while records are
+ * written, saving the extra pass of 'lofreq index'. fn is the output
+ * file name: nothing is done for stdout. Has to be called after
+ * sam_hdr_write() and only if records are written in coordinate
+ * order. Writes BAI (fn.bai) unless a target is too long for it, in
+ * which case CSI (fn.csi) is used. The index has to be written with
+ * sam_idx_save() before closing fp. htslib keeps using the index file
+ * name until then, so it is returned in *fnidx and has to be freed
+ * by the caller only after sam_idx_save() (*fnidx is NULL if not
+ * indexing).
+ *
+ * Returns 1 if indexing, 0 if not and -1 on error.
+ */
+int
+sam_idx_out_init(samFile *fp, bam_hdr_t *h, const char *fn, char **fnidx)
+{
+     int min_shift = 0; /* BAI */
+     int i;
+
+     *fnidx = NULL;
+     if (! fn || 0 == strcmp(fn, "-")) {
+          return 0;
+     }
+     for (i=0; i<h->n_targets; i++) {
+          /* BAI can't hold positions beyond 2^29 */
+          if (h->target_len[i] >= (1U<<29)) {
+               min_shift = 14;
+               break;
+          }
+     }
+     if (NULL == (*fnidx = malloc(strlen(fn) + 5))) {
+          LOG_FATAL("%s\n", "memory allocation failed");
+          return -1;
+     }
+     sprintf(*fnidx, "%s.%s", fn, min_shift ? "csi" : "bai");
+     if (sam_idx_init(fp, h, min_shift, *fnidx) < 0) {
+          LOG_ERROR("Failed to start building index %s\n", *fnidx);
+          free(*fnidx);
+          *fnidx = NULL;
+          return -1;
+     }
+     LOG_VERBOSE("Indexing %s on the fly (%s)\n", fn, *fnidx);
+     return 1;
+}
+/* sam_idx_out_init() */
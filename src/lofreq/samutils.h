@@ -92,4 +92,10 @@ free_alnerrprof(alnerrprof_t *alnerrprof);
 
 int checkref(char *fasta_file, char *bam_file);
 
+int
+sam_hdr_is_coord_sorted(const bam_hdr_t *h);
+
+int
+sam_idx_out_init(samFile *fp, bam_hdr_t *h, const char *fn, char **fnidx);
+
 #endif
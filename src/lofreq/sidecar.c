@@ -0,0 +1,632 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+/* Per-read tag sidecar files. See sidecar.h */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "htslib/bgzf.h"
+#include "htslib/sam.h"
+
+#include "log.h"
+#include "sidecar.h"
+
+
+#define SIDECAR_MAGIC "LSC\1"
+#define SIDECAR_IDX_MAGIC "LSI\1"
+#define SIDECAR_BIN_SHIFT 14 /* 16kbp windows as in BAI linear index */
+
+/* flag bits distinguishing records of the same name */
+#define SIDECAR_KEY_FLAGS (BAM_FREAD1 | BAM_FREAD2 | BAM_FSECONDARY | BAM_FSUPPLEMENTARY)
+
+
+typedef struct {
+     int32_t tid;
+     int32_t pos;
+     uint64_t key;
+     uint32_t l_aux;
+     uint32_t m_aux;
+     uint8_t *aux;
+} sidecar_rec_t;
+
+/* linear index */
+typedef struct {
+     int n_tids;
+     int *n_bins;
+     int *m_bins;
+     uint64_t **bins;
+} sidecar_idx_t;
+
+struct sidecar_writer {
+     BGZF *fp;
+     char *fn;
+     char **tags;
+     int n_tags;
+     int32_t last_tid;
+     int32_t last_pos;
+     sidecar_idx_t idx;
+     sidecar_rec_t rec;
+     long int num_recs;
+};
+
+struct sidecar {
+     BGZF *fp;
+     char *fn;
+     sidecar_idx_t idx;
+     sidecar_rec_t next; /* read ahead */
+     int has_next;
+     int is_eof;
+     int is_init;
+     /* records at position of last read */
+     sidecar_rec_t *grp;
+     int n_grp;
+     int m_grp;
+     int32_t grp_tid;
+     int32_t grp_pos;
+     long int num_attached;
+     long int num_missing;
+};
+
+
+static uint64_t
+rec_key(const bam1_t *b)
+{
+     /* FNV-1a */
+     const char *s = bam_get_qname(b);
+     uint64_t h = 14695981039346656037ULL;
+     uint16_t f = b->core.flag & SIDECAR_KEY_FLAGS;
+
+     for (; *s; s++) {
+          h ^= (uint8_t)*s;
+          h *= 1099511628211ULL;
+     }
+     h ^= f & 0xff;
+     h *= 1099511628211ULL;
+     h ^= f >> 8;
+     h *= 1099511628211ULL;
+     return h;
+}
+
+
+/* size of aux value pointed to by s (type char) incl. type, or -1 */
+static int
+aux_val_len(const uint8_t *s, const uint8_t *end)
+{
+     int size;
+
+     switch (*s) {
+     case 'A': case 'c': case 'C': return 2;
+     case 's': case 'S': return 3;
+     case 'i': case 'I': case 'f': return 5;
+     case 'd': return 9;
+     case 'Z': case 'H': {
+          const uint8_t *p = s+1;
+          while (p < end && *p) {
+               p++;
+          }
+          return p < end ? p - s + 1 : -1;
+     }
+     case 'B': {
+          uint32_t n;
+          if (end - s < 6) {
+               return -1;
+          }
+          switch (s[1]) {
+          case 'c': case 'C': size = 1; break;
+          case 's': case 'S': size = 2; break;
+          case 'i': case 'I': case 'f': size = 4; break;
+          default: return -1;
+          }
+          memcpy(&n, s+2, 4);
+          if ((int64_t)n * size > end - s - 6) {
+               return -1;
+          }
+          return 6 + n*size;
+     }
+     default:
+          return -1;
+     }
+}
+/* aux_val_len() */
+
+
+static void
+rec_reserve(sidecar_rec_t *rec, uint32_t len)
+{
+     if (len > rec->m_aux) {
+          rec->m_aux = len;
+          if (NULL == (rec->aux = realloc(rec->aux, rec->m_aux))) {
+               LOG_FATAL("%s\n", "memory allocation failed");
+               exit(1);
+          }
+     }
+}
+
+
+static void
+idx_free(sidecar_idx_t *idx)
+{
+     int i;
+     for (i=0; i<idx->n_tids; i++) {
+          free(idx->bins[i]);
+     }
+     free(idx->bins);
+     free(idx->n_bins);
+     free(idx->m_bins);
+     memset(idx, 0, sizeof(sidecar_idx_t));
+}
+
+
+static char *
+idx_fn(const char *fn)
+{
+     char *ifn = malloc(strlen(fn) + strlen(SIDECAR_IDX_EXT) + 1);
+     strcpy(ifn, fn);
+     strcat(ifn, SIDECAR_IDX_EXT);
+     return ifn;
+}
+
+
+sidecar_writer_t *
+sidecar_writer_open(const char *fn, const char **tags, int n_tags)
+{
+     sidecar_writer_t *w;
+     int i;
+
+     w = calloc(1, sizeof(sidecar_writer_t));
+     if (NULL == (w->fp = bgzf_open(fn, "w"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", fn);
+          free(w);
+          return NULL;
+     }
+     if (bgzf_write(w->fp, SIDECAR_MAGIC, 4) != 4) {
+          LOG_ERROR("Couldn't write to %s\n", fn);
+          bgzf_close(w->fp);
+          free(w);
+          return NULL;
+     }
+     w->fn = strdup(fn);
+     w->n_tags = n_tags;
+     w->tags = malloc(n_tags * sizeof(char *));
+     for (i=0; i<n_tags; i++) {
+          w->tags[i] = strdup(tags[i]);
+     }
+     w->last_tid = -1;
+     w->last_pos = -1;
+     return w;
+}
+/* sidecar_writer_open() */
+
+
+int
+sidecar_writer_add(sidecar_writer_t *w, const bam1_t *b)
+{
+     sidecar_rec_t *rec = &w->rec;
+     sidecar_idx_t *idx = &w->idx;
+     const uint8_t *aux_end = b->data + b->l_data;
+     int32_t tid = b->core.tid;
+     int32_t pos = b->core.pos;
+     uint64_t voff;
+     int bin, i;
+
+     if (tid < 0 || (b->core.flag & BAM_FUNMAP)) {
+          return 0;
+     }
+     if (tid < w->last_tid || (tid == w->last_tid && pos < w->last_pos)) {
+          LOG_ERROR("%s\n", "Sidecar output needs coordinate sorted input");
+          return 1;
+     }
+     w->last_tid = tid;
+     w->last_pos = pos;
+
+     rec->l_aux = 0;
+     for (i=0; i<w->n_tags; i++) {
+          uint8_t *s = bam_aux_get(b, w->tags[i]);
+          int len;
+          if (! s) {
+               continue;
+          }
+          if ((len = aux_val_len(s, aux_end)) < 0) {
+               LOG_ERROR("Couldn't parse tag %s of read %s\n", w->tags[i], bam_get_qname(b));
+               return 1;
+          }
+          rec_reserve(rec, rec->l_aux + 2 + len);
+          memcpy(rec->aux + rec->l_aux, s-2, 2 + len);
+          rec->l_aux += 2 + len;
+     }
+     if (0 == rec->l_aux) {
+          return 0;
+     }
+
+     /* every window up to this one starts here */
+     voff = bgzf_tell(w->fp);
+     if (tid >= idx->n_tids) {
+          idx->n_bins = realloc(idx->n_bins, (tid+1) * sizeof(int));
+          idx->m_bins = realloc(idx->m_bins, (tid+1) * sizeof(int));
+          idx->bins = realloc(idx->bins, (tid+1) * sizeof(uint64_t *));
+          for (i=idx->n_tids; i<=tid; i++) {
+               idx->n_bins[i] = idx->m_bins[i] = 0;
+               idx->bins[i] = NULL;
+          }
+          idx->n_tids = tid+1;
+     }
+     bin = pos >> SIDECAR_BIN_SHIFT;
+     while (idx->n_bins[tid] <= bin) {
+          if (idx->n_bins[tid] == idx->m_bins[tid]) {
+               idx->m_bins[tid] = idx->m_bins[tid] ? 2*idx->m_bins[tid] : 64;
+               idx->bins[tid] = realloc(idx->bins[tid], idx->m_bins[tid] * sizeof(uint64_t));
+          }
+          idx->bins[tid][idx->n_bins[tid]++] = voff;
+     }
+
+     rec->key = rec_key(b);
+     if (bgzf_write(w->fp, &tid, 4) != 4
+         || bgzf_write(w->fp, &pos, 4) != 4
+         || bgzf_write(w->fp, &rec->key, 8) != 8
+         || bgzf_write(w->fp, &rec->l_aux, 4) != 4
+         || bgzf_write(w->fp, rec->aux, rec->l_aux) != rec->l_aux) {
+          LOG_ERROR("Couldn't write to %s\n", w->fn);
+          return 1;
+     }
+     w->num_recs++;
+     return 0;
+}
+/* sidecar_writer_add() */
+
+
+int
+sidecar_writer_close(sidecar_writer_t *w)
+{
+     char *ifn;
+     FILE *fh;
+     int rc = 0;
+     int i;
+
+     if (bgzf_close(w->fp)) {
+          LOG_ERROR("Couldn't close %s\n", w->fn);
+          rc = 1;
+     }
+
+     ifn = idx_fn(w->fn);
+     if (NULL == (fh = fopen(ifn, "wb"))) {
+          LOG_ERROR("Couldn't open %s for writing\n", ifn);
+          rc = 1;
+     } else {
+          fwrite(SIDECAR_IDX_MAGIC, 1, 4, fh);
+          fwrite(&w->idx.n_tids, sizeof(int32_t), 1, fh);
+          for (i=0; i<w->idx.n_tids; i++) {
+               fwrite(&w->idx.n_bins[i], sizeof(int32_t), 1, fh);
+               fwrite(w->idx.bins[i], sizeof(uint64_t), w->idx.n_bins[i], fh);
+          }
+          if (fclose(fh)) {
+               LOG_ERROR("Couldn't write %s\n", ifn);
+               rc = 1;
+          }
+     }
+     LOG_VERBOSE("Wrote %ld records to sidecar %s\n", w->num_recs, w->fn);
+
+     free(ifn);
+     for (i=0; i<w->n_tags; i++) {
+          free(w->tags[i]);
+     }
+     free(w->tags);
+     free(w->rec.aux);
+     idx_free(&w->idx);
+     free(w->fn);
+     free(w);
+     return rc;
+}
+/* sidecar_writer_close() */
+
+
+static int
+idx_load(sidecar_idx_t *idx, const char *fn)
+{
+     char *ifn = idx_fn(fn);
+     FILE *fh;
+     char magic[4];
+     int32_t n;
+     int i, rc = 0;
+
+     memset(idx, 0, sizeof(sidecar_idx_t));
+     if (NULL == (fh = fopen(ifn, "rb"))) {
+          LOG_ERROR("Couldn't open sidecar index %s\n", ifn);
+          free(ifn);
+          return 1;
+     }
+     if (fread(magic, 1, 4, fh) != 4 || memcmp(magic, SIDECAR_IDX_MAGIC, 4)
+         || fread(&n, sizeof(int32_t), 1, fh) != 1 || n < 0) {
+          rc = 1;
+          goto done;
+     }
+     idx->n_tids = n;
+     idx->n_bins = calloc(n, sizeof(int));
+     idx->bins = calloc(n, sizeof(uint64_t *));
+     for (i=0; i<n; i++) {
+          if (fread(&idx->n_bins[i], sizeof(int32_t), 1, fh) != 1 || idx->n_bins[i] < 0) {
+               rc = 1;
+               goto done;
+          }
+          idx->bins[i] = malloc((idx->n_bins[i]+1) * sizeof(uint64_t));
+          if (fread(idx->bins[i], sizeof(uint64_t), idx->n_bins[i], fh) != (size_t)idx->n_bins[i]) {
+               rc = 1;
+               goto done;
+          }
+     }
+done:
+     if (rc) {
+          LOG_ERROR("Invalid sidecar index %s\n", ifn);
+          idx_free(idx);
+     }
+     fclose(fh);
+     free(ifn);
+     return rc;
+}
+/* idx_load() */
+
+
+sidecar_t *
+sidecar_open(const char *fn)
+{
+     sidecar_t *sc;
+     char magic[4];
+
+     sc = calloc(1, sizeof(sidecar_t));
+     if (NULL == (sc->fp = bgzf_open(fn, "r"))) {
+          LOG_ERROR("Couldn't open sidecar %s\n", fn);
+          free(sc);
+          return NULL;
+     }
+     if (bgzf_read(sc->fp, magic, 4) != 4 || memcmp(magic, SIDECAR_MAGIC, 4)) {
+          LOG_ERROR("%s is not a sidecar file\n", fn);
+          bgzf_close(sc->fp);
+          free(sc);
+          return NULL;
+     }
+     if (idx_load(&sc->idx, fn)) {
+          bgzf_close(sc->fp);
+          free(sc);
+          return NULL;
+     }
+     sc->fn = strdup(fn);
+     sc->grp_tid = -1;
+     return sc;
+}
+/* sidecar_open() */
+
+
+void
+sidecar_close(sidecar_t *sc)
+{
+     int i;
+
+     if (! sc) {
+          return;
+     }
+     LOG_VERBOSE("Attached data from sidecar %s to %ld reads (%ld reads without)\n",
+                 sc->fn, sc->num_attached, sc->num_missing);
+     bgzf_close(sc->fp);
+     idx_free(&sc->idx);
+     free(sc->next.aux);
+     for (i=0; i<sc->m_grp; i++) {
+          free(sc->grp[i].aux);
+     }
+     free(sc->grp);
+     free(sc->fn);
+     free(sc);
+}
+/* sidecar_close() */
+
+
+/* positions file at the first record at or after tid:pos */
+static int
+sidecar_seek(sidecar_t *sc, int32_t tid, int32_t pos)
+{
+     const sidecar_idx_t *idx = &sc->idx;
+     int bin = pos >> SIDECAR_BIN_SHIFT;
+     int64_t voff = -1;
+     int t;
+
+     sc->has_next = 0;
+     sc->is_eof = 0;
+     if (tid < idx->n_tids && bin < idx->n_bins[tid]) {
+          voff = idx->bins[tid][bin];
+     } else {
+          /* nothing at or after pos on tid */
+          for (t=tid+1; t<idx->n_tids; t++) {
+               if (idx->n_bins[t]) {
+                    voff = idx->bins[t][0];
+                    break;
+               }
+          }
+     }
+     if (voff < 0) {
+          sc->is_eof = 1;
+          return 0;
+     }
+     if (bgzf_seek(sc->fp, voff, SEEK_SET) < 0) {
+          LOG_ERROR("Seeking in sidecar %s failed\n", sc->fn);
+          return -1;
+     }
+     return 0;
+}
+/* sidecar_seek() */
+
+
+/* makes sure sc->next is loaded unless at eof. returns -1 on error */
+static int
+read_next(sidecar_t *sc)
+{
+     sidecar_rec_t *rec = &sc->next;
+     ssize_t ret;
+
+     if (sc->has_next || sc->is_eof) {
+          return 0;
+     }
+     if (0 == (ret = bgzf_read(sc->fp, &rec->tid, 4))) {
+          sc->is_eof = 1;
+          return 0;
+     }
+     if (ret != 4
+         || bgzf_read(sc->fp, &rec->pos, 4) != 4
+         || bgzf_read(sc->fp, &rec->key, 8) != 8
+         || bgzf_read(sc->fp, &rec->l_aux, 4) != 4) {
+          LOG_ERROR("Truncated sidecar %s\n", sc->fn);
+          return -1;
+     }
+     rec_reserve(rec, rec->l_aux);
+     if (bgzf_read(sc->fp, rec->aux, rec->l_aux) != rec->l_aux) {
+          LOG_ERROR("Truncated sidecar %s\n", sc->fn);
+          return -1;
+     }
+     sc->has_next = 1;
+     return 0;
+}
+/* read_next() */
+
+
+/* -1, 0, 1 if tid1:pos1 is before, equal or after tid2:pos2 */
+static int
+pos_cmp(int32_t tid1, int32_t pos1, int32_t tid2, int32_t pos2)
+{
+     if (tid1 != tid2) {
+          return tid1 < tid2 ? -1 : 1;
+     }
+     return pos1 < pos2 ? -1 : (pos1 > pos2);
+}
+
+
+/* loads all records at tid:pos into grp */
+static int
+load_group(sidecar_t *sc, int32_t tid, int32_t pos)
+{
+     int need_seek = ! sc->is_init
+          || pos_cmp(tid, pos, sc->grp_tid, sc->grp_pos) < 0;
+
+     if (! need_seek && sc->has_next) {
+          /* skip ahead if more than one window away */
+          need_seek = tid != sc->next.tid
+               || (pos >> SIDECAR_BIN_SHIFT) > (sc->next.pos >> SIDECAR_BIN_SHIFT) + 1;
+          need_seek = need_seek && pos_cmp(tid, pos, sc->next.tid, sc->next.pos) > 0;
+     }
+     if (need_seek && sidecar_seek(sc, tid, pos)) {
+          return -1;
+     }
+     sc->is_init = 1;
+     sc->n_grp = 0;
+     sc->grp_tid = tid;
+     sc->grp_pos = pos;
+
+     while (1) {
+          sidecar_rec_t tmp;
+          int c;
+
+          if (read_next(sc)) {
+               return -1;
+          }
+          if (! sc->has_next) {
+               break;
+          }
+          c = pos_cmp(sc->next.tid, sc->next.pos, tid, pos);
+          if (c > 0) {
+               break;
+          }
+          sc->has_next = 0;
+          if (c < 0) {
+               continue;
+          }
+          if (sc->n_grp == sc->m_grp) {
+               sc->m_grp = sc->m_grp ? 2*sc->m_grp : 16;
+               sc->grp = realloc(sc->grp, sc->m_grp * sizeof(sidecar_rec_t));
+               memset(sc->grp + sc->n_grp, 0, (sc->m_grp - sc->n_grp) * sizeof(sidecar_rec_t));
+          }
+          /* swap buffers */
+          tmp = sc->grp[sc->n_grp];
+          sc->grp[sc->n_grp] = sc->next;
+          sc->next = tmp;
+          sc->n_grp++;
+     }
+     return 0;
+}
+/* load_group() */
+
+
+int
+sidecar_attach(sidecar_t *sc, bam1_t *b)
+{
+     const sidecar_rec_t *rec = NULL;
+     uint64_t key;
+     const uint8_t *s, *end;
+     int i;
+
+     if (b->core.tid < 0) {
+          return 0;
+     }
+     if (! sc->is_init || b->core.tid != sc->grp_tid || b->core.pos != sc->grp_pos) {
+          if (load_group(sc, b->core.tid, b->core.pos)) {
+               return -1;
+          }
+     }
+     key = rec_key(b);
+     for (i=0; i<sc->n_grp; i++) {
+          if (sc->grp[i].key == key) {
+               rec = &sc->grp[i];
+               break;
+          }
+     }
+     if (! rec) {
+          sc->num_missing++;
+          return 0;
+     }
+
+     s = rec->aux;
+     end = rec->aux + rec->l_aux;
+     while (s < end) {
+          char tag[2];
+          uint8_t *old;
+          int len;
+
+          if (end - s < 3 || (len = aux_val_len(s+2, end)) < 0) {
+               LOG_ERROR("Corrupt record in sidecar %s\n", sc->fn);
+               return -1;
+          }
+          tag[0] = s[0];
+          tag[1] = s[1];
+          if (NULL != (old = bam_aux_get(b, tag))) {
+               bam_aux_del(b, old);
+          }
+          bam_aux_append(b, tag, s[2], len-1, s+3);
+          s += 2 + len;
+     }
+     sc->num_attached++;
+     return 1;
+}
+/* sidecar_attach() */
@@ -0,0 +1,87 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef SIDECAR_H
+#define SIDECAR_H
+
+#include <stdint.h>
+
+#include "htslib/sam.h"
+
+
+/* Per-read tag sidecar files.
+ *
+ * Instead of writing a complete new BAM, tools like alnqual and
+ * indelqual can write the tags they compute (BAQ, IDAQ, indel
+ * qualities) to a sidecar file. The pileup then attaches them to the
+ * reads of the original, unchanged BAM as they are decoded.
+ *
+ * A sidecar file is BGZF compressed and holds one record per read
+ * (of a coordinate sorted BAM) with its position, a key derived
+ * from read name and flag, and the tags in BAM aux encoding. A
+ * linear index (FILE.lsi) maps 16kbp windows to file offsets, so that
+ * region queries don't need to read the sidecar from the start.
+ */
+
+#define SIDECAR_IDX_EXT ".lsi"
+
+
+typedef struct sidecar_writer sidecar_writer_t;
+typedef struct sidecar sidecar_t;
+
+
+/* tags are copied (if present) from each read passed to
+ * sidecar_writer_add() */
+sidecar_writer_t *
+sidecar_writer_open(const char *fn, const char **tags, int n_tags);
+
+/* reads have to be added in coordinate order. unmapped reads and
+ * reads without any of the tags are skipped. returns non-zero on
+ * error */
+int
+sidecar_writer_add(sidecar_writer_t *w, const bam1_t *b);
+
+/* writes the index as well. returns non-zero on error */
+int
+sidecar_writer_close(sidecar_writer_t *w);
+
+
+sidecar_t *
+sidecar_open(const char *fn);
+
+/* attaches the tags stored for b (overwriting existing ones). reads
+ * have to come in coordinate order, but may skip regions. returns 1
+ * if tags were attached, 0 if there were none and -1 on error */
+int
+sidecar_attach(sidecar_t *sc, bam1_t *b);
+
+void
+sidecar_close(sidecar_t *sc);
+
+#endif
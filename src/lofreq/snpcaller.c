@@ -47,22 +47,13 @@
 #include "gsl/gsl_cdf.h"
 
 #include "snpcaller.h"
+#include "pbin_owner.h"
+#include "autotune.h"
 
-#ifdef USE_FPGA
-#include "fpga.h"
-#endif
-
-#ifdef USE_FPGA
-#if TIMING || PROFILING
-#include <time.h>
-#endif
-#else
 #if TIMING
 #include <time.h>
 #endif
 
-#endif
-
 /* Converting MQ=0 into prob would 'kill' a read. Previously used 0.66 here since
    the median number of best hits in BWA for one examined human wgs sample
    was 3 (sadly BWA-MEM doesn't produce X0 tags anymore). For simplicity's
@@ -74,6 +65,12 @@
 #define LOGZERO -1e100
 /* shouldn't we use something from float.h ? */
 
+/* pruned_calc_prob_dist() tries to certify significance early. checks
+ * are O(K*num_accept_counts) each, so only done every now and then:
+ * first after this many reads and from then on after another max(this,
+ * n/4) reads */
+#define EARLY_ACCEPT_MIN_INTERVAL 16
+
 
 #if 0
 #define DEBUG
@@ -257,8 +254,6 @@ double log_diff(double log_a, double log_b);
 double probvec_tailsum(const double *probvec, int tail_startindex,
                        int probvec_len);
 double *naive_calc_prob_dist(const double *err_probs, int N, int K);
-double *pruned_calc_prob_dist(const double *err_probs, int N, int K,
-                      long long int bonf_factor, double sig_level);
 
 
 
@@ -646,9 +641,12 @@ init_varcall_conf(varcall_conf_t *c)
      c->flag |= VARCALL_USE_MQ;
      c->flag |= VARCALL_USE_BAQ;
      c->flag |= VARCALL_USE_IDAQ;
+     c->flag |= VARCALL_EARLY_ACCEPT;
      c->only_indels = 0;
      c->no_indels = 0;
      c->approx_threshold_n = -1;
+     c->num_snv_tests = 0;
+     c->num_indel_tests = 0;
 }
 
 
@@ -672,6 +670,7 @@ dump_varcall_conf(const varcall_conf_t *c, FILE *stream)
      fprintf(stream, "  flag & VARCALL_USE_MQ      = %d\n", c->flag&VARCALL_USE_MQ?1:0);
      fprintf(stream, "  flag & VARCALL_USE_SQ      = %d\n", c->flag&VARCALL_USE_SQ?1:0);
      fprintf(stream, "  flag & VARCALL_USE_IDAQ    = %d\n", c->flag&VARCALL_USE_IDAQ?1:0);
+     fprintf(stream, "  flag & VARCALL_EARLY_ACCEPT = %d\n", c->flag&VARCALL_EARLY_ACCEPT?1:0);
 #ifdef SCALE_MQ
      LOG_WARN("%s\n", "MQ scaling switched on!");
 #elif defined MQ_TRANS_TABLE
@@ -823,29 +822,147 @@ naive_calc_prob_dist(const double *err_probs, int N, int K)
 
 
 
+/**
+ * @brief Log of a Chernoff upper bound on P(Y >= j), where Y is the
+ * number of failures in independent Bernoulli trials with a summed
+ * failure probability (mean) of mu, i.e. exp(-mu) * (e*mu/j)^j for
+ * j > mu. Trivially 1 (log 0.0) otherwise.
+ */
+static double
+log_chernoff_tail(int j, double mu)
+{
+     if (j <= 0 || (double)j <= mu) {
+          return 0.0;
+     }
+     if (mu <= 0.0) {
+          return LOGZERO;
+     }
+     return -mu + j + j * log(mu/j);
+}
+/* log_chernoff_tail() */
+
+
+/**
+ * @brief Tries to certify the final tail probabilities P(X_N >= c)
+ * for all counts c in accept_counts, given the distribution after
+ * only n of N error probabilities (probvec, log space, last entry
+ * being the tail P(X_n >= K)). mu_rest is the summed error
+ * probability of the remaining N-n trials.
+ *
+ * The remaining N-n trials can at most add Y failures, so P(X_N >=
+ * c) <= sum_k P(X_n = k) * P(Y >= c-k), with P(Y >= j) bounded by
+ * log_chernoff_tail(). P(X_n >= c) on the other hand is a lower
+ * bound, since failures never go away.
+ *
+ * Returns 1 if every count is either certainly significant (upper
+ * bound below sig_level/bonf_factor) or certainly not (lower bound
+ * not below it) and at least one count is significant. The logged
+ * bounds to report are then stored in log_bounds in the order of
+ * accept_counts. Returns 0 otherwise.
+ */
+static int
+certify_early_accept(double *log_bounds, const double *probvec,
+                     int n, int K, double mu_rest,
+                     const int *accept_counts, int num_accept_counts,
+                     long long int bonf_factor, double sig_level)
+{
+     double log_thresh = log(sig_level) - log((double)bonf_factor);
+     int num_sig = 0;
+     int i, k;
+     int kmax = MIN(n, K);
+
+     for (i=0; i<num_accept_counts; i++) {
+          int c = accept_counts[i];
+          double log_upper = LOGZERO;
+          double log_lower = LOGZERO;
+
+          for (k=0; k<=kmax; k++) {
+               double log_t = (k >= c) ? 0.0 : log_chernoff_tail(c-k, mu_rest);
+               log_upper = log_sum(log_upper, probvec[k] + log_t);
+               if (k >= c) {
+                    log_lower = log_sum(log_lower, probvec[k]);
+               }
+          }
+
+          if (log_upper < log_thresh) {
+               log_bounds[i] = log_upper;
+               num_sig += 1;
+          } else if (log_lower >= log_thresh) {
+               /* not significant anyway. lower bound is good enough
+                * since insignificant pvalues aren't computed properly
+                * anyway, see poissbin() */
+               log_bounds[i] = log_lower;
+          } else {
+               return 0;
+          }
+     }
+
+     return num_sig > 0;
+}
+/* certify_early_accept() */
+
+
 /**
  * Should really get rid of bonf_factor and sig_level here and
  * upstream as well
  *
+ * If accept_counts is given, try to stop early once the tail
+ * probability of each of these counts (all <= K and including K
+ * itself) is certainly significant or certainly not (see
+ * certify_early_accept()). The returned vector will then only hold
+ * conservative bounds, stored such that probvec_tailsum() from each
+ * of these counts gives its bound, and is_bound (if not NULL) will
+ * be set to 1.
+ *
  */
 double *
 pruned_calc_prob_dist(const double *err_probs, int N, int K,
-                      long long int bonf_factor, double sig_level)
+                      long long int bonf_factor, double sig_level,
+                      const int *accept_counts, int num_accept_counts,
+                      int *is_bound)
 {
     double *probvec = NULL;
     double *probvec_prev = NULL;
     double *probvec_swp = NULL;
+    double *log_bounds = NULL;
+    double *mu_rest = NULL; /* summed error probs from n on. for early accept */
+    int next_accept_check = EARLY_ACCEPT_MIN_INTERVAL;
     int n;
 
+    if (is_bound) {
+         *is_bound = 0;
+    }
+    if (accept_counts && num_accept_counts > 0) {
+         for (n=0; n<num_accept_counts; n++) {
+              assert(accept_counts[n] > 0 && accept_counts[n] <= K);
+         }
+         if (NULL == (log_bounds = malloc(num_accept_counts * sizeof(double)))
+             || NULL == (mu_rest = malloc((N+1) * sizeof(double)))) {
+              fprintf(stderr, "FATAL: couldn't allocate memory at %s:%s():%d\n",
+                      __FILE__, __FUNCTION__, __LINE__);
+              free(log_bounds);
+              return NULL;
+         }
+         mu_rest[N] = 0.0;
+         for (n=N-1; n>=0; n--) {
+              /* treating 0 as DBL_EPSILON as below */
+              mu_rest[n] = mu_rest[n+1] + MAX(err_probs[n], DBL_EPSILON);
+         }
+    }
+
     if (NULL == (probvec = malloc((K+1) * sizeof(double)))) {
         fprintf(stderr, "FATAL: couldn't allocate memory at %s:%s():%d\n",
                 __FILE__, __FUNCTION__, __LINE__);
+        free(log_bounds);
+        free(mu_rest);
         return NULL;
     }
     if (NULL == (probvec_prev = malloc((K+1) * sizeof(double)))) {
         fprintf(stderr, "FATAL: couldn't allocate memory at %s:%s():%d\n",
                 __FILE__, __FUNCTION__, __LINE__);
         free(probvec);
+        free(log_bounds);
+        free(mu_rest);
         return NULL;
     }
 
@@ -954,6 +1071,65 @@ pruned_calc_prob_dist(const double *err_probs, int N, int K,
                           __FILE__, __FUNCTION__, __LINE__, n, K, pvalue);
 #endif
                   free(probvec_prev);
+                  free(log_bounds);
+                  free(mu_rest);
+                  return probvec;
+             }
+        }
+
+        /* early accept: no need to look at the remaining reads if
+         * the outcome is certain anyway */
+        if (log_bounds && n < N && n >= next_accept_check) {
+             next_accept_check = n + MAX(EARLY_ACCEPT_MIN_INTERVAL, n/4);
+             if (certify_early_accept(log_bounds, probvec, n, K, mu_rest[n],
+                                      accept_counts, num_accept_counts,
+                                      bonf_factor, sig_level)) {
+                  int i, k;
+                  int min_count = K;
+#ifdef DEBUG
+                  fprintf(stderr, "DEBUG(%s:%s:%d): early accept at n=%d of N=%d K=%d\n",
+                          __FILE__, __FUNCTION__, __LINE__, n, N, K);
+#endif
+                  for (i=0; i<num_accept_counts; i++) {
+                       min_count = MIN(min_count, accept_counts[i]);
+                  }
+                  for (k=MIN(n, K)+1; k<min_count; k++) {
+                       probvec[k] = LOGZERO;
+                  }
+                  /* store bounds as differences, so that tailsums
+                   * starting at any of the counts yield its bound.
+                   * bounds are monotone in the count, see
+                   * certify_early_accept() */
+                  for (k=K; k>=min_count; k--) {
+                       double log_bound = LOGZERO;
+                       double log_bound_next = LOGZERO;
+                       int is_count = 0;
+                       for (i=0; i<num_accept_counts; i++) {
+                            if (accept_counts[i] == k) {
+                                 log_bound = log_bounds[i];
+                                 is_count = 1;
+                            }
+                       }
+                       if (! is_count) {
+                            probvec[k] = LOGZERO;
+                            continue;
+                       }
+                       /* tail already stored above k */
+                       if (k < K) {
+                            log_bound_next = probvec_tailsum(probvec, k+1, K+1);
+                       }
+                       if (log_bound > log_bound_next) {
+                            probvec[k] = log_diff(log_bound, log_bound_next);
+                       } else {
+                            probvec[k] = LOGZERO;
+                       }
+                  }
+                  if (is_bound) {
+                       *is_bound = 1;
+                  }
+                  free(probvec_prev);
+                  free(log_bounds);
+                  free(mu_rest);
                   return probvec;
              }
         }
@@ -968,11 +1144,181 @@ pruned_calc_prob_dist(const double *err_probs, int N, int K,
 
     /* return prev because we just swapped (if not pruned) */
     free(probvec);
+    free(log_bounds);
+    free(mu_rest);
     return probvec_prev;
 }
 /* pruned_calc_prob_dist */
 
 
+/**
+ * @brief Number of runs of identical values in err_probs, i.e. the
+ * number of distinct error probabilities if err_probs is sorted
+ */
+int
+num_err_prob_runs(const double *err_probs, int N)
+{
+     int n;
+     int num_runs = N>0 ? 1 : 0;
+
+     for (n=1; n<N; n++) {
+          if (err_probs[n] != err_probs[n-1]) {
+               num_runs += 1;
+          }
+     }
+     return num_runs;
+}
+/* num_err_prob_runs() */
+
+
+/**
+ * @brief Same distribution as pruned_calc_prob_dist() (including
+ * the early exit, but without early accept), computed per run of
+ * identical error probabilities instead of per error probability.
+ *
+ * A run of m trials with error probability p adds a binomial number
+ * of failures, so the distribution is convolved with Binomial(m, p)
+ * truncated at K (last entry being the tail again). This costs
+ * O(K^2) per run instead of O(m*K), which pays off if err_probs is
+ * sorted and there are only few distinct qualities.
+ */
+double *
+hist_calc_prob_dist(const double *err_probs, int N, int K,
+                    long long int bonf_factor, double sig_level)
+{
+     double *probvec = NULL;
+     double *probvec_prev = NULL;
+     double *probvec_swp = NULL;
+     double *log_pmf = NULL; /* binomial pmf of run for 0..K */
+     double *log_tail = NULL; /* binomial tail of run for 0..K+1 */
+     int kmax = 0; /* highest count with non-zero prob so far */
+     int n, m, k;
+
+     if (NULL == (probvec = malloc((K+1) * sizeof(double)))
+         || NULL == (probvec_prev = malloc((K+1) * sizeof(double)))
+         || NULL == (log_pmf = malloc((K+1) * sizeof(double)))
+         || NULL == (log_tail = malloc((K+2) * sizeof(double)))) {
+          fprintf(stderr, "FATAL: couldn't allocate memory at %s:%s():%d\n",
+                  __FILE__, __FUNCTION__, __LINE__);
+          free(probvec);
+          free(probvec_prev);
+          free(log_pmf);
+          return NULL;
+     }
+
+     for (n=0; n<N; n++) {
+          assert(err_probs[n] + DBL_EPSILON >= 0.0 && err_probs[n] - DBL_EPSILON <= 1.0);
+     }
+
+     /* init */
+     probvec_prev[0] = 0.0; /* log(1.0) */
+
+     for (n=0; n<N; n+=m) {
+          double pn = err_probs[n];
+          double log_pn, log_1_pn;
+          double log_binom;
+          int rmax;
+          int r, i;
+
+          for (m=1; n+m<N && err_probs[n+m]==pn; m++) {
+               ;
+          }
+
+          /* same safeguards as in pruned_calc_prob_dist() */
+          if (fabs(pn) < DBL_EPSILON) {
+               log_pn = log(DBL_EPSILON);
+          } else {
+               log_pn = log(pn);
+          }
+          if (fabs(pn-1.0) < DBL_EPSILON) {
+               log_1_pn = log1p(-pn+DBL_EPSILON);
+          } else {
+               log_1_pn = log1p(-pn);
+          }
+
+          /* pmf of run up to K */
+          rmax = MIN(m, K);
+          log_binom = 0.0; /* log(m choose r) */
+          for (r=0; r<=rmax; r++) {
+               if (r > 0) {
+                    log_binom += log((double)(m-r+1)) - log((double)r);
+               }
+               log_pmf[r] = log_binom + r*log_pn + (m-r)*log_1_pn;
+          }
+
+          /* tail above rmax: sum terms until they become negligible
+           * past the mode */
+          log_tail[rmax+1] = LOGZERO;
+          for (r=rmax+1; r<=m; r++) {
+               double log_term;
+               log_binom += log((double)(m-r+1)) - log((double)r);
+               log_term = log_binom + r*log_pn + (m-r)*log_1_pn;
+               log_tail[rmax+1] = log_sum(log_tail[rmax+1], log_term);
+               if (r > m*pn && log_term < log_tail[rmax+1] - 50.0) {
+                    break;
+               }
+          }
+          for (r=rmax; r>=0; r--) {
+               log_tail[r] = log_sum(log_tail[r+1], log_pmf[r]);
+          }
+
+          /* convolve. entries up to K-1 are exact counts */
+          for (k=MIN(kmax+rmax, K-1); k>=0; k--) {
+               double log_max = LOGZERO;
+               double sum = 0.0;
+               int imin = MAX(0, k-rmax);
+               int imax = MIN(k, kmax);
+               for (i=imin; i<=imax; i++) {
+                    log_max = MAX(log_max, probvec_prev[i] + log_pmf[k-i]);
+               }
+               for (i=imin; i<=imax; i++) {
+                    sum += exp(probvec_prev[i] + log_pmf[k-i] - log_max);
+               }
+               probvec[k] = MIN(log_max + log(sum), 0.0);
+          }
+          /* tail: previous tail plus everything reaching K now */
+          if (kmax+m >= K) {
+               double log_max = (kmax==K) ? probvec_prev[K] : LOGZERO;
+               double sum = 0.0;
+               for (i=MAX(0, K-m); i<=MIN(kmax, K-1); i++) {
+                    log_max = MAX(log_max, probvec_prev[i] + log_tail[K-i]);
+               }
+               if (kmax==K) {
+                    sum += exp(probvec_prev[K] - log_max);
+               }
+               for (i=MAX(0, K-m); i<=MIN(kmax, K-1); i++) {
+                    sum += exp(probvec_prev[i] + log_tail[K-i] - log_max);
+               }
+               /* rounding errors can push the tail above 1 */
+               probvec[K] = MIN(log_max + log(sum), 0.0);
+          }
+          kmax = MIN(kmax+m, K);
+
+          probvec_swp = probvec;
+          probvec = probvec_prev;
+          probvec_prev = probvec_swp;
+
+          if (kmax==K && n+m>K) {
+               /* early exit as in pruned_calc_prob_dist() */
+               if (expl(probvec_prev[K]) * (double)bonf_factor > sig_level) {
+                    break;
+               }
+          }
+     }
+
+     /* values never reached */
+     for (k=kmax+1; k<=K; k++) {
+          probvec_prev[k] = LOGZERO;
+     }
+
+     free(probvec);
+     free(log_pmf);
+     free(log_tail);
+     return probvec_prev;
+}
+/* hist_calc_prob_dist() */
+
+
 #ifdef PSEUDO_BINOMIAL
 /* binomial test using poissbin. only good for high n and small prob.
  * returns -1 on error */
@@ -999,7 +1345,7 @@ pseudo_binomial(long double *pvalue,
 
      probvec = poissbin(pvalue, probs,
                         num_trials, num_success,
-                        bonf, sig);
+                        bonf, sig, NULL, 0, NULL);
      free(probvec);
      free(probs);
 
@@ -1015,12 +1361,24 @@ pseudo_binomial(long double *pvalue,
  * only if first pvalue was below limits implied by bonf and sig.
  * default pvalue is DBL_MAX (1 might still be significant).
  *
+ * if accept_counts (all <= num_failures and including it) are given,
+ * computation might stop early once their significance is certain,
+ * in which case probvec and pvalue only hold conservative bounds and
+ * is_bound will be set (see pruned_calc_prob_dist()). is_bound
+ * might be NULL.
+ *
+ * the distribution is computed by the pbin-owner if attached (see
+ * pbin_client), otherwise by the engine pbin_autotune picked for
+ * this column's bucket (pruned if not set).
+ *
  *  note: pvalues > sig/bonf are not computed properly
  */
 double *
 poissbin(long double *pvalue, const double *err_probs,
          const int num_err_probs, const int num_failures,
-         const long long int bonf, const double sig)
+         const long long int bonf, const double sig,
+         const int *accept_counts, const int num_accept_counts,
+         int *is_bound)
 {
     double *probvec = NULL;
     int errsv;
@@ -1029,6 +1387,9 @@ poissbin(long double *pvalue, const double *err_probs,
     int msec;
 #endif
     *pvalue = LDBL_MAX;
+    if (is_bound) {
+         *is_bound = 0;
+    }
 
 #if TIMING
     start = clock();
@@ -1038,75 +1399,27 @@ poissbin(long double *pvalue, const double *err_probs,
                                     num_failures);
 #else
 
-#ifdef USE_FPGA
-    int use_cpu = 0;
-    if (MAX_BUFFER_SIZE < num_failures)
-          use_cpu = 1;
-
-    if (1 == use_cpu) { 
-        // Using the cpu instead the device 
-        probvec = pruned_calc_prob_dist(err_probs, num_err_probs,
-                num_failures, bonf, sig);
-
-        fprintf(stderr, "CPU: N: %d, K: %d\n", num_err_probs, num_failures);
-        return probvec; 
-    } else { 
-
-#if PROFILING
-        struct timespec kernel_s, kernel_t;
-        clock_gettime(CLOCK_REALTIME, &kernel_s);
-#endif
-        cl_event host_2_device;
-        cl_event exec_event;
-        cl_event device_2_host;
-        cl_mem mems[1] = {in_buf};
-        cl_int err = CL_SUCCESS;
-
-        err = clEnqueueMigrateMemObjects(cmd_queue, 1, mems, 0, 0, NULL,
-          &host_2_device);
-        if (err != CL_SUCCESS) {
-            fprintf(stderr, "clEnqueueMigrateMemObjects failed.\n");
-        }
-
-        err = CL_SUCCESS;
-        err = clEnqueueTask(cmd_queue, kernel1, 1, &host_2_device, &exec_event);
-        if(err != CL_SUCCESS) {
-            fprintf(stderr, "clEnqueueTask failed.\n");
-        }
-
-        err = CL_SUCCESS;
-        err = clEnqueueMigrateMemObjects(cmd_queue, 1, &out_buf,
-        CL_MIGRATE_MEM_OBJECT_HOST, 1, &exec_event, &device_2_host);
-        if (err != CL_SUCCESS) {
-            fprintf(stderr, "clEnqueueMigrateMemObjects failed.\n");
-        }
-
-        // Synchronization point: wait until the results are ready.
-        clWaitForEvents(1, &device_2_host);
-        clReleaseEvent(host_2_device);
-        clReleaseEvent(exec_event);
-        clReleaseEvent(device_2_host);
-
-#if PROFILING
-        clock_gettime(CLOCK_REALTIME, &kernel_t);
-
-        long seconds = kernel_t.tv_sec - kernel_s.tv_sec;
-        long nanoseconds = kernel_t.tv_nsec - kernel_s.tv_nsec;
-        double elapsed = seconds + nanoseconds*1e-9;
-        printf("krnl: %g, N: %d, K: %d\n", elapsed, num_err_probs, num_failures);
-#endif
-
-        probvec = malloc((num_failures + 1) * sizeof(double));
-
-        for (int j = 0; j < (num_failures + 1); j++) {
-            probvec[j] = out_buf_host[j];
-        }
-     }
-#else
-    // Executing the CPU version as if the FPGA components doesn't exist.
-    probvec = pruned_calc_prob_dist(err_probs, num_err_probs,
-                                    num_failures, bonf, sig);
-#endif
+    probvec = NULL;
+    if (pbin_client) {
+         /* served by the pbin-owner process. NULL if not possible */
+         probvec = pbin_client_calc_prob_dist(pbin_client, err_probs, num_err_probs,
+                                              num_failures, bonf, sig,
+                                              accept_counts, num_accept_counts,
+                                              is_bound);
+    }
+    if (NULL == probvec && pbin_autotune
+        && PBIN_ENGINE_HIST == autotune_engine(pbin_autotune, num_err_probs, num_failures,
+                                               num_err_prob_runs(err_probs, num_err_probs))) {
+         /* no early accept here, so is_bound stays 0 */
+         probvec = hist_calc_prob_dist(err_probs, num_err_probs,
+                                       num_failures, bonf, sig);
+    }
+    if (NULL == probvec) {
+         probvec = pruned_calc_prob_dist(err_probs, num_err_probs,
+                                         num_failures, bonf, sig,
+                                         accept_counts, num_accept_counts,
+                                         is_bound);
+    }
 
 #endif
 #if TIMING
@@ -1140,18 +1453,25 @@ poissbin(long double *pvalue, const double *err_probs,
  * will be written to snp_pvalues in the same order. If pvalue was not
  * computed (always insignificant) its value will be set to LDBL_MAX
  *
+ * If pvalues_are_bounds is not NULL, computation is allowed to stop
+ * as soon as the significance of all counts is certain. The reported
+ * pvalues are then conservative upper bounds (lower bounds for the
+ * insignificant ones) and pvalues_are_bounds will be set to 1.
+ *
  */
 int
 snpcaller(long double *snp_pvalues,
           const double *err_probs, const int num_err_probs,
           const int *noncons_counts,
           const long long int bonf_factor, const double sig_level,
-          const int approx_threshold_n)
+          const int approx_threshold_n, int *pvalues_are_bounds)
 {
     double *probvec = NULL;
     int i;
     int max_noncons_count = 0;
     long double pvalue;
+    int accept_counts[NUM_NONCONS_BASES];
+    int num_accept_counts = 0;
 
 #if 0
     for (i=0; i<num_err_probs; i++) {
@@ -1171,6 +1491,9 @@ snpcaller(long double *snp_pvalues,
     for (i=0; i<NUM_NONCONS_BASES; i++) {
         snp_pvalues[i] = LDBL_MAX;
     }
+    if (pvalues_are_bounds) {
+        *pvalues_are_bounds = 0;
+    }
 
     /* determine max non-consensus count */
     for (i=0; i<NUM_NONCONS_BASES; i++) {
@@ -1184,6 +1507,15 @@ snpcaller(long double *snp_pvalues,
         goto free_and_exit;
     }
 
+    /* counts for which we need pvalues. used for early accept */
+    if (pvalues_are_bounds) {
+        for (i=0; i<NUM_NONCONS_BASES; i++) {
+            if (noncons_counts[i] > 0) {
+                accept_counts[num_accept_counts++] = noncons_counts[i];
+            }
+        }
+    }
+
 /* how to combine ifndef? */
 #ifndef HAVE_LIBGSL
 #ifndef HAVE_LIBGSLCBLAS
@@ -1211,88 +1543,10 @@ snpcaller(long double *snp_pvalues,
      #endif
 #endif
 
-#ifdef USE_FPGA
-    /* Initializing OpenCL objects */
-    // Setting up DDR bank(s)
-    cl_int err = CL_SUCCESS;
-    cl_mem_ext_ptr_t in_buffer_ext = {0};
-    cl_mem_ext_ptr_t out_buffer_ext = {0};
-
-    // By default, each column unit connects to DDR bank 1.
-    int bank_id = 1;
-    in_buffer_ext.obj = 0;
-    out_buffer_ext.obj = 0;
-    in_buffer_ext.param = 0;
-    out_buffer_ext.param = 0;
-    in_buffer_ext.banks = bank_id | XCL_MEM_TOPOLOGY;
-    out_buffer_ext.banks = bank_id | XCL_MEM_TOPOLOGY;
-    in_buffer_ext.flags = bank_id | XCL_MEM_TOPOLOGY;
-    out_buffer_ext.flags = bank_id | XCL_MEM_TOPOLOGY;
-
-#if USE_MANY_COMPUTE_UNITS
-    // Each memory port can connect at most 15 CUs.
-    // If the design contains more than 15 CUs, some need to connect to DDR
-    // bank 3 instead of 1.
-    // The assignment is done based on the data chunk (bin) id of the process.
-    if (proc_bin_id % 2 == 0) {
-        bank_id = 3;
-        in_buffer_ext.banks = bank_id | XCL_MEM_TOPOLOGY;
-        out_buffer_ext.banks = bank_id | XCL_MEM_TOPOLOGY;
-        in_buffer_ext.flags = bank_id | XCL_MEM_TOPOLOGY;
-        out_buffer_ext.flags = bank_id | XCL_MEM_TOPOLOGY;
-    }
-#endif
-
-    int N_size = num_err_probs;
-    int K_plus1_size = max_noncons_count + 1;
-
-    in_buf = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_EXT_PTR_XILINX,
-     sizeof(double) * N_size, &in_buffer_ext, &err);
-    out_buf = clCreateBuffer(context, CL_MEM_WRITE_ONLY | CL_MEM_EXT_PTR_XILINX,
-     sizeof(double) * K_plus1_size, &out_buffer_ext, &err);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "clCreateBuffer failed.\n");
-    }
-
-    // Setting up the arguments of the kernel function
-    err = CL_SUCCESS;
-    err |= clSetKernelArg(kernel1, 0, sizeof(in_buf), &in_buf);
-    err |= clSetKernelArg(kernel1, 1, sizeof(int), &num_err_probs); // N
-    err |= clSetKernelArg(kernel1, 2, sizeof(int), &max_noncons_count); // K
-    err |= clSetKernelArg(kernel1, 3, sizeof(out_buf), &out_buf);
-
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "clSetKernelArg failed.\n");
-        return -1;
-    }
-
-    // Setting up the pointer to the input and output buffer
-    err = CL_SUCCESS;
-    in_buf_host = (double*) clEnqueueMapBuffer(cmd_queue, in_buf,
-     CL_TRUE, CL_MAP_WRITE, 0, sizeof(double) * N_size, 0, NULL, NULL, &err);
-    out_buf_host = (double*) clEnqueueMapBuffer(cmd_queue, out_buf,
-     CL_TRUE, CL_MAP_READ, 0, sizeof(double) * K_plus1_size, 0, NULL, NULL, &err);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "clEnqueueMapBuffer failed.\n");
-        return -1;
-    }
-
-    // Filling the input buffer with actual input (error probabilities)
-    for (int k = 0; k < N_size; k++) {
-        in_buf_host[k] = err_probs[k];
-    }
-
-    /* Initializing OpenCL objects ends */
-#endif
-
     probvec = poissbin(&pvalue, err_probs, num_err_probs,
-                       max_noncons_count, bonf_factor, sig_level);
-
-#ifdef USE_FPGA
-    // Releasing the OpenCL buffer objects
-    clReleaseMemObject(in_buf);
-    clReleaseMemObject(out_buf);
-#endif
+                       max_noncons_count, bonf_factor, sig_level,
+                       num_accept_counts ? accept_counts : NULL,
+                       num_accept_counts, pvalues_are_bounds);
 
 #if 0
     for (i=1; i<max_noncons_count+1; i++) {
@@ -1452,7 +1706,7 @@ int main(int argc, char *argv[]) {
           noncons_counts[1] = num_errs-1;
           noncons_counts[2] = num_errs-2;
 
-          snpcaller(snp_pvalues, err_probs, num_trials, noncons_counts, bonf, sig);
+          snpcaller(snp_pvalues, err_probs, num_trials, noncons_counts, bonf, sig, -1, NULL);
           printf("prob from snpcaller(): (.. -2:%Lg .. -1:%Lg ..) = %Lg\n", snp_pvalues[2], snp_pvalues[1], snp_pvalues[0]);
      }
 #else
@@ -1460,7 +1714,7 @@ int main(int argc, char *argv[]) {
           double *probvec;
           long double pvalue;
           probvec = poissbin(&pvalue, err_probs, num_trials,
-                             num_errs, bonf, sig);
+                             num_errs, bonf, sig, NULL, 0, NULL);
           printf("%Lg\n", pvalue);
           free(probvec);
      }
@@ -60,6 +60,12 @@ typedef struct {
      int no_indels; 
 
      int approx_threshold_n; /* when to use fast poisson binomial approximation for early exit */
+
+     /* number of tests performed (CONSVAR doesn't count). for
+      * downstream multiple testing correction. corresponds to bonf if
+      * bonf_dynamic is true. */
+     long long int num_snv_tests;
+     long long int num_indel_tests;
 } varcall_conf_t;
 
 
@@ -90,16 +96,29 @@ void
 dump_varcall_conf(const varcall_conf_t *c, FILE *stream) ;
 
 
+extern double *
+pruned_calc_prob_dist(const double *err_probs, int N, int K,
+                      long long int bonf_factor, double sig_level,
+                      const int *accept_counts, int num_accept_counts,
+                      int *is_bound);
+extern double *
+hist_calc_prob_dist(const double *err_probs, int N, int K,
+                    long long int bonf_factor, double sig_level);
+extern int
+num_err_prob_runs(const double *err_probs, int N);
 extern double *
 poissbin(long double *pvalue, const double *err_probs,
          const int num_err_probs, const int num_failures, 
-         const long long int bonf, const double sig);
+         const long long int bonf, const double sig,
+         const int *accept_counts, const int num_accept_counts,
+         int *is_bound);
 extern int
 snpcaller(long double *snp_pvalues, const double *err_probs,
           const int num_err_probs, const int *noncons_counts,
           const long long int bonf_factor,
           const double sig_level,
-          const int approx_treshold_n);
+          const int approx_treshold_n,
+          int *pvalues_are_bounds);
 
 
 #endif
@@ -0,0 +1,227 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "htslib/thread_pool.h"
+
+#include "thread_budget.h"
+#include "log.h"
+
+
+struct thread_budget_queue {
+     hts_tpool_process *q; /* NULL without pool */
+     void **results; /* ring buffer of results without pool */
+     int first, n, m;
+     int pending;
+};
+
+
+static int budget_size = 1;
+static hts_tpool *budget_pool = NULL;
+
+
+int
+thread_budget_init(int num_threads)
+{
+     long int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+     if (budget_pool) {
+          LOG_ERROR("%s\n", "Thread budget already initialized");
+          return 1;
+     }
+     if (num_threads <= 0) {
+          const char *env = getenv(THREAD_BUDGET_ENV);
+          num_threads = env ? atoi(env) : 1;
+          if (num_threads <= 0) {
+               LOG_WARN("Ignoring invalid %s=%s\n", THREAD_BUDGET_ENV, env);
+               num_threads = 1;
+          }
+     }
+     if (num_cpus > 0 && num_threads > num_cpus) {
+          LOG_WARN("Requested number of threads (%d) higher than number of CPUs (%ld)\n",
+                   num_threads, num_cpus);
+     }
+
+     budget_size = num_threads;
+     if (num_threads > 1) {
+          if (NULL == (budget_pool = hts_tpool_init(num_threads-1))) {
+               LOG_ERROR("Couldn't start pool of %d threads\n", num_threads-1);
+               budget_size = 1;
+               return 1;
+          }
+     }
+     LOG_VERBOSE("Using a budget of %d thread(s)\n", budget_size);
+     return 0;
+}
+/* thread_budget_init() */
+
+
+void
+thread_budget_destroy(void)
+{
+     if (budget_pool) {
+          hts_tpool_destroy(budget_pool);
+          budget_pool = NULL;
+     }
+     budget_size = 1;
+}
+
+
+int
+thread_budget_size(void)
+{
+     return budget_size;
+}
+
+
+int
+thread_budget_workers(void)
+{
+     return budget_pool ? budget_size-1 : 0;
+}
+
+
+int
+thread_budget_hts(htsFile *fp)
+{
+     htsThreadPool p;
+
+     if (! budget_pool) {
+          return 0;
+     }
+     p.pool = budget_pool;
+     p.qsize = 0; /* htslib default */
+     return hts_set_thread_pool(fp, & p);
+}
+
+
+int
+thread_budget_bgzf(BGZF *fp)
+{
+     if (! budget_pool) {
+          return 0;
+     }
+     /* same queue size htslib uses by default */
+     return bgzf_thread_pool(fp, budget_pool, 0);
+}
+
+
+thread_budget_queue_t *
+thread_budget_queue_init(void)
+{
+     thread_budget_queue_t *q = calloc(1, sizeof(thread_budget_queue_t));
+
+     if (budget_pool) {
+          /* room for every worker plus one job waiting for each */
+          if (NULL == (q->q = hts_tpool_process_init(budget_pool, 2*(budget_size-1), 0))) {
+               LOG_ERROR("%s\n", "Couldn't create job queue");
+               free(q);
+               return NULL;
+          }
+     }
+     return q;
+}
+
+
+void
+thread_budget_queue_destroy(thread_budget_queue_t *q)
+{
+     if (! q) {
+          return;
+     }
+     if (q->q) {
+          hts_tpool_process_destroy(q->q);
+     }
+     free(q->results);
+     free(q);
+}
+
+
+int
+thread_budget_dispatch(thread_budget_queue_t *q, void *(*func)(void *arg), void *arg)
+{
+     if (q->q) {
+          if (hts_tpool_dispatch(budget_pool, q->q, func, arg)) {
+               LOG_ERROR("%s\n", "Couldn't dispatch job");
+               return 1;
+          }
+     } else {
+          void *res = func(arg);
+          if (q->n == q->m) {
+               /* grow ring buffer, unwrapping it */
+               int i;
+               void **results = malloc((q->m ? 2*q->m : 4) * sizeof(void *));
+               for (i=0; i<q->n; i++) {
+                    results[i] = q->results[(q->first+i) % q->m];
+               }
+               free(q->results);
+               q->results = results;
+               q->first = 0;
+               q->m = q->m ? 2*q->m : 4;
+          }
+          q->results[(q->first + q->n++) % q->m] = res;
+     }
+     q->pending++;
+     return 0;
+}
+
+
+void *
+thread_budget_next_result(thread_budget_queue_t *q)
+{
+     void *res;
+
+     if (0 == q->pending) {
+          return NULL;
+     }
+     if (q->q) {
+          hts_tpool_result *r = hts_tpool_next_result_wait(q->q);
+          if (! r) {
+               return NULL;
+          }
+          res = hts_tpool_result_data(r);
+          hts_tpool_delete_result(r, 0);
+     } else {
+          res = q->results[q->first];
+          q->first = (q->first+1) % q->m;
+          q->n--;
+     }
+     q->pending--;
+     return res;
+}
+
+
+int
+thread_budget_pending(const thread_budget_queue_t *q)
+{
+     return q->pending;
+}
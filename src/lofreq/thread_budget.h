@@ -0,0 +1,100 @@
+/* -*- c-file-style: "k&r"; indent-tabs-mode: nil; -*- */
+/*********************************************************************
+* The MIT License (MIT)
+*
+* Copyright (c) 2013,2014 Genome Institute of Singapore
+*
+* Permission is hereby granted, free of charge, to any person
+* obtaining a copy of this software and associated documentation files
+* (the "Software"), to deal in the Software without restriction,
+* including without limitation the rights to use, copy, modify, merge,
+* publish, distribute, sublicense, and/or sell copies of the Software,
+* and to permit persons to whom the Software is furnished to do so,
+* subject to the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS
+* BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN
+* ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+* CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+* SOFTWARE.
+*
+************************************************************************/
+
+
+#ifndef THREAD_BUDGET_H
+#define THREAD_BUDGET_H
+
+#include "htslib/hts.h"
+#include "htslib/bgzf.h"
+
+
+/* Process wide thread budget.
+ *
+ * One htslib thread pool of N-1 workers is shared by BGZF/htsFile
+ * compression and decompression and by lofreq's own compute jobs.
+ * Together with the calling thread this keeps N cores busy, no matter
+ * which phase a command is in: whenever a queue's consumer falls
+ * behind (its output queue is full) the workers move on to the other
+ * queues, so I/O and compute share the workers according to demand.
+ *
+ * With a budget of 1 there is no pool and jobs run in the calling
+ * thread on dispatch, so callers don't need a separate serial code
+ * path.
+ */
+
+#define THREAD_BUDGET_ENV "LOFREQ_THREADS"
+
+typedef struct thread_budget_queue thread_budget_queue_t;
+
+/* num_threads <= 0 means LOFREQ_THREADS from the environment or 1.
+ * returns non-zero on error */
+int
+thread_budget_init(int num_threads);
+
+void
+thread_budget_destroy(void);
+
+/* total budget, including the calling thread */
+int
+thread_budget_size(void);
+
+/* number of pool workers (0 if running serially) */
+int
+thread_budget_workers(void);
+
+/* let htslib use the shared pool for (de)compression of fp. no-op
+ * without pool. return non-zero on error */
+int
+thread_budget_hts(htsFile *fp);
+
+int
+thread_budget_bgzf(BGZF *fp);
+
+/* queue of compute jobs. results come out in dispatch order */
+thread_budget_queue_t *
+thread_budget_queue_init(void);
+
+void
+thread_budget_queue_destroy(thread_budget_queue_t *q);
+
+/* runs func(arg) on the pool (or right away without pool). blocks if
+ * the queue is full. returns non-zero on error */
+int
+thread_budget_dispatch(thread_budget_queue_t *q, void *(*func)(void *arg), void *arg);
+
+/* returns the result of the oldest job still pending, waiting for it
+ * if needed, or NULL if there is none */
+void *
+thread_budget_next_result(thread_budget_queue_t *q);
+
+/* jobs dispatched but not collected yet */
+int
+thread_budget_pending(const thread_budget_queue_t *q);
+
+#endif
@@ -604,6 +604,26 @@ ins_event * find_ins_sequence(ins_event *const *head_ins_counts, char seq[]) {
      return it;
 }
 
+/* like find_ins_sequence(), but adds an empty event if seq was not
+ * found */
+ins_event * get_ins_sequence(ins_event **head_ins_counts, char seq[]) {
+     ins_event *it = NULL;
+     int seq_length = strlen(seq);
+     const int grow_by_size = 16384;
+
+     HASH_FIND(hh_ins, *head_ins_counts, seq, seq_length, it);
+     if (! it) {
+          it = calloc(1, sizeof(ins_event));
+          strncpy((char *)it->key, seq, MAX_INDELSIZE-1);
+          int_varray_init(& it->ins_quals, grow_by_size);
+          int_varray_init(& it->ins_aln_quals, grow_by_size);
+          int_varray_init(& it->ins_map_quals, grow_by_size);
+          int_varray_init(& it->ins_source_quals, grow_by_size);
+          HASH_ADD_KEYPTR(hh_ins, *head_ins_counts, it->key, seq_length, it);
+     }
+     return it;
+}
+
 void destruct_ins_event_counts(ins_event **head_ins_counts) {
      ins_event *it_ins, *it_tmp;
      HASH_ITER(hh_ins, *head_ins_counts, it_ins, it_tmp) {
@@ -664,6 +684,26 @@ del_event * find_del_sequence(del_event *const *head_del_counts, char seq[]) {
      return it;
 }
 
+/* like find_del_sequence(), but adds an empty event if seq was not
+ * found */
+del_event * get_del_sequence(del_event **head_del_counts, char seq[]) {
+     del_event *it = NULL;
+     int seq_length = strlen(seq);
+     const int grow_by_size = 16384;
+
+     HASH_FIND(hh_del, *head_del_counts, seq, seq_length, it);
+     if (! it) {
+          it = calloc(1, sizeof(del_event));
+          strncpy((char *)it->key, seq, MAX_INDELSIZE-1);
+          int_varray_init(& it->del_quals, grow_by_size);
+          int_varray_init(& it->del_aln_quals, grow_by_size);
+          int_varray_init(& it->del_map_quals, grow_by_size);
+          int_varray_init(& it->del_source_quals, grow_by_size);
+          HASH_ADD_KEYPTR(hh_del, *head_del_counts, it->key, seq_length, it);
+     }
+     return it;
+}
+
 void destruct_del_event_counts(del_event **head_del_counts) {
      del_event *it_del, *it_tmp;
      HASH_ITER(hh_del, *head_del_counts, it_del, it_tmp) {
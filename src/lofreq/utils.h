@@ -114,6 +114,7 @@ void add_ins_sequence(ins_event **head_ins_count, char seq[],
   int ins_qual, int ins_aln_qual, int ins_map_qual, int ins_source_qual, 
   int fw_rv);
 ins_event *find_ins_sequence(ins_event *const *head_ins_counts, char seq[]);
+ins_event *get_ins_sequence(ins_event **head_ins_counts, char seq[]);
 void destruct_ins_event_counts(ins_event **head_ins_counts);
 
 typedef struct {
@@ -132,6 +133,7 @@ void add_del_sequence(del_event **head_del_counts, char seq[],
   int del_qual, int del_aln_qual, int del_map_qual, int del_source_qual, 
   int fw_rv);
 del_event * find_del_sequence(del_event *const *head_del_counts, char seq[]);
+del_event * get_del_sequence(del_event **head_del_counts, char seq[]);
 void destruct_del_event_counts(del_event **head_del_counts);
 
 void
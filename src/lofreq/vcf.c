@@ -647,6 +647,7 @@ void vcf_write_new_header(vcf_file_t *vcf_file, const char *src, const char *ref
      vcf_printf(vcf_file, "##INFO=<ID=INDEL,Number=0,Type=Flag,Description=\"Indicates that the variant is an INDEL.\">\n");
      vcf_printf(vcf_file, "##INFO=<ID=CONSVAR,Number=0,Type=Flag,Description=\"Indicates that the variant is a consensus variant (as opposed to a low frequency variant).\">\n");
      vcf_printf(vcf_file, "##INFO=<ID=HRUN,Number=1,Type=Integer,Description=\"Homopolymer length to the right of report indel position\">\n");
+     vcf_printf(vcf_file, "##INFO=<ID=%s,Number=0,Type=Flag,Description=\"Indicates that QUAL is based on a conservative bound of the p-value (early accept) instead of its exact value\">\n", QUAL_BOUND_FLAG);
      vcf_printf(vcf_file, "%s\n", VCF_HEADER);
 }
 
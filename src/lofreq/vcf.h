@@ -83,6 +83,10 @@ void  var_hash_free_table(var_hash_t *var_hash);
 #define VCF_MISSING_VAL_STR "."
 #define VCF_MISSING_VAL_CHAR VCF_MISSING_VAL_STR[0]
 
+/* info flag for variants whose QUAL is derived from a conservative
+ * pvalue bound (caller stopped early) instead of the exact pvalue */
+#define QUAL_BOUND_FLAG "QUALBOUND"
+
 
 #define VCF_VAR_PASSES(v) ((v)->filter[0]==VCF_MISSING_VAL_CHAR || 0==strncmp((v)->filter, "PASS", 4))
 
@@ -19,6 +19,7 @@ import multiprocessing
 import tempfile
 import shutil
 import os
+import bisect
 from collections import namedtuple
 from math import log10
 
@@ -50,6 +51,10 @@ logging.basicConfig(level=logging.WARN,
 
 BIN_PER_THREAD = 2
 
+# regions without entry in a cost model (i.e. no coverage in earlier
+# runs) are assumed to cost this fraction of the mean cost per bp
+COST_MODEL_MIN_FRAC = 0.01
+
 
 def prob_to_phredqual(prob):
     """WARNING: near-identical copy from utils.py. copied here to make
@@ -92,6 +97,136 @@ def split_region(reg):
             for x in split_region_(reg.start, reg.end)]
 
 
+def read_cost_model(cost_profiles):
+    """Reads cost profiles written by 'lofreq call --cost-profile'
+    (e.g. from earlier runs of the same assay) and returns the
+    seconds per window summed over all profiles, as dict of chrom to
+    a list of (start, end, seconds) sorted by start
+    """
+
+    costs = dict()
+    for f in cost_profiles:
+        with open(f, 'r') as fh:
+            for line in fh:
+                if line.startswith('#') or len(line.strip()) == 0:
+                    continue
+                (chrom, start, end, seconds) = line.rstrip().split('\t')[0:4]
+                key = (int(start), int(end))
+                costs.setdefault(chrom, dict())
+                costs[chrom][key] = costs[chrom].get(key, 0.0) + float(seconds)
+
+    model = dict()
+    for (chrom, wins) in costs.items():
+        model[chrom] = sorted([(k[0], k[1], v) for (k, v) in wins.items()])
+    return model
+
+
+def cost_model_default(model):
+    """Cost per bp assumed for regions not listed in model
+    """
+
+    total_cost = sum([sum([w[2] for w in wins]) for wins in model.values()])
+    total_len = sum([sum([w[1]-w[0] for w in wins]) for wins in model.values()])
+    if total_len == 0:
+        return 1.0
+    return COST_MODEL_MIN_FRAC * total_cost/float(total_len)
+
+
+def region_cost_profile(reg, model, default_cost):
+    """Returns list of (start, end, cost) of pieces of region reg
+    (Region()) according to cost model (see read_cost_model). Gaps
+    cost default_cost per bp.
+
+    >>> model = {'c': [(0, 10, 5.0), (20, 30, 1.0)]}
+    >>> region_cost_profile(Region('c', 5, 25), model, 0.0)
+    [(5, 10, 2.5), (10, 20, 0.0), (20, 25, 0.5)]
+    """
+
+    pieces = []
+    wins = model.get(reg.chrom, [])
+    # first window that could overlap (windows don't overlap)
+    i = max(0, bisect.bisect_right(wins, (reg.start, )) - 1)
+    pos = reg.start
+    for (start, end, cost) in wins[i:]:
+        if start >= reg.end:
+            break
+        if end <= pos:
+            continue
+        if start > pos:
+            pieces.append((pos, start, (start-pos)*default_cost))
+            pos = start
+        piece_end = min(end, reg.end)
+        pieces.append((pos, piece_end, cost*(piece_end-pos)/float(end-start)))
+        pos = piece_end
+    if pos < reg.end:
+        pieces.append((pos, reg.end, (reg.end-pos)*default_cost))
+    return pieces
+
+
+def region_cost(reg, model, default_cost):
+    """Returns the cost of region reg according to cost model
+
+    >>> model = {'c': [(0, 10, 5.0), (20, 30, 1.0)]}
+    >>> region_cost(Region('c', 0, 100), model, 0.01)
+    6.8
+    """
+    return sum([p[2] for p in region_cost_profile(reg, model, default_cost)])
+
+
+def split_region_by_cost(reg, model, default_cost):
+    """split region in two halves of (about) equal cost according to
+    cost model. Falls back to split_region() if that's not possible
+
+    >>> model = {'c': [(0, 10, 9.0), (10, 20, 1.0)]}
+    >>> split_region_by_cost(Region('c', 0, 20), model, 0.0)
+    [Region(chrom='c', start=0, end=6), Region(chrom='c', start=6, end=20)]
+    """
+
+    pieces = region_cost_profile(reg, model, default_cost)
+    half = sum([p[2] for p in pieces])/2.0
+    cum = 0.0
+    mid = None
+    for (start, end, cost) in pieces:
+        if cost > 0 and cum + cost >= half:
+            mid = start + int(round((end-start) * (half-cum)/cost))
+            break
+        cum += cost
+    if mid is None or mid <= reg.start or mid >= reg.end:
+        return split_region(reg)
+    return [Region(reg.chrom, reg.start, mid), Region(reg.chrom, mid, reg.end)]
+
+
+def merge_cost_profiles(cost_profiles, cost_profile_out):
+    """Concatenates cost profiles of all bins, which have to be given
+    in genomic order. Windows split between neighbouring bins are
+    merged
+    """
+
+    header = []
+    wins = []
+    for f in cost_profiles:
+        with open(f, 'r') as fh:
+            for line in fh:
+                if line.startswith('#'):
+                    if f == cost_profiles[0]:
+                        header.append(line)
+                    continue
+                fields = line.rstrip().split('\t')
+                (chrom, start, end) = (fields[0], int(fields[1]), int(fields[2]))
+                (seconds, num_cols, depth, work) = (float(fields[3]), int(fields[4]),
+                                                    int(fields[5]), int(fields[6]))
+                if wins and wins[-1][0:3] == [chrom, start, end]:
+                    prev = wins[-1]
+                    wins[-1] = prev[0:3] + [prev[3]+seconds, prev[4]+num_cols,
+                                            prev[5]+depth, prev[6]+work]
+                else:
+                    wins.append([chrom, start, end, seconds, num_cols, depth, work])
+    with open(cost_profile_out, 'w') as fh:
+        fh.write(''.join(header))
+        for w in wins:
+            fh.write("%s\t%d\t%d\t%.6f\t%d\t%d\t%d\n" % tuple(w))
+
+
 def read_bed_coords(fbed):
     """Fault-resistant reading of coordinates from bed file. Yields
     regions as chrom, start, end tuple with zero-based half-open
@@ -299,34 +434,47 @@ def bins_from_bamheader(bam):
     return [(x[0], 0, x[1]) for x in sq_list]
 
 
-def lofreq_cmd_per_bin(lofreq_call_args, bins, tmp_dir, use_fpga=False):
+def metrics_file_for(metrics_file, name):
+    """Inserts name into metrics file name, keeping the .json
+    extension which determines the format
+    """
+    (base, ext) = os.path.splitext(metrics_file)
+    if ext == '.json':
+        return "%s.%s%s" % (base, name, ext)
+    return "%s.%s" % (metrics_file, name)
+
+
+def lofreq_cmd_per_bin(lofreq_call_args, bins, tmp_dir, pbin_owner=None,
+                       metrics_file=None, bin_cost=region_length,
+                       cost_profile=False):
     """Returns argument for one lofreq call per bins (Regions()).
-    Order is by length byt file naming is according to input order
+    Order is by cost (bin_cost, length by default) but file naming
+    is according to input order. If pbin_owner is given, all calls
+    will let this pbin-owner process compute their p-values. If
+    metrics_file is given, each call writes its metrics to its own
+    file derived from it. If cost_profile is set, each call writes
+    its cost profile to %d.cost in tmp_dir.
     """
 
-    # longest bins first, but keep input order as index so that we can
-    # use this as file name and only need to concatenate later and
-    # output will be sorted by input order
+    # most expensive bins first, but keep input order as index so that
+    # we can use this as file name and only need to concatenate later
+    # and output will be sorted by input order
 
     enum_bins = sorted(enumerate(bins),
-                       key=lambda eb: region_length(eb[1]), reverse=True)
+                       key=lambda eb: bin_cost(eb[1]), reverse=True)
 
     for (i, b) in enum_bins:
         LOG.debug("length sorted bin keeping input index #%d: %s" % (i, b))
         # maintain region order by using index
         reg_str = "%s:%d-%d" % (b.chrom, b.start+1, b.end)
 
-        if use_fpga:
-            # using the FPGA version, passing the bin number to lofreq call
-            arg_pos=2   # inserting bin number arguments right after 'lofreq', 'call'
-            lofreq_call_args_local = lofreq_call_args[:-1]
-            lofreq_call_args_local.insert(arg_pos, "-p")
-            lofreq_call_args_local.insert(arg_pos+1, str(i))
-            cmd = ' '.join(lofreq_call_args_local)
-        else:
-            # using the original CPU version
-            cmd = ' '.join(lofreq_call_args)
-
+        cmd = ' '.join(lofreq_call_args)
+        if pbin_owner:
+            cmd += ' --pbin-owner %s' % pbin_owner
+        if metrics_file:
+            cmd += ' --metrics-file %s' % metrics_file_for(metrics_file, str(i))
+        if cost_profile:
+            cmd += ' --cost-profile %s/%d.cost' % (tmp_dir, i)
         cmd += ' --no-default-filter'# needed here whether user-arg or not
         cmd += ' -r "%s" -o %s/%d.vcf.gz > %s/%d.log 2>&1' % (
             reg_str, tmp_dir, i, tmp_dir, i)
@@ -334,6 +482,26 @@ def lofreq_cmd_per_bin(lofreq_call_args, bins, tmp_dir, use_fpga=False):
         yield cmd
 
 
+def lofreq_cmd_priority(lofreq_call_args, priority_args, tmp_dir,
+                        pbin_owner=None, bed_file=None):
+    """Returns the lofreq call for the priority regions only
+    (--priority-bed etc. in priority_args). Its output is final and
+    not merged with the bins.
+
+    >>> lofreq_cmd_priority(['lofreq', 'call', 'x.bam'],
+    ...                     ['--priority-bed', 'p.bed', '--priority-out', 'p.vcf'], '/tmp')
+    'lofreq call x.bam --priority-bed p.bed --priority-out p.vcf --priority-only > /tmp/priority.log 2>&1'
+    """
+
+    cmd = ' '.join(lofreq_call_args + priority_args)
+    if bed_file and '-l' not in lofreq_call_args:
+        cmd += ' -l %s' % bed_file
+    if pbin_owner:
+        cmd += ' --pbin-owner %s' % pbin_owner
+    cmd += ' --priority-only > %s/priority.log 2>&1' % (tmp_dir)
+    return cmd
+
+
 def work(cmd):
     """Command caller wrapper for multiprocessing"""
 
@@ -367,12 +535,22 @@ def main():
     if '-h' in orig_argv:
         sys.stderr.write(__doc__ + "\n")
         sys.stderr.write("All arguments except --pp-threads (mandatory),"
-                         " --pp-debug, --pp-verbose\nand --pp-dryrun will"
+                         " --pp-debug, --pp-verbose,\n--pp-dryrun and --pp-pbin-owner will"
                          " be passed down to 'lofreq call'. Make sure that"
                          " the\nremaining args are valid 'lofreq call'"
                          " args as no syntax check will be\nperformed.\n")
         sys.stderr.write("Note that the output is always compressed vcf and"
                          " stdout is not supported\n")
+        sys.stderr.write("--pp-pbin-owner lets one process compute the p-values"
+                         " of all threads\n(always on with the FPGA version)\n")
+        sys.stderr.write("--pp-threads is the number of 'lofreq call' processes run"
+                         " in parallel. The\npbin owner (if any) runs in addition"
+                         " to these\n")
+        sys.stderr.write("--pp-cost-model FILE[,FILE...] balances shards by the cost"
+                         " profiles (call --cost-profile)\nof earlier runs of the same"
+                         " assay instead of region length\n")
+        sys.stderr.write("--priority-bed/--priority-out/--priority-bonf are handled by"
+                         " one extra call,\nwhich runs before all others\n")
         sys.exit(1)
 
     verbose = True
@@ -403,6 +581,32 @@ def main():
     except (IndexError, ValueError):
         pass
 
+    # p-values computed by one pbin-owner process (on CPU). The FPGA
+    # version (--fpga) always uses it
+    use_pbin_owner = False
+    try:
+        idx = orig_argv.index('--pp-pbin-owner')
+        orig_argv = orig_argv[0:idx] +  orig_argv[idx+1:]
+        use_pbin_owner = True
+    except (IndexError, ValueError):
+        pass
+
+    # cost profiles of earlier runs used for planning shards
+    cost_model_files = []
+    try:
+        idx = orig_argv.index('--pp-cost-model')
+        cost_model_files = orig_argv[idx+1].split(',')
+        orig_argv = orig_argv[0:idx] +  orig_argv[idx+2:]
+    except ValueError:
+        pass
+    except IndexError:
+        LOG.fatal("--pp-cost-model needs a file argument")
+        sys.exit(1)
+    for f in cost_model_files:
+        if not os.path.exists(f):
+            LOG.fatal("Cost profile %s does not exist" % f)
+            sys.exit(1)
+
     # number of threads
     #
     num_threads = -1
@@ -449,7 +653,8 @@ def main():
     # FIXME (re-) use of region could easily be merged into main logic
     # by turning it into a region and intersecting with the rest
     #
-    for disallowed_arg in ['--plp-summary-only', '-r', '--region']:
+    for disallowed_arg in ['--plp-summary-only', '-r', '--region', '--param-set',
+                           '--consensus-out', '--priority-only', '--evidence-bam']:
         if disallowed_arg in lofreq_call_args:
             LOG.fatal("%s not allowed in pparallel mode" % disallowed_arg)
             sys.exit(1)
@@ -479,6 +684,42 @@ def main():
                   " stdout is not supported.")
         sys.exit(1)
 
+    # metrics-file: one per call (numbered as the bins) plus one for
+    # the pbin-owner
+    #
+    metrics_file = None
+    if '--metrics-file' in lofreq_call_args:
+        idx = lofreq_call_args.index('--metrics-file')
+        metrics_file = lofreq_call_args[idx+1]
+        lofreq_call_args = lofreq_call_args[0:idx] +  lofreq_call_args[idx+2:]
+
+    # cost-profile: one per call, merged at the end
+    #
+    cost_profile_out = None
+    if '--cost-profile' in lofreq_call_args:
+        idx = lofreq_call_args.index('--cost-profile')
+        cost_profile_out = lofreq_call_args[idx+1]
+        lofreq_call_args = lofreq_call_args[0:idx] +  lofreq_call_args[idx+2:]
+
+
+    # priority regions: called by an extra call scheduled first
+    #
+    priority_args = []
+    for arg in ['--priority-bed', '--priority-out', '--priority-bonf']:
+        if arg in lofreq_call_args:
+            idx = lofreq_call_args.index(arg)
+            priority_args.extend(lofreq_call_args[idx:idx+2])
+            lofreq_call_args = lofreq_call_args[0:idx] +  lofreq_call_args[idx+2:]
+    priority_out = None
+    if priority_args:
+        if '--priority-bed' not in priority_args or '--priority-out' not in priority_args:
+            LOG.fatal("--priority-bed and --priority-out have to be used together")
+            sys.exit(1)
+        priority_out = priority_args[priority_args.index('--priority-out')+1]
+        if os.path.exists(priority_out):
+            LOG.fatal("Cowardly refusing to overwrite already existing"
+                      " VCF output file %s" % priority_out)
+            sys.exit(1)
 
     # bed-file
     #
@@ -529,11 +770,13 @@ def main():
     if '--no-default-filter' in lofreq_call_args:
         no_default_filter = True
 
-    # determine whether the FPGA or CPU version is used
-    # 
+    # determine whether the FPGA or CPU version is used. the device
+    # is only ever used by the pbin-owner process, not by lofreq call
+    #
     use_fpga = False
     if '--fpga' in lofreq_call_args:
         use_fpga = True
+        lofreq_call_args.remove('--fpga')
 
     # prepend actual lofreq command
     #
@@ -603,29 +846,42 @@ def main():
         LOG.debug("initial bins: #%d %s %d %d len %d" % (
             i, b.chrom, b.start, b.end, region_length(b)))
 
+    # cost of a bin is its length, unless we have a cost model from
+    # earlier runs
+    #
+    bin_cost = region_length
+    split_func = split_region
+    if cost_model_files:
+        cost_model = read_cost_model(cost_model_files)
+        default_cost = cost_model_default(cost_model)
+        LOG.info("Using cost model from %s (%d windows)" % (
+            ', '.join(cost_model_files), sum([len(w) for w in cost_model.values()])))
+        bin_cost = lambda b: region_cost(b, cost_model, default_cost)
+        split_func = lambda b: split_region_by_cost(b, cost_model, default_cost)
+
     # split greedily into bins such that nregions ~ 2*threads:
     # keep more bins than threads to make up for differences in regions
     # even after split
     #
-    total_length = sum([region_length(b) for b in bins])
+    total_cost = sum([bin_cost(b) for b in bins])
     while True:
         #  inefficient but doesn't matter in practice: should split
         #  max and insert new elements
         # intelligently to avoid sorting whole list.
-        bins = sorted(bins, key=lambda b: region_length(b))
+        bins = sorted(bins, key=lambda b: bin_cost(b))
         biggest = bins[-1]
-        biggest_length = region_length(biggest)
+        biggest_cost = bin_cost(biggest)
 
-        LOG.debug("biggest_length=%d total_length/(%d*num_threads)=%f",
-                  biggest_length, BIN_PER_THREAD, total_length/(BIN_PER_THREAD*num_threads))
-        if biggest_length < total_length/(BIN_PER_THREAD*num_threads):
+        LOG.debug("biggest_cost=%f total_cost/(%d*num_threads)=%f",
+                  biggest_cost, BIN_PER_THREAD, total_cost/(BIN_PER_THREAD*num_threads))
+        if biggest_cost < total_cost/(BIN_PER_THREAD*num_threads):
             break
-        elif biggest_length < 100:
+        elif region_length(biggest) < 100:
             LOG.warning("Regions getting too small to be efficiently processed")
             break
 
         biggest = bins.pop()
-        (b1, b2) = split_region(biggest)
+        (b1, b2) = split_func(biggest)
         bins.extend([b1, b2])
 
     for (i, b) in enumerate(bins):
@@ -653,7 +909,17 @@ def main():
             i, b.chrom, b.start, b.end, region_length(b)))
 
     #bins = [Region('chr22', 0, 50000000)]# TMPDEBUG
-    cmd_list = list(lofreq_cmd_per_bin(lofreq_call_args, bins, tmp_dir, use_fpga))
+    pbin_owner = None
+    if use_fpga or use_pbin_owner:
+        pbin_owner = "/lofreq-pbin-%d" % os.getpid()
+    cmd_list = list(lofreq_cmd_per_bin(lofreq_call_args, bins, tmp_dir, pbin_owner,
+                                       metrics_file, bin_cost,
+                                       cost_profile_out is not None))
+    priority_cmd = None
+    if priority_args:
+        priority_cmd = lofreq_cmd_priority(lofreq_call_args, priority_args, tmp_dir,
+                                           pbin_owner, bed_file)
+        LOG.debug("priority_cmd = %s" % priority_cmd)
     #FIXME assert len(cmd_list) > 1, (
     #    "Oops...did get %d instead of multiple commands to run on BAM: %s" % (len(cmd_list), bam))
     LOG.info("Adding %d commands to mp-pool" % len(cmd_list))
@@ -661,6 +927,8 @@ def main():
     #import pdb; pdb.set_trace()
     LOG.debug("cmd_list = %s" % cmd_list)
     if dryrun:
+        if priority_cmd:
+            print("%s" % priority_cmd)
         for cmd in cmd_list:
             print("%s" % cmd)
         LOG.critical("dryrun ending here")
@@ -671,12 +939,47 @@ def main():
     #        LOG.warn("multiprocessing.Pool call result: %s" % x)
     #        pool.terminate()
 
+    # single process owning the accelerator (or emulating it on the
+    # CPU), serving all calls below
+    owner_proc = None
+    if pbin_owner:
+        owner_cmd = ['lofreq', 'pbin-owner', '--name', pbin_owner,
+                     '--slots', str(num_threads)]
+        if not use_fpga:
+            owner_cmd.append('--cpu')
+        if metrics_file:
+            owner_cmd.extend(['--metrics-file',
+                              metrics_file_for(metrics_file, 'pbin-owner')])
+        if debug:
+            owner_cmd.append('--verbose')
+        LOG.info("Starting %s" % ' '.join(owner_cmd))
+        owner_log = open(os.path.join(tmp_dir, "pbin-owner.log"), 'w')
+        owner_proc = subprocess.Popen(owner_cmd, stderr=owner_log)
+
     pool = multiprocessing.Pool(processes=num_threads)
+    priority_result = None
+    if priority_cmd:
+        # queued first, so that it's picked up first. its output is
+        # final as soon as it's done
+        def priority_done(res):
+            if not res:
+                LOG.info("Priority calls written to %s" % priority_out)
+        priority_result = pool.apply_async(work, (priority_cmd,),
+                                           callback=priority_done)
     results = pool.map(work, cmd_list, chunksize=1)
+    if priority_result:
+        results.append(priority_result.get())
     #results = pool.map_async(work, cmd_list, chunksize=1, callback=mycallback)
     pool.close()# not adding any more
     pool.join()# wait until all done
 
+    if owner_proc:
+        owner_proc.terminate()
+        if owner_proc.wait():
+            LOG.warning("pbin-owner exited with status %d (see %s)" % (
+                owner_proc.returncode, owner_log.name))
+        owner_log.close()
+
     if any(results):
         # rerrors printed in work()
         LOG.fatal("Some commands in pool failed. Can't continue")
@@ -694,6 +997,10 @@ def main():
     concat_vcf_files(vcf_files, vcf_concat,
                      "##source=%s" % ' '.join(sys.argv))
 
+    if cost_profile_out:
+        merge_cost_profiles([os.path.join(tmp_dir, "%d.cost" % no)
+                             for no in range(len(cmd_list))], cost_profile_out)
+
     # filtering
     #
     log_files = [os.path.join(tmp_dir, "%d.log" % no)
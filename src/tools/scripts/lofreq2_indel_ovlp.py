@@ -1,5 +1,8 @@
 #!/usr/bin/env python
 """Removes overlapping indels
+
+Same as `lofreq filter --rm-ovlp-indels`, which does this in a single
+streaming pass together with all other filters.
 """
 
 __author__ = "Andreas Wilm"
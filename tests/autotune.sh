@@ -0,0 +1,57 @@
+#!/bin/bash
+
+# call --autotune has to give the same calls as the default (pruned)
+# engine and cache its benchmark results
+
+source lib.sh || exit 1
+
+
+BAM=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+
+cmd="$LOFREQ call -f $REF -o $outdir/default.vcf $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+for run in 1 2; do
+    # first run benchmarks, second one reads the cache
+    cmd="$LOFREQ call -f $REF -o $outdir/autotune$run.vcf --autotune-cache $outdir/autotune.txt $BAM"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+    if [ ! -s $outdir/autotune.txt ]; then
+        echoerror "Autotune cache missing after run $run. Check $outdir"
+        exit 1
+    fi
+    nda=$($LOFREQ vcfset -a complement -1 $outdir/default.vcf -2 $outdir/autotune$run.vcf --count-only)
+    nad=$($LOFREQ vcfset -a complement -2 $outdir/default.vcf -1 $outdir/autotune$run.vcf --count-only)
+    if [ $nda -ne 0 ] || [ $nad -ne 0 ] ; then
+        echoerror "Calls differ with autotuned engines (run $run). Check $outdir"
+        exit 1
+    fi
+done
+echook "Autotuned engines give same calls."
+
+ncached=$(grep -vc '^#' $outdir/autotune.txt)
+if [ $ncached -ne 150 ]; then
+    echoerror "Expected 150 buckets in autotune cache but got $ncached. Check $outdir"
+    exit 1
+fi
+echook "Autotune cache lists all buckets."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
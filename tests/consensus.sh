@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# call --consensus-out: one record per target covering all of it.
+# ambiguity codes only change bases, not the length
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+cmd="$LOFREQ call -f $reffa -o $outdir/out.vcf --consensus-out $outdir/cons.fa $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+cmd="$LOFREQ call -f $reffa -o $outdir/out_ambig.vcf --consensus-out $outdir/cons_ambig.fa --consensus-threshold 0.99 $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+ndiff=$(diff <(grep -v '^#' $outdir/out.vcf) <(grep -v '^#' $outdir/out_ambig.vcf) | wc -l)
+if [ "$ndiff" -ne 0 ]; then
+    echoerror "Calls differ when writing consensus. Check $outdir"
+    exit 1
+fi
+
+refname=$(head -n 1 $reffa | cut -c 2- | cut -d ' ' -f 1)
+if [ "$(grep '^>' $outdir/cons.fa)" != ">$refname" ]; then
+    echoerror "Expected exactly one consensus record named $refname. Check $outdir"
+    exit 1
+fi
+reflen=$(grep -v '^>' $reffa | tr -d '\n' | wc -c)
+conslen=$(grep -v '^>' $outdir/cons.fa | tr -d '\n' | wc -c)
+if [ $(( (conslen-reflen)*100 / reflen )) -ne 0 ]; then
+    echoerror "Consensus length $conslen too different from reference length $reflen. Check $outdir"
+    exit 1
+fi
+echook "Consensus covers reference."
+
+ambiglen=$(grep -v '^>' $outdir/cons_ambig.fa | tr -d '\n' | wc -c)
+if [ "$ambiglen" -ne "$conslen" ]; then
+    echoerror "Consensus with ambiguity codes has different length ($ambiglen vs $conslen). Check $outdir"
+    exit 1
+fi
+if grep -v '^>' $outdir/cons.fa | grep -q '[^ACGTN]'; then
+    echoerror "Majority consensus contains ambiguity codes. Check $outdir"
+    exit 1
+fi
+echook "Ambiguity codes only change bases."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# call --cost-profile has to account for all columns, call-parallel
+# has to merge the profiles of its calls and give the same calls when
+# shards are planned with a cost model
+
+source lib.sh || exit 1
+
+
+BAM=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+LOFREQ_PARALLEL="$(dirname $LOFREQ)/../scripts/lofreq2_call_pparallel.py"
+
+
+cmd="$LOFREQ call -f $REF -o $outdir/single.vcf.gz --cost-profile $outdir/single.cost $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+cmd="$LOFREQ call -f $REF --plp-summary-only $BAM"
+ncols=$(eval $cmd 2>> $log | grep -vc '^#')
+ncols_prof=$(grep -v '^#' $outdir/single.cost | awk '{s+=$5} END {print s}')
+if [ "$ncols" != "$ncols_prof" ]; then
+    echoerror "Cost profile lists $ncols_prof instead of $ncols columns. Check $outdir"
+    exit 1
+fi
+echook "Cost profile accounts for all columns."
+
+cmd="$LOFREQ_PARALLEL --pp-threads $threads -f $REF -o $outdir/parallel.vcf.gz --cost-profile $outdir/parallel.cost $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+ncols_prof=$(grep -v '^#' $outdir/parallel.cost | awk '{s+=$5} END {print s}')
+if [ "$ncols" != "$ncols_prof" ]; then
+    echoerror "Merged cost profile of call-parallel lists $ncols_prof instead of $ncols columns. Check $outdir"
+    exit 1
+fi
+ndup=$(grep -v '^#' $outdir/parallel.cost | cut -f 1-3 | uniq -d | wc -l)
+if [ "$ndup" -ne 0 ]; then
+    echoerror "Merged cost profile of call-parallel has duplicate windows. Check $outdir"
+    exit 1
+fi
+echook "call-parallel merges cost profiles."
+
+cmd="$LOFREQ_PARALLEL --pp-threads $threads --pp-cost-model $outdir/single.cost,$outdir/parallel.cost -f $REF -o $outdir/planned.vcf.gz $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+nup=$($LOFREQ vcfset -a complement -1 $outdir/parallel.vcf.gz -2 $outdir/planned.vcf.gz --count-only)
+nus=$($LOFREQ vcfset -a complement -2 $outdir/parallel.vcf.gz -1 $outdir/planned.vcf.gz --count-only)
+# occasional differences possible due to BAQ effects on region ends (see parallel.sh)
+if [ $nup -gt 1 ] || [ $nus -gt 1 ] ; then
+    echoerror "Calls differ when planning with cost model. Check $outdir"
+    exit 1
+fi
+echook "Planning with cost model gives same calls."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,82 @@
+#!/bin/bash
+
+# early accept must not change default (dynamic bonferroni) output at
+# all, since it's not used then. with a fixed bonferroni factor it
+# may only turn QUALs into bounds, but never change the calls
+
+source lib.sh || exit 1
+
+
+BAM=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+
+for ea in on off; do
+    opt=""
+    if [ $ea == "off" ]; then
+        opt="--no-early-accept"
+    fi
+    cmd="$LOFREQ call --call-indels -f $REF -o $outdir/dyn_$ea.vcf $opt $BAM"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+    cmd="$LOFREQ call --call-indels -f $REF -b 1000000 -o $outdir/fixed_$ea.vcf $opt $BAM"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+done
+
+if ! diff -q <(grep -v '^#' $outdir/dyn_on.vcf) <(grep -v '^#' $outdir/dyn_off.vcf) >> $log; then
+    echoerror "Default output differs with --no-early-accept. Check $outdir"
+    exit 1
+fi
+if grep -v '^#' $outdir/dyn_on.vcf | grep -q QUALBOUND; then
+    echoerror "QUAL bounds reported with dynamic Bonferroni factor. Check $outdir"
+    exit 1
+fi
+echook "Default output identical with and without early accept."
+
+n12=$($LOFREQ vcfset -a complement -1 $outdir/fixed_on.vcf -2 $outdir/fixed_off.vcf --count-only)
+n21=$($LOFREQ vcfset -a complement -2 $outdir/fixed_on.vcf -1 $outdir/fixed_off.vcf --count-only)
+if [ $n12 -ne 0 ] || [ $n21 -ne 0 ] ; then
+    echoerror "Early accept changed calls made with fixed Bonferroni factor. Check $outdir"
+    exit 1
+fi
+if grep -v '^#' $outdir/fixed_off.vcf | grep -q QUALBOUND; then
+    echoerror "QUAL bounds reported with --no-early-accept. Check $outdir"
+    exit 1
+fi
+echook "Early accept doesn't change calls made with fixed Bonferroni factor."
+
+# early accept has to actually fire with a fixed factor and bounds
+# have to be conservative, i.e. never above the exact QUAL
+nbound=$(grep -v '^#' $outdir/fixed_on.vcf | grep -c QUALBOUND)
+if [ $nbound -eq 0 ]; then
+    echoerror "No QUAL bounds reported with fixed Bonferroni factor. Check $outdir"
+    exit 1
+fi
+nbad=$(awk -F'\t' '/^#/ {next}
+    FNR==NR {exact[$1":"$2":"$4":"$5]=$6; next}
+    $8 ~ /(^|;)QUALBOUND(;|$)/ {k=$1":"$2":"$4":"$5;
+        if (! (k in exact) || $6 == "." || exact[k] == "." || $6+0 > exact[k]+0) {print k}}' \
+    $outdir/fixed_off.vcf $outdir/fixed_on.vcf | tee -a $log | wc -l)
+if [ $nbad -ne 0 ]; then
+    echoerror "$nbad of $nbound QUAL bounds missing in or above exact QUAL of --no-early-accept output. Check $outdir"
+    exit 1
+fi
+echook "All $nbound QUAL bounds at most the exact QUAL."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
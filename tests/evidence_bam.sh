@@ -0,0 +1,84 @@
+#!/bin/bash
+
+# call --evidence-bam has to leave calls untouched and write a sorted,
+# indexed BAM with reads supporting each call. reference reads have
+# to add to it
+
+source lib.sh || exit 1
+
+
+BAM=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+
+cmd="$LOFREQ call -f $REF --no-default-filter -o $outdir/plain.vcf $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+cmd="$LOFREQ call -f $REF --no-default-filter -o $outdir/evidence.vcf --evidence-bam $outdir/evidence.bam $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+n12=$($LOFREQ vcfset -a complement -1 $outdir/plain.vcf -2 $outdir/evidence.vcf --count-only)
+n21=$($LOFREQ vcfset -a complement -2 $outdir/plain.vcf -1 $outdir/evidence.vcf --count-only)
+if [ $n12 -ne 0 ] || [ $n21 -ne 0 ] ; then
+    echoerror "Calls changed with --evidence-bam. Check $outdir"
+    exit 1
+fi
+echook "Calls unchanged with --evidence-bam."
+
+if [ ! -s $outdir/evidence.bam.bai ]; then
+    echoerror "Evidence BAM wasn't indexed. Check $outdir"
+    exit 1
+fi
+nreads=$(samtools view -c $outdir/evidence.bam)
+if [ $nreads -lt 1 ]; then
+    echoerror "No reads in evidence BAM. Check $outdir"
+    exit 1
+fi
+nunsorted=$(samtools view $outdir/evidence.bam | \
+    awk '$3!=c {if ($3 in seen) {n++}; seen[$3]=1; c=$3; p=0} $4<p {n++} {p=$4} END {print n+0}')
+if [ $nunsorted -ne 0 ]; then
+    echoerror "Evidence BAM is not sorted. Check $outdir"
+    exit 1
+fi
+nmissing=0
+for reg in $(grep -v '^#' $outdir/evidence.vcf | head -n 20 | awk '{printf "%s:%d-%d\n", $1, $2, $2}'); do
+    n=$(samtools view -c $outdir/evidence.bam $reg)
+    if [ $n -lt 1 ]; then
+        nmissing=$((nmissing+1))
+    fi
+done
+if [ $nmissing -ne 0 ]; then
+    echoerror "$nmissing calls without reads in evidence BAM. Check $outdir"
+    exit 1
+fi
+echook "Evidence BAM is sorted, indexed and has reads for calls."
+
+cmd="$LOFREQ call -f $REF --no-default-filter -o $outdir/evidence_ref.vcf --evidence-bam $outdir/evidence_ref.bam --evidence-ref-reads 5 $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+nreads_ref=$(samtools view -c $outdir/evidence_ref.bam)
+if [ $nreads_ref -le $nreads ]; then
+    echoerror "No reference reads added with --evidence-ref-reads ($nreads_ref vs. $nreads). Check $outdir"
+    exit 1
+fi
+echook "Reference reads added with --evidence-ref-reads."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,37 @@
+#!/bin/bash
+
+# compares lofreq filter --rm-ovlp-indels against lofreq2_indel_ovlp.py
+
+source lib.sh || exit 1
+
+OVLP_PY=../src/tools/scripts/lofreq2_indel_ovlp.py
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+vcf_in=$outdir/in.vcf
+vcf_c=$outdir/c.vcf
+vcf_py=$outdir/py.vcf
+
+cat > $vcf_in <<VCF
+##fileformat=VCFv4.0
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO
+c1	10	.	A	AT	50	PASS	DP=100;AF=0.1;INDEL
+c1	11	.	CTT	C	50	PASS	DP=100;AF=0.3;INDEL
+c1	13	.	TA	T	60	PASS	DP=100;AF=0.1;INDEL
+c1	20	.	A	AG	30	PASS	DP=100;AF=0.1;INDEL
+c1	30	.	AGG	A	30	PASS	DP=100;AF=0.1;INDEL
+c2	1	.	A	AG	30	PASS	DP=100;AF=0.1;INDEL
+c2	2	.	AC	A	30	PASS	DP=100;AF=0.1;INDEL
+c2	5	.	A	AC	.	PASS	DP=100;AF=0.1;INDEL
+c2	5	.	AC	A	90	PASS	DP=100;AF=0.9;INDEL
+VCF
+
+$LOFREQ filter --no-defaults --rm-ovlp-indels -i $vcf_in | grep -v '^#' | cut -f 1-5 > $vcf_c || exit 1
+python $OVLP_PY $vcf_in | grep -v '^#' | cut -f 1-5 > $vcf_py || exit 1
+
+if ! diff -q $vcf_c $vcf_py >/dev/null; then
+    echoerror "lofreq filter --rm-ovlp-indels and $(basename $OVLP_PY) differ (see $outdir)"
+    exit 1
+else
+    echook "lofreq filter --rm-ovlp-indels and $(basename $OVLP_PY) agree"
+fi
+rm -rf $outdir
@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# call --state: calling a BAM in two parts incrementally has to give
+# the same calls as calling it in one go
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+# split reads (not pairs) into two sorted parts
+for i in 0 1; do
+    samtools view -h $bam | \
+        awk -v i=$i '/^@/ {print; next} {n++; if (n%2==i) {print}}' | \
+        samtools view -b - > $outdir/part$i.bam || exit 1
+    samtools index $outdir/part$i.bam || exit 1
+done
+
+for in_bam in $bam $outdir/part0.bam; do
+    cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/$(basename $in_bam .bam).vcf $in_bam"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+done
+
+for i in 0 1; do
+    cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/incr$i.vcf --state $outdir/state.lps $outdir/part$i.bam"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+done
+if [ -e $outdir/state.lps.tmp ]; then
+    echoerror "Temporary state file left behind"
+    exit 1
+fi
+
+ndiff=$(diff <(grep -v '^#' $outdir/part0.vcf) <(grep -v '^#' $outdir/incr0.vcf) | wc -l)
+if [ "$ndiff" -ne 0 ]; then
+    echoerror "Calls made with new state differ from calls without. Check $outdir"
+    exit 1
+fi
+ndiff=$(diff <(grep -v '^#' $outdir/denv2-pseudoclonal.vcf) <(grep -v '^#' $outdir/incr1.vcf) | wc -l)
+if [ "$ndiff" -ne 0 ]; then
+    echoerror "Incremental calls differ from calls made in one go. Check $outdir"
+    exit 1
+fi
+echook "Incremental calls identical to calls made in one go."
+
+# state has to be refused if parameters change
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/incr2.vcf --state $outdir/state.lps -q 30 $outdir/part0.bam"
+if eval $cmd >> $log 2>&1; then
+    echoerror "Update of state with different parameters should have failed: $cmd"
+    exit 1
+fi
+echook "State with different parameters refused."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,108 @@
+#!/bin/bash
+
+# call --max-indel-alleles: a limit that's never reached has to give
+# the same calls, a limit of one allele has to work, can't give more
+# indel calls and has to count every allele as a test
+
+source lib.sh || exit 1
+
+KEEP_TMP=0
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+BAM=data/icgc-tcga-dream-indel_chr19/chr19.tumor_didq_aq.bam
+BED=data/icgc-tcga-dream-indel_chr19/chr19.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+
+for k in 0 1000 1; do
+    vcf=$outdir/k$k.vcf
+    cmd="$LOFREQ call --call-indels --only-indels --no-default-filter --verbose -f $REF -l $BED -o $vcf --max-indel-alleles $k $BAM"
+    if ! eval $cmd > $outdir/k$k.log 2>&1; then
+        echoerror "The following command failed (see $outdir/k$k.log for more): $cmd"
+        exit 1
+    fi
+done
+
+ndiff=$(diff <(grep -v '^#' $outdir/k0.vcf) <(grep -v '^#' $outdir/k1000.vcf) | wc -l)
+if [ "$ndiff" -ne 0 ]; then
+    echoerror "Calls with unreached allele limit differ from unlimited calls. Check $outdir"
+    exit 1
+fi
+echook "Calls with unreached allele limit identical to unlimited calls."
+
+ntests0=$(grep 'Number of indel tests performed' $outdir/k0.log | awk '{print $NF}')
+ntests1=$(grep 'Number of indel tests performed' $outdir/k1.log | awk '{print $NF}')
+if [ -z "$ntests0" ] || [ -z "$ntests1" ] || [ "$ntests1" -lt "$ntests0" ]; then
+    echoerror "Number of indel tests decreased with allele limit ($ntests0 vs $ntests1). Check $outdir"
+    exit 1
+fi
+ncalls0=$(grep -vc '^#' $outdir/k0.vcf)
+ncalls1=$(grep -vc '^#' $outdir/k1.vcf)
+if [ "$ncalls1" -gt "$ncalls0" ]; then
+    echoerror "Got more indel calls with allele limit ($ncalls1 vs $ncalls0). Check $outdir"
+    exit 1
+fi
+echook "Allele limit of one doesn't lower number of tests and doesn't add calls."
+
+
+# constructed column: a frequent insertion whose reads come first,
+# followed by many singleton insertions. with an allele limit of one
+# the frequent allele has to survive with its exact count (AF).
+# DP4 differs, since singleton reads become non-events
+awk 'BEGIN {srand(1); printf ">chrT\n"; for (i=0; i<300; i++) {printf "%s", substr("ACGT", int(rand()*4)+1, 1)}; printf "\n"}' > $outdir/topk.fa
+samtools faidx $outdir/topk.fa || exit 1
+refseq=$(tail -n 1 $outdir/topk.fa)
+left=${refseq:50:50}
+right=${refseq:100:48}
+qual=$(printf 'I%.0s' $(seq 102))
+(
+    printf "@HD\tVN:1.4\tSO:coordinate\n@SQ\tSN:chrT\tLN:300\n"
+    for i in $(seq 30); do
+        printf "dom$i\t0\tchrT\t51\t60\t50M4I48M\t*\t0\t0\t${left}TTTT${right}\t$qual\n"
+    done
+    for i in $(seq 0 29); do
+        ins=$(echo $i | awk '{s=""; for (j=0; j<4; j++) {s=s substr("ACG", $1%3+1, 1); $1=int($1/3)}; print s}')
+        printf "single$i\t0\tchrT\t51\t60\t50M4I48M\t*\t0\t0\t${left}${ins}${right}\t$qual\n"
+    done
+    for i in $(seq 30); do
+        printf "ref$i\t0\tchrT\t51\t60\t98M\t*\t0\t0\t${left}${right}\t$(printf 'I%.0s' $(seq 98))\n"
+    done
+) | samtools view -b - > $outdir/topk_raw.bam || exit 1
+cmd="$LOFREQ indelqual -u 45 -o $outdir/topk.bam $outdir/topk_raw.bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+samtools index $outdir/topk.bam || exit 1
+for k in 0 1; do
+    cmd="$LOFREQ call --call-indels --only-indels --no-default-filter -B -A -f $outdir/topk.fa -o $outdir/topk_k$k.vcf --max-indel-alleles $k $outdir/topk.bam"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+done
+dom0=$(grep -v '^#' $outdir/topk_k0.vcf | awk '$5 ~ /TTTT$/ {match($8, /AF=[^;]*/); print $1, $2, $4, $5, substr($8, RSTART, RLENGTH)}')
+dom1=$(grep -v '^#' $outdir/topk_k1.vcf | awk '$5 ~ /TTTT$/ {match($8, /AF=[^;]*/); print $1, $2, $4, $5, substr($8, RSTART, RLENGTH)}')
+if [ -z "$dom0" ]; then
+    echoerror "Frequent insertion not called without allele limit. Check $outdir"
+    exit 1
+fi
+if [ "$dom0" != "$dom1" ]; then
+    echoerror "Frequent insertion lost or changed with allele limit of one (\"$dom0\" vs \"$dom1\"). Check $outdir"
+    exit 1
+fi
+nother=$(grep -v '^#' $outdir/topk_k1.vcf | awk '$5 !~ /TTTT$/' | wc -l)
+if [ $nother -ne 0 ]; then
+    echoerror "Singleton insertions reported with allele limit of one. Check $outdir"
+    exit 1
+fi
+echook "Frequent insertion survives allele limit of one after many singletons."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
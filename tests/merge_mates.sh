@@ -0,0 +1,121 @@
+#!/bin/bash
+
+# Merging overlapping mates must never increase the number of bases
+# counted (DP4), but lower it where mates overlap. Merged qualities
+# are checked on a constructed pair
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+for opt in "" "--merge-mates"; do
+    out=$outdir/out${opt}.vcf
+    cmd="$LOFREQ call -f $reffa -l $bed -o $out --no-default-filter $opt $bam"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+done
+
+# per position DP4 sum of both runs
+dp() {
+    grep -v '^#' $1 | sed -e 's,.*DP4=\([0-9,]*\).*,\1,' | awk -F, '{print $1+$2+$3+$4}' | paste <(grep -v '^#' $1 | cut -f 2) - | sort -u -k1,1
+}
+join <(dp $outdir/out.vcf) <(dp $outdir/out--merge-mates.vcf) > $outdir/dp.txt
+n=$(awk '$3>$2' $outdir/dp.txt | wc -l)
+if [ $n -ne 0 ]; then
+    echoerror "Base counts increased at $n positions after merging mates. Check $outdir"
+    exit 1
+fi
+echook "Merging mates never increased base counts."
+if [ $(samtools view -c -f 1 $bam) -gt 0 ]; then
+    n=$(awk '$3<$2' $outdir/dp.txt | wc -l)
+    if [ $n -eq 0 ]; then
+        echoerror "Merging mates didn't lower base counts anywhere. Check $outdir"
+        exit 1
+    fi
+    echook "Merging mates lowered base counts at $n positions."
+fi
+
+
+# constructed pairs overlapping at 81-100: one with both mates
+# agreeing everywhere, one with the second mate disagreeing at 90.
+# all bases have BQ 20, except the disagreeing one with BQ 30. agreeing
+# bases are merged into one with BQ 40, for the disagreeing base the
+# higher quality one is kept with 80% of its quality (24)
+awk 'BEGIN {srand(1); printf ">chrM\n"; for (i=0; i<300; i++) {printf "%s", substr("ACGT", int(rand()*4)+1, 1)}; printf "\n"}' > $outdir/pair.fa
+samtools faidx $outdir/pair.fa || exit 1
+refseq=$(tail -n 1 $outdir/pair.fa)
+seq1=${refseq:50:50}
+seq2=${refseq:80:50}
+refbase=${seq2:9:1}
+altbase=$(echo ACGT | tr -d $refbase | cut -c 1)
+seq2alt=${seq2:0:9}${altbase}${seq2:10}
+qual=$(printf '5%.0s' $(seq 50))
+qual2alt=${qual:0:9}?${qual:10}
+(
+    printf "@HD\tVN:1.4\tSO:coordinate\n@SQ\tSN:chrM\tLN:300\n"
+    printf "agree\t99\tchrM\t51\t60\t50M\t=\t81\t80\t$seq1\t$qual\n"
+    printf "disagree\t99\tchrM\t51\t60\t50M\t=\t81\t80\t$seq1\t$qual\n"
+    printf "agree\t147\tchrM\t81\t60\t50M\t=\t51\t-80\t$seq2\t$qual\n"
+    printf "disagree\t147\tchrM\t81\t60\t50M\t=\t51\t-80\t$seq2alt\t$qual2alt\n"
+) | samtools view -b - > $outdir/pair.bam || exit 1
+samtools index $outdir/pair.bam || exit 1
+
+# prints "pos nt BQ" for all bases at the given positions
+plp_bqs() {
+    awk -v pos=" $2 " '/^[^ ]/ {cur=$2; next}
+        $2 == "BQ" && index(pos, " " cur " ") {for (i=4; i<=NF; i++) {print cur, $1, $i}}' $1 | \
+        sort -k1,1n -k2,2 -k3,3n
+}
+for opt in "" "--merge-mates"; do
+    cmd="$LOFREQ call --plp-summary-only -B -f $outdir/pair.fa $opt $outdir/pair.bam > $outdir/pair${opt}.txt"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+done
+r60=${refseq:59:1}
+r85=${refseq:84:1}
+expected="60 $r60 20
+60 $r60 20
+85 $r85 20
+85 $r85 20
+85 $r85 20
+85 $r85 20
+90 $altbase 30
+90 $refbase 20
+90 $refbase 20
+90 $refbase 20"
+if [ "$(plp_bqs $outdir/pair.txt '60 85 90')" != "$(echo "$expected" | sort -k1,1n -k2,2 -k3,3n)" ]; then
+    echoerror "Unexpected qualities without merging mates. Check $outdir"
+    exit 1
+fi
+expected="60 $r60 20
+60 $r60 20
+85 $r85 40
+85 $r85 40
+90 $altbase 24
+90 $refbase 40"
+if [ "$(plp_bqs $outdir/pair--merge-mates.txt '60 85 90')" != "$(echo "$expected" | sort -k1,1n -k2,2 -k3,3n)" ]; then
+    echoerror "Unexpected qualities after merging mates. Check $outdir"
+    exit 1
+fi
+echook "Merging mates gives expected qualities for agreeing and disagreeing bases."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
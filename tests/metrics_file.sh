@@ -0,0 +1,65 @@
+#!/bin/bash
+
+# call --metrics-file: final snapshot has to be complete and mark the
+# job as done, in JSON as well as Prometheus text format
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/out.vcf --metrics-file $outdir/metrics.json $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+if ! python -c "
+import json, sys
+m = json.load(open('$outdir/metrics.json'))
+assert m['done'] == 1
+assert m['columns'] > 0 and m['reads'] > 0 and m['position'] > 0
+assert m['calls'] >= $(grep -vc '^#' $outdir/out.vcf)
+assert m['chrom']
+" >> $log 2>&1; then
+    echoerror "Incomplete or wrong JSON metrics. Check $outdir"
+    exit 1
+fi
+echook "JSON metrics complete."
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/out2.vcf --metrics-file $outdir/metrics.prom $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+for m in columns reads calls position rss_bytes; do
+    if ! grep -q "^lofreq_call_${m}{chrom=\".*\"} [0-9]" $outdir/metrics.prom; then
+        echoerror "Metric $m missing in $outdir/metrics.prom"
+        exit 1
+    fi
+done
+if ! grep -q '^lofreq_call_done{.*} 1$' $outdir/metrics.prom; then
+    echoerror "Final snapshot in $outdir/metrics.prom not marked as done"
+    exit 1
+fi
+if [ -e $outdir/metrics.prom.tmp ]; then
+    echoerror "Temporary metrics file left behind"
+    exit 1
+fi
+echook "Prometheus metrics complete."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,46 @@
+#!/bin/bash
+
+# Make sure the parallel wrapper produces the same result whether
+# p-values are computed by one pbin-owner process or by each call
+
+source lib.sh || exit 1
+
+
+BAM=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+outraw_owner=$outdir/raw_owner.vcf.gz
+outraw_parallel=$outdir/raw_parallel.vcf.gz
+log=$outdir/log.txt
+
+LOFREQ_PARALLEL="$(dirname $LOFREQ)/../scripts/lofreq2_call_pparallel.py"
+
+cmd="$LOFREQ_PARALLEL --pp-threads $threads --pp-pbin-owner -f $REF -o $outraw_owner --verbose $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+cmd="$LOFREQ_PARALLEL --pp-threads $threads -f $REF -o $outraw_parallel --verbose $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+if ! diff -q <(zgrep -v '^#' $outraw_owner) <(zgrep -v '^#' $outraw_parallel) >/dev/null; then
+    echoerror "Results with and without pbin-owner differ. Check $outraw_owner and $outraw_parallel"
+    exit 1
+else
+    echook "Results with and without pbin-owner are identical."
+fi
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
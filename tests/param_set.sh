@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# Make sure calling with --param-set gives the same results as
+# separate runs with the corresponding options
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+paramset=$outdir/param-set.txt
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+opts_list=("--sig 0.001" "--no-baq --min-bq 5" "--no-mq -b 1000")
+
+rm -f $paramset
+i=0
+for opts in "${opts_list[@]}"; do
+    echo "$outdir/set$i.vcf $opts" >> $paramset
+    i=$((i+1))
+done
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/base.vcf --param-set $paramset $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/base_single.vcf $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+if ! diff -q <(grep -v '^#' $outdir/base.vcf) <(grep -v '^#' $outdir/base_single.vcf) >/dev/null; then
+    echoerror "Base results differ when using --param-set. Check $outdir"
+    exit 1
+fi
+
+i=0
+for opts in "${opts_list[@]}"; do
+    cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/set${i}_single.vcf $opts $bam"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+    if ! diff -q <(grep -v '^#' $outdir/set$i.vcf) <(grep -v '^#' $outdir/set${i}_single.vcf) >/dev/null; then
+        echoerror "Results for parameter set '$opts' differ from single run. Check $outdir"
+        exit 1
+    fi
+    i=$((i+1))
+done
+echook "--param-set results identical to single runs."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
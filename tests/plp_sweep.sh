@@ -0,0 +1,73 @@
+#!/bin/bash
+
+# pileup sweep has to give the same per-column summary as the
+# bam_mplp based pileup it replaced. The old version is either given
+# as LOFREQ_BASELINE (binary) or built from the last commit before
+# plp_sweep.c was added, configured like this tree.
+
+source lib.sh || exit 1
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+if [ -z "$LOFREQ_BASELINE" ]; then
+    first=$(git rev-list --reverse HEAD -- ../src/lofreq/plp_sweep.c 2>/dev/null | head -n 1)
+    if [ -z "$first" ] || [ ! -e ../config.status ]; then
+        echowarn "No baseline binary (LOFREQ_BASELINE) and can't build one from git. Skipping test"
+        rm -f $outdir/*; rmdir $outdir
+        exit 0
+    fi
+    echoinfo "Building baseline from commit ${first}^ in $outdir/baseline"
+    mkdir $outdir/baseline
+    git archive ${first}^ .. | tar -x -C $outdir/baseline || exit 1
+    config=$(cd .. && ./config.status --config)
+    if ! (cd $outdir/baseline && ./bootstrap && eval ./configure $config && make) >> $log 2>&1; then
+        echoerror "Building baseline failed. See $log"
+        exit 1
+    fi
+    LOFREQ_BASELINE=$outdir/baseline/src/lofreq/lofreq
+fi
+
+
+# deep coverage exercises window shrinking, icgc mixed coverage
+# and paired reads
+denv2_dir=data/denv2-pseudoclonal
+icgc_bam=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+icgc_ref=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+n=0
+for args in "-f $denv2_dir/denv2-pseudoclonal_cons.fa $denv2_dir/denv2-pseudoclonal.bam" \
+            "-f $denv2_dir/denv2-pseudoclonal_cons.fa -B -d 500 $denv2_dir/denv2-pseudoclonal.bam" \
+            "-f $icgc_ref -r 1 $icgc_bam"; do
+    n=$((n+1))
+    for v in new old; do
+        if [ $v == new ]; then
+            bin=$LOFREQ
+        else
+            bin=$LOFREQ_BASELINE
+        fi
+        cmd="$bin call --plp-summary-only $args > $outdir/$v.$n.txt"
+        if ! eval $cmd >> $log 2>&1; then
+            echoerror "The following command failed (see $log for more): $cmd"
+            exit 1
+        fi
+    done
+    if ! cmp -s $outdir/new.$n.txt $outdir/old.$n.txt; then
+        echoerror "Pileup summary differs from baseline for args $args. Check $outdir"
+        exit 1
+    fi
+    if [ ! -s $outdir/new.$n.txt ]; then
+        echoerror "Empty pileup summary for args $args. Check $outdir"
+        exit 1
+    fi
+done
+echook "Pileup summary same as baseline."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm -rf $outdir
+fi
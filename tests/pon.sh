@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# pon: calls of a sample have to be found in a panel built from the
+# same sample. with the sample used twice as normal they have to be
+# filtered, unless only annotating
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/calls.vcf $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+ncalls=$(grep -vc '^#' $outdir/calls.vcf)
+
+echo "$bam" > $outdir/bams.txt
+cmd="$LOFREQ pon build -f $reffa -l $bed -a 1 -o $outdir/pon.db -L $outdir/bams.txt $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+cmd="$LOFREQ pon filter -p $outdir/pon.db -i $outdir/calls.vcf -o $outdir/filtered.vcf"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+nfiltered=$(grep -v '^#' $outdir/filtered.vcf | awk '$7 ~ /pon/' | grep -c 'PON=2;')
+if [ "$nfiltered" -ne "$ncalls" ]; then
+    echoerror "Expected all $ncalls calls to be filtered by panel, but got $nfiltered. Check $outdir"
+    exit 1
+fi
+echook "All calls filtered by panel built from same sample."
+
+cmd="$LOFREQ pon filter -p $outdir/pon.db -i $outdir/calls.vcf -o $outdir/annotated.vcf --annotate-only"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+ndiff=$(diff <(grep -v '^#' $outdir/calls.vcf | cut -f 1-7) <(grep -v '^#' $outdir/annotated.vcf | cut -f 1-7) | wc -l)
+nannot=$(grep -v '^#' $outdir/annotated.vcf | grep -c 'PON_MAXAF=')
+if [ "$ndiff" -ne 0 ] || [ "$nannot" -ne "$ncalls" ]; then
+    echoerror "Annotation only changed filter or missed calls. Check $outdir"
+    exit 1
+fi
+echook "Annotation only annotated all calls without filtering."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,85 @@
+#!/bin/bash
+
+# lofreq preprocess has to give the same records as the piped
+# viterbi, alnqual, indelqual and sort
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+cmd="$LOFREQ viterbi -f $reffa $bam | $LOFREQ alnqual -u - $reffa | $LOFREQ indelqual --dindel -f $reffa - | samtools sort -o $outdir/piped.bam -"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+cmd="$LOFREQ preprocess -f $reffa --threads 2 -o $outdir/fused.bam $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+if ! diff -q <(samtools view $outdir/piped.bam) <(samtools view $outdir/fused.bam) >/dev/null; then
+    echoerror "preprocess and piped preprocessing differ. Check $outdir"
+    exit 1
+fi
+echook "preprocess gives same records as piped preprocessing."
+
+# output has to be indexable, i.e. sorted, and the index built on
+# the fly has to be the same as the one built afterwards
+if [ ! -s $outdir/fused.bam.bai ]; then
+    echoerror "preprocess didn't index its output. Check $outdir"
+    exit 1
+fi
+if ! samtools index $outdir/fused.bam $outdir/reindexed.bai >> $log 2>&1; then
+    echoerror "Output of preprocess not sorted. Check $outdir"
+    exit 1
+fi
+echook "Output of preprocess sorted."
+if ! cmp -s $outdir/fused.bam.bai $outdir/reindexed.bai; then
+    echoerror "Index built by preprocess differs from samtools index. Check $outdir"
+    exit 1
+fi
+echook "Index built by preprocess same as samtools index."
+
+# viterbi output isn't sorted anymore, so writers downstream must not
+# try to index it
+cmd="$LOFREQ viterbi -f $reffa $bam | $LOFREQ indelqual --dindel -f $reffa -o $outdir/viterbi_iq.bam -"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "Indelqual on viterbi output failed (see $log for more): $cmd"
+    exit 1
+fi
+if [ -e $outdir/viterbi_iq.bam.bai ]; then
+    echoerror "Unsorted viterbi output was indexed. Check $outdir"
+    exit 1
+fi
+echook "Unsorted viterbi output not indexed downstream."
+
+# sorted input on the other hand gives an indexed indelqual output
+cmd="$LOFREQ indelqual -u 20 -o $outdir/sorted_iq.bam $outdir/fused.bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+if [ ! -s $outdir/sorted_iq.bam.bai ]; then
+    echoerror "indelqual didn't index its sorted output. Check $outdir"
+    exit 1
+fi
+echook "indelqual indexes sorted output."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
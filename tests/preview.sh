@@ -0,0 +1,66 @@
+#!/bin/bash
+
+# call --preview: sampling all windows has to give the normal calls and
+# matching estimates. a real sample has to produce a complete report
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/full.vcf $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/preview1.vcf --preview 1.0 $bam"
+if ! eval $cmd > $outdir/preview1.txt 2>&1; then
+    echoerror "The following command failed (see $outdir/preview1.txt for more): $cmd"
+    exit 1
+fi
+ndiff=$(diff <(grep -v '^#' $outdir/full.vcf) <(grep -v '^#' $outdir/preview1.vcf) | wc -l)
+if [ "$ndiff" -ne 0 ]; then
+    echoerror "Preview of all windows differs from normal calls. Check $outdir"
+    exit 1
+fi
+nsnvs=$(grep -v '^#' $outdir/full.vcf | awk 'length($4)==1 && length($5)==1' | wc -l)
+if ! grep -q "^snvs	$nsnvs	" $outdir/preview1.txt; then
+    echoerror "Preview of all windows doesn't report $nsnvs SNVs. Check $outdir"
+    exit 1
+fi
+echook "Preview of all windows identical to normal calls."
+
+cmd="$LOFREQ call -f $reffa -l $bed --preview 0.2 $bam"
+if ! eval $cmd > $outdir/preview0.2.vcf 2> $outdir/preview0.2.txt; then
+    echoerror "The following command failed (see $outdir/preview0.2.txt for more): $cmd"
+    exit 1
+fi
+if ! grep -q '^#CHROM' $outdir/preview0.2.vcf; then
+    echoerror "Preview didn't write vcf to stdout. Check $outdir"
+    exit 1
+fi
+for e in snvs indels ts_tv covered_positions mean_depth mean_snv_sb; do
+    if ! grep -q "^$e	" $outdir/preview0.2.txt; then
+        echoerror "Estimate $e missing in preview report. Check $outdir"
+        exit 1
+    fi
+done
+echook "Preview report complete."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,76 @@
+#!/bin/bash
+
+# Sanity checks for on-the-fly primer clipping (call --primer-bed):
+# an amplicon spanning the whole reference only touches its ends and
+# no calls are made outside the insert of an inner amplicon
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+chrom=$(head -n 1 $reffa | sed -e 's,^>,,' -e 's, .*,,')
+reflen=$(grep -v '^>' $reffa | tr -d '\n' | wc -c)
+
+
+cmd="$LOFREQ call -f $reffa -b 1000 -o $outdir/noclip.vcf $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+
+primers=$outdir/full.bed
+echo -e "$chrom\t0\t1\tfull_LEFT\t1\t+" > $primers
+echo -e "$chrom\t$((reflen-1))\t$reflen\tfull_RIGHT\t1\t-" >> $primers
+cmd="$LOFREQ call -f $reffa -b 1000 -o $outdir/full.vcf --primer-bed $primers $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+# ignore ends where BAQ might differ. fixed bonf since number of tests changes
+if ! diff -q <(grep -v '^#' $outdir/noclip.vcf | awk -v l=$reflen '$2>10 && $2<l-10 {print $1, $2, $4, $5}') \
+     <(grep -v '^#' $outdir/full.vcf | awk -v l=$reflen '$2>10 && $2<l-10 {print $1, $2, $4, $5}') >/dev/null; then
+    echoerror "Clipping whole-reference amplicon changed calls. Check $outdir"
+    exit 1
+fi
+echook "Clipping whole-reference amplicon left calls unchanged."
+
+
+# inner amplicon: insert is the middle third
+ins_beg=$((reflen/3))
+ins_end=$((2*reflen/3))
+primers=$outdir/inner.bed
+echo -e "$chrom\t$((ins_beg-25))\t$ins_beg\tinner_LEFT\t1\t+" > $primers
+echo -e "$chrom\t$ins_end\t$((ins_end+25))\tinner_RIGHT\t1\t-" >> $primers
+cmd="$LOFREQ call -f $reffa -o $outdir/inner.vcf --primer-bed $primers $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+n=$(grep -v '^#' $outdir/inner.vcf | awk -v b=$ins_beg -v e=$ins_end '$2<=b || $2>e' | wc -l)
+if [ $n -ne 0 ]; then
+    echoerror "Got $n calls outside amplicon insert. Check $outdir"
+    exit 1
+fi
+n=$(grep -vc '^#' $outdir/inner.vcf)
+if [ $n -eq 0 ]; then
+    echoerror "Got no calls inside amplicon insert. Check $outdir"
+    exit 1
+fi
+echook "Inner amplicon: all $n calls within insert."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
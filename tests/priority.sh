@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# call --priority-bed has to write final calls for the priority
+# regions only, which are also part of the main calls (their
+# Bonferroni factor is conservative), and leave the main calls
+# untouched. call-parallel has to give the same priority calls
+
+source lib.sh || exit 1
+
+
+BAM=data/icgc-tcga-first10kperchrom-syn1/dream-icgc-tcga-first10kperchrom-synthetic.challenge.set1.normal.v2.bam
+REF=data/icgc-tcga-dream-support/Homo_sapiens_assembly19.fasta
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+LOFREQ_PARALLEL="$(dirname $LOFREQ)/../scripts/lofreq2_call_pparallel.py"
+
+
+cmd="$LOFREQ call -f $REF -o $outdir/plain.vcf $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+# priority regions around the first few calls
+grep -v '^#' $outdir/plain.vcf | head -n 5 | \
+    awk 'BEGIN {OFS="\t"} {s=$2-100; if (s<0) {s=0}; print $1, s, $2+100}' > $outdir/priority.bed
+if [ ! -s $outdir/priority.bed ]; then
+    echoerror "No calls to build priority regions from. Check $outdir"
+    exit 1
+fi
+
+cmd="$LOFREQ call -f $REF -o $outdir/main.vcf --priority-bed $outdir/priority.bed --priority-out $outdir/priority.vcf $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+npm=$($LOFREQ vcfset -a complement -1 $outdir/plain.vcf -2 $outdir/main.vcf --count-only)
+nmp=$($LOFREQ vcfset -a complement -2 $outdir/plain.vcf -1 $outdir/main.vcf --count-only)
+if [ $npm -ne 0 ] || [ $nmp -ne 0 ] ; then
+    echoerror "Main calls changed with --priority-bed. Check $outdir"
+    exit 1
+fi
+echook "Main calls unchanged with --priority-bed."
+
+npri=$(grep -vc '^#' $outdir/priority.vcf)
+if [ $npri -lt 1 ]; then
+    echoerror "No priority calls. Check $outdir"
+    exit 1
+fi
+nextra=$($LOFREQ vcfset -a complement -1 $outdir/priority.vcf -2 $outdir/main.vcf --count-only)
+if [ $nextra -ne 0 ]; then
+    echoerror "$nextra priority calls missing from main calls. Check $outdir"
+    exit 1
+fi
+ninside=$(grep -v '^#' $outdir/priority.vcf | \
+    awk 'NR==FNR {c[NR]=$1; s[NR]=$2; e[NR]=$3; n=NR; next}
+         {for (i=1; i<=n; i++) {if ($1==c[i] && $2>s[i] && $2<=e[i]) {print; break}}}' \
+    $outdir/priority.bed - | wc -l)
+if [ $ninside -ne $npri ]; then
+    echoerror "Priority calls outside of priority regions. Check $outdir"
+    exit 1
+fi
+echook "Priority calls are final calls within priority regions."
+
+cmd="$LOFREQ_PARALLEL --pp-threads $threads -f $REF -o $outdir/parallel.vcf.gz --priority-bed $outdir/priority.bed --priority-out $outdir/parallel_priority.vcf $BAM"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+n12=$($LOFREQ vcfset -a complement -1 $outdir/priority.vcf -2 $outdir/parallel_priority.vcf --count-only)
+n21=$($LOFREQ vcfset -a complement -2 $outdir/priority.vcf -1 $outdir/parallel_priority.vcf --count-only)
+if [ $n12 -ne 0 ] || [ $n21 -ne 0 ] ; then
+    echoerror "call-parallel gives different priority calls. Check $outdir"
+    exit 1
+fi
+echook "call-parallel gives same priority calls."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,88 @@
+#!/bin/bash
+
+# On-the-fly base quality recalibration (call --recal-table): an
+# identity table must not change calls and a table mapping everything
+# to Q1 must remove all calls
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+rgs=$(samtools view -H $bam | grep '^@RG' | tr '\t' '\n' | grep '^ID:' | cut -d : -f 2-)
+if [ -z "$rgs" ]; then
+    echowarn "No read groups in $bam. Skipping test"
+    rmdir $outdir
+    exit 0
+fi
+
+# writes a GATK recalibration table with given empirical quality
+# (default: reported quality) for all read groups and qualities
+recal_table() {
+    emp=$1
+    echo "#:GATKReport.v1.1:5"
+    echo "#:GATKTable:6:1:%s:%s:%.4f:%.4f:%d:%.2f:;"
+    echo "#:GATKTable:RecalTable0:"
+    echo "ReadGroup EventType EmpiricalQuality EstimatedQReported Observations Errors"
+    for rg in $rgs; do
+        echo "$rg M ${emp:-30} 30 1000 1"
+    done
+    echo ""
+    echo "#:GATKTable:6:1:%s:%d:%s:%.4f:%d:%.2f:;"
+    echo "#:GATKTable:RecalTable1:"
+    echo "ReadGroup QualityScore EventType EmpiricalQuality Observations Errors"
+    for rg in $rgs; do
+        for q in $(seq 0 93); do
+            echo "$rg $q M ${emp:-$q} 1000 1"
+        done
+    done
+    echo ""
+}
+
+
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/norecal.vcf $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+recal_table > $outdir/identity.table
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/identity.vcf --recal-table $outdir/identity.table $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+if ! diff -q <(grep -v '^#' $outdir/norecal.vcf) <(grep -v '^#' $outdir/identity.vcf) >/dev/null; then
+    echoerror "Identity recalibration table changed calls. Check $outdir"
+    exit 1
+fi
+echook "Identity recalibration table left calls unchanged."
+
+recal_table 1 > $outdir/q1.table
+cmd="$LOFREQ call -f $reffa -l $bed -o $outdir/q1.vcf --recal-table $outdir/q1.table $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+n=$(grep -vc '^#' $outdir/q1.vcf)
+if [ $n -ne 0 ]; then
+    echoerror "Got $n calls after recalibrating to Q1. Check $outdir"
+    exit 1
+fi
+echook "No calls after recalibrating to Q1."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,71 @@
+#!/bin/bash
+
+# Tags written to sidecar files (alnqual -s, indelqual --sidecar) and
+# attached on the fly (call --sidecar) must give the same calls as
+# tags written into a new BAM
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+bed=$basedir/denv2-pseudoclonal_incl.bed
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+# tags in a new bam
+cmd="$LOFREQ alnqual -b $bam $reffa > $outdir/aq.bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+cmd="$LOFREQ indelqual --dindel -f $reffa -o $outdir/aq_iq.bam $outdir/aq.bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+cmd="$LOFREQ call --call-indels -f $reffa -l $bed -o $outdir/bam.vcf $outdir/aq_iq.bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+# same tags in sidecars
+cmd="$LOFREQ alnqual -s $outdir/aq.lsc $bam $reffa"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+cmd="$LOFREQ indelqual --dindel -f $reffa --sidecar $outdir/iq.lsc $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+if [ ! -s $outdir/aq.lsc ] || [ ! -s $outdir/aq.lsc.lsi ] || [ ! -s $outdir/iq.lsc ]; then
+    echoerror "Sidecar or sidecar index missing. Check $outdir"
+    exit 1
+fi
+cmd="$LOFREQ call --call-indels -f $reffa -l $bed -o $outdir/sidecar.vcf --sidecar $outdir/aq.lsc --sidecar $outdir/iq.lsc $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+
+if ! diff -q <(grep -v '^#' $outdir/bam.vcf) <(grep -v '^#' $outdir/sidecar.vcf) >/dev/null; then
+    echoerror "Calls with sidecars differ from calls on BAM with tags. Check $outdir"
+    exit 1
+fi
+echook "Calls with sidecars identical to calls on BAM with tags."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,87 @@
+#!/bin/bash
+
+# vcfsort: shuffled calls have to come out sorted by position, ref and
+# alt, no matter how many runs they were split into. bgzipped output
+# has to be indexed
+
+source lib.sh || exit 1
+
+
+basedir=data/denv2-pseudoclonal
+bam=$basedir/denv2-pseudoclonal.bam
+reffa=$basedir/denv2-pseudoclonal_cons.fa
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+KEEP_TMP=0
+
+
+cmd="$LOFREQ call -f $reffa -o $outdir/calls.vcf --no-default-filter -a 1 -b 1 $bam"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+grep '^#' $outdir/calls.vcf > $outdir/shuffled.vcf
+grep -v '^#' $outdir/calls.vcf | awk 'BEGIN {srand(42)} {print rand() "\t" $0}' | \
+    sort -k1,1 | cut -f 2- >> $outdir/shuffled.vcf
+# single contig
+grep '^#' $outdir/calls.vcf > $outdir/expected.vcf
+grep -v '^#' $outdir/calls.vcf | LC_ALL=C sort -s -t '	' -k2,2n -k4,4 -k5,5 >> $outdir/expected.vcf
+
+for opts in "" "-m 10K" "-m 10K --threads 3"; do
+    sorted=$outdir/sorted.vcf
+    cmd="$LOFREQ vcfsort $opts -o $sorted $outdir/shuffled.vcf"
+    if ! eval $cmd >> $log 2>&1; then
+        echoerror "The following command failed (see $log for more): $cmd"
+        exit 1
+    fi
+    if ! cmp -s $outdir/expected.vcf $sorted; then
+        echoerror "vcfsort $opts didn't sort properly. Check $outdir"
+        exit 1
+    fi
+    rm $sorted
+done
+echook "vcfsort sorted properly."
+
+# more runs than files can be open at once have to be merged in
+# several passes
+nruns=$(ulimit -n 32 && $LOFREQ vcfsort -m 10K --verbose -o $outdir/sorted.vcf $outdir/shuffled.vcf 2>&1 | \
+    sed -n -e 's/.*Merging \([0-9]*\) runs.*/\1/p')
+if [ -z "$nruns" ] || [ "$nruns" -le 32 ]; then
+    echoerror "Expected vcfsort -m 10K to merge more than 32 runs but got '$nruns'. Check $outdir"
+    exit 1
+fi
+if ! cmp -s $outdir/expected.vcf $outdir/sorted.vcf; then
+    echoerror "vcfsort with $nruns runs and 32 open files at most didn't sort properly. Check $outdir"
+    exit 1
+fi
+rm $outdir/sorted.vcf
+echook "vcfsort merged $nruns runs in several passes."
+
+# several shards, bgzipped output
+head -n 1000 $outdir/shuffled.vcf > $outdir/shard1.vcf
+tail -n +1001 $outdir/shuffled.vcf | bgzip > $outdir/shard2.vcf.gz
+cmd="$LOFREQ vcfsort -m 10K --threads 2 -o $outdir/sorted.vcf.gz $outdir/shard2.vcf.gz $outdir/shard1.vcf"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+if [ ! -s $outdir/sorted.vcf.gz.tbi ]; then
+    echoerror "No index for bgzipped vcfsort output. Check $outdir"
+    exit 1
+fi
+ndiff=$(diff <(grep -v '^#' $outdir/expected.vcf) <(gzip -dc $outdir/sorted.vcf.gz | grep -v '^#') | wc -l)
+if [ "$ndiff" -ne 0 ]; then
+    echoerror "vcfsort of shards differs from expected. Check $outdir"
+    exit 1
+fi
+echook "vcfsort of shards sorted properly and indexed."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi
@@ -0,0 +1,118 @@
+#!/bin/bash
+
+# vcfstats: counts, substitution types, Ts/Tv and distances on a
+# small VCF with known values
+
+source lib.sh || exit 1
+
+KEEP_TMP=0
+
+outdir=$(mktemp -d -t $(basename $0).XXXXXX)
+log=$outdir/log.txt
+
+# 3 transitions and 2 transversions passing, one filtered transversion,
+# one indel and one CONSVAR. distances on c1 are 100, 100, 200 (the
+# filtered variant doesn't count), c2 has a single variant
+vcf=$outdir/in.vcf
+cat > $vcf <<EOF
+##fileformat=VCFv4.0
+##INFO=<ID=DP,Number=1,Type=Integer,Description="Raw Depth">
+##INFO=<ID=AF,Number=1,Type=Float,Description="Allele Frequency">
+##INFO=<ID=CONSVAR,Number=0,Type=Flag,Description="Indicates that the variant is a consensus variant">
+#CHROM	POS	ID	REF	ALT	QUAL	FILTER	INFO
+c1	100	.	A	G	50	PASS	DP=100;AF=0.1
+c1	200	.	C	T	60	PASS	DP=200;AF=0.2
+c1	300	.	A	C	70	PASS	DP=300;AF=0.3
+c1	400	.	G	T	10	min_dp_10	DP=5;AF=0.4
+c1	500	.	T	A	80	PASS	DP=500;AF=0.5
+c1	600	.	AT	A	90	PASS	DP=600;AF=0.6;INDEL
+c2	10	.	G	A	100	PASS	DP=1000;AF=0.9;CONSVAR
+EOF
+
+# prints values of given section and name
+val() {
+    awk -F'\t' -v s=$2 -v n=$3 '$1==s && $2==n {print $3}' $1
+}
+check() {
+    if [ "$3" != "$4" ]; then
+        echoerror "Expected $2 to be $4 but got '$3' for $1. Check $outdir"
+        exit 1
+    fi
+}
+
+cmd="$LOFREQ vcfstats -i $vcf -o $outdir/stats.tsv"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+tsv=$outdir/stats.tsv
+check "$cmd" num_vars_in $(val $tsv count num_vars_in) 7
+check "$cmd" num_ign_filtered $(val $tsv count num_ign_filtered) 1
+check "$cmd" num_ign_type $(val $tsv count num_ign_type) 1
+check "$cmd" num_vars $(val $tsv count num_vars) 5
+check "$cmd" num_consvars $(val $tsv count num_consvars) 1
+check "$cmd" num_ts $(val $tsv count num_ts) 3
+check "$cmd" num_tv $(val $tsv count num_tv) 2
+check "$cmd" ts_tv $(val $tsv ratio ts_tv) 1.500000
+check "$cmd" "A>G|T>C" $(val $tsv subst "A>G|T>C") 1
+check "$cmd" "C>T|G>A" $(val $tsv subst "C>T|G>A") 2
+check "$cmd" "A>C|T>G" $(val $tsv subst "A>C|T>G") 1
+check "$cmd" "A>T|T>A" $(val $tsv subst "A>T|T>A") 1
+check "$cmd" "C>A|G>T" $(val $tsv subst "C>A|G>T") 0
+# n, missing, min, max and mean. log10 of distances
+summary() {
+    awk -F'\t' -v p=$2 '$1=="summary" && $2==p {print $3, $4, $5, $6, $7}' $1
+}
+check "$cmd" "AF summary" "$(summary $tsv AF)" "5 0 0.100000 0.900000 0.400000"
+check "$cmd" "left distance summary" "$(summary $tsv dist_left_log10)" "3 2 2.000000 2.301030 2.100343"
+check "$cmd" "min distance summary" "$(summary $tsv dist_min_log10)" "4 1 2.000000 2.301030 2.075257"
+# one value per variant in input order
+series=$(awk -F'\t' '$1=="series" && $2=="AF" {printf " %s", $5}' $tsv)
+check "$cmd" "AF series" "$series" " 0.100000 0.200000 0.300000 0.500000 0.900000"
+echook "vcfstats counts, substitution types, Ts/Tv and distances as expected."
+
+cmd="$LOFREQ vcfstats --ign-filter -i $vcf -o $outdir/stats_ign.tsv"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+check "$cmd" num_vars $(val $outdir/stats_ign.tsv count num_vars) 6
+check "$cmd" ts_tv $(val $outdir/stats_ign.tsv ratio ts_tv) 1.000000
+
+cmd="$LOFREQ vcfstats --indels -i $vcf -o $outdir/stats_indels.tsv"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+check "$cmd" num_vars $(val $outdir/stats_indels.tsv count num_vars) 1
+check "$cmd" num_ts $(val $outdir/stats_indels.tsv count num_ts) 0
+check "$cmd" ts_tv $(val $outdir/stats_indels.tsv ratio ts_tv) NA
+
+cmd="$LOFREQ vcfstats --maxdp 400 -i $vcf -o $outdir/stats_maxdp.tsv"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+check "$cmd" num_ign_maxdp $(val $outdir/stats_maxdp.tsv count num_ign_maxdp) 2
+check "$cmd" num_vars $(val $outdir/stats_maxdp.tsv count num_vars) 3
+echook "vcfstats --ign-filter, --indels and --maxdp as expected."
+
+# json has to agree with tsv
+cmd="$LOFREQ vcfstats --json -i $vcf -o $outdir/stats.json"
+if ! eval $cmd >> $log 2>&1; then
+    echoerror "The following command failed (see $log for more): $cmd"
+    exit 1
+fi
+json=$(python3 -c "import json, sys; d=json.load(open(sys.argv[1])); \
+print(d['counts']['num_vars'], d['counts']['num_ts'], d['counts']['num_tv'], d['ts_tv_ratio'], d['subst']['C>T|G>A'])" \
+    $outdir/stats.json 2>>$log)
+check "$cmd" "json counts" "$json" "5 3 2 1.5 2"
+echook "vcfstats json output agrees with tsv."
+
+
+if [ $KEEP_TMP -eq 1 ]; then
+    echowarn "Not deleting tmp dir $outdir"
+else
+    rm  $outdir/*
+    rmdir $outdir
+fi